@@ -0,0 +1,101 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include "arena.h"
+
+__thread struct Arena thread_arena;
+
+static inline u_char * arena_block_data(struct ArenaBlock * block)
+{
+    // header is padded to the alignment, so aligned offsets are aligned addresses
+    return (u_char *)block + ((sizeof(struct ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(u_int64_t)(ARENA_ALIGNMENT - 1));
+}
+
+struct ArenaBlock * arena_block_new(u_int64_t size)
+{
+    u_int64_t header = (sizeof(struct ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(u_int64_t)(ARENA_ALIGNMENT - 1);
+    struct ArenaBlock * block = malloc(header + size);
+    if (block == NULL) return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void * Arena_alloc(struct Arena * arena, u_int64_t size)
+/// bump allocation aligned to ARENA_ALIGNMENT, moves to the next kept block or a new one when the current is full;
+/// NULL only when malloc fails
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(u_int64_t)(ARENA_ALIGNMENT - 1);
+    struct ArenaBlock * block = arena->current;
+    if (block && block->used + size <= block->size)
+    {
+        block->used += size;
+        return arena_block_data(block) + block->used - size;
+    }
+    if (block && block->next && block->next->size >= size)
+        block = block->next;
+    else
+    {
+        struct ArenaBlock * added = arena_block_new(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+        if (added == NULL) return NULL;
+        // a kept block too small for this request stays after the new one
+        if (block)
+        {
+            added->next = block->next;
+            block->next = added;
+        }
+        else
+        {
+            added->next = arena->first;
+            arena->first = added;
+        }
+        block = added;
+    }
+    block->used = size;
+    arena->current = block;
+    return arena_block_data(block);
+}
+
+struct ArenaMark Arena_mark(struct Arena * arena)
+{
+    struct ArenaMark mark = {arena->current, arena->current ? arena->current->used : 0};
+    return mark;
+}
+
+void Arena_rewind(struct Arena * arena, struct ArenaMark mark)
+/// drops everything allocated since the mark was taken, blocks taken meanwhile are kept for reuse
+{
+    if (mark.block == NULL)
+    {
+        if (arena->first) arena->first->used = 0;
+        arena->current = arena->first;
+        return;
+    }
+    mark.block->used = mark.used;
+    arena->current = mark.block;
+}
+
+void Arena_reset(struct Arena * arena)
+/// drops all allocations and returns every block except the first one
+{
+    if (arena->first == NULL) return;
+    struct ArenaBlock * block = arena->first->next;
+    while (block)
+    {
+        struct ArenaBlock * next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first->next = NULL;
+    arena->first->used = 0;
+    arena->current = arena->first;
+}
+
+void Arena_free(struct Arena * arena)
+{
+    Arena_reset(arena);
+    free(arena->first);
+    arena->first = NULL;
+    arena->current = NULL;
+}
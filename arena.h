@@ -0,0 +1,44 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_ARENA_H
+#define EXT4_BINARY_READ_ARENA_H
+#include <stdlib.h>
+
+// Scratch memory for transient buffers of the read paths: block buffers of inode and group descriptor loads, extent
+// tree levels and names of found directory entries. Every thread has its own arena (thread_arena), allocations bump a
+// pointer within blocks of at least ARENA_BLOCK_SIZE and are never freed one by one. A function takes Arena_mark
+// before its allocations and Arena_rewind to it when done, so nested calls (extent tree recursion) stack up and unwind;
+// the shell and batch workers reset the arena after every command, which also drops whatever a command left behind,
+// and reset returns all blocks but the first one, so memory of a long session stays flat.
+// Worker threads call Arena_free(&thread_arena) before they exit.
+
+#define ARENA_BLOCK_SIZE (256u << 10u)
+#define ARENA_ALIGNMENT 16
+
+struct ArenaBlock {
+    struct ArenaBlock * next;  // blocks after the current one are free for reuse
+    u_int64_t size;  // usable bytes after the header
+    u_int64_t used;
+};
+
+struct Arena {
+    struct ArenaBlock * first;
+    struct ArenaBlock * current;  // allocations are bumped from this block
+};
+
+struct ArenaMark {
+    struct ArenaBlock * block;  // NULL for an empty arena
+    u_int64_t used;
+};
+
+extern __thread struct Arena thread_arena;
+
+void * Arena_alloc(struct Arena * arena, u_int64_t size);
+struct ArenaMark Arena_mark(struct Arena * arena);
+void Arena_rewind(struct Arena * arena, struct ArenaMark mark);
+void Arena_reset(struct Arena * arena);
+void Arena_free(struct Arena * arena);
+
+#endif //EXT4_BINARY_READ_ARENA_H
@@ -0,0 +1,365 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#define _GNU_SOURCE
+#include "batch.h"
+#include "hash.h"
+#include "stats.h"
+#include "arena.h"
+#include "xattr.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const u_int64_t MAX_PENDING_RESULTS_PER_JOB = 64;  // how far workers may run ahead of the printed output
+static const u_int64_t BATCH_XATTR_CACHE_SIZE = 256;  // shared xattr blocks kept in memory, for all workers
+static const char * const BATCH_READ_ERROR = "error reading image";  // details of it go to stderr
+
+struct batch_command {
+    u_int64_t line;  // line number in commands file
+    char * text;
+};
+
+struct batch {
+    FILE * file;  // image, shared by workers (reads are positional)
+    struct SuperBlock * superBlock;
+    struct XattrCache xattr_cache;
+    struct batch_command * commands;
+    u_int64_t count;
+    char ** results;  // NDJSON line of every command, NULL until it is done
+    u_int64_t next_command;  // first command not taken by any worker
+    u_int64_t printed;  // number of results already written out
+    u_int64_t max_pending;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;  // signalled when a result is stored or printed
+};
+
+void json_string(FILE * out, const char * text, u_int64_t length)
+/// writes text as quoted JSON string
+{
+    fputc('"', out);
+    for (u_int64_t i = 0; i < length; ++i)
+    {
+        u_char c = text[i];
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+const char * file_type_name(u_int8_t file_type)
+{
+    if (file_type == DEFT_REGULAR) return "file";
+    if (file_type == DEFT_DIRECTORY) return "dir";
+    if (file_type == DEFT_CHAR_DEV) return "char";
+    if (file_type == DEFT_BLOCK_DEV) return "block";
+    if (file_type == DEFT_FIFO) return "fifo";
+    if (file_type == DEFT_SOCKET) return "socket";
+    if (file_type == DEFT_SYMLINK) return "symlink";
+    return "unknown";
+}
+
+int hash_update(void * ctx, const u_char * data, u_int64_t length)
+{
+    Sha256_update(ctx, data, length);
+    return 0;
+}
+
+const char * batch_ls(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inode, FILE * out)
+/// returns NULL when directory entries were written to out, otherwise error of the command
+{
+    struct DirCursor cursor;
+    struct ext4_dir_entry_2 dir_entry;
+    if ((inode->i_mode & 0xF000u) != S_IFDIR) return "not a directory";
+    if (DirCursor_open(&cursor, file, superBlock, inode)) return BATCH_READ_ERROR;
+    fprintf(out, ",\"entries\":[");
+    for (u_int64_t i = 0; DirCursor_next(&cursor, &dir_entry) == 0; ++i)
+    {
+        fprintf(out, "%s{\"name\":", i ? "," : "");
+        json_string(out, (char *)dir_entry.name, dir_entry.name_len);
+        fprintf(out, ",\"inode\":%" PRIu32 ",\"type\":\"%s\"}", dir_entry.inode,
+                file_type_name(dir_entry.file_type));
+    }
+    fprintf(out, "]");
+    int err = cursor.err;
+    DirCursor_close(&cursor);
+    return err ? BATCH_READ_ERROR : NULL;
+}
+
+const char * batch_stat(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inode, u_int64_t inode_id,
+        FILE * out)
+{
+    struct InodeStat inodeStat;
+    struct ExtentRun * runs;
+    u_int64_t runs_count;
+    if (get_inode_extent_runs(file, superBlock, inode, &runs, &runs_count)) return BATCH_READ_ERROR;
+    free(runs);
+    InodeStat_new(&inodeStat, inode, inode_id);
+    fprintf(out, ",\"inode\":%" PRIu32 ",\"mode\":%" PRIu16 ",\"links\":%" PRIu16 ",\"uid\":%" PRIu32
+                 ",\"gid\":%" PRIu32 ",\"flags\":%" PRIu32 ",\"size\":%" PRIu64 ",\"atime\":%" PRIu32 ",\"ctime\":%" PRIu32
+                 ",\"mtime\":%" PRIu32 ",\"extents\":%" PRIu64,
+            inodeStat.inode, inodeStat.mode, inodeStat.links_count, inodeStat.uid, inodeStat.gid, inodeStat.flags,
+            inodeStat.size, inodeStat.atime, inodeStat.ctime, inodeStat.mtime, runs_count);
+    if ((inode->i_mode & 0xF000u) == S_IFLNK)
+    {
+        char target[SYMLINK_MAX_TARGET];
+        if (read_symlink(file, superBlock, inode, target, sizeof(target))) return BATCH_READ_ERROR;
+        fprintf(out, ",\"target\":");
+        json_string(out, target, strlen(target));
+    }
+    return NULL;
+}
+
+const char * batch_extract(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inode,
+        const char * destination, FILE * out)
+{
+    FILE * destination_file = fopen(destination, "w");
+    if (destination_file == NULL) return "cannot open destination";
+    struct stat destination_stat;
+    int regular = fstat(fileno(destination_file), &destination_stat) == 0 && S_ISREG(destination_stat.st_mode);
+    int err = copy_inode_data(file, superBlock, inode, destination_file);
+    err |= fclose(destination_file) != 0;
+    if (err)
+    {
+        // a truncated copy would look like a successful extract to whoever reads the destination later,
+        // devices and pipes given as destination are left alone
+        if (regular) remove(destination);
+        return BATCH_READ_ERROR;
+    }
+    fprintf(out, ",\"destination\":");
+    json_string(out, destination, strlen(destination));
+    fprintf(out, ",\"bytes\":%" PRIu64, inode->i_size_u64);
+    return NULL;
+}
+
+const char * batch_hash(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inode, FILE * out)
+{
+    struct Sha256 sha;
+    u_char digest[32];
+    char hex[65];
+    Sha256_init(&sha);
+    if (read_inode_data(file, superBlock, inode, hash_update, &sha)) return BATCH_READ_ERROR;
+    Sha256_final(&sha, digest);
+    Sha256_hex(digest, hex);
+    fprintf(out, ",\"size\":%" PRIu64 ",\"sha256\":\"%s\"", inode->i_size_u64, hex);
+    return NULL;
+}
+
+const char * batch_getfattr(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inode,
+        struct XattrCache * cache, FILE * out)
+{
+    struct Xattr * xattrs;
+    u_int64_t xattrs_count;
+    if (get_inode_xattrs(file, superBlock, inode, cache, &xattrs, &xattrs_count)) return BATCH_READ_ERROR;
+    fprintf(out, ",\"xattrs\":[");
+    for (u_int64_t i = 0; i < xattrs_count; ++i)
+    {
+        char * value = format_xattr_value(xattrs + i);
+        fprintf(out, "%s{\"name\":", i ? "," : "");
+        json_string(out, xattrs[i].name, strlen(xattrs[i].name));
+        fprintf(out, ",\"value\":");
+        json_string(out, value, strlen(value));
+        fprintf(out, "}");
+        free(value);
+    }
+    fprintf(out, "]");
+    Xattrs_free(xattrs, xattrs_count);
+    return NULL;
+}
+
+char * execute_command(FILE * file, struct SuperBlock * superBlock, struct XattrCache * cache,
+        struct batch_command * command)
+/// runs a single command, returns its result as a JSON line (caller frees it)
+{
+    char * result;
+    size_t result_size;
+    FILE * out = open_memstream(&result, &result_size);
+    const char * text = command->text;
+    u_int64_t verb_len = strcspn(text, " ");
+    const char * path = text[verb_len] ? text + verb_len + 1 : text + verb_len;
+    u_int64_t path_len = strlen(path);
+    const char * destination = NULL;
+    if (verb_len == 7 && strncmp(text, "extract", 7) == 0)
+    {
+        // destination is the last word of the line
+        const char * last_space = strrchr(path, ' ');
+        if (last_space)
+        {
+            destination = last_space + 1;
+            path_len = last_space - path;
+        }
+    }
+    char * path_copy = strndup(path, path_len);
+
+    fprintf(out, "{\"line\":%" PRIu64 ",\"command\":", command->line);
+    json_string(out, text, verb_len);
+    fprintf(out, ",\"path\":");
+    json_string(out, path, path_len);
+
+    u_int64_t inode_id;
+    struct InodeTable inode;
+    int err;
+    const char * error = NULL;
+    // payload is kept aside, status is known only once the command has read everything it needs
+    char * body;
+    size_t body_size;
+    FILE * body_out = open_memstream(&body, &body_size);
+    if (!(verb_len == 2 && strncmp(text, "ls", 2) == 0) && !(verb_len == 4 && strncmp(text, "stat", 4) == 0)
+        && !(verb_len == 4 && strncmp(text, "hash", 4) == 0) && !(verb_len == 8 && strncmp(text, "getfattr", 8) == 0)
+        && !destination)
+        error = "unknown command or missing argument";
+    else if ((err = resolve_path(file, superBlock, ROOT_INODE_ID, path_copy, text[0] != 's', &inode_id)))
+        // stat describes a symlink itself, other commands follow it
+        error = err == 2 ? "too many levels of symbolic links" : "no such file or directory";
+    else if (load_inode_table(file, superBlock, &inode, inode_id))
+        error = BATCH_READ_ERROR;
+    else if (text[0] == 'l')
+        error = batch_ls(file, superBlock, &inode, body_out);
+    else if (text[0] == 's')
+        error = batch_stat(file, superBlock, &inode, inode_id, body_out);
+    else if (text[0] == 'g')
+        error = batch_getfattr(file, superBlock, &inode, cache, body_out);
+    else if ((inode.i_mode & 0xF000u) != S_IFREG)
+        error = "not a regular file";
+    else if (destination)
+        error = batch_extract(file, superBlock, &inode, destination, body_out);
+    else
+        error = batch_hash(file, superBlock, &inode, body_out);
+    fclose(body_out);
+    if (error)
+        fprintf(out, ",\"status\":\"error\",\"error\":\"%s\"}\n", error);
+    else
+        fprintf(out, ",\"status\":\"ok\"%s}\n", body);
+    free(body);
+    fclose(out);
+    free(path_copy);
+    return result;
+}
+
+void * batch_worker(void * arg)
+/// takes commands in order until all are taken
+{
+    struct batch * batch = arg;
+    while (1)
+    {
+        pthread_mutex_lock(&batch->lock);
+        while (batch->next_command < batch->count && batch->next_command >= batch->printed + batch->max_pending)
+            pthread_cond_wait(&batch->changed, &batch->lock);
+        u_int64_t index = batch->next_command;
+        if (index < batch->count)
+            batch->next_command += 1;
+        pthread_mutex_unlock(&batch->lock);
+        if (index >= batch->count) break;
+
+        char * result = execute_command(batch->file, batch->superBlock, &batch->xattr_cache, batch->commands + index);
+        Arena_reset(&thread_arena);
+        pthread_mutex_lock(&batch->lock);
+        batch->results[index] = result;
+        pthread_cond_broadcast(&batch->changed);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    stats_flush_thread();
+    Arena_free(&thread_arena);
+    return NULL;
+}
+
+int read_commands(const char * commands_path, struct batch_command ** commands, u_int64_t * count)
+/// loads non empty, non comment lines of commands file ("-" reads standard input)
+{
+    FILE * input = strcmp(commands_path, "-") == 0 ? stdin : fopen(commands_path, "r");
+    if (input == NULL) return 1;
+    u_int64_t capacity = 64, line_number = 0;
+    *commands = malloc(sizeof(struct batch_command) * capacity);
+    *count = 0;
+    char * line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_len;
+    while ((line_len = getline(&line, &line_capacity, input)) != -1)
+    {
+        ++line_number;
+        while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r'))
+            line[--line_len] = '\0';
+        if (line_len == 0 || line[0] == '#') continue;
+        if (*count == capacity)
+        {
+            capacity *= 2;
+            *commands = realloc(*commands, sizeof(struct batch_command) * capacity);
+        }
+        (*commands)[*count].line = line_number;
+        (*commands)[*count].text = strdup(line);
+        *count += 1;
+    }
+    free(line);
+    if (input != stdin)
+        fclose(input);
+    return 0;
+}
+
+int run_batch(FILE * file, struct SuperBlock * superBlock, const char * commands_path, u_int64_t jobs,
+        FILE * out)
+/// executes commands file on jobs worker threads (0 picks number of CPUs), results are written to out in order
+{
+    struct batch batch;
+    memset(&batch, 0, sizeof(batch));
+    if (read_commands(commands_path, &batch.commands, &batch.count))
+    {
+        fprintf(stderr, "Error reading commands file %s\n", commands_path);
+        return 1;
+    }
+    if (jobs == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? cpus : 1;
+    }
+    if (jobs > batch.count) jobs = batch.count ? batch.count : 1;
+    batch.file = file;
+    batch.superBlock = superBlock;
+    batch.results = calloc(batch.count ? batch.count : 1, sizeof(char *));
+    batch.max_pending = jobs * MAX_PENDING_RESULTS_PER_JOB;
+    XattrCache_init(&batch.xattr_cache, BATCH_XATTR_CACHE_SIZE);
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.changed, NULL);
+
+    pthread_t * workers = malloc(sizeof(pthread_t) * jobs);
+    u_int64_t started = 0;
+    for (; started < jobs; ++started)
+        if (pthread_create(workers + started, NULL, batch_worker, &batch)) break;
+    int err = started == 0;
+    // print results in command order as soon as they are ready
+    for (u_int64_t i = 0; i < batch.count && !err; ++i)
+    {
+        pthread_mutex_lock(&batch.lock);
+        while (batch.results[i] == NULL)
+            pthread_cond_wait(&batch.changed, &batch.lock);
+        char * result = batch.results[i];
+        batch.results[i] = NULL;
+        batch.printed = i + 1;
+        pthread_cond_broadcast(&batch.changed);
+        pthread_mutex_unlock(&batch.lock);
+        fputs(result, out);
+        free(result);
+    }
+    fflush(out);
+    for (u_int64_t i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    for (u_int64_t i = 0; i < batch.count; ++i)
+    {
+        free(batch.commands[i].text);
+        free(batch.results[i]);
+    }
+    free(batch.commands);
+    free(batch.results);
+    XattrCache_free(&batch.xattr_cache);
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.changed);
+    return err;
+}
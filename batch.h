@@ -0,0 +1,27 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_BATCH_H
+#define EXT4_BINARY_READ_BATCH_H
+#include "filesystem.h"
+
+// Non interactive mode: executes a file of commands, one per line, and prints one JSON object per command (NDJSON).
+// Supported commands (paths are absolute, relative ones start at root, symlinks on the way are followed):
+//   ls <path>                 directory entries
+//   stat <path>               inode attributes and number of extent runs, of a symlink itself with its target
+//   extract <path> <dest>     copies file content into <dest> on host (dest can't contain spaces)
+//   hash <path>               SHA-256 of file content
+//   getfattr <path>           extended attributes, ACLs decoded to text
+// Empty lines and lines starting with # are skipped. Commands are executed concurrently by a pool of workers
+// sharing one handle of the image, results are printed in the order of commands. A command reports "status":"ok" with
+// its payload only once it completed, otherwise "status":"error" with a message (details of read errors on stderr).
+
+// JSON helpers shared with other reports
+void json_string(FILE * out, const char * text, u_int64_t length);
+const char * file_type_name(u_int8_t file_type);
+
+int run_batch(FILE * file, struct SuperBlock * superBlock, const char * commands_path, u_int64_t jobs,
+        FILE * out);
+
+#endif //EXT4_BINARY_READ_BATCH_H
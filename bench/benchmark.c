@@ -0,0 +1,423 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#define _GNU_SOURCE
+#include "../filesystem.h"
+#include "image_generator.h"
+#include "../dir_search.h"
+#include "../interfaces.h"
+#include "../stats.h"
+#include "../arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+// Generates a synthetic image with given shape and times the reader on it:
+//   resolve - path -> inode lookups of random files (latency percentiles)
+//   scan    - loading every allocated inode (inodes/s)
+//   ls      - listing every directory (entries/s)
+//   extract - copying content of every file (MB/s)
+//   name_search - finding names of random files in their directory blocks already in memory: the per entry loop
+//                 (record parsed into ext4_dir_entry_2 and strncmp) against the scalar and vector search kernels
+// Results are printed as a single JSON object so runs with different parameters can be compared by scripts.
+
+struct benchmark_options {
+    struct ImageGeneratorOptions image;
+    u_int64_t lookups;
+    const char * image_path;
+    const char * json_path;
+    u_int8_t keep_image;
+    u_int8_t cold;
+};
+
+double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void drop_image_cache(FILE * file)
+/// asks the kernel to forget cached pages of the image so the next phase starts cold
+/// (pages only go away if they are clean, which is always true for a freshly written and synced image)
+{
+    fdatasync(fileno(file));
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_DONTNEED);
+}
+
+int compare_doubles(const void * a, const void * b)
+{
+    double value_a = *(const double *)a, value_b = *(const double *)b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+double percentile(double * sorted, u_int64_t count, double fraction)
+{
+    if (count == 0) return 0;
+    u_int64_t position = (u_int64_t)(fraction * (double)(count - 1) + 0.5);
+    return sorted[position];
+}
+
+int run_resolve(FILE * file, struct SuperBlock * superBlock, struct GeneratedImage * image, u_int64_t lookups,
+        u_int64_t seed, FILE * json)
+{
+    if (image->file_count == 0 || lookups == 0)
+    {
+        fprintf(json, "  \"resolve\": null,\n");
+        return 0;
+    }
+    double * latencies = malloc(sizeof(double) * lookups);
+    u_int64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    u_int64_t mismatches = 0;
+    double start = now_seconds();
+    for (u_int64_t i = 0; i < lookups; ++i)
+    {
+        state ^= state << 13u;
+        state ^= state >> 7u;
+        state ^= state << 17u;
+        struct GeneratedFile * target = image->files + state % image->file_count;
+        u_int64_t inode_id = 0;
+        double lookup_start = now_seconds();
+        int err = resolve_path(file, superBlock, ROOT_INODE_ID, target->path, 1, &inode_id);
+        latencies[i] = now_seconds() - lookup_start;
+        if (err || inode_id != target->inode)
+            ++mismatches;
+    }
+    double total = now_seconds() - start;
+    qsort(latencies, lookups, sizeof(double), compare_doubles);
+    fprintf(json, "  \"resolve\": {\"lookups\": %" PRIu64 ", \"errors\": %" PRIu64 ", \"seconds\": %.6f, "
+                  "\"lookups_per_second\": %.1f, \"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f},\n",
+            lookups, mismatches, total, (double)lookups / total, percentile(latencies, lookups, 0.5) * 1e6,
+            percentile(latencies, lookups, 0.99) * 1e6, latencies[lookups - 1] * 1e6);
+    free(latencies);
+    return mismatches != 0;
+}
+
+int run_scan(FILE * file, struct SuperBlock * superBlock, struct GeneratedImage * image, FILE * json)
+{
+    u_int64_t last_inode = 2 + image->dir_count + image->file_count + 8;  // every allocated inode
+    if (last_inode > superBlock->s_inodes_count) last_inode = superBlock->s_inodes_count;
+    u_int64_t errors = 0, in_use = 0;
+    double start = now_seconds();
+    for (u_int64_t inode_id = 1; inode_id <= last_inode; ++inode_id)
+    {
+        struct InodeTable inode;
+        if (load_inode_table(file, superBlock, &inode, inode_id))
+            ++errors;
+        else if (inode.i_links_count)
+            ++in_use;
+    }
+    double total = now_seconds() - start;
+    fprintf(json, "  \"scan\": {\"inodes\": %" PRIu64 ", \"in_use\": %" PRIu64 ", \"errors\": %" PRIu64
+                  ", \"seconds\": %.6f, \"inodes_per_second\": %.1f},\n",
+            last_inode, in_use, errors, total, (double)last_inode / total);
+    return errors != 0;
+}
+
+int run_ls(FILE * file, struct SuperBlock * superBlock, struct GeneratedImage * image, FILE * json)
+{
+    u_int64_t entries = 0, errors = 0;
+    double start = now_seconds();
+    for (u_int64_t d = 0; d < image->dir_count; ++d)
+    {
+        struct InodeTable directory;
+        struct ext4_dir_entry_2 * dir_entries;
+        u_int64_t elements_count;
+        struct ArenaMark mark = Arena_mark(&thread_arena);
+        if (load_inode_table(file, superBlock, &directory, image->dir_inodes[d])
+            || get_directory_list(file, superBlock, &directory, &dir_entries, &elements_count))
+        {
+            Arena_rewind(&thread_arena, mark);
+            ++errors;
+            continue;
+        }
+        free(dir_entries);
+        Arena_rewind(&thread_arena, mark);
+        entries += elements_count;
+    }
+    double total = now_seconds() - start;
+    fprintf(json, "  \"ls\": {\"directories\": %" PRIu64 ", \"entries\": %" PRIu64 ", \"errors\": %" PRIu64
+                  ", \"seconds\": %.6f, \"entries_per_second\": %.1f},\n",
+            image->dir_count, entries, errors, total, (double)entries / total);
+    return errors != 0;
+}
+
+int run_extract(FILE * file, struct SuperBlock * superBlock, struct GeneratedImage * image, FILE * json)
+{
+    FILE * sink = fopen("/dev/null", "w");
+    if (sink == NULL) return 1;
+    u_int64_t bytes = 0, errors = 0;
+    double start = now_seconds();
+    for (u_int64_t j = 0; j < image->file_count; ++j)
+    {
+        struct InodeTable inode;
+        if (load_inode_table(file, superBlock, &inode, image->files[j].inode)
+            || copy_inode_data(file, superBlock, &inode, sink))
+        {
+            ++errors;
+            continue;
+        }
+        bytes += inode.i_size_u64;
+    }
+    double total = now_seconds() - start;
+    fclose(sink);
+    fprintf(json, "  \"extract\": {\"files\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"errors\": %" PRIu64
+                  ", \"seconds\": %.6f, \"mb_per_second\": %.2f}\n",
+            image->file_count, bytes, errors, total, (double)bytes / (1024.0 * 1024.0) / total);
+    return errors != 0;
+}
+
+struct dir_blocks {  // raw content of a directory, searched in memory
+    u_char * data;
+    u_int64_t size;
+};
+
+typedef int (*name_search_kernel)(const u_char * data, u_int64_t size, u_int64_t * offset, const char * name,
+        u_int8_t name_len);
+
+int entry_loop_search(const u_char * data, u_int64_t size, u_int64_t * offset, const char * name, u_int8_t name_len)
+/// per entry loop lookups used before the search kernel, every record is parsed and its name compared by strncmp
+{
+    u_int64_t pointer = *offset;
+    while (pointer + 8 <= size)
+    {
+        struct ext4_dir_entry_2 dir_entry;
+        ext4_dir_entry_2_new(&dir_entry, (char *)data + pointer, 0);
+        if (dir_entry.rec_len < 8 || pointer + 8 + dir_entry.name_len > size) break;
+        if (dir_entry.inode && dir_entry.name_len == name_len
+            && strncmp(name, (const char *)data + pointer + 8, name_len) == 0)
+        {
+            *offset = pointer;
+            return 0;
+        }
+        pointer += dir_entry.rec_len;
+    }
+    *offset = size;
+    return 1;
+}
+
+double time_name_search(name_search_kernel kernel, struct dir_blocks * dirs, u_int64_t * target_dirs,
+        struct GeneratedFile ** targets, u_int64_t lookups, u_int64_t * mismatches)
+{
+    double start = now_seconds();
+    for (u_int64_t i = 0; i < lookups; ++i)
+    {
+        struct dir_blocks * dir = dirs + target_dirs[i];
+        const char * name = strrchr(targets[i]->path, '/') + 1;
+        u_int64_t offset = 0;
+        if (kernel(dir->data, dir->size, &offset, name, strlen(name))
+            || convert_le_byte_array_to_uint((char *)dir->data + offset, 4) != targets[i]->inode)
+            ++*mismatches;
+    }
+    return now_seconds() - start;
+}
+
+int run_name_search(FILE * file, struct SuperBlock * superBlock, struct GeneratedImage * image, u_int64_t fanout,
+        u_int64_t lookups, u_int64_t seed, FILE * json)
+{
+    if (image->file_count == 0 || lookups == 0)
+    {
+        fprintf(json, "  \"name_search\": null,\n");
+        return 0;
+    }
+    // generator puts file j into generated directory j / fanout, which follows root and lost+found
+    struct dir_blocks * dirs = calloc(image->dir_count, sizeof(struct dir_blocks));
+    u_int64_t errors = 0, entries_bytes = 0;
+    for (u_int64_t d = 0; d < image->dir_count; ++d)
+    {
+        struct InodeTable directory;
+        struct ExtentRun * runs = NULL;
+        u_int64_t runs_count = 0, blocks = 0;
+        if (load_inode_table(file, superBlock, &directory, image->dir_inodes[d])
+            || get_inode_extent_runs(file, superBlock, &directory, &runs, &runs_count))
+        {
+            ++errors;
+            continue;
+        }
+        for (u_int64_t r = 0; r < runs_count; ++r)
+            blocks += runs[r].length;
+        dirs[d].data = malloc(blocks * superBlock->s_block_size + 1);
+        for (u_int64_t r = 0; r < runs_count; ++r)
+        {
+            errors += read_blocks(file, superBlock->s_block_size, runs[r].physical, runs[r].length,
+                                  (char *)dirs[d].data + dirs[d].size) != 0;
+            dirs[d].size += runs[r].length * superBlock->s_block_size;
+        }
+        entries_bytes += dirs[d].size;
+        free(runs);
+    }
+    u_int64_t * target_dirs = malloc(sizeof(u_int64_t) * lookups);
+    struct GeneratedFile ** targets = malloc(sizeof(struct GeneratedFile *) * lookups);
+    u_int64_t state = seed * 0x9E3779B97F4A7C15ull + 7;
+    for (u_int64_t i = 0; i < lookups; ++i)
+    {
+        state ^= state << 13u;
+        state ^= state >> 7u;
+        state ^= state << 17u;
+        u_int64_t j = state % image->file_count;
+        targets[i] = image->files + j;
+        target_dirs[i] = 2 + j / (fanout ? fanout : 1);
+    }
+    u_int64_t mismatches = 0;
+    double loop = time_name_search(entry_loop_search, dirs, target_dirs, targets, lookups, &mismatches);
+    double scalar = time_name_search(dir_search_name_scalar, dirs, target_dirs, targets, lookups, &mismatches);
+    double vector = time_name_search(dir_search_name, dirs, target_dirs, targets, lookups, &mismatches);
+    fprintf(json, "  \"name_search\": {\"lookups\": %" PRIu64 ", \"directory_bytes\": %" PRIu64
+                  ", \"errors\": %" PRIu64 ", \"kernel\": \"%s\", \"entry_loop_ns\": %.1f, \"scalar_ns\": %.1f"
+                  ", \"vector_ns\": %.1f, \"speedup\": %.2f},\n",
+            lookups, entries_bytes, errors + mismatches, dir_search_kernel(), loop / (double)lookups * 1e9,
+            scalar / (double)lookups * 1e9, vector / (double)lookups * 1e9, vector > 0 ? loop / vector : 0);
+    for (u_int64_t d = 0; d < image->dir_count; ++d)
+        free(dirs[d].data);
+    free(dirs);
+    free(target_dirs);
+    free(targets);
+    return errors + mismatches != 0;
+}
+
+void print_usage()
+{
+    printf("Usage: ext4_benchmark [options]\n"
+           "  --block-size <1024|4096>   block size of generated image (default 4096)\n"
+           "  --files <n>                number of regular files (default 1000)\n"
+           "  --fanout <n>               max files and subdirectories per directory (default 100)\n"
+           "  --file-size <bytes>        size of every file (default 65536)\n"
+           "  --fragment-run <blocks>    max blocks per extent, extents are separated by free blocks (default 0, contiguous)\n"
+           "  --extent-depth <n>         minimal extent tree depth of files (default 0)\n"
+           "  --htree <0|1>              index directories larger than one block (default 1)\n"
+           "  --lookups <n>              number of random path lookups (default 10000)\n"
+           "  --seed <n>                 seed of image contents and lookups (default 1)\n"
+           "  --image <path>             where to write the image (default ext4_benchmark.img)\n"
+           "  --keep                     keep the image after benchmark\n"
+           "  --json <path>              write results into file instead of standard output\n"
+           "  --cold                     drop image from page cache before every phase\n");
+}
+
+int parse_options(int argc, char ** argv, struct benchmark_options * options)
+{
+    static struct option long_options[] = {
+            {"block-size", required_argument, NULL, 'b'},
+            {"files", required_argument, NULL, 'n'},
+            {"fanout", required_argument, NULL, 'f'},
+            {"file-size", required_argument, NULL, 's'},
+            {"fragment-run", required_argument, NULL, 'r'},
+            {"extent-depth", required_argument, NULL, 'd'},
+            {"htree", required_argument, NULL, 'H'},
+            {"lookups", required_argument, NULL, 'l'},
+            {"seed", required_argument, NULL, 'S'},
+            {"image", required_argument, NULL, 'i'},
+            {"keep", no_argument, NULL, 'k'},
+            {"json", required_argument, NULL, 'j'},
+            {"cold", no_argument, NULL, 'c'},
+            {"help", no_argument, NULL, 'h'},
+            {NULL, 0, NULL, 0}
+    };
+    ImageGeneratorOptions_default(&options->image);
+    options->lookups = 10000;
+    options->image_path = "ext4_benchmark.img";
+    options->json_path = NULL;
+    options->keep_image = 0;
+    options->cold = 0;
+    int option;
+    while ((option = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+    {
+        if (option == 'b') options->image.block_size = strtoul(optarg, NULL, 10);
+        else if (option == 'n') options->image.file_count = strtoull(optarg, NULL, 10);
+        else if (option == 'f') options->image.dir_fanout = strtoull(optarg, NULL, 10);
+        else if (option == 's') options->image.file_size = strtoull(optarg, NULL, 10);
+        else if (option == 'r') options->image.fragment_run = strtoull(optarg, NULL, 10);
+        else if (option == 'd') options->image.extent_depth = strtoul(optarg, NULL, 10);
+        else if (option == 'H') options->image.htree = strtoul(optarg, NULL, 10) != 0;
+        else if (option == 'l') options->lookups = strtoull(optarg, NULL, 10);
+        else if (option == 'S') options->image.seed = strtoull(optarg, NULL, 10);
+        else if (option == 'i') options->image_path = optarg;
+        else if (option == 'k') options->keep_image = 1;
+        else if (option == 'j') options->json_path = optarg;
+        else if (option == 'c') options->cold = 1;
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+    if (options->image.block_size != 1024 && options->image.block_size != 4096)
+    {
+        printf("Block size has to be 1024 or 4096\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    struct benchmark_options options;
+    if (parse_options(argc, argv, &options)) return 1;
+
+    struct GeneratedImage image;
+    double generate_start = now_seconds();
+    if (generate_ext4_image(options.image_path, &options.image, &image))
+    {
+        GeneratedImage_free(&image);
+        return 1;
+    }
+    double generate_time = now_seconds() - generate_start;
+
+    FILE * file = fopen(options.image_path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening generated image %s\n", options.image_path);
+        GeneratedImage_free(&image);
+        return 1;
+    }
+    FILE * json = options.json_path ? fopen(options.json_path, "w") : stdout;
+    if (json == NULL)
+    {
+        fprintf(stderr, "Error opening %s\n", options.json_path);
+        fclose(file);
+        GeneratedImage_free(&image);
+        return 1;
+    }
+    struct SuperBlock superBlock;
+    int err = load_super_block(file, &superBlock);
+    if (!err)
+    {
+        fprintf(json, "{\n");
+        fprintf(json, "  \"image\": {\"path\": \"%s\", \"block_size\": %" PRIu32 ", \"files\": %" PRIu64
+                      ", \"directories\": %" PRIu64 ", \"fanout\": %" PRIu64 ", \"file_size\": %" PRIu64
+                      ", \"fragment_run\": %" PRIu64 ", \"extent_depth\": %" PRIu32 ", \"htree\": %d"
+                      ", \"htree_directories\": %" PRIu64 ", \"blocks\": %" PRIu64 ", \"groups\": %" PRIu64
+                      ", \"seed\": %" PRIu64 ", \"cold\": %d, \"generate_seconds\": %.3f},\n",
+                options.image_path, options.image.block_size, image.file_count, image.dir_count,
+                options.image.dir_fanout, options.image.file_size, options.image.fragment_run,
+                options.image.extent_depth, options.image.htree, image.htree_dirs, image.blocks_count,
+                image.groups_count, options.image.seed, options.cold, generate_time);
+        if (options.cold) drop_image_cache(file);
+        err |= run_resolve(file, &superBlock, &image, options.lookups, options.image.seed, json);
+        if (options.cold) drop_image_cache(file);
+        err |= run_scan(file, &superBlock, &image, json);
+        if (options.cold) drop_image_cache(file);
+        err |= run_ls(file, &superBlock, &image, json);
+        err |= run_name_search(file, &superBlock, &image, options.image.dir_fanout, options.lookups,
+                               options.image.seed, json);
+        if (options.cold) drop_image_cache(file);
+        err |= run_extract(file, &superBlock, &image, json);
+        fprintf(json, "}\n");
+    }
+    if (stats_enabled())
+        stats_print(stderr);
+    if (err)
+        fprintf(stderr, "Reader reported errors, see \"errors\" fields of results\n");
+    if (json != stdout)
+        fclose(json);
+    fclose(file);
+    if (!options.keep_image)
+        unlink(options.image_path);
+    GeneratedImage_free(&image);
+    return err;
+}
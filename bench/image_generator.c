@@ -0,0 +1,810 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "image_generator.h"
+
+// Layout of generated image: every block group starts with a superblock copy, group descriptor table,
+// block bitmap, inode bitmap and inode table, rest of the group holds data. Features used are
+// filetype, extents and dir_index, without 64bit, flex_bg, sparse_super or a journal,
+// so group descriptors are 32 bytes long and no checksums have to be computed.
+
+static const u_int32_t GEN_INODE_SIZE = 256;
+static const u_int32_t GEN_FIRST_INODE = 11;  // first non reserved inode, used for lost+found
+static const u_int32_t GEN_TIMESTAMP = 1600000000;
+static const u_int64_t GEN_MAX_EXTENT_LEN = 32768;
+static const u_int64_t GEN_WRITE_CHUNK_BLOCKS = 256;
+
+struct gen_dirent {
+    u_int32_t inode;
+    u_int32_t hash;
+    u_int8_t file_type;
+    u_int8_t name_len;
+    char name[22];
+};
+
+struct gen_dir {
+    u_int32_t inode;
+    u_int32_t parent;
+    char * path;
+    struct gen_dirent * entries;
+    u_int64_t entry_count, entry_capacity;
+    u_int64_t subdir_count;
+};
+
+struct gen_extent {
+    u_int32_t logical;
+    u_int64_t start;  // first block of data, or block of child node in index levels
+    u_int32_t len;
+};
+
+struct generator {
+    int fd;
+    struct ImageGeneratorOptions * options;
+    u_int64_t block_size, blocks_per_group, inodes_per_group, groups, gdt_blocks, itable_blocks, meta_blocks;
+    u_int64_t first_data_block, blocks_count, inodes_count;
+    u_char * block_bitmaps;  // block_size bytes per group
+    u_char * inode_bitmaps;
+    u_int64_t * used_dirs;
+    u_int64_t cursor;  // next candidate block for allocation
+    u_char uuid[16];
+    u_int64_t random_state;
+};
+
+void put_le(u_char * buffer, u_int64_t value, int number_of_bytes)
+/// stores value as little endian number
+{
+    for (int i = 0; i < number_of_bytes; ++i)
+    {
+        buffer[i] = value & 0xFFu;
+        value >>= 8u;
+    }
+}
+
+u_int64_t gen_random(struct generator * gen)
+/// xorshift64, keeps generated images reproducible for a given seed
+{
+    gen->random_state ^= gen->random_state << 13u;
+    gen->random_state ^= gen->random_state >> 7u;
+    gen->random_state ^= gen->random_state << 17u;
+    return gen->random_state;
+}
+
+void ImageGeneratorOptions_default(struct ImageGeneratorOptions * options)
+{
+    options->block_size = 4096;
+    options->file_count = 1000;
+    options->dir_fanout = 100;
+    options->file_size = 64 * 1024;
+    options->fragment_run = 0;
+    options->extent_depth = 0;
+    options->htree = 1;
+    options->seed = 1;
+}
+
+// region htree hash (half MD4, unsigned variant, as in fs/ext4/hash.c)
+#define HASH_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define HASH_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define HASH_H(x, y, z) ((x) ^ (y) ^ (z))
+#define HASH_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = (a << (s)) | (a >> (32u - (s))))
+
+void half_md4_transform(u_int32_t buf[4], const u_int32_t in[8])
+{
+    const u_int32_t K2 = 013240474631u, K3 = 015666365641u;
+    u_int32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+    HASH_ROUND(HASH_F, a, b, c, d, in[0], 3u);
+    HASH_ROUND(HASH_F, d, a, b, c, in[1], 7u);
+    HASH_ROUND(HASH_F, c, d, a, b, in[2], 11u);
+    HASH_ROUND(HASH_F, b, c, d, a, in[3], 19u);
+    HASH_ROUND(HASH_F, a, b, c, d, in[4], 3u);
+    HASH_ROUND(HASH_F, d, a, b, c, in[5], 7u);
+    HASH_ROUND(HASH_F, c, d, a, b, in[6], 11u);
+    HASH_ROUND(HASH_F, b, c, d, a, in[7], 19u);
+    HASH_ROUND(HASH_G, a, b, c, d, in[1] + K2, 3u);
+    HASH_ROUND(HASH_G, d, a, b, c, in[3] + K2, 5u);
+    HASH_ROUND(HASH_G, c, d, a, b, in[5] + K2, 9u);
+    HASH_ROUND(HASH_G, b, c, d, a, in[7] + K2, 13u);
+    HASH_ROUND(HASH_G, a, b, c, d, in[0] + K2, 3u);
+    HASH_ROUND(HASH_G, d, a, b, c, in[2] + K2, 5u);
+    HASH_ROUND(HASH_G, c, d, a, b, in[4] + K2, 9u);
+    HASH_ROUND(HASH_G, b, c, d, a, in[6] + K2, 13u);
+    HASH_ROUND(HASH_H, a, b, c, d, in[3] + K3, 3u);
+    HASH_ROUND(HASH_H, d, a, b, c, in[7] + K3, 9u);
+    HASH_ROUND(HASH_H, c, d, a, b, in[2] + K3, 11u);
+    HASH_ROUND(HASH_H, b, c, d, a, in[6] + K3, 15u);
+    HASH_ROUND(HASH_H, a, b, c, d, in[1] + K3, 3u);
+    HASH_ROUND(HASH_H, d, a, b, c, in[5] + K3, 9u);
+    HASH_ROUND(HASH_H, c, d, a, b, in[0] + K3, 11u);
+    HASH_ROUND(HASH_H, b, c, d, a, in[4] + K3, 15u);
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+void str2hashbuf_unsigned(const char * msg, int len, u_int32_t * buf, int num)
+{
+    u_int32_t pad = (u_int32_t)len | ((u_int32_t)len << 8u);
+    pad |= pad << 16u;
+    u_int32_t val = pad;
+    if (len > num * 4)
+        len = num * 4;
+    for (int i = 0; i < len; i++)
+    {
+        val = ((const u_char *)msg)[i] + (val << 8u);
+        if ((i % 4) == 3)
+        {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0)
+        *buf++ = val;
+    while (--num >= 0)
+        *buf++ = pad;
+}
+
+u_int32_t dx_hash_half_md4(const char * name, int len)
+/// directory index hash of a name, for a filesystem with zero hash seed
+{
+    u_int32_t buf[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    u_int32_t in[8];
+    while (len > 0)
+    {
+        str2hashbuf_unsigned(name, len, in, 8);
+        half_md4_transform(buf, in);
+        len -= 32;
+        name += 32;
+    }
+    u_int32_t hash = buf[1] & ~1u;
+    if (hash == (0x7fffffffu << 1u))
+        hash = (0x7fffffffu - 1) << 1u;
+    return hash;
+}
+// endregion
+
+u_int64_t group_start(struct generator * gen, u_int64_t group)
+{
+    return gen->first_data_block + group * gen->blocks_per_group;
+}
+
+void mark_block(struct generator * gen, u_int64_t block)
+{
+    u_int64_t relative = block - gen->first_data_block;
+    u_char * bitmap = gen->block_bitmaps + (relative / gen->blocks_per_group) * gen->block_size;
+    u_int64_t bit = relative % gen->blocks_per_group;
+    bitmap[bit / 8] |= 1u << (bit % 8);
+}
+
+void mark_inode(struct generator * gen, u_int64_t inode)
+{
+    u_char * bitmap = gen->inode_bitmaps + ((inode - 1) / gen->inodes_per_group) * gen->block_size;
+    u_int64_t bit = (inode - 1) % gen->inodes_per_group;
+    bitmap[bit / 8] |= 1u << (bit % 8);
+}
+
+u_int64_t alloc_run(struct generator * gen, u_int64_t wanted, u_int64_t * start)
+/// allocates up to wanted contiguous blocks, runs never cross group metadata
+/// returns number of allocated blocks, 0 when image is full
+{
+    while (gen->cursor < gen->blocks_count)
+    {
+        u_int64_t group = (gen->cursor - gen->first_data_block) / gen->blocks_per_group;
+        u_int64_t data_start = group_start(gen, group) + gen->meta_blocks;
+        u_int64_t data_end = group_start(gen, group) + gen->blocks_per_group;
+        if (data_end > gen->blocks_count) data_end = gen->blocks_count;
+        if (gen->cursor < data_start) gen->cursor = data_start;
+        if (gen->cursor >= data_end) continue;
+        u_int64_t got = data_end - gen->cursor < wanted ? data_end - gen->cursor : wanted;
+        *start = gen->cursor;
+        for (u_int64_t i = 0; i < got; ++i)
+            mark_block(gen, gen->cursor + i);
+        gen->cursor += got;
+        return got;
+    }
+    return 0;
+}
+
+int write_at(struct generator * gen, const void * data, u_int64_t size, u_int64_t offset)
+{
+    return pwrite(gen->fd, data, size, (off_t)offset) != (ssize_t)size;
+}
+
+int write_extent_node(u_char * node, struct gen_extent * entries, u_int64_t count, u_int64_t max, u_int32_t depth)
+/// fills extent tree node (header and entries) into node buffer
+{
+    put_le(node + 0x0, 0xF30A, 2);
+    put_le(node + 0x2, count, 2);
+    put_le(node + 0x4, max, 2);
+    put_le(node + 0x6, depth, 2);
+    put_le(node + 0x8, 0, 4);
+    for (u_int64_t i = 0; i < count; ++i)
+    {
+        u_char * entry = node + 12 + 12 * i;
+        put_le(entry + 0x0, entries[i].logical, 4);
+        if (depth == 0)
+        {
+            put_le(entry + 0x4, entries[i].len, 2);
+            put_le(entry + 0x6, entries[i].start >> 32u, 2);
+            put_le(entry + 0x8, entries[i].start & 0xFFFFFFFFu, 4);
+        }
+        else
+        {
+            put_le(entry + 0x4, entries[i].start & 0xFFFFFFFFu, 4);
+            put_le(entry + 0x8, entries[i].start >> 32u, 2);
+            put_le(entry + 0xA, 0, 2);
+        }
+    }
+    return 0;
+}
+
+int build_extent_tree(struct generator * gen, struct gen_extent * extents, u_int64_t count, u_int32_t min_depth,
+        u_char * i_block, u_int64_t * tree_blocks)
+/// stores extents as a tree of at least min_depth levels, root goes into i_block
+{
+    u_int64_t per_block = (gen->block_size - 12) / 12;
+    struct gen_extent * level = malloc(sizeof(struct gen_extent) * (count ? count : 1));
+    memcpy(level, extents, sizeof(struct gen_extent) * count);
+    u_char * node = malloc(gen->block_size);
+    u_int32_t depth = 0;
+    *tree_blocks = 0;
+    while (count > 4 || depth < min_depth)
+    {
+        u_int64_t nodes = count ? (count + per_block - 1) / per_block : 1;
+        struct gen_extent * next = malloc(sizeof(struct gen_extent) * nodes);
+        for (u_int64_t i = 0; i < nodes; ++i)
+        {
+            u_int64_t first = i * per_block;
+            u_int64_t entries = count - first < per_block ? count - first : per_block;
+            u_int64_t block;
+            if (alloc_run(gen, 1, &block) != 1)
+            {
+                free(next);
+                free(level);
+                free(node);
+                return 1;
+            }
+            memset(node, 0, gen->block_size);
+            write_extent_node(node, level + first, entries, per_block, depth);
+            if (write_at(gen, node, gen->block_size, block * gen->block_size))
+            {
+                free(next);
+                free(level);
+                free(node);
+                return 1;
+            }
+            next[i].logical = entries ? level[first].logical : 0;
+            next[i].start = block;
+            next[i].len = 0;
+            *tree_blocks += 1;
+        }
+        free(level);
+        level = next;
+        count = nodes;
+        depth += 1;
+    }
+    memset(i_block, 0, 60);
+    write_extent_node(i_block, level, count, 4, depth);
+    free(level);
+    free(node);
+    return 0;
+}
+
+struct gen_inode {
+    u_int16_t mode;
+    u_int16_t links_count;
+    u_int32_t flags;
+    u_int64_t size;
+    u_int64_t blocks;  // data and extent tree blocks
+    u_char i_block[60];
+};
+
+int write_inode(struct generator * gen, u_int64_t inode_id, struct gen_inode * inode)
+{
+    u_char raw[256];
+    memset(raw, 0, sizeof(raw));
+    put_le(raw + 0x0, inode->mode, 2);
+    put_le(raw + 0x4, inode->size & 0xFFFFFFFFu, 4);
+    put_le(raw + 0x8, GEN_TIMESTAMP, 4);
+    put_le(raw + 0xC, GEN_TIMESTAMP, 4);
+    put_le(raw + 0x10, GEN_TIMESTAMP, 4);
+    put_le(raw + 0x1A, inode->links_count, 2);
+    put_le(raw + 0x1C, inode->blocks * (gen->block_size / 512), 4);
+    put_le(raw + 0x20, inode->flags, 4);
+    memcpy(raw + 0x28, inode->i_block, 60);
+    put_le(raw + 0x6C, inode->size >> 32u, 4);
+    put_le(raw + 0x80, 32, 2);  // i_extra_isize
+    put_le(raw + 0x90, GEN_TIMESTAMP, 4);  // i_crtime
+    u_int64_t group = (inode_id - 1) / gen->inodes_per_group;
+    u_int64_t index = (inode_id - 1) % gen->inodes_per_group;
+    u_int64_t table = group_start(gen, group) + 1 + gen->gdt_blocks + 2;
+    mark_inode(gen, inode_id);
+    return write_at(gen, raw, GEN_INODE_SIZE, table * gen->block_size + index * GEN_INODE_SIZE);
+}
+
+typedef void (*content_callback)(void * ctx, u_int64_t logical_block, u_int64_t block_count, u_char * buffer);
+
+int store_inode_data(struct generator * gen, struct gen_inode * inode, u_int64_t block_count, u_int64_t run_limit,
+        u_int32_t min_depth, content_callback content, void * ctx)
+/// allocates block_count data blocks, writes their content and builds extent tree of the inode
+{
+    u_int64_t extent_capacity = 8, extent_count = 0;
+    struct gen_extent * extents = malloc(sizeof(struct gen_extent) * extent_capacity);
+    u_char * buffer = malloc(gen->block_size * GEN_WRITE_CHUNK_BLOCKS);
+    u_int64_t logical = 0;
+    int err = 0;
+    while (logical < block_count && !err)
+    {
+        u_int64_t wanted = block_count - logical;
+        if (run_limit && wanted > run_limit) wanted = run_limit;
+        if (wanted > GEN_MAX_EXTENT_LEN) wanted = GEN_MAX_EXTENT_LEN;
+        u_int64_t start;
+        u_int64_t got = alloc_run(gen, wanted, &start);
+        if (got == 0)
+        {
+            fprintf(stderr, "Generated image ran out of space\n");
+            err = 1;
+            break;
+        }
+        if (extent_count == extent_capacity)
+        {
+            extent_capacity *= 2;
+            extents = realloc(extents, sizeof(struct gen_extent) * extent_capacity);
+        }
+        extents[extent_count].logical = logical;
+        extents[extent_count].start = start;
+        extents[extent_count].len = got;
+        ++extent_count;
+        for (u_int64_t done = 0; done < got && !err; done += GEN_WRITE_CHUNK_BLOCKS)
+        {
+            u_int64_t chunk = got - done < GEN_WRITE_CHUNK_BLOCKS ? got - done : GEN_WRITE_CHUNK_BLOCKS;
+            content(ctx, logical + done, chunk, buffer);
+            err = write_at(gen, buffer, chunk * gen->block_size, (start + done) * gen->block_size);
+        }
+        logical += got;
+        if (run_limit && logical < block_count)
+            gen->cursor += 1;  // leave a free block behind every extent to fragment the file
+    }
+    u_int64_t tree_blocks = 0;
+    if (!err)
+        err = build_extent_tree(gen, extents, extent_count, min_depth, inode->i_block, &tree_blocks);
+    inode->blocks = block_count + tree_blocks;
+    inode->flags |= 0x80000u;  // EXT4_EXTENTS_FL
+    free(buffer);
+    free(extents);
+    return err;
+}
+
+struct file_content {
+    u_int64_t inode;
+    u_int64_t seed;
+    u_int64_t block_size;
+};
+
+void fill_file_content(void * ctx, u_int64_t logical_block, u_int64_t block_count, u_char * buffer)
+/// every 8 bytes of a file hold (seed, inode, position) mix, so misplaced blocks are easy to spot
+{
+    struct file_content * file = ctx;
+    u_int64_t words = block_count * file->block_size / 8;
+    u_int64_t first = logical_block * file->block_size / 8;
+    for (u_int64_t i = 0; i < words; ++i)
+        put_le(buffer + i * 8, (file->seed << 48u) ^ (file->inode << 32u) ^ (first + i), 8);
+}
+
+struct dir_content {
+    u_char * data;
+    u_int64_t block_size;
+};
+
+void copy_dir_content(void * ctx, u_int64_t logical_block, u_int64_t block_count, u_char * buffer)
+{
+    struct dir_content * dir = ctx;
+    memcpy(buffer, dir->data + logical_block * dir->block_size, block_count * dir->block_size);
+}
+
+u_int64_t dirent_size(u_int64_t name_len)
+{
+    return (8 + name_len + 3) & ~(u_int64_t)3u;
+}
+
+void put_dirent(u_char * data, u_int32_t inode, u_int64_t rec_len, const char * name, u_int8_t name_len, u_int8_t file_type)
+{
+    put_le(data + 0x0, inode, 4);
+    put_le(data + 0x4, rec_len, 2);
+    put_le(data + 0x6, name_len, 1);
+    put_le(data + 0x7, file_type, 1);
+    memcpy(data + 0x8, name, name_len);
+}
+
+u_int64_t pack_dirents(struct generator * gen, u_char * data, u_int64_t first_block_used,
+        struct gen_dirent * entries, u_int64_t count, u_int64_t * leaf_first_entry)
+/// packs entries into consecutive blocks, first_block_used bytes of the first block are already taken
+/// returns number of blocks used, leaf_first_entry (if given) receives index of first entry of every block
+{
+    u_int64_t block = 0, offset = first_block_used;
+    u_int64_t last_entry_offset = first_block_used ? first_block_used - 12 : 0;  // ".." entry ends the used part
+    u_int8_t block_has_entry = first_block_used > 0;
+    if (leaf_first_entry) leaf_first_entry[0] = 0;
+    for (u_int64_t i = 0; i < count; ++i)
+    {
+        u_int64_t size = dirent_size(entries[i].name_len);
+        if (offset + size > gen->block_size)
+        {
+            // stretch last entry of full block up to its end
+            put_le(data + block * gen->block_size + last_entry_offset + 4, gen->block_size - last_entry_offset, 2);
+            ++block;
+            offset = 0;
+            if (leaf_first_entry) leaf_first_entry[block] = i;
+        }
+        put_dirent(data + block * gen->block_size + offset, entries[i].inode, size, entries[i].name,
+                   entries[i].name_len, entries[i].file_type);
+        last_entry_offset = offset;
+        offset += size;
+        block_has_entry = 1;
+    }
+    if (block_has_entry)
+        put_le(data + block * gen->block_size + last_entry_offset + 4, gen->block_size - last_entry_offset, 2);
+    return block + 1;
+}
+
+int dirent_hash_compare(const void * a, const void * b)
+{
+    u_int32_t hash_a = ((const struct gen_dirent *)a)->hash, hash_b = ((const struct gen_dirent *)b)->hash;
+    return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+int store_directory(struct generator * gen, struct gen_dir * dir, u_int64_t * htree_dirs)
+/// writes directory blocks and inode, directories that don't fit into one block get hash tree index if enabled
+{
+    u_int64_t bytes = 12 + 12;
+    for (u_int64_t i = 0; i < dir->entry_count; ++i)
+        bytes += dirent_size(dir->entries[i].name_len);
+    u_int64_t max_blocks = bytes / (gen->block_size / 2) + 3;  // generous upper bound, entries never straddle blocks
+    u_char * data = calloc(max_blocks + 1, gen->block_size);
+    struct gen_inode inode;
+    memset(&inode, 0, sizeof(inode));
+    inode.mode = 0x4000u | 0755u;
+    inode.links_count = 2 + dir->subdir_count;
+    u_int64_t dx_limit = (gen->block_size - 32) / 8;
+    u_int64_t blocks;
+
+    u_int8_t use_htree = gen->options->htree && bytes > gen->block_size;
+    if (use_htree)
+    {
+        for (u_int64_t i = 0; i < dir->entry_count; ++i)
+            dir->entries[i].hash = dx_hash_half_md4(dir->entries[i].name, dir->entries[i].name_len);
+        qsort(dir->entries, dir->entry_count, sizeof(struct gen_dirent), dirent_hash_compare);
+        u_int64_t * leaf_first_entry = malloc(sizeof(u_int64_t) * max_blocks);
+        u_int64_t leaves = pack_dirents(gen, data + gen->block_size, 0, dir->entries, dir->entry_count, leaf_first_entry);
+        if (leaves > dx_limit)
+        {
+            fprintf(stderr, "Directory %s has too many entries for a single level hash tree, storing it as linear\n",
+                    dir->path);
+            memset(data, 0, (max_blocks + 1) * gen->block_size);
+            use_htree = 0;
+        }
+        else
+        {
+            // dx_root: fake "." and ".." entries, dx_root_info, then count/limit and (hash, block) pairs
+            u_char * root = data;
+            put_dirent(root, dir->inode, 12, ".", 1, 2);
+            put_dirent(root + 12, dir->parent, gen->block_size - 12, "..", 2, 2);
+            put_le(root + 24, 0, 4);  // reserved_zero
+            put_le(root + 28, 1, 1);  // hash_version, half MD4
+            put_le(root + 29, 8, 1);  // info_length
+            put_le(root + 30, 0, 1);  // indirect_levels
+            put_le(root + 31, 0, 1);  // unused_flags
+            put_le(root + 32, dx_limit, 2);
+            put_le(root + 34, leaves, 2);
+            put_le(root + 36, 1, 4);  // first leaf, its hash is implicitly 0
+            for (u_int64_t leaf = 1; leaf < leaves; ++leaf)
+            {
+                struct gen_dirent * first = dir->entries + leaf_first_entry[leaf];
+                u_int32_t hash = first->hash;
+                if (hash == dir->entries[leaf_first_entry[leaf] - 1].hash)
+                    hash |= 1u;  // hash collision continues from previous leaf
+                put_le(root + 32 + 8 * leaf, hash, 4);
+                put_le(root + 32 + 8 * leaf + 4, leaf + 1, 4);
+            }
+            blocks = leaves + 1;
+            inode.flags |= 0x1000u;  // EXT4_INDEX_FL
+            *htree_dirs += 1;
+        }
+        free(leaf_first_entry);
+    }
+    if (!use_htree)
+    {
+        put_dirent(data, dir->inode, 12, ".", 1, 2);
+        put_dirent(data + 12, dir->parent, 12, "..", 2, 2);
+        blocks = pack_dirents(gen, data, 24, dir->entries, dir->entry_count, NULL);
+    }
+    inode.size = blocks * gen->block_size;
+    struct dir_content content = {data, gen->block_size};
+    int err = store_inode_data(gen, &inode, blocks, 0, 0, copy_dir_content, &content)
+              || write_inode(gen, dir->inode, &inode);
+    gen->used_dirs[(dir->inode - 1) / gen->inodes_per_group] += 1;
+    free(data);
+    return err;
+}
+
+void add_dirent(struct gen_dir * dir, u_int32_t inode, u_int8_t file_type, const char * name)
+{
+    if (dir->entry_count == dir->entry_capacity)
+    {
+        dir->entry_capacity = dir->entry_capacity ? dir->entry_capacity * 2 : 8;
+        dir->entries = realloc(dir->entries, sizeof(struct gen_dirent) * dir->entry_capacity);
+    }
+    struct gen_dirent * entry = dir->entries + dir->entry_count++;
+    memset(entry, 0, sizeof(struct gen_dirent));
+    entry->inode = inode;
+    entry->file_type = file_type;
+    entry->name_len = strlen(name);
+    memcpy(entry->name, name, entry->name_len);
+}
+
+void write_super_block(struct generator * gen, u_char * sb, u_int64_t group, u_int64_t free_blocks, u_int64_t free_inodes)
+{
+    memset(sb, 0, 1024);
+    put_le(sb + 0x0, gen->inodes_count, 4);
+    put_le(sb + 0x4, gen->blocks_count, 4);
+    put_le(sb + 0xC, free_blocks, 4);
+    put_le(sb + 0x10, free_inodes, 4);
+    put_le(sb + 0x14, gen->first_data_block, 4);
+    put_le(sb + 0x18, gen->block_size == 1024 ? 0 : 2, 4);  // s_log_block_size
+    put_le(sb + 0x1C, gen->block_size == 1024 ? 0 : 2, 4);  // s_log_cluster_size
+    put_le(sb + 0x20, gen->blocks_per_group, 4);
+    put_le(sb + 0x24, gen->blocks_per_group, 4);  // s_clusters_per_group
+    put_le(sb + 0x28, gen->inodes_per_group, 4);
+    put_le(sb + 0x30, GEN_TIMESTAMP, 4);  // s_wtime
+    put_le(sb + 0x36, 0xFFFF, 2);  // s_max_mnt_count
+    put_le(sb + 0x38, 0xEF53, 2);  // s_magic
+    put_le(sb + 0x3A, 1, 2);  // s_state, cleanly unmounted
+    put_le(sb + 0x3C, 1, 2);  // s_errors, continue
+    put_le(sb + 0x40, GEN_TIMESTAMP, 4);  // s_lastcheck
+    put_le(sb + 0x4C, 1, 4);  // s_rev_level, dynamic
+    put_le(sb + 0x54, GEN_FIRST_INODE, 4);
+    put_le(sb + 0x58, GEN_INODE_SIZE, 2);
+    put_le(sb + 0x5A, group, 2);  // s_block_group_nr
+    put_le(sb + 0x5C, 0x20, 4);  // compat: dir_index
+    put_le(sb + 0x60, 0x2 | 0x40, 4);  // incompat: filetype, extents
+    put_le(sb + 0x64, 0x2 | 0x40, 4);  // ro_compat: large_file, extra_isize
+    memcpy(sb + 0x68, gen->uuid, 16);
+    put_le(sb + 0xFC, 1, 1);  // s_def_hash_version, half MD4
+    put_le(sb + 0x108, GEN_TIMESTAMP, 4);  // s_mkfs_time
+    put_le(sb + 0x15C, 32, 2);  // s_min_extra_isize
+    put_le(sb + 0x15E, 32, 2);  // s_want_extra_isize
+    put_le(sb + 0x160, 0x2, 4);  // s_flags, unsigned directory hash
+}
+
+int write_group_metadata(struct generator * gen)
+/// writes superblock copies, group descriptor tables and bitmaps of every group
+{
+    u_int64_t gdt_size = gen->gdt_blocks * gen->block_size;
+    u_char * gdt = calloc(gdt_size, 1);
+    u_int64_t free_blocks_total = 0, free_inodes_total = 0;
+    for (u_int64_t group = 0; group < gen->groups; ++group)
+    {
+        u_char * block_bitmap = gen->block_bitmaps + group * gen->block_size;
+        u_char * inode_bitmap = gen->inode_bitmaps + group * gen->block_size;
+        u_int64_t free_blocks = 0, free_inodes = 0;
+        for (u_int64_t bit = 0; bit < gen->blocks_per_group; ++bit)
+            free_blocks += !(block_bitmap[bit / 8] & (1u << (bit % 8)));
+        for (u_int64_t bit = 0; bit < gen->inodes_per_group; ++bit)
+            free_inodes += !(inode_bitmap[bit / 8] & (1u << (bit % 8)));
+        for (u_int64_t bit = gen->inodes_per_group; bit < gen->block_size * 8; ++bit)
+            inode_bitmap[bit / 8] |= 1u << (bit % 8);  // padding past last inode of the group is marked used
+        free_blocks_total += free_blocks;
+        free_inodes_total += free_inodes;
+        u_int64_t start = group_start(gen, group);
+        u_char * descriptor = gdt + group * 32;
+        put_le(descriptor + 0x0, start + 1 + gen->gdt_blocks, 4);
+        put_le(descriptor + 0x4, start + 1 + gen->gdt_blocks + 1, 4);
+        put_le(descriptor + 0x8, start + 1 + gen->gdt_blocks + 2, 4);
+        put_le(descriptor + 0xC, free_blocks, 2);
+        put_le(descriptor + 0xE, free_inodes, 2);
+        put_le(descriptor + 0x10, gen->used_dirs[group], 2);
+        if (write_at(gen, block_bitmap, gen->block_size, (start + 1 + gen->gdt_blocks) * gen->block_size)
+            || write_at(gen, inode_bitmap, gen->block_size, (start + 1 + gen->gdt_blocks + 1) * gen->block_size))
+        {
+            free(gdt);
+            return 1;
+        }
+    }
+    u_char sb[1024];
+    int err = 0;
+    for (u_int64_t group = 0; group < gen->groups && !err; ++group)
+    {
+        u_int64_t start = group_start(gen, group);
+        write_super_block(gen, sb, group, free_blocks_total, free_inodes_total);
+        // primary superblock always sits at byte 1024, its copies at the beginning of their group
+        u_int64_t sb_offset = group == 0 ? 1024 : start * gen->block_size;
+        err = write_at(gen, sb, sizeof(sb), sb_offset) || write_at(gen, gdt, gdt_size, (start + 1) * gen->block_size);
+    }
+    free(gdt);
+    return err;
+}
+
+int plan_geometry(struct generator * gen, u_int64_t inodes_needed, u_int64_t data_blocks_needed)
+/// picks number of groups and inodes per group so that all inodes and data blocks fit
+{
+    struct ImageGeneratorOptions * options = gen->options;
+    if (options->block_size != 1024 && options->block_size != 4096) return 1;
+    gen->block_size = options->block_size;
+    gen->first_data_block = gen->block_size == 1024 ? 1 : 0;
+    gen->blocks_per_group = gen->block_size * 8;
+    u_int64_t inodes_per_block = gen->block_size / GEN_INODE_SIZE;
+    gen->groups = 1;
+    while (1)
+    {
+        u_int64_t per_group = (inodes_needed + gen->groups - 1) / gen->groups;
+        per_group = (per_group + inodes_per_block - 1) / inodes_per_block * inodes_per_block;
+        per_group = (per_group + 7) / 8 * 8;
+        if (per_group < 16) per_group = 16;
+        if (per_group > gen->block_size * 8)
+        {
+            gen->groups += 1;
+            continue;
+        }
+        gen->inodes_per_group = per_group;
+        gen->itable_blocks = per_group * GEN_INODE_SIZE / gen->block_size;
+        gen->gdt_blocks = (gen->groups * 32 + gen->block_size - 1) / gen->block_size;
+        gen->meta_blocks = 1 + gen->gdt_blocks + 2 + gen->itable_blocks;
+        if (gen->meta_blocks >= gen->blocks_per_group) return 1;
+        u_int64_t data_per_group = gen->blocks_per_group - gen->meta_blocks;
+        u_int64_t groups_needed = (data_blocks_needed + data_per_group - 1) / data_per_group;
+        if (groups_needed <= gen->groups) break;
+        gen->groups = groups_needed;
+    }
+    gen->blocks_count = gen->first_data_block + gen->groups * gen->blocks_per_group;
+    gen->inodes_count = gen->groups * gen->inodes_per_group;
+    return 0;
+}
+
+int generate_ext4_image(const char * path, struct ImageGeneratorOptions * options, struct GeneratedImage * image)
+/// writes a new ext4 image into path, image receives list of created files and directories
+{
+    struct generator gen;
+    memset(&gen, 0, sizeof(gen));
+    memset(image, 0, sizeof(struct GeneratedImage));
+    gen.options = options;
+    gen.random_state = options->seed ? options->seed : 1;
+    for (int i = 0; i < 16; ++i)
+        gen.uuid[i] = gen_random(&gen) & 0xFFu;
+    u_int64_t fanout = options->dir_fanout ? options->dir_fanout : 1;
+
+    // directory tree: root, lost+found, then a complete fanout-ary tree of generated directories
+    u_int64_t generated_dirs = (options->file_count + fanout - 1) / fanout;
+    if (generated_dirs == 0) generated_dirs = 1;
+    u_int64_t dir_count = generated_dirs + 2;
+    struct gen_dir * dirs = calloc(dir_count, sizeof(struct gen_dir));
+    dirs[0].inode = 2;
+    dirs[0].parent = 2;
+    dirs[0].path = strdup("/");
+    dirs[1].inode = GEN_FIRST_INODE;
+    dirs[1].parent = 2;
+    dirs[1].path = strdup("/lost+found");
+    add_dirent(&dirs[0], GEN_FIRST_INODE, 2, "lost+found");
+    dirs[0].subdir_count += 1;
+    char name[22];
+    for (u_int64_t k = 0; k < generated_dirs; ++k)
+    {
+        struct gen_dir * dir = dirs + 2 + k;
+        struct gen_dir * parent = k < fanout ? dirs : dirs + 2 + (k / fanout - 1);
+        dir->inode = GEN_FIRST_INODE + 1 + k;
+        dir->parent = parent->inode;
+        snprintf(name, sizeof(name), "d%llu", (unsigned long long)k);
+        dir->path = malloc(strlen(parent->path) + strlen(name) + 2);
+        sprintf(dir->path, "%s%s%s", parent->path, strcmp(parent->path, "/") ? "/" : "", name);
+        add_dirent(parent, dir->inode, 2, name);
+        parent->subdir_count += 1;
+    }
+    image->files = calloc(options->file_count ? options->file_count : 1, sizeof(struct GeneratedFile));
+    image->file_count = options->file_count;
+    u_int64_t first_file_inode = GEN_FIRST_INODE + 1 + generated_dirs;
+    for (u_int64_t j = 0; j < options->file_count; ++j)
+    {
+        struct gen_dir * dir = dirs + 2 + j / fanout;
+        snprintf(name, sizeof(name), "f%llu", (unsigned long long)j);
+        add_dirent(dir, first_file_inode + j, 1, name);
+        image->files[j].inode = first_file_inode + j;
+        image->files[j].size = options->file_size;
+        image->files[j].path = malloc(strlen(dir->path) + strlen(name) + 2);
+        sprintf(image->files[j].path, "%s/%s", dir->path, name);
+    }
+
+    // upper bound of data blocks, files and directories are later allocated for real
+    u_int64_t file_blocks = (options->file_size + options->block_size - 1) / options->block_size;
+    u_int64_t per_extent_block = (options->block_size - 12) / 12;
+    u_int64_t extents_per_file = (options->fragment_run ? file_blocks / options->fragment_run + 1 : 1)
+                                 + file_blocks / (options->block_size * 4) + 2;
+    u_int64_t tree_per_file = options->extent_depth + 2 * (extents_per_file / per_extent_block + 1);
+    u_int64_t data_blocks = options->file_count * (file_blocks + extents_per_file + tree_per_file);
+    for (u_int64_t d = 0; d < dir_count; ++d)
+        data_blocks += (dirs[d].entry_count * 32) / options->block_size * 2 + 4;
+    data_blocks += data_blocks / 16 + 64;
+    int err = plan_geometry(&gen, first_file_inode + options->file_count, data_blocks);
+    if (err)
+        fprintf(stderr, "Unsupported image geometry\n");
+
+    if (!err)
+    {
+        gen.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (gen.fd < 0)
+        {
+            fprintf(stderr, "Error creating image %s\n", path);
+            err = 1;
+        }
+        else if (ftruncate(gen.fd, (off_t)(gen.blocks_count * gen.block_size)))
+            err = 1;
+    }
+    if (!err)
+    {
+        gen.block_bitmaps = calloc(gen.groups, gen.block_size);
+        gen.inode_bitmaps = calloc(gen.groups, gen.block_size);
+        gen.used_dirs = calloc(gen.groups, sizeof(u_int64_t));
+        for (u_int64_t group = 0; group < gen.groups; ++group)
+            for (u_int64_t block = 0; block < gen.meta_blocks; ++block)
+                mark_block(&gen, group_start(&gen, group) + block);
+        for (u_int64_t inode = 1; inode < GEN_FIRST_INODE; ++inode)
+            mark_inode(&gen, inode);
+        gen.cursor = gen.first_data_block;
+
+        struct gen_inode inode;
+        for (u_int64_t j = 0; j < options->file_count && !err; ++j)
+        {
+            memset(&inode, 0, sizeof(inode));
+            inode.mode = 0x8000u | 0644u;
+            inode.links_count = 1;
+            inode.size = options->file_size;
+            struct file_content content = {image->files[j].inode, options->seed, gen.block_size};
+            err = store_inode_data(&gen, &inode, file_blocks, options->fragment_run, options->extent_depth,
+                                   fill_file_content, &content)
+                  || write_inode(&gen, image->files[j].inode, &inode);
+            image->data_bytes += options->file_size;
+        }
+        for (u_int64_t d = 0; d < dir_count && !err; ++d)
+            err = store_directory(&gen, dirs + d, &image->htree_dirs);
+        if (!err)
+            err = write_group_metadata(&gen);
+        if (err)
+            fprintf(stderr, "Error writing image %s\n", path);
+    }
+    if (gen.fd > 0)
+        close(gen.fd);
+
+    image->dir_count = dir_count;
+    image->dir_paths = malloc(sizeof(char *) * dir_count);
+    image->dir_inodes = malloc(sizeof(u_int32_t) * dir_count);
+    for (u_int64_t d = 0; d < dir_count; ++d)
+    {
+        image->dir_paths[d] = dirs[d].path;
+        image->dir_inodes[d] = dirs[d].inode;
+        free(dirs[d].entries);
+    }
+    image->blocks_count = gen.blocks_count;
+    image->inodes_count = gen.inodes_count;
+    image->groups_count = gen.groups;
+    free(dirs);
+    free(gen.block_bitmaps);
+    free(gen.inode_bitmaps);
+    free(gen.used_dirs);
+    return err;
+}
+
+void GeneratedImage_free(struct GeneratedImage * image)
+{
+    for (u_int64_t j = 0; j < image->file_count; ++j)
+        free(image->files[j].path);
+    for (u_int64_t d = 0; d < image->dir_count; ++d)
+        free(image->dir_paths[d]);
+    free(image->files);
+    free(image->dir_paths);
+    free(image->dir_inodes);
+    memset(image, 0, sizeof(struct GeneratedImage));
+}
@@ -0,0 +1,47 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_IMAGE_GENERATOR_H
+#define EXT4_BINARY_READ_IMAGE_GENERATOR_H
+#include <stdlib.h>
+
+// Builds synthetic ext4 images in-process (no mkfs, no mounting, no root).
+// Files are spread over a tree of directories, every directory holds up to dir_fanout files
+// and up to dir_fanout subdirectories.
+
+struct ImageGeneratorOptions {
+    u_int32_t block_size;  // 1024 or 4096
+    u_int64_t file_count;  // number of regular files
+    u_int64_t dir_fanout;  // max number of files (and of subdirectories) in a single directory
+    u_int64_t file_size;  // size of every regular file in bytes
+    u_int64_t fragment_run;  // max blocks in a file extent, every extent is followed by a free block; 0 keeps files contiguous
+    u_int32_t extent_depth;  // minimal extent tree depth of regular files, deeper trees are built when needed
+    u_int8_t htree;  // directories spanning more than one block get a hash tree index
+    u_int64_t seed;  // seeds UUID and file contents
+};
+void ImageGeneratorOptions_default(struct ImageGeneratorOptions * options);
+
+struct GeneratedFile {
+    char * path;
+    u_int32_t inode;
+    u_int64_t size;
+};
+
+struct GeneratedImage {  // what was written into the image, used to drive benchmarks
+    struct GeneratedFile * files;
+    u_int64_t file_count;
+    char ** dir_paths;
+    u_int32_t * dir_inodes;
+    u_int64_t dir_count;  // including root and lost+found
+    u_int64_t blocks_count;
+    u_int64_t inodes_count;
+    u_int64_t groups_count;
+    u_int64_t data_bytes;
+    u_int64_t htree_dirs;
+};
+
+int generate_ext4_image(const char * path, struct ImageGeneratorOptions * options, struct GeneratedImage * image);
+void GeneratedImage_free(struct GeneratedImage * image);
+
+#endif //EXT4_BINARY_READ_IMAGE_GENERATOR_H
@@ -0,0 +1,385 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include "columnar_export.h"
+#include "inode_record.h"
+#include "inode_scan.h"
+#include "batch.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#define COLUMNAR_MAX_COLUMNS 10
+#define COLUMNAR_STRING 0  // width of string columns
+
+enum columnar_encoding {
+    ENCODING_PLAIN,
+    ENCODING_DICTIONARY,
+    ENCODING_STRING,
+};
+
+static const char * const encoding_names[] = {"plain", "dictionary", "string"};
+
+struct columnar_column {
+    const char * name;
+    u_int8_t width;  // bytes per value, COLUMNAR_STRING for strings
+    u_int8_t dictionary;  // dictionary encoding is tried for the column
+};
+
+struct columnar_chunk {
+    u_int64_t offset;
+    u_int64_t length;
+    u_int8_t encoding;
+};
+
+struct columnar_row_group {
+    u_int64_t rows;
+    struct columnar_chunk chunks[COLUMNAR_MAX_COLUMNS];
+};
+
+struct columnar_table {
+    const char * name;
+    const struct columnar_column * columns;
+    u_int64_t columns_count;
+    struct columnar_row_group * row_groups;
+    u_int64_t row_groups_count;
+    u_int64_t row_groups_capacity;
+    u_int64_t rows;
+};
+
+static const struct columnar_column inode_columns[] = {
+    {"inode", 4, 0},
+    {"mode", 2, 1},
+    {"uid", 4, 1},
+    {"gid", 4, 1},
+    {"links_count", 2, 0},
+    {"flags", 4, 0},
+    {"size", 8, 0},
+    {"atime", 4, 0},
+    {"ctime", 4, 0},
+    {"mtime", 4, 0},
+};
+
+static const struct columnar_column entry_columns[] = {
+    {"parent", 4, 0},
+    {"inode", 4, 0},
+    {"file_type", 1, 0},
+    {"path", COLUMNAR_STRING, 0},
+};
+
+struct columnar_writer {
+    FILE * out;
+    u_int64_t offset;  // end of data written so far
+    struct columnar_table inodes;
+    struct columnar_table entries;
+    pthread_mutex_t lock;
+    int err;
+};
+
+struct byte_buffer {
+    u_char * data;
+    u_int64_t size;
+    u_int64_t capacity;
+};
+
+u_char * byte_buffer_reserve(struct byte_buffer * buffer, u_int64_t length)
+/// returns pointer to length bytes appended at the end of buffer
+{
+    if (buffer->size + length > buffer->capacity)
+    {
+        while (buffer->size + length > buffer->capacity)
+            buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+    u_char * end = buffer->data + buffer->size;
+    buffer->size += length;
+    return end;
+}
+
+void byte_buffer_put(struct byte_buffer * buffer, u_int64_t value, u_int8_t width)
+/// appends value as width byte little endian integer
+{
+    u_char * end = byte_buffer_reserve(buffer, width);
+    for (u_int8_t i = 0; i < width; ++i)
+        end[i] = (u_char)(value >> (8u * i));
+}
+
+static inline u_int64_t column_value(const void * values, u_int8_t width, u_int64_t index)
+{
+    if (width == 1) return ((const u_int8_t *)values)[index];
+    if (width == 2) return ((const u_int16_t *)values)[index];
+    if (width == 4) return ((const u_int32_t *)values)[index];
+    return ((const u_int64_t *)values)[index];
+}
+
+void encode_plain(struct byte_buffer * buffer, const void * values, u_int8_t width, u_int64_t rows)
+{
+    for (u_int64_t i = 0; i < rows; ++i)
+        byte_buffer_put(buffer, column_value(values, width, i), width);
+}
+
+int encode_dictionary(struct byte_buffer * buffer, const void * values, u_int8_t width, u_int64_t rows)
+/// dictionary encodes a column of up to 4 byte values, returns 1 without touching buffer when plain would be smaller
+{
+    u_int64_t slots = 16;
+    while (slots < rows * 2)
+        slots *= 2;
+    u_int32_t * keys = malloc(sizeof(u_int32_t) * slots);
+    int32_t * codes_of_keys = malloc(sizeof(int32_t) * slots);
+    u_int32_t * dictionary = malloc(sizeof(u_int32_t) * rows);
+    u_int32_t * codes = malloc(sizeof(u_int32_t) * rows);
+    memset(codes_of_keys, 0xFF, sizeof(int32_t) * slots);
+    u_int64_t dictionary_count = 0;
+    for (u_int64_t i = 0; i < rows; ++i)
+    {
+        u_int32_t value = column_value(values, width, i);
+        u_int64_t slot = (value * 0x9E3779B1u) & (slots - 1);
+        while (codes_of_keys[slot] >= 0 && keys[slot] != value)
+            slot = (slot + 1) & (slots - 1);
+        if (codes_of_keys[slot] < 0)
+        {
+            keys[slot] = value;
+            codes_of_keys[slot] = (int32_t)dictionary_count;
+            dictionary[dictionary_count++] = value;
+        }
+        codes[i] = codes_of_keys[slot];
+    }
+    u_int8_t code_width = dictionary_count <= 0x100 ? 1 : dictionary_count <= 0x10000 ? 2 : 4;
+    u_int64_t encoded_size = 4 + dictionary_count * width + 1 + rows * code_width;
+    int plain = encoded_size >= rows * width;
+    if (!plain)
+    {
+        byte_buffer_put(buffer, dictionary_count, 4);
+        for (u_int64_t i = 0; i < dictionary_count; ++i)
+            byte_buffer_put(buffer, dictionary[i], width);
+        byte_buffer_put(buffer, code_width, 1);
+        for (u_int64_t i = 0; i < rows; ++i)
+            byte_buffer_put(buffer, codes[i], code_width);
+    }
+    free(keys);
+    free(codes_of_keys);
+    free(dictionary);
+    free(codes);
+    return plain;
+}
+
+void encode_strings(struct byte_buffer * buffer, const u_int32_t * offsets, const char * bytes, u_int64_t rows)
+{
+    for (u_int64_t i = 0; i <= rows; ++i)
+        byte_buffer_put(buffer, offsets[i], 4);
+    memcpy(byte_buffer_reserve(buffer, offsets[rows]), bytes, offsets[rows]);
+}
+
+int columnar_write_row_group(struct columnar_writer * writer, struct columnar_table * table, const void ** values,
+        u_int64_t rows, const char * string_bytes)
+/// encodes one row group (values holds a column array per table column, string columns hold offsets and take their
+/// bytes from string_bytes) and appends it to the file; thread safe, encoding runs outside of the lock
+{
+    struct columnar_row_group row_group;
+    struct byte_buffer buffer = {NULL, 0, 0};
+    row_group.rows = rows;
+    for (u_int64_t c = 0; c < table->columns_count; ++c)
+    {
+        const struct columnar_column * column = table->columns + c;
+        struct columnar_chunk * chunk = row_group.chunks + c;
+        chunk->offset = buffer.size;
+        if (column->width == COLUMNAR_STRING)
+        {
+            chunk->encoding = ENCODING_STRING;
+            encode_strings(&buffer, values[c], string_bytes, rows);
+        }
+        else if (column->dictionary && encode_dictionary(&buffer, values[c], column->width, rows) == 0)
+            chunk->encoding = ENCODING_DICTIONARY;
+        else
+        {
+            chunk->encoding = ENCODING_PLAIN;
+            encode_plain(&buffer, values[c], column->width, rows);
+        }
+        chunk->length = buffer.size - chunk->offset;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    int err = writer->err;
+    if (!err && fwrite(buffer.data, 1, buffer.size, writer->out) != buffer.size)
+    {
+        fprintf(stderr, "Error writing columnar export\n");
+        err = writer->err = 1;
+    }
+    if (!err)
+    {
+        for (u_int64_t c = 0; c < table->columns_count; ++c)
+            row_group.chunks[c].offset += writer->offset;
+        writer->offset += buffer.size;
+        if (table->row_groups_count == table->row_groups_capacity)
+        {
+            table->row_groups_capacity = table->row_groups_capacity ? table->row_groups_capacity * 2 : 64;
+            table->row_groups = realloc(table->row_groups,
+                                        sizeof(struct columnar_row_group) * table->row_groups_capacity);
+        }
+        table->row_groups[table->row_groups_count++] = row_group;
+        table->rows += rows;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    free(buffer.data);
+    return err;
+}
+
+int export_inode_columns(void * ctx, struct InodeColumns * columns)
+/// writes a scan batch as one row group of the inodes table, called from scan workers
+{
+    struct columnar_writer * writer = ctx;
+    if (columns->count == 0) return 0;
+    const void * values[] = {columns->inode, columns->mode, columns->uid, columns->gid, columns->links_count,
+                             columns->flags, columns->size, columns->atime, columns->ctime, columns->mtime};
+    return columnar_write_row_group(writer, &writer->inodes, values, columns->count, NULL);
+}
+
+struct entry_batch {
+    struct columnar_writer * writer;
+    u_int64_t count;
+    u_int32_t parent[COLUMNAR_ENTRY_ROW_GROUP];
+    u_int32_t inode[COLUMNAR_ENTRY_ROW_GROUP];
+    u_int8_t file_type[COLUMNAR_ENTRY_ROW_GROUP];
+    u_int32_t path_offsets[COLUMNAR_ENTRY_ROW_GROUP + 1];
+    struct byte_buffer paths;
+};
+
+int entry_batch_flush(struct entry_batch * batch)
+{
+    if (batch->count == 0) return 0;
+    const void * values[] = {batch->parent, batch->inode, batch->file_type, batch->path_offsets};
+    int err = columnar_write_row_group(batch->writer, &batch->writer->entries, values, batch->count,
+                                       (const char *)batch->paths.data);
+    batch->count = 0;
+    batch->paths.size = 0;
+    return err;
+}
+
+int export_directory_entry(void * ctx, u_int64_t parent_inode_id, struct ext4_dir_entry_2 * dir_entry,
+        const char * path, u_int64_t path_len)
+{
+    struct entry_batch * batch = ctx;
+    u_int64_t i = batch->count++;
+    batch->parent[i] = parent_inode_id;
+    batch->inode[i] = dir_entry->inode;
+    batch->file_type[i] = dir_entry->file_type;
+    batch->path_offsets[i] = batch->paths.size;
+    memcpy(byte_buffer_reserve(&batch->paths, path_len), path, path_len);
+    batch->path_offsets[i + 1] = batch->paths.size;
+    if (batch->count == COLUMNAR_ENTRY_ROW_GROUP)
+        return entry_batch_flush(batch);
+    return 0;
+}
+
+void columnar_write_table(FILE * out, struct columnar_table * table)
+/// writes table description of the footer
+{
+    static const char * const type_names[] = {"string", "u8", "u16", "", "u32", "", "", "", "u64"};
+    fprintf(out, "{\"name\":\"%s\",\"rows\":%" PRIu64 ",\"columns\":[", table->name, table->rows);
+    for (u_int64_t c = 0; c < table->columns_count; ++c)
+        fprintf(out, "%s{\"name\":\"%s\",\"type\":\"%s\"}", c ? "," : "", table->columns[c].name,
+                type_names[table->columns[c].width]);
+    fprintf(out, "],\"row_groups\":[");
+    for (u_int64_t g = 0; g < table->row_groups_count; ++g)
+    {
+        struct columnar_row_group * row_group = table->row_groups + g;
+        fprintf(out, "%s{\"rows\":%" PRIu64 ",\"columns\":[", g ? "," : "", row_group->rows);
+        for (u_int64_t c = 0; c < table->columns_count; ++c)
+            fprintf(out, "%s{\"offset\":%" PRIu64 ",\"length\":%" PRIu64 ",\"encoding\":\"%s\"}", c ? "," : "",
+                    row_group->chunks[c].offset, row_group->chunks[c].length,
+                    encoding_names[row_group->chunks[c].encoding]);
+        fprintf(out, "]}");
+    }
+    fprintf(out, "]}");
+}
+
+int columnar_write_footer(struct columnar_writer * writer, const char * image_path)
+{
+    FILE * out = writer->out;
+    fprintf(out, "{\"format\":\"e4col\",\"version\":1,\"image\":");
+    json_string(out, image_path, strlen(image_path));
+    fprintf(out, ",\"tables\":[");
+    columnar_write_table(out, &writer->inodes);
+    fprintf(out, ",");
+    columnar_write_table(out, &writer->entries);
+    fprintf(out, "]}");
+    off_t end = ftello(out);
+    if (end < 0) return 1;
+    u_int64_t footer_length = (u_int64_t)end - writer->offset;
+    u_char trailer[16];
+    for (u_int8_t i = 0; i < 8; ++i)
+        trailer[i] = (u_char)(footer_length >> (8u * i));
+    memcpy(trailer + 8, COLUMNAR_MAGIC, 8);
+    return fwrite(trailer, sizeof(trailer), 1, out) != 1;
+}
+
+int export_columnar(FILE * file, const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        const char * out_path)
+/// writes inodes table (parallel inode scan, jobs workers, 0 picks number of CPUs) and entries table (directory walk
+/// from root) into out_path; the file is written next to it and renamed when complete, when some directories couldn't
+/// be read it is kept without their entries but 1 is returned
+{
+    struct columnar_writer writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.inodes.name = "inodes";
+    writer.inodes.columns = inode_columns;
+    writer.inodes.columns_count = sizeof(inode_columns) / sizeof(inode_columns[0]);
+    writer.entries.name = "entries";
+    writer.entries.columns = entry_columns;
+    writer.entries.columns_count = sizeof(entry_columns) / sizeof(entry_columns[0]);
+    pthread_mutex_init(&writer.lock, NULL);
+
+    u_int64_t tmp_path_len = strlen(out_path) + 5;
+    char * tmp_path = malloc(tmp_path_len);
+    snprintf(tmp_path, tmp_path_len, "%s.tmp", out_path);
+    writer.out = fopen(tmp_path, "wb");
+    int err = 0;
+    u_int64_t unreadable = 0;  // directories skipped by the walk
+    if (writer.out == NULL)
+    {
+        fprintf(stderr, "Error creating columnar export %s\n", tmp_path);
+        err = 1;
+    }
+    else
+    {
+        err = fwrite(COLUMNAR_MAGIC, 8, 1, writer.out) != 1;
+        writer.offset = 8;
+        if (!err)
+            err = scan_inode_columns(image_path, superBlock, jobs, export_inode_columns, &writer);
+        if (!err)
+        {
+            struct entry_batch * batch = malloc(sizeof(struct entry_batch));
+            batch->writer = &writer;
+            batch->count = 0;
+            memset(&batch->paths, 0, sizeof(batch->paths));
+            err = walk_directory_tree(file, superBlock, ROOT_INODE_ID, export_directory_entry, batch, &unreadable);
+            if (!err)
+                err = entry_batch_flush(batch);
+            free(batch->paths.data);
+            free(batch);
+        }
+        if (!err)
+            err = columnar_write_footer(&writer, image_path);
+        if (fclose(writer.out)) err = 1;
+        if (!err && rename(tmp_path, out_path)) err = 1;
+        if (err)
+        {
+            fprintf(stderr, "Error writing columnar export %s\n", out_path);
+            remove(tmp_path);
+        }
+    }
+    if (!err && unreadable)
+    {
+        // the export is kept, inode columns are complete, but the caller has to know entries are missing
+        fprintf(stderr, "Error %" PRIu64 " directories couldn't be read, export %s misses entries below them\n",
+                        unreadable, out_path);
+        err = 1;
+    }
+    free(tmp_path);
+    free(writer.inodes.row_groups);
+    free(writer.entries.row_groups);
+    pthread_mutex_destroy(&writer.lock);
+    return err;
+}
@@ -0,0 +1,31 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_COLUMNAR_EXPORT_H
+#define EXT4_BINARY_READ_COLUMNAR_EXPORT_H
+#include "filesystem.h"
+
+// Export of file system metadata into a self-describing columnar file for analytics tools. Two tables are written:
+//   inodes  - one row per used inode (inode, mode, uid, gid, links_count, flags, size, atime, ctime, mtime),
+//             collected by the parallel inode scan, every worker batch becomes a row group written as soon as it is
+//             encoded, so row groups are not in inode order
+//   entries - one row per directory entry below root (parent, inode, file_type, path), from the directory walk
+// Memory stays bounded by a row group per worker and the directory walk stack, whatever the number of inodes.
+//
+// File layout (all integers little endian):
+//   "E4COL1\n\0" | column chunks of every row group | footer (JSON) | footer length (u64) | "E4COL1\n\0"
+// The footer describes the schema of both tables and offset, length and encoding of every column chunk.
+// Column chunk encodings:
+//   plain      - rows values of the column type (u8, u16, u32 or u64)
+//   dictionary - u32 dictionary size, dictionary values of the column type, u8 code width (1, 2 or 4),
+//                rows codes; used for mode, uid and gid while it is smaller than plain
+//   string     - rows + 1 u32 offsets relative to the end of offsets, followed by the bytes of all values
+
+#define COLUMNAR_MAGIC "E4COL1\n"
+#define COLUMNAR_ENTRY_ROW_GROUP 16384  // directory entries per row group
+
+int export_columnar(FILE * file, const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        const char * out_path);
+
+#endif //EXT4_BINARY_READ_COLUMNAR_EXPORT_H
@@ -0,0 +1,159 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include "dir_search.h"
+
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define DIR_SEARCH_X86
+#include <immintrin.h>
+#endif
+
+#define RECORD_HEADER 8  // inode (4), rec_len (2), name_len (1), file_type (1), followed by name
+
+static inline int record_matches(const u_char * record, const char * name, u_int8_t name_len)
+/// full check of a candidate record: used, same length and same name
+{
+    return record[6] == name_len && (record[0] | record[1] | record[2] | record[3]) != 0
+           && memcmp(record + RECORD_HEADER, name, name_len) == 0;
+}
+
+static inline int record_broken(const u_char * record, u_int64_t pointer, u_int64_t size)
+{
+    u_int64_t rec_len = record[4] | (u_int64_t)record[5] << 8u;
+    return rec_len < RECORD_HEADER || pointer + RECORD_HEADER + record[6] > size;
+}
+
+static inline u_int64_t record_length(const u_char * record)
+{
+    return record[4] | (u_int64_t)record[5] << 8u;
+}
+
+int dir_search_name_scalar(const u_char * data, u_int64_t size, u_int64_t * offset, const char * name,
+        u_int8_t name_len)
+/// plain C kernel, compares name_len and first name byte before calling memcmp
+{
+    u_int64_t pointer = *offset;
+    u_char first = name_len ? (u_char)name[0] : 0;
+    while (pointer + RECORD_HEADER <= size)
+    {
+        const u_char * record = data + pointer;
+        if (record_broken(record, pointer, size))
+        {
+            *offset = pointer;
+            return 1;
+        }
+        if (record[6] == name_len && (name_len == 0 || record[RECORD_HEADER] == first)
+            && record_matches(record, name, name_len))
+        {
+            *offset = pointer;
+            return 0;
+        }
+        pointer += record_length(record);
+    }
+    *offset = size;
+    return 1;
+}
+
+#ifdef DIR_SEARCH_X86
+int dir_search_name_sse2(const u_char * data, u_int64_t size, u_int64_t * offset, const char * name,
+        u_int8_t name_len)
+/// every record is tested with one 16 byte compare: name_len and up to 8 leading name bytes
+{
+    u_char key_bytes[16];
+    u_int32_t prefix = name_len < 8 ? name_len : 8;
+    memset(key_bytes, 0, sizeof(key_bytes));
+    key_bytes[6] = name_len;
+    memcpy(key_bytes + RECORD_HEADER, name, prefix);
+    __m128i key = _mm_loadu_si128((const __m128i *)key_bytes);
+    u_int32_t mask = (1u << 6u) | (((1u << prefix) - 1) << 8u);
+    u_int64_t pointer = *offset;
+    while (pointer + RECORD_HEADER <= size)
+    {
+        const u_char * record = data + pointer;
+        int candidate;
+        if (pointer + 16 <= size)
+        {
+            u_int32_t equal = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)record), key));
+            candidate = (equal & mask) == mask;
+        }
+        else
+            candidate = record[6] == name_len;  // less than a vector left in the chunk
+        if (record_broken(record, pointer, size))
+        {
+            *offset = pointer;
+            return 1;
+        }
+        if (candidate && record_matches(record, name, name_len))
+        {
+            *offset = pointer;
+            return 0;
+        }
+        pointer += record_length(record);
+    }
+    *offset = size;
+    return 1;
+}
+
+__attribute__((target("avx2")))
+int dir_search_name_avx2(const u_char * data, u_int64_t size, u_int64_t * offset, const char * name,
+        u_int8_t name_len)
+/// every record is tested with one 32 byte compare: name_len and up to 24 leading name bytes
+{
+    u_char key_bytes[32];
+    u_int32_t prefix = name_len < 24 ? name_len : 24;
+    memset(key_bytes, 0, sizeof(key_bytes));
+    key_bytes[6] = name_len;
+    memcpy(key_bytes + RECORD_HEADER, name, prefix);
+    __m256i key = _mm256_loadu_si256((const __m256i *)key_bytes);
+    u_int32_t mask = (1u << 6u) | (u_int32_t)(((1ull << prefix) - 1) << 8u);
+    u_int64_t pointer = *offset;
+    while (pointer + RECORD_HEADER <= size)
+    {
+        const u_char * record = data + pointer;
+        int candidate;
+        if (pointer + 32 <= size)
+        {
+            u_int32_t equal = (u_int32_t)_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)record), key));
+            candidate = (equal & mask) == mask;
+        }
+        else
+            candidate = record[6] == name_len;  // less than a vector left in the chunk
+        if (record_broken(record, pointer, size))
+        {
+            *offset = pointer;
+            return 1;
+        }
+        if (candidate && record_matches(record, name, name_len))
+        {
+            *offset = pointer;
+            return 0;
+        }
+        pointer += record_length(record);
+    }
+    *offset = size;
+    return 1;
+}
+#endif
+
+int dir_search_name(const u_char * data, u_int64_t size, u_int64_t * offset, const char * name, u_int8_t name_len)
+/// runs the widest kernel supported by the CPU
+{
+#ifdef DIR_SEARCH_X86
+    if (__builtin_cpu_supports("avx2"))
+        return dir_search_name_avx2(data, size, offset, name, name_len);
+    return dir_search_name_sse2(data, size, offset, name, name_len);
+#else
+    return dir_search_name_scalar(data, size, offset, name, name_len);
+#endif
+}
+
+const char * dir_search_kernel()
+{
+#ifdef DIR_SEARCH_X86
+    return __builtin_cpu_supports("avx2") ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
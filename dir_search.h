@@ -0,0 +1,22 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_DIR_SEARCH_H
+#define EXT4_BINARY_READ_DIR_SEARCH_H
+#include <stdlib.h>
+
+// Name search over packed ext4_dir_entry_2 records (a chunk of linear directory blocks). The rec_len chain is walked
+// in place and every record is tested with a single vector compare of its header and first name bytes against a
+// precomputed key (name_len byte plus up to 8 name bytes with SSE2, 24 with AVX2), so records that can't match are
+// rejected without any function call; only candidates are confirmed with memcmp. AVX2 is used when the CPU has it,
+// SSE2 on other x86 CPUs and plain C elsewhere.
+
+// starts at *offset, returns 0 with *offset at the first used record named name, otherwise returns 1 with *offset
+// at the first broken record (rec_len < 8 or name running past size), or at size when the chain ended cleanly
+int dir_search_name(const u_char * data, u_int64_t size, u_int64_t * offset, const char * name, u_int8_t name_len);
+int dir_search_name_scalar(const u_char * data, u_int64_t size, u_int64_t * offset, const char * name,
+        u_int8_t name_len);
+const char * dir_search_kernel();  // "avx2", "sse2" or "scalar"
+
+#endif //EXT4_BINARY_READ_DIR_SEARCH_H
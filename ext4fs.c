@@ -0,0 +1,427 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include "ext4fs.h"
+#include "interfaces.h"
+#include "image_backend.h"
+#include "arena.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+static const u_int16_t EXT4_SUPER_MAGIC = 0xEF53;
+#define INODE_CACHE_SHARDS 64  // locks of the inode cache, slot i is guarded by lock i % INODE_CACHE_SHARDS
+#define DENTRY_CACHE_SHARDS 64  // locks of the dentry cache, the same way
+
+struct inode_cache_entry {
+    u_int64_t inode_id;  // 0 when the slot is empty
+    struct InodeTable inode;
+    int runs_loaded;
+    struct ExtentRun * runs;  // extent runs of the inode, filled by the first call that needs them
+    u_int64_t runs_count;
+};
+
+struct dentry_cache_entry {
+    u_int64_t directory_inode_id;  // 0 when the slot is empty
+    u_int32_t inode;
+    u_int8_t file_type;  // DEFT_*, taken from the inode when the entry has none
+    u_int8_t name_len;
+    char name[255];
+    char * target;  // target of a symlink, filled by the first lookup that follows it
+};
+
+struct Ext4Fs {
+    char * image_path;
+    FILE * file;  // read only with positional reads, shared by all threads
+    struct SuperBlock superBlock;
+    struct GroupDescriptor * groupDescriptors;  // read only after open, no locking needed
+    u_int64_t groups_count;
+    struct inode_cache_entry * inodes;  // direct mapped by inode number
+    u_int64_t inodes_capacity;
+    pthread_mutex_t inode_locks[INODE_CACHE_SHARDS];
+    struct dentry_cache_entry * dentries;  // hashed by directory inode and name
+    u_int64_t dentries_capacity;
+    pthread_mutex_t dentry_locks[DENTRY_CACHE_SHARDS];
+    struct XattrCache xattr_cache;  // sharded the same way internally
+};
+
+struct Ext4Dir {
+    struct DirCursor cursor;
+};
+
+FILE * Ext4Fs_file(struct Ext4Fs * fs)
+/// image FILE of the handle, valid until Ext4Fs_close
+{
+    return fs->file;
+}
+
+pthread_mutex_t * inode_cache_lock(struct Ext4Fs * fs, struct inode_cache_entry * entry)
+{
+    return fs->inode_locks + (entry - fs->inodes) % INODE_CACHE_SHARDS;
+}
+
+int Ext4Fs_open(struct Ext4Fs ** fs, const char * image_path, const struct Ext4FsOptions * options)
+/// opens image and loads its super block and group descriptors, options may be NULL for EXT4FS_DEFAULT_OPTIONS
+{
+    if (options == NULL) options = &EXT4FS_DEFAULT_OPTIONS;
+    struct Ext4Fs * opened = calloc(1, sizeof(struct Ext4Fs));
+    for (u_int64_t i = 0; i < INODE_CACHE_SHARDS; ++i)
+        pthread_mutex_init(opened->inode_locks + i, NULL);
+    for (u_int64_t i = 0; i < DENTRY_CACHE_SHARDS; ++i)
+        pthread_mutex_init(opened->dentry_locks + i, NULL);
+    opened->image_path = strdup(image_path);
+    XattrCache_init(&opened->xattr_cache, options->xattr_cache_size);
+    opened->inodes_capacity = options->inode_cache_size;
+    if (opened->inodes_capacity)
+        opened->inodes = calloc(opened->inodes_capacity, sizeof(struct inode_cache_entry));
+    opened->dentries_capacity = options->dentry_cache_size;
+    if (opened->dentries_capacity)
+        opened->dentries = calloc(opened->dentries_capacity, sizeof(struct dentry_cache_entry));
+    FILE * file = opened->file = image_open(image_path);
+    if (file == NULL)
+        fprintf(stderr, "Error opening image %s\n", image_path);
+    int err = file == NULL || load_super_block(file, &opened->superBlock);
+    if (!err && opened->superBlock.s_magic != EXT4_SUPER_MAGIC)
+    {
+        fprintf(stderr, "Error %s is not an ext4 image\n", image_path);
+        err = 1;
+    }
+    if (!err && load_group_descriptors(file, &opened->superBlock, &opened->groupDescriptors, &opened->groups_count))
+    {
+        fprintf(stderr, "Error loading group descriptors of %s\n", image_path);
+        err = 1;
+    }
+    if (err)
+    {
+        Ext4Fs_close(opened);
+        return 1;
+    }
+    *fs = opened;
+    return 0;
+}
+
+void Ext4Fs_close(struct Ext4Fs * fs)
+/// closes the handle, no call on it may be running
+{
+    if (fs->file)
+        fclose(fs->file);
+    for (u_int64_t i = 0; i < fs->inodes_capacity; ++i)
+        free(fs->inodes[i].runs);
+    free(fs->inodes);
+    for (u_int64_t i = 0; i < fs->dentries_capacity; ++i)
+        free(fs->dentries[i].target);
+    free(fs->dentries);
+    free(fs->groupDescriptors);
+    free(fs->image_path);
+    XattrCache_free(&fs->xattr_cache);
+    for (u_int64_t i = 0; i < INODE_CACHE_SHARDS; ++i)
+        pthread_mutex_destroy(fs->inode_locks + i);
+    for (u_int64_t i = 0; i < DENTRY_CACHE_SHARDS; ++i)
+        pthread_mutex_destroy(fs->dentry_locks + i);
+    free(fs);
+}
+
+struct SuperBlock * Ext4Fs_super_block(struct Ext4Fs * fs)
+{
+    return &fs->superBlock;
+}
+
+const char * Ext4Fs_image_path(struct Ext4Fs * fs)
+{
+    return fs->image_path;
+}
+
+int fs_read_inode(struct Ext4Fs * fs, FILE * file, u_int64_t inode_id, struct InodeTable * inodeTable)
+/// reads inode from its table, located through the cached group descriptors
+{
+    struct SuperBlock * superBlock = &fs->superBlock;
+    u_int64_t group_id = (inode_id - 1) / superBlock->s_inodes_per_group;
+    u_int64_t index = (inode_id - 1) % superBlock->s_inodes_per_group;
+    if (inode_id == 0 || group_id >= fs->groups_count)
+    {
+        fprintf(stderr, "Error inode %" PRIu64 " is outside of the file system\n", inode_id);
+        return 1;
+    }
+    u_int64_t block = fs->groupDescriptors[group_id].bg_inode_table_u64
+                      + index * superBlock->s_inode_size / superBlock->s_block_size;
+    struct ArenaMark mark = Arena_mark(&thread_arena);
+    char * buffer = Arena_alloc(&thread_arena, superBlock->s_block_size);
+    int err = read_block(file, superBlock->s_block_size, block, buffer);
+    if (!err)
+    {
+        InodeTable_new(inodeTable, buffer + index * superBlock->s_inode_size % superBlock->s_block_size,
+                       superBlock->s_inode_size);
+        inodeTable->i_ino = inode_id;
+    }
+    Arena_rewind(&thread_arena, mark);
+    return err;
+}
+
+int Ext4Fs_load_inode(struct Ext4Fs * fs, u_int64_t inode_id, struct InodeTable * inodeTable)
+/// loads inode, from the inode cache when possible
+{
+    struct inode_cache_entry * entry = fs->inodes_capacity ? fs->inodes + inode_id % fs->inodes_capacity : NULL;
+    if (entry)
+    {
+        pthread_mutex_lock(inode_cache_lock(fs, entry));
+        int hit = entry->inode_id == inode_id;
+        if (hit)
+            memcpy(inodeTable, &entry->inode, sizeof(struct InodeTable));
+        pthread_mutex_unlock(inode_cache_lock(fs, entry));
+        if (hit) return 0;
+    }
+    int err = fs_read_inode(fs, fs->file, inode_id, inodeTable);
+    if (err || entry == NULL) return err;
+    pthread_mutex_lock(inode_cache_lock(fs, entry));
+    free(entry->runs);
+    entry->inode_id = inode_id;
+    memcpy(&entry->inode, inodeTable, sizeof(struct InodeTable));
+    entry->runs_loaded = 0;
+    entry->runs = NULL;
+    entry->runs_count = 0;
+    pthread_mutex_unlock(inode_cache_lock(fs, entry));
+    return 0;
+}
+
+void select_runs(struct ExtentRun * runs, u_int64_t runs_count, u_int64_t block_size, u_int64_t offset,
+        u_int64_t length, struct ExtentRun ** selected, u_int64_t * selected_count)
+/// copies runs overlapping given byte range of the file
+{
+    u_int64_t first = 0, last = runs_count;
+    while (first < last)  // first run ending after offset
+    {
+        u_int64_t middle = (first + last) / 2;
+        if ((runs[middle].logical + runs[middle].length) * block_size <= offset) first = middle + 1;
+        else last = middle;
+    }
+    for (last = first; last < runs_count && runs[last].logical * block_size < offset + length; ++last);
+    *selected_count = last - first;
+    *selected = malloc(sizeof(struct ExtentRun) * (*selected_count ? *selected_count : 1));
+    memcpy(*selected, runs + first, sizeof(struct ExtentRun) * *selected_count);
+}
+
+int fs_extent_runs(struct Ext4Fs * fs, struct InodeTable * inodeTable, u_int64_t offset, u_int64_t length,
+        struct ExtentRun ** runs, u_int64_t * runs_count, u_int64_t * total_count)
+/// copies extent runs of an inode overlapping given byte range, total_count is the number of all its runs;
+/// runs of cached inodes are walked only once and kept next to the inode
+{
+    u_int64_t inode_id = inodeTable->i_ino, block_size = fs->superBlock.s_block_size;
+    struct inode_cache_entry * entry = fs->inodes_capacity ? fs->inodes + inode_id % fs->inodes_capacity : NULL;
+    if (entry)
+    {
+        pthread_mutex_lock(inode_cache_lock(fs, entry));
+        int hit = entry->inode_id == inode_id && entry->runs_loaded;
+        if (hit)
+        {
+            select_runs(entry->runs, entry->runs_count, block_size, offset, length, runs, runs_count);
+            *total_count = entry->runs_count;
+        }
+        pthread_mutex_unlock(inode_cache_lock(fs, entry));
+        if (hit) return 0;
+    }
+    struct ExtentRun * all;
+    u_int64_t all_count;
+    if (get_inode_extent_runs(fs->file, &fs->superBlock, inodeTable, &all, &all_count)) return 1;
+    select_runs(all, all_count, block_size, offset, length, runs, runs_count);
+    *total_count = all_count;
+    if (entry)
+    {
+        pthread_mutex_lock(inode_cache_lock(fs, entry));
+        if (entry->inode_id == inode_id && !entry->runs_loaded)
+        {
+            entry->runs = all;
+            entry->runs_count = all_count;
+            entry->runs_loaded = 1;
+            all = NULL;
+        }
+        pthread_mutex_unlock(inode_cache_lock(fs, entry));
+    }
+    free(all);
+    return 0;
+}
+
+int Ext4Fs_stat(struct Ext4Fs * fs, u_int64_t inode_id, struct InodeStat * inodeStat, u_int64_t * extent_count)
+/// attributes of an inode, extent_count (may be NULL) is the number of its extent runs
+{
+    struct InodeTable inode;
+    if (Ext4Fs_load_inode(fs, inode_id, &inode)) return 1;
+    InodeStat_new(inodeStat, &inode, inode_id);
+    if (extent_count == NULL) return 0;
+    struct ExtentRun * runs;
+    u_int64_t runs_count;
+    if (fs_extent_runs(fs, &inode, 0, 0, &runs, &runs_count, extent_count)) return 1;
+    free(runs);
+    return 0;
+}
+
+int Ext4Fs_pread(struct Ext4Fs * fs, u_int64_t inode_id, void * buffer, u_int64_t length, u_int64_t offset,
+        u_int64_t * read_length)
+/// reads up to length bytes of file content at offset, read_length is shorter only at the end of file
+{
+    struct InodeTable inode;
+    if (Ext4Fs_load_inode(fs, inode_id, &inode)) return 1;
+    u_int64_t size = inode.i_size_u64;
+    *read_length = offset < size ? (size - offset < length ? size - offset : length) : 0;
+    if (*read_length == 0) return 0;
+    struct ExtentRun * runs = NULL;
+    u_int64_t runs_count = 0, total_count;
+    if (!(inode.i_flags & EXT4_INLINE_DATA_FL)
+        && fs_extent_runs(fs, &inode, offset, *read_length, &runs, &runs_count, &total_count))
+        return 1;
+    int err = read_inode_range(fs->file, &fs->superBlock, &inode, runs, runs_count, offset, *read_length, buffer);
+    free(runs);
+    return err;
+}
+
+int Ext4Fs_get_xattrs(struct Ext4Fs * fs, u_int64_t inode_id, struct Xattr ** xattrs, u_int64_t * xattrs_count)
+/// extended attributes of an inode, shared xattr blocks go through the handle's xattr cache
+{
+    struct InodeTable inode;
+    if (Ext4Fs_load_inode(fs, inode_id, &inode)) return 1;
+    return get_inode_xattrs(fs->file, &fs->superBlock, &inode, &fs->xattr_cache, xattrs, xattrs_count);
+}
+
+int fs_open_directory(struct Ext4Fs * fs, u_int64_t inode_id, struct DirCursor * cursor)
+{
+    struct InodeTable directory;
+    if (Ext4Fs_load_inode(fs, inode_id, &directory)) return 1;
+    if ((directory.i_mode & 0xF000u) != S_IFDIR) return 1;
+    return DirCursor_open(cursor, fs->file, &fs->superBlock, &directory);
+}
+
+struct dentry_cache_entry * dentry_cache_slot(struct Ext4Fs * fs, u_int64_t directory_inode_id, const char * name,
+        u_int8_t name_len)
+/// slot of a directory entry in the dentry cache (FNV-1a of directory inode and name), NULL without the cache
+{
+    if (fs->dentries_capacity == 0) return NULL;
+    u_int64_t hash = 14695981039346656037ull;
+    for (u_int64_t i = 0; i < 8; ++i)
+        hash = (hash ^ ((directory_inode_id >> (i * 8)) & 0xFFu)) * 1099511628211ull;
+    for (u_int64_t i = 0; i < name_len; ++i)
+        hash = (hash ^ (u_char)name[i]) * 1099511628211ull;
+    return fs->dentries + hash % fs->dentries_capacity;
+}
+
+pthread_mutex_t * dentry_cache_lock(struct Ext4Fs * fs, struct dentry_cache_entry * entry)
+{
+    return fs->dentry_locks + (entry - fs->dentries) % DENTRY_CACHE_SHARDS;
+}
+
+int fs_lookup_entry(void * ctx, u_int64_t directory_inode_id, const char * name, u_int8_t name_len,
+        u_int64_t * inode_id, u_int8_t * file_type, char * target, u_int64_t target_size)
+/// lookup step of Ext4Fs_resolve: entries and targets of symlinks followed through them come from the dentry cache,
+/// a miss searches the directory and reads the target once
+{
+    struct Ext4Fs * fs = ctx;
+    struct dentry_cache_entry * entry = dentry_cache_slot(fs, directory_inode_id, name, name_len);
+    int hit = 0, target_hit = 0;
+    if (entry)
+    {
+        pthread_mutex_lock(dentry_cache_lock(fs, entry));
+        hit = entry->directory_inode_id == directory_inode_id && entry->name_len == name_len
+              && memcmp(entry->name, name, name_len) == 0;
+        if (hit)
+        {
+            *inode_id = entry->inode;
+            *file_type = entry->file_type;
+            target_hit = target && entry->target && strlen(entry->target) < target_size;
+            if (target_hit)
+                strcpy(target, entry->target);
+        }
+        pthread_mutex_unlock(dentry_cache_lock(fs, entry));
+    }
+    if (!hit)
+    {
+        struct DirCursor cursor;
+        struct ext4_dir_entry_2 dir_entry;
+        if (fs_open_directory(fs, directory_inode_id, &cursor)) return 1;
+        int found = DirCursor_find(&cursor, name, name_len, &dir_entry) == 0;
+        DirCursor_close(&cursor);
+        if (!found) return 1;
+        *inode_id = dir_entry.inode;
+        *file_type = dir_entry.file_type;
+        struct InodeTable inode;
+        if (*file_type == DEFT_UNKNOWN)
+        {
+            if (Ext4Fs_load_inode(fs, *inode_id, &inode)) return 1;
+            *file_type = mode_file_type(inode.i_mode);
+        }
+    }
+    if (target && *file_type == DEFT_SYMLINK && !target_hit
+        && Ext4Fs_readlink(fs, *inode_id, target, target_size))
+        return 1;
+    if (entry == NULL || (hit && (target_hit || !target || *file_type != DEFT_SYMLINK))) return 0;
+    pthread_mutex_lock(dentry_cache_lock(fs, entry));
+    if (!hit)
+    {
+        free(entry->target);
+        entry->directory_inode_id = directory_inode_id;
+        entry->inode = *inode_id;
+        entry->file_type = *file_type;
+        entry->name_len = name_len;
+        memcpy(entry->name, name, name_len);
+        entry->target = NULL;
+    }
+    if (target && *file_type == DEFT_SYMLINK && entry->target == NULL && entry->directory_inode_id == directory_inode_id
+        && entry->inode == *inode_id)
+        entry->target = strdup(target);
+    pthread_mutex_unlock(dentry_cache_lock(fs, entry));
+    return 0;
+}
+
+int Ext4Fs_resolve(struct Ext4Fs * fs, u_int64_t start_inode_id, const char * path, int follow_last,
+        u_int64_t * inode_id)
+/// returns (through u_int64_t * inode_id) inode that given path leads to, absolute paths start at root directory,
+/// relative ones at start_inode_id; symlinks are followed in all components but the last one, which is followed with
+/// follow_last (or a trailing slash); returns 2 when SYMLINK_MAX_FOLLOW symlinks weren't enough (a loop)
+{
+    return walk_path(fs_lookup_entry, fs, start_inode_id, path, follow_last, inode_id);
+}
+
+int Ext4Fs_lookup(struct Ext4Fs * fs, u_int64_t start_inode_id, const char * path, u_int64_t * inode_id)
+/// Ext4Fs_resolve that doesn't follow a symlink in the last component (as lstat)
+{
+    return Ext4Fs_resolve(fs, start_inode_id, path, 0, inode_id);
+}
+
+int Ext4Fs_readlink(struct Ext4Fs * fs, u_int64_t inode_id, char * target, u_int64_t target_size)
+/// NUL terminated target of a symlink, fast symlinks are served from the cached inode without any read
+{
+    struct InodeTable inode;
+    if (Ext4Fs_load_inode(fs, inode_id, &inode)) return 1;
+    return read_symlink(fs->file, &fs->superBlock, &inode, target, target_size);
+}
+
+int Ext4Fs_opendir(struct Ext4Fs * fs, u_int64_t inode_id, struct Ext4Dir ** dir)
+/// starts iterating over entries of a directory, blocks are read only as the entries are
+{
+    struct Ext4Dir * opened = calloc(1, sizeof(struct Ext4Dir));
+    if (fs_open_directory(fs, inode_id, &opened->cursor))
+    {
+        free(opened);
+        return 1;
+    }
+    *dir = opened;
+    return 0;
+}
+
+int Ext4Dir_read(struct Ext4Dir * dir, struct Ext4DirEntry * entry)
+/// fills next entry of the directory, returns 1 when there are no more entries
+{
+    struct ext4_dir_entry_2 dir_entry;
+    if (DirCursor_next(&dir->cursor, &dir_entry)) return 1;
+    entry->inode = dir_entry.inode;
+    entry->file_type = dir_entry.file_type;
+    entry->name_len = dir_entry.name_len;
+    memcpy(entry->name, dir_entry.name, dir_entry.name_len);
+    entry->name[dir_entry.name_len] = '\0';
+    return 0;
+}
+
+void Ext4Dir_close(struct Ext4Dir * dir)
+{
+    DirCursor_close(&dir->cursor);
+    free(dir);
+}
@@ -0,0 +1,57 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_EXT4FS_H
+#define EXT4_BINARY_READ_EXT4FS_H
+#include "filesystem.h"
+#include "xattr.h"
+
+// Embeddable reader API. An opened image is an opaque handle keeping the super block, all group descriptors and
+// caches of inodes (with their extent runs), directory entries (with targets of symlinks found through them) and shared
+// xattr blocks warm between calls, so a long running process
+// pays the startup once instead of per query. Every function may be called from any number of threads on one
+// handle: the image is read with positional reads through a single FILE, group descriptors never change after open
+// and caches are split into shards with their own locks, so there is no lock shared by all readers.
+
+struct Ext4Fs;  // opaque handle of an opened image
+struct Ext4Dir;  // opaque directory iterator
+
+struct Ext4FsOptions {
+    u_int64_t inode_cache_size;  // inodes kept in memory, 0 disables the cache
+    u_int64_t xattr_cache_size;  // shared xattr blocks kept in memory
+    u_int64_t dentry_cache_size;  // directory entries found by lookups kept in memory, 0 disables the cache
+};
+
+static const struct Ext4FsOptions EXT4FS_DEFAULT_OPTIONS = {1024, 64, 4096};
+
+struct Ext4DirEntry {
+    u_int32_t inode;
+    u_int8_t file_type;  // DEFT_*
+    u_int8_t name_len;
+    char name[256];  // zero terminated
+};
+
+int Ext4Fs_open(struct Ext4Fs ** fs, const char * image_path, const struct Ext4FsOptions * options);
+void Ext4Fs_close(struct Ext4Fs * fs);
+struct SuperBlock * Ext4Fs_super_block(struct Ext4Fs * fs);
+const char * Ext4Fs_image_path(struct Ext4Fs * fs);
+
+int Ext4Fs_lookup(struct Ext4Fs * fs, u_int64_t start_inode_id, const char * path, u_int64_t * inode_id);
+int Ext4Fs_resolve(struct Ext4Fs * fs, u_int64_t start_inode_id, const char * path, int follow_last,
+        u_int64_t * inode_id);
+int Ext4Fs_readlink(struct Ext4Fs * fs, u_int64_t inode_id, char * target, u_int64_t target_size);
+int Ext4Fs_load_inode(struct Ext4Fs * fs, u_int64_t inode_id, struct InodeTable * inodeTable);
+int Ext4Fs_stat(struct Ext4Fs * fs, u_int64_t inode_id, struct InodeStat * inodeStat, u_int64_t * extent_count);
+int Ext4Fs_pread(struct Ext4Fs * fs, u_int64_t inode_id, void * buffer, u_int64_t length, u_int64_t offset,
+        u_int64_t * read_length);
+int Ext4Fs_get_xattrs(struct Ext4Fs * fs, u_int64_t inode_id, struct Xattr ** xattrs, u_int64_t * xattrs_count);
+
+int Ext4Fs_opendir(struct Ext4Fs * fs, u_int64_t inode_id, struct Ext4Dir ** dir);
+int Ext4Dir_read(struct Ext4Dir * dir, struct Ext4DirEntry * entry);
+void Ext4Dir_close(struct Ext4Dir * dir);
+
+// image FILE for lower level modules (scans, reports, indexes), safe to share between threads
+FILE * Ext4Fs_file(struct Ext4Fs * fs);
+
+#endif //EXT4_BINARY_READ_EXT4FS_H
@@ -0,0 +1,1041 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "filesystem.h"
+#include "dir_search.h"
+#include "interfaces.h"
+#include "stats.h"
+#include "xattr.h"
+#include "arena.h"
+
+int load_super_block(FILE * file, struct SuperBlock * superBlock)
+/// loads super block from second 1024 bytes of a device/file
+{
+    static const uint sb_offset = 1024, sb_length = 1024;
+    char buffer[sb_length];
+    if (read_file_into_buffer(file, buffer, sb_offset, sb_length)) return 1;
+    return SuperBblock_new(superBlock, buffer);
+}
+
+uint64_t get_descriptors_per_block(struct SuperBlock * superBlock)
+{
+    return superBlock->s_block_size / superBlock->s_desc_size;
+}
+
+uint64_t get_old_descriptor_blocks(struct SuperBlock * superBlock)
+/// number of group descriptor blocks placed right after the super block, with META_BG only the first
+/// s_first_meta_bg of them, the rest is spread over meta block groups
+{
+    uint64_t table_blocks = (get_groups_count(superBlock) + get_descriptors_per_block(superBlock) - 1)
+                            / get_descriptors_per_block(superBlock);
+    if (!(superBlock->s_feature_incompat & INCOMPAT_META_BG)) return table_blocks;
+    return superBlock->s_first_meta_bg < table_blocks ? superBlock->s_first_meta_bg : table_blocks;
+}
+
+uint64_t get_group_descriptor_block(struct SuperBlock * superBlock, uint64_t table_block)
+/// location of given block of the group descriptor table; with META_BG descriptors of every meta block group
+/// (as many groups as fit into one block) live in a single block at the start of the meta group's first group,
+/// right after a super block copy if there is one (copies sit in its second and last group)
+{
+    if (table_block < get_old_descriptor_blocks(superBlock))
+        return superBlock->s_first_group_desc_block + table_block;
+    uint64_t group_id = table_block * get_descriptors_per_block(superBlock);
+    return superBlock->s_first_data_block + group_id * superBlock->s_blocks_per_group
+           + (group_has_super_block(superBlock, group_id) ? 1 : 0);
+}
+
+int load_group_descriptor(FILE * file, struct SuperBlock * superBlock, struct GroupDescriptor * groupDescriptor,
+                          u_int64_t group_id)
+/// loads group descriptor for given block group
+{
+    STAT_BEGIN();
+    // group descriptor tables are located in first(0) block group, or with META_BG in first group of every
+    // meta block group, other block groups MAY store copies of them
+
+    // locate block in which our group descriptor is in
+    uint64_t block_offset = group_id / get_descriptors_per_block(superBlock);
+    // locate byte offset in block
+    uint64_t byte_offset = (group_id % get_descriptors_per_block(superBlock)) * superBlock->s_desc_size;
+    struct ArenaMark mark = Arena_mark(&thread_arena);
+    char * buffer = Arena_alloc(&thread_arena, superBlock->s_block_size);
+    int err = read_block(file, superBlock->s_block_size, get_group_descriptor_block(superBlock, block_offset), buffer);
+    if (!err)
+        err = GroupDescriptor_new(groupDescriptor, buffer + byte_offset, superBlock->s_desc_size);
+    Arena_rewind(&thread_arena, mark);
+    STAT_END(STAT_LOAD_GROUP_DESCRIPTOR, superBlock->s_desc_size);
+    return err;
+}
+
+uint64_t get_groups_count(struct SuperBlock * superBlock)
+{
+    return (superBlock->s_blocks_count_u64 - superBlock->s_first_data_block + superBlock->s_blocks_per_group - 1)
+           / superBlock->s_blocks_per_group;
+}
+
+uint64_t get_inode_table_blocks(struct SuperBlock * superBlock)
+{
+    return ((uint64_t)superBlock->s_inodes_per_group * superBlock->s_inode_size + superBlock->s_block_size - 1)
+           / superBlock->s_block_size;
+}
+
+uint64_t group_metadata_block(struct GroupDescriptor * groupDescriptor, enum GroupMetadata metadata)
+{
+    if (metadata == GROUP_BLOCK_BITMAP) return groupDescriptor->bg_block_bitmap_u64;
+    if (metadata == GROUP_INODE_BITMAP) return groupDescriptor->bg_inode_bitmap_u64;
+    return groupDescriptor->bg_inode_table_u64;
+}
+
+uint64_t contiguous_metadata_groups(struct SuperBlock * superBlock, struct GroupDescriptor * groupDescriptors,
+        uint64_t groups_count, uint64_t first_group, enum GroupMetadata metadata, uint64_t max_groups)
+/// number of groups (at least 1, at most max_groups) starting at first_group whose metadata of given kind lie
+/// back to back on disk, so they can be read with a single request; with flex_bg that is up to the whole flex group,
+/// without it metadata of every group sits in the group itself and runs are one group long
+{
+    uint64_t flex_end = (first_group / superBlock->s_groups_per_flex + 1) * superBlock->s_groups_per_flex;
+    uint64_t size = metadata == GROUP_INODE_TABLE ? get_inode_table_blocks(superBlock) : 1;
+    uint64_t count = 1;
+    while (first_group + count < groups_count && first_group + count < flex_end && count < max_groups
+           && group_metadata_block(groupDescriptors + first_group + count, metadata)
+              == group_metadata_block(groupDescriptors + first_group, metadata) + count * size)
+        ++count;
+    return count;
+}
+
+int is_power_of(uint64_t number, uint64_t base)
+{
+    while (number > 1 && number % base == 0)
+        number /= base;
+    return number == 1;
+}
+
+int group_has_super_block(struct SuperBlock * superBlock, uint64_t group_id)
+/// tells if block group starts with a copy of super block and group descriptor table
+{
+    if (group_id == 0) return 1;
+    if (superBlock->s_feature_compat & COMPAT_SPARSE_SUPER2)
+        return group_id == superBlock->s_backup_bgs[0] || group_id == superBlock->s_backup_bgs[1];
+    if (!(superBlock->s_feature_ro_compat & RO_COMPAT_SPARSE_SUPER)) return 1;
+    // sparse_super keeps copies in groups 1 and powers of 3, 5 and 7
+    return is_power_of(group_id, 3) || is_power_of(group_id, 5) || is_power_of(group_id, 7);
+}
+
+int load_group_descriptors(FILE * file, struct SuperBlock * superBlock, struct GroupDescriptor ** groupDescriptors,
+        uint64_t * groups_count)
+/// loads descriptors of all block groups, the table behind the super block is read with a single request,
+/// scattered META_BG descriptor blocks are all hinted to the kernel first and then read one by one
+{
+    STAT_BEGIN();
+    *groups_count = get_groups_count(superBlock);
+    uint64_t descriptors_per_block = get_descriptors_per_block(superBlock);
+    uint64_t table_blocks = (*groups_count + descriptors_per_block - 1) / descriptors_per_block;
+    uint64_t old_blocks = get_old_descriptor_blocks(superBlock);
+    char * buffer = malloc(superBlock->s_block_size * (table_blocks ? table_blocks : 1));
+    int err = old_blocks && read_blocks(file, superBlock->s_block_size, superBlock->s_first_group_desc_block, old_blocks,
+                                        buffer);
+    for (uint64_t block = old_blocks; block < table_blocks; ++block)
+        prefetch_blocks(file, superBlock->s_block_size, get_group_descriptor_block(superBlock, block), 1);
+    for (uint64_t block = old_blocks; !err && block < table_blocks; ++block)
+        err = read_block(file, superBlock->s_block_size, get_group_descriptor_block(superBlock, block),
+                         buffer + block * superBlock->s_block_size);
+    *groupDescriptors = malloc(sizeof(struct GroupDescriptor) * (*groups_count ? *groups_count : 1));
+    for (uint64_t group_id = 0; !err && group_id < *groups_count; ++group_id)
+        err = GroupDescriptor_new(*groupDescriptors + group_id, buffer + group_id * superBlock->s_desc_size,
+                                  superBlock->s_desc_size);
+    free(buffer);
+    if (err)
+    {
+        free(*groupDescriptors);
+        *groupDescriptors = NULL;
+    }
+    STAT_END(STAT_LOAD_GROUP_DESCRIPTOR, *groups_count * superBlock->s_desc_size);
+    return err;
+}
+
+int load_inode_table(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable, uint64_t inode_id)
+/// loads inode of given id
+{
+    STAT_BEGIN();
+    // locate block group this inode belongs to
+    uint64_t block_group = (inode_id - 1) / superBlock->s_inodes_per_group;
+    uint64_t index = (inode_id - 1) % superBlock->s_inodes_per_group;
+    uint64_t containing_block = (index * superBlock->s_inode_size) / superBlock->s_block_size;
+    uint64_t byte_offset = (index * superBlock->s_inode_size) % superBlock->s_block_size;
+    struct GroupDescriptor groupDescriptor;
+    if (load_group_descriptor(file, superBlock, &groupDescriptor, block_group)) return 1;
+    struct ArenaMark mark = Arena_mark(&thread_arena);
+    char * buffer = Arena_alloc(&thread_arena, superBlock->s_block_size);
+    uint8_t err = read_block(file, superBlock->s_block_size, groupDescriptor.bg_inode_table_u64 + containing_block, buffer);
+    if (!err)
+    {
+        InodeTable_new(inodeTable, buffer + byte_offset, superBlock->s_inode_size);
+        inodeTable->i_ino = inode_id;
+    }
+    Arena_rewind(&thread_arena, mark);
+    STAT_END(STAT_LOAD_INODE_TABLE, superBlock->s_inode_size);
+    return err;
+}
+
+uint64_t leaf_prefetch_blocks = 0;  // number of data blocks to prefetch from the start of every leaf extent, 0 disables
+#define MAX_MERGED_INDEX_READ 64  // max number of index blocks read by a single merged request
+
+struct extent_child {
+    uint64_t block;  // block number of child node
+    uint64_t order;  // position of child in its parent index node
+};
+
+int extent_child_compare(const void * a, const void * b)
+{
+    uint64_t block_a = ((const struct extent_child *)a)->block, block_b = ((const struct extent_child *)b)->block;
+    return (block_a > block_b) - (block_a < block_b);
+}
+
+int read_extent_children(FILE * file, struct SuperBlock * superBlock, struct extent_child * children, uint64_t count,
+        u_char * children_data)
+/// reads all child nodes of an index node into children_data (in index order, one block each)
+/// prefetch hints for every child are issued first, then physically adjacent children are merged into single reads
+{
+    for (uint64_t i = 0; i < count; ++i)
+        prefetch_blocks(file, superBlock->s_block_size, children[i].block, 1);
+    struct ArenaMark mark = Arena_mark(&thread_arena);
+    struct extent_child * sorted = Arena_alloc(&thread_arena, sizeof(struct extent_child) * count);
+    u_char * run_data = Arena_alloc(&thread_arena, superBlock->s_block_size * MAX_MERGED_INDEX_READ);
+    if (sorted == NULL || run_data == NULL)
+    {
+        fprintf(stderr, "Error allocating extent tree walk buffers\n");
+        Arena_rewind(&thread_arena, mark);
+        return 1;
+    }
+    memcpy(sorted, children, sizeof(struct extent_child) * count);
+    qsort(sorted, count, sizeof(struct extent_child), extent_child_compare);
+    uint64_t run_start = 0;
+    while (run_start < count)
+    {
+        uint64_t run_end = run_start + 1;
+        while (run_end < count && run_end - run_start < MAX_MERGED_INDEX_READ
+               && sorted[run_end].block == sorted[run_start].block + (run_end - run_start))
+            ++run_end;
+        if (read_blocks(file, superBlock->s_block_size, sorted[run_start].block, run_end - run_start, (char *)run_data))
+        {
+            fprintf(stderr, "Error reading extent index blocks %" PRIu64 "-%" PRIu64 "\n", sorted[run_start].block,
+                            sorted[run_end - 1].block);
+            Arena_rewind(&thread_arena, mark);
+            return 1;
+        }
+        STAT_ADD_BYTES(STAT_EXTENT_WALK, (run_end - run_start) * superBlock->s_block_size);
+        for (uint64_t i = run_start; i < run_end; ++i)
+            memcpy(children_data + sorted[i].order * superBlock->s_block_size,
+                   run_data + (i - run_start) * superBlock->s_block_size, superBlock->s_block_size);
+        run_start = run_end;
+    }
+    Arena_rewind(&thread_arena, mark);
+    return 0;
+}
+
+uint64_t ext4_extent_length(struct ext4_extent * extent)
+/// number of blocks covered by extent, lengths above 32768 mark uninitialized extents
+{
+    return extent->ee_len > 32768 ? extent->ee_len - 32768 : extent->ee_len;
+}
+
+int extent_tree_recursive(FILE * file, struct SuperBlock * superBlock, struct ext4_extent_header * extent_header,
+        u_char * extent_data, extent_callback callback, void * ctx)
+/// calls callback for every leaf extent below given extent node, in logical order
+{
+    return extent_tree_walk(file, superBlock, extent_header, extent_data, callback, NULL, ctx);
+}
+
+int extent_header_valid(struct ext4_extent_header * extent_header, uint64_t node_size)
+/// checks that a node header read from disk describes entries that fit in its node (60 bytes of i_block for the root,
+/// a block for the rest) and a depth ext4 can have, so a corrupted tree can't make the walk read past its buffers
+{
+    return extent_header->eh_entries <= extent_header->eh_max
+           && 12 + 12 * (uint64_t)extent_header->eh_max <= node_size
+           && extent_header->eh_depth <= MAX_EXTENT_DEPTH;
+}
+
+int extent_node_walk(FILE * file, struct SuperBlock * superBlock, struct ext4_extent_header * extent_header,
+        u_char * extent_data, extent_callback callback, extent_node_callback node_callback, void * ctx)
+/// walks a node whose header was already checked, children are checked before descending into them
+/// children of an index node are read in batches of up to MAX_MERGED_INDEX_READ before descending, so the first leaf
+/// is reached after one batched read per tree level and memory taken per level stays bounded
+{
+    if (extent_header->eh_depth == 0)
+    {
+        for(uint64_t leaf_num = 0; leaf_num < extent_header->eh_entries; ++leaf_num)
+        {
+            struct ext4_extent leaf;
+            ext4_extent_new(&leaf, (char*)extent_data + 12 + 12 * leaf_num);
+            uint64_t leaf_len = ext4_extent_length(&leaf);
+            if (leaf_prefetch_blocks)
+                prefetch_blocks(file, superBlock->s_block_size, leaf.ee_start_u64,
+                                leaf_len < leaf_prefetch_blocks ? leaf_len : leaf_prefetch_blocks);
+            if (callback(ctx, &leaf))
+                return 1;
+        }
+        return 0;
+    }
+    // children of every batch stay in the thread arena until the batch is done, deeper levels stack after them
+    struct ArenaMark mark = Arena_mark(&thread_arena);
+    struct extent_child * children = Arena_alloc(&thread_arena, sizeof(struct extent_child) * MAX_MERGED_INDEX_READ);
+    u_char * children_data = Arena_alloc(&thread_arena, superBlock->s_block_size * MAX_MERGED_INDEX_READ);
+    if (children == NULL || children_data == NULL)
+    {
+        fprintf(stderr, "Error allocating extent tree walk buffers\n");
+        Arena_rewind(&thread_arena, mark);
+        return 1;
+    }
+    uint8_t err = 0;
+    for (uint64_t first = 0; !err && first < extent_header->eh_entries; first += MAX_MERGED_INDEX_READ)
+    {
+        uint64_t children_count = extent_header->eh_entries - first < MAX_MERGED_INDEX_READ
+                                  ? extent_header->eh_entries - first : MAX_MERGED_INDEX_READ;
+        for(uint64_t index_num = 0; !err && index_num < children_count; ++index_num)
+        {
+            struct ext4_extent_idx index;
+            ext4_extent_idx_new(&index, (char*)extent_data + 12 + 12 * (first + index_num));
+            children[index_num].block = index.ei_leaf_u64;
+            children[index_num].order = index_num;
+            if (node_callback && node_callback(ctx, index.ei_leaf_u64))
+                err = 1;
+        }
+        if (!err)
+            err = read_extent_children(file, superBlock, children, children_count, children_data);
+        for(uint64_t index_num = 0; !err && index_num < children_count; ++index_num)
+        {
+            u_char * leaf_data = children_data + index_num * superBlock->s_block_size;
+            struct ext4_extent_header header;
+            if (ext4_extent_header_new(&header, (char *)leaf_data) || !extent_header_valid(&header, superBlock->s_block_size)
+                || header.eh_depth != extent_header->eh_depth - 1)
+            {
+                fprintf(stderr, "Error reading extent header from block num %" PRIu64 "\n", children[index_num].block);
+                err = 1;
+            }
+            else if (extent_node_walk(file, superBlock, &header, leaf_data, callback, node_callback, ctx))
+                err = 1;
+        }
+    }
+    Arena_rewind(&thread_arena, mark);
+    return err;
+}
+
+int extent_tree_walk(FILE * file, struct SuperBlock * superBlock, struct ext4_extent_header * extent_header,
+        u_char * extent_data, extent_callback callback, extent_node_callback node_callback, void * ctx)
+/// calls callback for every leaf extent below given extent root (i_block of an inode), in logical order, and
+/// node_callback (if not NULL) for every tree block below it, before the block is read
+{
+    if (!extent_header_valid(extent_header, EXTENT_ROOT_SIZE))
+    {
+        fprintf(stderr, "Error corrupted extent tree root (%" PRIu16 " of %" PRIu16 " entries, depth %" PRIu16 ")\n",
+                        extent_header->eh_entries, extent_header->eh_max, extent_header->eh_depth);
+        return 1;
+    }
+    return extent_node_walk(file, superBlock, extent_header, extent_data, callback, node_callback, ctx);
+}
+
+struct block_list_ctx {
+    uint64_t * blocks;
+    uint64_t * blocks_read;
+    uint64_t capacity;
+};
+
+int block_list_append(void * ctx, struct ext4_extent * extent)
+{
+    struct block_list_ctx * list = ctx;
+    uint64_t extent_len = ext4_extent_length(extent);
+    if (*list->blocks_read + extent_len > list->capacity)
+    {
+        fprintf(stderr, "Extent tree covers more blocks than declared in inode table\n");
+        return 1;
+    }
+    for (uint64_t block_num = 0; block_num < extent_len; ++block_num)
+    {
+        list->blocks[*list->blocks_read] = extent->ee_start_u64 + block_num;
+        *list->blocks_read += 1;
+    }
+    return 0;
+}
+
+int inode_block_recursive(FILE * file, struct SuperBlock * superBlock, struct ext4_extent_header * extent_header,
+        u_char * extent_data, uint64_t * blocks, uint64_t * blocks_read, uint64_t blocks_capacity)
+/// appends (in logical order) ids of data blocks covered by given extent node
+{
+    struct block_list_ctx list = {blocks, blocks_read, blocks_capacity};
+    return extent_tree_recursive(file, superBlock, extent_header, extent_data, block_list_append, &list);
+}
+
+struct extent_runs_ctx {
+    struct ExtentRun * runs;
+    uint64_t count;
+    uint64_t capacity;
+};
+
+int extent_runs_append(void * ctx, struct ext4_extent * extent)
+{
+    struct extent_runs_ctx * list = ctx;
+    uint64_t extent_len = ext4_extent_length(extent);
+    if (extent_len == 0) return 0;
+    uint64_t uninitialized = extent->ee_len > 32768;
+    struct ExtentRun * last = list->count ? list->runs + list->count - 1 : NULL;
+    if (last && last->logical + last->length == extent->ee_block && last->physical + last->length == extent->ee_start_u64
+        && last->uninitialized == uninitialized)
+    {
+        last->length += extent_len;
+        return 0;
+    }
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 8;
+        list->runs = realloc(list->runs, sizeof(struct ExtentRun) * list->capacity);
+    }
+    list->runs[list->count].logical = extent->ee_block;
+    list->runs[list->count].physical = extent->ee_start_u64;
+    list->runs[list->count].length = extent_len;
+    list->runs[list->count].uninitialized = uninitialized;
+    list->count += 1;
+    return 0;
+}
+
+int get_inode_extent_runs(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        struct ExtentRun ** runs, uint64_t * runs_count)
+/// returns (through struct ExtentRun ** runs, uint64_t * runs_count) physically contiguous runs of given inode,
+/// in logical order, extents that continue each other are merged into single run
+{
+    struct extent_runs_ctx list = {NULL, 0, 0};
+    struct ext4_extent_header header;
+    *runs = NULL;
+    *runs_count = 0;
+    if (!(inodeTable->i_flags & EXT4_EXTENTS_FL)) return 0;  // inline data, fast symlinks, and block mapped files
+    if (ext4_extent_header_new(&header, (char*)inodeTable->i_block + 0x0)) return 1;
+    STAT_BEGIN();
+    int err = extent_tree_recursive(file, superBlock, &header, inodeTable->i_block, extent_runs_append, &list);
+    STAT_END(STAT_EXTENT_WALK, 0);
+    if (err)
+    {
+        free(list.runs);
+        return 1;
+    }
+    *runs = list.runs;
+    *runs_count = list.count;
+    return 0;
+}
+
+int get_inline_data(struct InodeTable * inodeTable, const u_char ** extra_data, uint64_t * extra_size)
+/// inline data inodes keep first 60 bytes of content in i_block and the rest in system.data xattr value,
+/// returns (through extra_data, extra_size) the part stored in the xattr (possibly empty)
+{
+    const u_char * value;
+    u_int32_t value_size;
+    *extra_data = NULL;
+    *extra_size = 0;
+    if (!(inodeTable->i_flags & EXT4_INLINE_DATA_FL)) return 1;
+    if (find_inode_xattr(inodeTable, XATTR_INDEX_SYSTEM, "data", &value, &value_size) == 0)
+    {
+        *extra_data = value;
+        *extra_size = value_size;
+    }
+    return 0;
+}
+
+static const uint64_t COPY_CHUNK_BLOCKS = 256;  // max number of blocks read by a single request when copying file data
+
+int read_inode_data(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        data_callback callback, void * ctx)
+/// passes i_size bytes of file content to callback in order, every extent run is read in large sequential chunks
+/// holes, uninitialized extents (and blocks past the last extent) are passed as zeros
+/// inline data is passed straight from the inode, without any further reads
+{
+    if (inodeTable->i_flags & EXT4_INLINE_DATA_FL)
+    {
+        const u_char * extra_data;
+        uint64_t extra_size, size = inodeTable->i_size_u64;
+        get_inline_data(inodeTable, &extra_data, &extra_size);
+        uint64_t first_part = size < sizeof(inodeTable->i_block) ? size : sizeof(inodeTable->i_block);
+        uint64_t second_part = size - first_part < extra_size ? size - first_part : extra_size;
+        if (first_part && callback(ctx, inodeTable->i_block, first_part)) return 1;
+        if (second_part && callback(ctx, extra_data, second_part)) return 1;
+        return 0;
+    }
+    struct ExtentRun * runs;
+    uint64_t runs_count;
+    if (get_inode_extent_runs(file, superBlock, inodeTable, &runs, &runs_count)) return 1;
+    uint64_t block_size = superBlock->s_block_size;
+    // with bigalloc a chunk holds at least a whole cluster, so large clusters are read with one request each
+    uint64_t chunk_blocks = COPY_CHUNK_BLOCKS > superBlock->s_cluster_blocks ? COPY_CHUNK_BLOCKS
+                                                                             : superBlock->s_cluster_blocks;
+    u_char * chunk = calloc(chunk_blocks, block_size);
+    uint64_t written = 0, size = inodeTable->i_size_u64;
+    int err = 0;
+    for (uint64_t i = 0; i <= runs_count && written < size && !err; ++i)
+    {
+        // uninitialized runs are left to the zero fill in front of the next run
+        if (i < runs_count && runs[i].uninitialized) continue;
+        // zero fill everything before the next run (or up to the end of file after the last one)
+        uint64_t run_start = i < runs_count ? runs[i].logical * block_size : size;
+        if (run_start > size) run_start = size;
+        if (written < run_start)
+            memset(chunk, 0, chunk_blocks * block_size);
+        while (written < run_start && !err)
+        {
+            uint64_t length = run_start - written < chunk_blocks * block_size ? run_start - written
+                                                                                : chunk_blocks * block_size;
+            err = callback(ctx, chunk, length);
+            written += length;
+        }
+        if (i == runs_count) break;
+        for (uint64_t done = 0; done < runs[i].length && written < size && !err; done += chunk_blocks)
+        {
+            uint64_t blocks = runs[i].length - done < chunk_blocks ? runs[i].length - done : chunk_blocks;
+            err = read_blocks(file, block_size, runs[i].physical + done, blocks, (char *)chunk);
+            uint64_t length = blocks * block_size < size - written ? blocks * block_size : size - written;
+            if (!err)
+                err = callback(ctx, chunk, length);
+            written += length;
+        }
+    }
+    free(chunk);
+    free(runs);
+    return err;
+}
+
+int write_to_file(void * ctx, const u_char * data, uint64_t length)
+{
+    return fwrite(data, 1, length, (FILE *)ctx) != length;
+}
+
+int copy_inode_data(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable, FILE * out)
+/// writes i_size bytes of file content into out
+{
+    return read_inode_data(file, superBlock, inodeTable, write_to_file, out);
+}
+
+int read_inode_range(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        struct ExtentRun * runs, uint64_t runs_count, uint64_t offset, uint64_t length, u_char * buffer)
+/// copies length bytes of file content starting at offset into buffer, the caller keeps the range within i_size
+/// runs are extent runs of the inode (in logical order), holes and uninitialized runs read as zeros, inline data comes
+/// from the inode itself
+/// whole blocks are read straight into buffer, only partial blocks at the edges of the range go through a copy
+{
+    memset(buffer, 0, length);
+    if (inodeTable->i_flags & EXT4_INLINE_DATA_FL)
+    {
+        const u_char * extra_data;
+        uint64_t extra_size;
+        get_inline_data(inodeTable, &extra_data, &extra_size);
+        for (uint64_t i = 0; i < length; ++i)
+        {
+            uint64_t position = offset + i;
+            if (position < sizeof(inodeTable->i_block))
+                buffer[i] = inodeTable->i_block[position];
+            else if (position - sizeof(inodeTable->i_block) < extra_size)
+                buffer[i] = extra_data[position - sizeof(inodeTable->i_block)];
+        }
+        return 0;
+    }
+    uint64_t block_size = superBlock->s_block_size, end = offset + length;
+    // first run ending after offset
+    uint64_t low = 0, high = runs_count;
+    while (low < high)
+    {
+        uint64_t middle = (low + high) / 2;
+        if ((runs[middle].logical + runs[middle].length) * block_size <= offset) low = middle + 1;
+        else high = middle;
+    }
+    u_char * edge = NULL;
+    int err = 0;
+    for (uint64_t i = low; i < runs_count && runs[i].logical * block_size < end && !err; ++i)
+    {
+        if (runs[i].uninitialized) continue;
+        uint64_t run_start = runs[i].logical * block_size, run_end = run_start + runs[i].length * block_size;
+        uint64_t position = offset > run_start ? offset : run_start, stop = end < run_end ? end : run_end;
+        while (position < stop && !err)
+        {
+            uint64_t block = runs[i].physical + (position - run_start) / block_size;
+            uint64_t within = (position - run_start) % block_size;
+            if (within == 0 && stop - position >= block_size)
+            {
+                uint64_t blocks = (stop - position) / block_size;
+                err = read_blocks(file, block_size, block, blocks, (char *)buffer + (position - offset));
+                position += blocks * block_size;
+                continue;
+            }
+            if (edge == NULL)
+                edge = malloc(block_size);
+            uint64_t count = block_size - within < stop - position ? block_size - within : stop - position;
+            err = read_block(file, block_size, block, (char *)edge);
+            if (!err)
+                memcpy(buffer + (position - offset), edge + within, count);
+            position += count;
+        }
+    }
+    free(edge);
+    return err;
+}
+
+int get_inode_block_list(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        uint64_t ** blocks, uint64_t * blocks_count)
+/// returns (through uint64_t ** blocks, uint64_t * blocks_count params) an ordered list of block ids that given inode uses
+{
+    uint64_t sector_size_in_block_count;
+    uint64_t blocks_in_inode;
+    if (inodeTable->i_flags & EXT4_INLINE_DATA_FL)
+    {
+        // content lives inside the inode, there are no blocks to list
+        *blocks = NULL;
+        *blocks_count = 0;
+        return 0;
+    }
+    if (!(superBlock->s_feature_ro_compat & 0x8u))
+    {
+        sector_size_in_block_count = 512;
+        blocks_in_inode = inodeTable->i_blocks_lo;
+    }
+    else if (!(inodeTable->i_flags & EXT4_HUGE_FILE_FL))
+    {
+        sector_size_in_block_count = 512;
+        blocks_in_inode = inodeTable->i_blocks_lo + ((uint64_t)inodeTable->l_i_blocks_high << 32u);
+    }
+    else
+    {
+        sector_size_in_block_count = superBlock->s_block_size;
+        blocks_in_inode = ((uint64_t)inodeTable->i_blocks_lo + (uint64_t)inodeTable->l_i_blocks_high) << 32u;
+    }
+    blocks_in_inode /= superBlock->s_block_size / sector_size_in_block_count;
+
+    *blocks = malloc(sizeof(uint64_t) * blocks_in_inode);
+    struct ext4_extent_header header;
+    if (ext4_extent_header_new(&header, (char*)inodeTable->i_block + 0x0)) return 1;
+    uint64_t blocks_read = 0;
+    STAT_BEGIN();
+    int err = inode_block_recursive(file, superBlock, &header, inodeTable->i_block, *blocks, &blocks_read, blocks_in_inode);
+    STAT_END(STAT_EXTENT_WALK, 0);
+    if (err) return 1;
+    // i_blocks also counts extent tree blocks, so it is only an upper bound of data blocks (it was used as capacity)
+    *blocks_count = blocks_read;
+    return 0;
+}
+
+int DirCursor_open(struct DirCursor * cursor, FILE * file, struct SuperBlock * superBlock,
+        struct InodeTable * inodeTable)
+/// positions cursor before the first entry of given directory, release it with DirCursor_close
+{
+    memset(cursor, 0, sizeof(struct DirCursor));
+    if ((inodeTable->i_mode & S_IFDIR) == 0) return 1; // if given inode is not a directory
+    cursor->file = file;
+    cursor->superBlock = superBlock;
+    memcpy(&cursor->inode, inodeTable, sizeof(struct InodeTable));
+    if (inodeTable->i_flags & EXT4_INLINE_DATA_FL) return 0;
+    if (!(inodeTable->i_flags & EXT4_EXTENTS_FL)
+        || get_inode_extent_runs(file, superBlock, inodeTable, &cursor->runs, &cursor->runs_count))
+    {
+        fprintf(stderr, "Error getting inode block list\n");
+        return 1;
+    }
+    cursor->buffer = malloc(superBlock->s_block_size * DIR_CURSOR_CHUNK_BLOCKS);
+    return 0;
+}
+
+int dir_cursor_fill(struct DirCursor * cursor)
+/// moves cursor to the next region of packed entries: next chunk of directory blocks, or for inline directories
+/// i_block (after parent inode number) followed by system.data xattr value; returns 1 when there is none left
+{
+    cursor->pointer = 0;
+    cursor->size = 0;
+    if (cursor->inode.i_flags & EXT4_INLINE_DATA_FL)
+    {
+        while (cursor->size == 0 && cursor->stage < 4)
+        {
+            cursor->stage += 1;
+            if (cursor->stage == 3)
+            {
+                cursor->data = (u_char *)cursor->inode.i_block + 4;
+                cursor->size = sizeof(cursor->inode.i_block) - 4;
+            }
+            else if (cursor->stage == 4)
+                get_inline_data(&cursor->inode, (const u_char **)&cursor->data, &cursor->size);
+        }
+        return cursor->size == 0;
+    }
+    if (cursor->run == cursor->runs_count) return 1;
+    struct ExtentRun * run = cursor->runs + cursor->run;
+    uint64_t blocks = run->length - cursor->run_offset;
+    if (blocks > DIR_CURSOR_CHUNK_BLOCKS) blocks = DIR_CURSOR_CHUNK_BLOCKS;
+    STAT_BEGIN();
+    if (read_blocks(cursor->file, cursor->superBlock->s_block_size, run->physical + cursor->run_offset, blocks,
+                    (char *)cursor->buffer))
+    {
+        fprintf(stderr, "Error reading directory block %" PRIu64 "\n", run->physical + cursor->run_offset);
+        cursor->err = 1;
+        return 1;
+    }
+    STAT_END(STAT_GET_DIRECTORY_LIST, blocks * cursor->superBlock->s_block_size);
+    cursor->run_offset += blocks;
+    if (cursor->run_offset == run->length)
+    {
+        cursor->run += 1;
+        cursor->run_offset = 0;
+    }
+    cursor->data = cursor->buffer;
+    cursor->size = blocks * cursor->superBlock->s_block_size;
+    return 0;
+}
+
+void dir_cursor_skip_broken(struct DirCursor * cursor)
+/// moves cursor past a record with broken rec_len or name_len, rest of its block can't be walked
+{
+    uint64_t block_size = cursor->superBlock->s_block_size;
+    cursor->pointer = cursor->data == cursor->buffer ? (cursor->pointer / block_size + 1) * block_size : cursor->size;
+}
+
+int DirCursor_next(struct DirCursor * cursor, struct ext4_dir_entry_2 * dir_entry)
+/// fills next used entry of the directory, its name points into the cursor and stays valid only until the next call
+/// (it is not NUL terminated); returns 1 when there are no more entries (or reading failed, see cursor->err)
+{
+    if ((cursor->inode.i_flags & EXT4_INLINE_DATA_FL) && cursor->stage < 2)
+    {
+        // "." and ".." of inline directories are not stored, the parent is the first word of i_block
+        cursor->stage += 1;
+        dir_entry->inode = cursor->stage == 1 ? cursor->inode.i_ino
+                                              : convert_le_byte_array_to_uint((char *)cursor->inode.i_block, 4);
+        dir_entry->rec_len = 0;
+        dir_entry->name_len = cursor->stage;
+        dir_entry->file_type = DEFT_DIRECTORY;
+        dir_entry->name = (u_char *)"..";
+        return 0;
+    }
+    while (1)
+    {
+        while (cursor->pointer + 8 <= cursor->size)
+        {
+            ext4_dir_entry_2_new(dir_entry, (char *)cursor->data + cursor->pointer, 0);
+            if (dir_entry->rec_len < 8 || cursor->pointer + 8 + dir_entry->name_len > cursor->size)
+            {
+                dir_cursor_skip_broken(cursor);
+                continue;
+            }
+            dir_entry->name = cursor->data + cursor->pointer + 8;
+            cursor->pointer += dir_entry->rec_len;
+            if (dir_entry->inode) return 0;
+        }
+        if (cursor->err || dir_cursor_fill(cursor)) return 1;
+    }
+}
+
+int DirCursor_find(struct DirCursor * cursor, const char * name, uint8_t name_len, struct ext4_dir_entry_2 * dir_entry)
+/// moves cursor past the next used entry named name and fills it (name points into the cursor like with
+/// DirCursor_next), whole chunks are searched by the vectorized kernel; returns 1 when there is no such entry
+{
+    while ((cursor->inode.i_flags & EXT4_INLINE_DATA_FL) && cursor->stage < 2)
+    {
+        if (DirCursor_next(cursor, dir_entry)) return 1;
+        if (dir_entry->name_len == name_len && memcmp(dir_entry->name, name, name_len) == 0) return 0;
+    }
+    while (1)
+    {
+        if (cursor->pointer < cursor->size
+            && dir_search_name(cursor->data, cursor->size, &cursor->pointer, name, name_len) == 0)
+        {
+            ext4_dir_entry_2_new(dir_entry, (char *)cursor->data + cursor->pointer, 0);
+            dir_entry->name = cursor->data + cursor->pointer + 8;
+            cursor->pointer += dir_entry->rec_len;
+            return 0;
+        }
+        if (cursor->pointer + 8 <= cursor->size)
+            dir_cursor_skip_broken(cursor);
+        else if (cursor->err || dir_cursor_fill(cursor))
+            return 1;
+    }
+}
+
+void DirCursor_close(struct DirCursor * cursor)
+{
+    free(cursor->runs);
+    free(cursor->buffer);
+    cursor->runs = NULL;
+    cursor->buffer = NULL;
+}
+
+int get_directory_list(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        struct ext4_dir_entry_2 ** dir_entries, uint64_t * dir_entries_count)
+/// returns (through struct ext4_dir_entry_2 ** dir_entries, uint64_t * dir_entries_count)
+/// a list of dir_entry elements that this directory contains, names are allocated in the thread arena and stay valid
+/// until the caller rewinds it (or the command ends); callers that only go through the entries once should use
+/// DirCursor instead
+{
+    struct DirCursor cursor;
+    if (DirCursor_open(&cursor, file, superBlock, inodeTable)) return 1;
+    uint64_t capacity = 0;
+    *dir_entries = NULL;
+    *dir_entries_count = 0;
+    struct ext4_dir_entry_2 dir_entry;
+    while (DirCursor_next(&cursor, &dir_entry) == 0)
+    {
+        if (*dir_entries_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 8;
+            *dir_entries = realloc(*dir_entries, sizeof(struct ext4_dir_entry_2) * capacity);
+        }
+        struct ext4_dir_entry_2 * entry = *dir_entries + *dir_entries_count;
+        memcpy(entry, &dir_entry, sizeof(struct ext4_dir_entry_2));
+        entry->name = Arena_alloc(&thread_arena, dir_entry.name_len ? dir_entry.name_len : 1);
+        memcpy(entry->name, dir_entry.name, dir_entry.name_len);
+        *dir_entries_count += 1;
+    }
+    int err = cursor.err;
+    DirCursor_close(&cursor);
+    return err;
+}
+
+int find_path_in_directory(FILE * file, struct SuperBlock * superBlock, struct InodeTable * current_directory,
+        char * file_name, struct ext4_dir_entry_2 * found_dir_entry)
+/// attempts to find a dir_entry of given name, reading of the directory stops at the first match
+/// returned through struct ext4_dir_entry_2 * found_dir_entry, its name is allocated in the thread arena
+{
+    struct DirCursor cursor;
+    if (DirCursor_open(&cursor, file, superBlock, current_directory)) return 1;
+    uint64_t file_name_len = strlen(file_name);
+    uint8_t found_dir = 0;
+    struct ext4_dir_entry_2 dir_entry;
+    if (file_name_len <= 255 && DirCursor_find(&cursor, file_name, file_name_len, &dir_entry) == 0)
+    {
+        memcpy(found_dir_entry, &dir_entry, sizeof(struct ext4_dir_entry_2));
+        found_dir_entry->name = Arena_alloc(&thread_arena, file_name_len ? file_name_len : 1);
+        memcpy(found_dir_entry->name, dir_entry.name, file_name_len);
+        found_dir = 1;
+    }
+    DirCursor_close(&cursor);
+    return !found_dir;
+}
+
+int InodeStat_new(struct InodeStat * inodeStat, struct InodeTable * inodeTable, uint64_t inode_id)
+/// fills stat record of given inode from its inode table
+{
+    inodeStat->inode = inode_id;
+    inodeStat->mode = inodeTable->i_mode;
+    inodeStat->links_count = inodeTable->i_links_count;
+    inodeStat->uid = ((uint32_t)inodeTable->l_i_uid_high << 16u) + inodeTable->i_uid;
+    inodeStat->gid = ((uint32_t)inodeTable->l_i_gid_high << 16u) + inodeTable->i_gid;
+    inodeStat->flags = inodeTable->i_flags;
+    inodeStat->atime = inodeTable->i_atime;
+    inodeStat->ctime = inodeTable->i_ctime;
+    inodeStat->mtime = inodeTable->i_mtime;
+    inodeStat->size = inodeTable->i_size_u64;
+    return 0;
+}
+
+u_int8_t mode_file_type(u_int16_t mode)
+/// directory entry type (DEFT_*) of an inode mode, for file systems without the filetype feature
+{
+    uint16_t file_format = mode & 0xF000u;
+    if (file_format == S_IFREG) return DEFT_REGULAR;
+    if (file_format == S_IFDIR) return DEFT_DIRECTORY;
+    if (file_format == S_IFCHR) return DEFT_CHAR_DEV;
+    if (file_format == S_IFBLK) return DEFT_BLOCK_DEV;
+    if (file_format == S_IFIFO) return DEFT_FIFO;
+    if (file_format == S_IFSOCK) return DEFT_SOCKET;
+    if (file_format == S_IFLNK) return DEFT_SYMLINK;
+    return DEFT_UNKNOWN;
+}
+
+int read_symlink(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable, char * target,
+        uint64_t target_size)
+/// NUL terminated target of a symlink; fast symlinks (targets shorter than 60 bytes) are kept in i_block and need
+/// no read, inline data ones come from the inode as well, longer ones are read through their extents
+{
+    uint64_t size = inodeTable->i_size_u64;
+    if ((inodeTable->i_mode & 0xF000u) != S_IFLNK || size >= target_size) return 1;
+    // a fast symlink never has extents, a target that happens to start with the extent magic still has the flag clear
+    int has_extent_root = (inodeTable->i_flags & EXT4_EXTENTS_FL) && inodeTable->i_block[0] == 0x0A
+                          && inodeTable->i_block[1] == 0xF3;
+    if (size < sizeof(inodeTable->i_block) && !(inodeTable->i_flags & EXT4_INLINE_DATA_FL) && !has_extent_root)
+        memcpy(target, inodeTable->i_block, size);
+    else
+    {
+        struct ExtentRun * runs = NULL;
+        uint64_t runs_count = 0;
+        if (!(inodeTable->i_flags & EXT4_INLINE_DATA_FL)
+            && get_inode_extent_runs(file, superBlock, inodeTable, &runs, &runs_count))
+            return 1;
+        int err = read_inode_range(file, superBlock, inodeTable, runs, runs_count, 0, size, (u_char *)target);
+        free(runs);
+        if (err) return 1;
+    }
+    target[size] = '\0';
+    return 0;
+}
+
+int walk_path(path_walk_lookup lookup, void * ctx, uint64_t start_inode_id, const char * path, int follow_last,
+        uint64_t * inode_id)
+/// returns (through uint64_t * inode_id) inode that given path leads to, absolute paths start at root directory,
+/// relative ones at start_inode_id; symlinks are followed in every component but the last one, which is followed only
+/// with follow_last or a trailing slash, relative targets continue from the directory holding the link;
+/// returns 1 when a component is missing and 2 after SYMLINK_MAX_FOLLOW symlinks (a loop)
+{
+    struct ArenaMark mark = Arena_mark(&thread_arena);
+    uint64_t current = (path[0] == '/') ? ROOT_INODE_ID : start_inode_id;
+    const char * pointer = path;
+    char * target = NULL;
+    uint64_t follows = 0;
+    int err = 0;
+    while (!err)
+    {
+        while (*pointer == '/') ++pointer;
+        if (!*pointer) break;
+        uint64_t component_len = strcspn(pointer, "/");
+        const char * rest = pointer + component_len;
+        uint64_t slashes = strspn(rest, "/");
+        int follow = rest[slashes] != '\0' || follow_last || slashes;
+        if (component_len > 255)
+        {
+            err = 1;
+            break;
+        }
+        if (follow && target == NULL)
+            target = Arena_alloc(&thread_arena, SYMLINK_MAX_TARGET);
+        uint64_t found;
+        uint8_t file_type;
+        if (lookup(ctx, current, pointer, component_len, &found, &file_type, follow ? target : NULL, SYMLINK_MAX_TARGET))
+            err = 1;
+        else if (file_type != DEFT_SYMLINK || !follow)
+        {
+            current = found;
+            pointer = rest;
+        }
+        else if (++follows > SYMLINK_MAX_FOLLOW)
+            err = 2;
+        else if (target[0] == '\0')
+            err = 1;
+        else
+        {
+            // the rest of the path continues after the target
+            uint64_t target_len = strlen(target), rest_len = strlen(rest);
+            char * expanded = Arena_alloc(&thread_arena, target_len + rest_len + 1);
+            memcpy(expanded, target, target_len);
+            memcpy(expanded + target_len, rest, rest_len + 1);
+            if (target[0] == '/') current = ROOT_INODE_ID;
+            pointer = expanded;
+        }
+    }
+    Arena_rewind(&thread_arena, mark);
+    if (!err) *inode_id = current;
+    return err;
+}
+
+struct image_walk {
+    FILE * file;
+    struct SuperBlock * superBlock;
+};
+
+int image_walk_lookup(void * ctx, uint64_t directory_inode_id, const char * name, uint8_t name_len,
+        uint64_t * inode_id, uint8_t * file_type, char * target, uint64_t target_size)
+/// lookup step of resolve_path, directories and symlinks are read straight from the image
+{
+    struct image_walk * walk = ctx;
+    struct InodeTable directory;
+    struct DirCursor cursor;
+    struct ext4_dir_entry_2 dir_entry;
+    if (load_inode_table(walk->file, walk->superBlock, &directory, directory_inode_id)) return 1;
+    if ((directory.i_mode & 0xF000u) != S_IFDIR) return 1;
+    if (DirCursor_open(&cursor, walk->file, walk->superBlock, &directory)) return 1;
+    int found = DirCursor_find(&cursor, name, name_len, &dir_entry) == 0;
+    DirCursor_close(&cursor);
+    if (!found) return 1;
+    *inode_id = dir_entry.inode;
+    *file_type = dir_entry.file_type;
+    if (*file_type != DEFT_UNKNOWN && !(target && *file_type == DEFT_SYMLINK)) return 0;
+    struct InodeTable inode;
+    if (load_inode_table(walk->file, walk->superBlock, &inode, *inode_id)) return 1;
+    *file_type = mode_file_type(inode.i_mode);
+    if (target && *file_type == DEFT_SYMLINK)
+        return read_symlink(walk->file, walk->superBlock, &inode, target, target_size);
+    return 0;
+}
+
+int resolve_path(FILE * file, struct SuperBlock * superBlock, uint64_t start_inode_id, const char * path,
+        int follow_last, uint64_t * inode_id)
+/// walk_path reading every directory and symlink from the image
+{
+    struct image_walk walk = {file, superBlock};
+    return walk_path(image_walk_lookup, &walk, start_inode_id, path, follow_last, inode_id);
+}
+
+struct tree_walk_item {
+    uint64_t inode_id;
+    char * path;
+    uint64_t path_len;
+};
+
+int walk_directory_tree(FILE * file, struct SuperBlock * superBlock, uint64_t root_inode_id,
+        tree_walk_callback callback, void * ctx, uint64_t * unreadable)
+/// depth first walk over every entry below given directory ("." and ".." are skipped); a directory that fails to read
+/// is reported and skipped (entries read before the failure are kept), unreadable (if not NULL) counts them
+{
+    if (unreadable) *unreadable = 0;
+    uint64_t stack_size = 0, stack_capacity = 64;
+    struct tree_walk_item * stack = malloc(sizeof(struct tree_walk_item) * stack_capacity);
+    stack[stack_size].inode_id = root_inode_id;
+    stack[stack_size].path = strdup("");
+    stack[stack_size].path_len = 0;
+    ++stack_size;
+    int err = 0;
+    while (stack_size && !err)
+    {
+        struct tree_walk_item item = stack[--stack_size];
+        struct InodeTable directory;
+        struct DirCursor cursor;
+        struct ext4_dir_entry_2 dir_entry;
+        if (load_inode_table(file, superBlock, &directory, item.inode_id)
+            || DirCursor_open(&cursor, file, superBlock, &directory))
+        {
+            fprintf(stderr, "Error reading directory %s/\n", item.path);
+            if (unreadable) *unreadable += 1;
+            free(item.path);
+            continue;
+        }
+        while (!err && DirCursor_next(&cursor, &dir_entry) == 0)
+        {
+            struct ext4_dir_entry_2 * entry = &dir_entry;
+            uint8_t is_dot = (entry->name_len == 1 && entry->name[0] == '.')
+                             || (entry->name_len == 2 && entry->name[0] == '.' && entry->name[1] == '.');
+            if (!is_dot)
+            {
+                uint64_t path_len = item.path_len + 1 + entry->name_len;
+                char * path = malloc(path_len + 1);
+                memcpy(path, item.path, item.path_len);
+                path[item.path_len] = '/';
+                memcpy(path + item.path_len + 1, entry->name, entry->name_len);
+                path[path_len] = '\0';
+                err = callback(ctx, item.inode_id, entry, path, path_len);
+                if (entry->file_type == DEFT_DIRECTORY && !err)
+                {
+                    if (stack_size == stack_capacity)
+                    {
+                        stack_capacity *= 2;
+                        stack = realloc(stack, sizeof(struct tree_walk_item) * stack_capacity);
+                    }
+                    stack[stack_size].inode_id = entry->inode;
+                    stack[stack_size].path = path;
+                    stack[stack_size].path_len = path_len;
+                    ++stack_size;
+                }
+                else
+                    free(path);
+            }
+        }
+        if (cursor.err)
+        {
+            fprintf(stderr, "Error reading directory %s/\n", item.path);
+            if (unreadable) *unreadable += 1;
+        }
+        DirCursor_close(&cursor);
+        free(item.path);
+    }
+    while (stack_size)
+        free(stack[--stack_size].path);
+    free(stack);
+    return err;
+}
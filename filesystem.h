@@ -0,0 +1,137 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_FILESYSTEM_H
+#define EXT4_BINARY_READ_FILESYSTEM_H
+#include <stdio.h>
+#include <stdlib.h>
+#include "structs/super_block.h"
+#include "structs/group_descriptor.h"
+#include "structs/inode_table.h"
+
+static const u_int64_t ROOT_INODE_ID = 2;  // 2 is always root directory
+
+extern u_int64_t leaf_prefetch_blocks;  // number of data blocks to prefetch from the start of every leaf extent, 0 disables
+
+struct InodeStat {  // attributes of an inode, as reported by stat
+    u_int32_t inode;
+    u_int16_t mode;
+    u_int16_t links_count;
+    u_int32_t uid;
+    u_int32_t gid;
+    u_int32_t flags;
+    u_int32_t atime;
+    u_int32_t ctime;
+    u_int32_t mtime;
+    u_int64_t size;
+};
+int InodeStat_new(struct InodeStat * inodeStat, struct InodeTable * inodeTable, u_int64_t inode_id);
+
+struct ExtentRun {  // physically contiguous run of file blocks
+    u_int64_t logical;  // first file block number covered by run
+    u_int64_t physical;  // first block number on device
+    u_int64_t length;  // number of blocks
+    u_int64_t uninitialized;  // 1 for unwritten (preallocated) blocks, which read as zeros whatever is on disk
+};
+
+int load_super_block(FILE * file, struct SuperBlock * superBlock);
+int load_group_descriptor(FILE * file, struct SuperBlock * superBlock, struct GroupDescriptor * groupDescriptor,
+                          u_int64_t group_id);
+u_int64_t get_groups_count(struct SuperBlock * superBlock);
+u_int64_t get_descriptors_per_block(struct SuperBlock * superBlock);
+u_int64_t get_old_descriptor_blocks(struct SuperBlock * superBlock);
+u_int64_t get_group_descriptor_block(struct SuperBlock * superBlock, u_int64_t table_block);
+int group_has_super_block(struct SuperBlock * superBlock, u_int64_t group_id);
+u_int64_t get_inode_table_blocks(struct SuperBlock * superBlock);
+
+enum GroupMetadata {  // per group metadata that flex_bg packs together for all groups of a flex group
+    GROUP_BLOCK_BITMAP,
+    GROUP_INODE_BITMAP,
+    GROUP_INODE_TABLE
+};
+u_int64_t group_metadata_block(struct GroupDescriptor * groupDescriptor, enum GroupMetadata metadata);
+u_int64_t contiguous_metadata_groups(struct SuperBlock * superBlock, struct GroupDescriptor * groupDescriptors,
+        u_int64_t groups_count, u_int64_t first_group, enum GroupMetadata metadata, u_int64_t max_groups);
+int load_group_descriptors(FILE * file, struct SuperBlock * superBlock, struct GroupDescriptor ** groupDescriptors,
+        u_int64_t * groups_count);
+int load_inode_table(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable, u_int64_t inode_id);
+u_int64_t ext4_extent_length(struct ext4_extent * extent);
+#define MAX_EXTENT_DEPTH 5  // deeper trees can't address 2^32 blocks, anything else is garbage
+#define EXTENT_ROOT_SIZE 60  // root node of an extent tree fills i_block
+// called for every leaf extent found while walking extent tree, returning non zero stops the walk
+typedef int (*extent_callback)(void * ctx, struct ext4_extent * extent);
+int extent_tree_recursive(FILE * file, struct SuperBlock * superBlock, struct ext4_extent_header * extent_header,
+        u_char * extent_data, extent_callback callback, void * ctx);
+// called with block number of every index or leaf block of extent tree, returning non zero stops the walk
+typedef int (*extent_node_callback)(void * ctx, u_int64_t block);
+int extent_tree_walk(FILE * file, struct SuperBlock * superBlock, struct ext4_extent_header * extent_header,
+        u_char * extent_data, extent_callback callback, extent_node_callback node_callback, void * ctx);
+int inode_block_recursive(FILE * file, struct SuperBlock * superBlock, struct ext4_extent_header * extent_header,
+        u_char * extent_data, u_int64_t * blocks, u_int64_t * blocks_read, u_int64_t blocks_capacity);
+int get_inode_block_list(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        u_int64_t ** blocks, u_int64_t * blocks_count);
+int get_inode_extent_runs(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        struct ExtentRun ** runs, u_int64_t * runs_count);
+// called with consecutive pieces of file content, returning non zero stops reading
+typedef int (*data_callback)(void * ctx, const u_char * data, u_int64_t length);
+int read_inode_data(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        data_callback callback, void * ctx);
+int copy_inode_data(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable, FILE * out);
+int read_inode_range(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        struct ExtentRun * runs, u_int64_t runs_count, u_int64_t offset, u_int64_t length, u_char * buffer);
+
+// Streaming directory reader: yields entries straight from the directory blocks currently read, so memory stays
+// constant whatever the directory size and a lookup stops reading at the first match.
+#define DIR_CURSOR_CHUNK_BLOCKS 16  // directory blocks read by a single request
+
+struct DirCursor {
+    FILE * file;
+    struct SuperBlock * superBlock;
+    struct InodeTable inode;  // own copy, inline entries point into it
+    struct ExtentRun * runs;
+    u_int64_t runs_count;
+    u_int64_t run;  // run of the next chunk
+    u_int64_t run_offset;  // first block of the next chunk within its run
+    u_char * buffer;  // DIR_CURSOR_CHUNK_BLOCKS blocks
+    u_char * data;  // current region of packed entries
+    u_int64_t size;
+    u_int64_t pointer;  // offset of the next record in data
+    int stage;  // inline directories: ".", "..", i_block, system.data
+    int err;
+};
+
+int DirCursor_open(struct DirCursor * cursor, FILE * file, struct SuperBlock * superBlock,
+        struct InodeTable * inodeTable);
+int DirCursor_next(struct DirCursor * cursor, struct ext4_dir_entry_2 * dir_entry);
+int DirCursor_find(struct DirCursor * cursor, const char * name, u_int8_t name_len, struct ext4_dir_entry_2 * dir_entry);
+void DirCursor_close(struct DirCursor * cursor);
+int get_directory_list(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        struct ext4_dir_entry_2 ** dir_entries, u_int64_t * dir_entries_count);
+int find_path_in_directory(FILE * file, struct SuperBlock * superBlock, struct InodeTable * current_directory,
+        char * file_name, struct ext4_dir_entry_2 * found_dir_entry);
+
+#define SYMLINK_MAX_FOLLOW 40  // symlinks followed while resolving one path, MAXSYMLINKS of the kernel
+#define SYMLINK_MAX_TARGET 4096  // longest symlink target read, with the terminating NUL
+
+// lookup step of a symlink aware path walk: resolve_path reads everything from the image, Ext4Fs_lookup goes through
+// its dentry and inode caches; fills inode and DEFT_* type of an entry of a directory and, when target is not NULL
+// (the walk follows this component), target of a symlink; returns 1 when there is no such entry or no such directory
+typedef int (*path_walk_lookup)(void * ctx, u_int64_t directory_inode_id, const char * name, u_int8_t name_len,
+        u_int64_t * inode_id, u_int8_t * file_type, char * target, u_int64_t target_size);
+int walk_path(path_walk_lookup lookup, void * ctx, u_int64_t start_inode_id, const char * path, int follow_last,
+        u_int64_t * inode_id);
+int resolve_path(FILE * file, struct SuperBlock * superBlock, u_int64_t start_inode_id, const char * path,
+        int follow_last, u_int64_t * inode_id);
+u_int8_t mode_file_type(u_int16_t mode);
+int read_symlink(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable, char * target,
+        u_int64_t target_size);
+
+// called for every entry found while walking directory tree, path is the full path of entry
+// returning non zero stops the walk
+typedef int (*tree_walk_callback)(void * ctx, u_int64_t parent_inode_id, struct ext4_dir_entry_2 * dir_entry,
+        const char * path, u_int64_t path_len);
+int walk_directory_tree(FILE * file, struct SuperBlock * superBlock, u_int64_t root_inode_id,
+        tree_walk_callback callback, void * ctx, u_int64_t * unreadable);
+
+#endif //EXT4_BINARY_READ_FILESYSTEM_H
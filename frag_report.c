@@ -0,0 +1,397 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#define _GNU_SOURCE
+#include "frag_report.h"
+#include "inode_scan.h"
+#include "batch.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+static const u_int64_t FRAG_SUMMARY_TOP_FILES = 10;  // most fragmented files listed by the summary
+
+struct file_extents_ctx {
+    struct FileFragStat * stat;
+    u_int64_t next_logical;  // logical and physical block right after the previous extent
+    u_int64_t next_physical;
+    int has_previous;
+};
+
+int frag_add_extent(void * ctx, struct ext4_extent * extent)
+{
+    struct file_extents_ctx * walk = ctx;
+    u_int64_t length = ext4_extent_length(extent);
+    walk->stat->extents += 1;
+    walk->stat->blocks += length;
+    if (!walk->has_previous || extent->ee_start_u64 != walk->next_physical || extent->ee_block != walk->next_logical)
+    {
+        walk->stat->runs += 1;
+        if (walk->has_previous)
+        {
+            if (extent->ee_start_u64 < walk->next_physical)
+            {
+                walk->stat->seek_distance += walk->next_physical - extent->ee_start_u64;
+                walk->stat->backward_runs += 1;
+            }
+            else
+                walk->stat->seek_distance += extent->ee_start_u64 - walk->next_physical;
+        }
+    }
+    walk->next_logical = extent->ee_block + length;
+    walk->next_physical = extent->ee_start_u64 + length;
+    walk->has_previous = 1;
+    return 0;
+}
+
+int frag_add_tree_block(void * ctx, u_int64_t block)
+{
+    (void)block;
+    struct file_extents_ctx * walk = ctx;
+    walk->stat->tree_blocks += 1;
+    return 0;
+}
+
+int fill_file_frag_stat(FILE * file, struct SuperBlock * superBlock, struct FileFragStat * stat)
+/// walks extent tree of stat->inode, inline data and block mapped inodes have no extents
+{
+    struct InodeTable inodeTable;
+    struct ext4_extent_header header;
+    if (load_inode_table(file, superBlock, &inodeTable, stat->inode)) return 1;
+    stat->size = inodeTable.i_size_u64;
+    if (!(inodeTable.i_flags & EXT4_EXTENTS_FL) || (inodeTable.i_flags & EXT4_INLINE_DATA_FL)) return 0;
+    if (ext4_extent_header_new(&header, (char *)inodeTable.i_block)) return 1;
+    stat->depth = header.eh_depth;
+    struct file_extents_ctx walk = {stat, 0, 0, 0};
+    return extent_tree_walk(file, superBlock, &header, inodeTable.i_block, frag_add_extent, frag_add_tree_block, &walk);
+}
+
+struct frag_walk_ctx {
+    FILE * file;
+    struct SuperBlock * superBlock;
+    struct FragReport * report;
+    const char * root_path;
+    u_int64_t files_capacity;
+    u_int64_t dirs_capacity;
+};
+
+char * join_path(const char * root_path, const char * path)
+{
+    char * joined = malloc(strlen(root_path) + strlen(path) + 2);
+    sprintf(joined, "%s%s", root_path, *root_path || *path ? path : "/");
+    return joined;
+}
+
+int frag_add_entry(struct frag_walk_ctx * walk, u_int64_t parent_inode_id, u_int64_t inode_id, u_int8_t file_type,
+        const char * path)
+{
+    struct FragReport * report = walk->report;
+    if (report->files_count == walk->files_capacity)
+    {
+        walk->files_capacity = walk->files_capacity ? walk->files_capacity * 2 : 256;
+        report->files = realloc(report->files, sizeof(struct FileFragStat) * walk->files_capacity);
+    }
+    struct FileFragStat * stat = report->files + report->files_count++;
+    memset(stat, 0, sizeof(struct FileFragStat));
+    stat->path = join_path(walk->root_path, path);
+    stat->inode = inode_id;
+    stat->parent = parent_inode_id;
+    stat->file_type = file_type;
+    if (fill_file_frag_stat(walk->file, walk->superBlock, stat))
+        fprintf(stderr, "Error reading extents of %s\n", stat->path);
+    if (file_type == DEFT_DIRECTORY)
+    {
+        if (report->dirs_count == walk->dirs_capacity)
+        {
+            walk->dirs_capacity = walk->dirs_capacity ? walk->dirs_capacity * 2 : 64;
+            report->dirs = realloc(report->dirs, sizeof(struct DirFragStat) * walk->dirs_capacity);
+        }
+        struct DirFragStat * dir = report->dirs + report->dirs_count++;
+        memset(dir, 0, sizeof(struct DirFragStat));
+        dir->path = strdup(stat->path);
+        dir->inode = inode_id;
+    }
+    return 0;
+}
+
+int frag_walk_entry(void * ctx, u_int64_t parent_inode_id, struct ext4_dir_entry_2 * dir_entry, const char * path,
+        u_int64_t path_len)
+{
+    (void)path_len;
+    return frag_add_entry(ctx, parent_inode_id, dir_entry->inode, dir_entry->file_type, path);
+}
+
+int dir_frag_compare(const void * a, const void * b)
+{
+    u_int32_t inode_a = ((const struct DirFragStat *)a)->inode, inode_b = ((const struct DirFragStat *)b)->inode;
+    return (inode_a > inode_b) - (inode_a < inode_b);
+}
+
+int group_free_space(void * ctx, u_int64_t group_id, struct GroupDescriptor * groupDescriptor, const u_char * bitmap,
+        u_int64_t blocks_count)
+/// block bitmap scan callback, every group writes only its own slot so no locking is needed
+{
+    struct FragReport * report = ctx;
+    struct GroupFreeStat * stat = report->groups + group_id;
+    memset(stat, 0, sizeof(struct GroupFreeStat));
+    stat->blocks = blocks_count;
+    // with bigalloc every bit stands for a whole cluster, runs are still measured in blocks
+    u_int64_t cluster_blocks = report->cluster_blocks;
+    u_int64_t clusters = (blocks_count + cluster_blocks - 1) / cluster_blocks;
+    u_int64_t run = 0;
+    if (bitmap == NULL)
+    {
+        // uninitialized bitmap: group holds at most its own metadata, at the start
+        stat->uninitialized = 1;
+        u_int64_t free_blocks = (u_int64_t)groupDescriptor->bg_free_blocks_count_u32 * cluster_blocks;
+        run = free_blocks < blocks_count ? free_blocks : blocks_count;
+        clusters = 0;
+    }
+    for (u_int64_t cluster = 0; cluster <= clusters; ++cluster)
+    {
+        // whole bytes of used or free clusters are handled at once
+        if (cluster % 8 == 0 && cluster + 8 <= clusters && bitmap[cluster / 8] == 0x00)
+        {
+            run += 8 * cluster_blocks;
+            cluster += 7;
+            continue;
+        }
+        int is_free = cluster < clusters && !((bitmap[cluster / 8] >> (cluster % 8)) & 1u);
+        if (is_free)
+        {
+            run += cluster_blocks;
+            continue;
+        }
+        if (cluster % 8 == 0 && cluster + 8 <= clusters && bitmap[cluster / 8] == 0xFF)
+            cluster += 7;
+        if (run == 0) continue;
+        if (cluster == clusters && bitmap && clusters * cluster_blocks > blocks_count)
+            run -= clusters * cluster_blocks - blocks_count;  // last cluster of the file system may be cut short
+        u_int64_t bucket = 0;
+        while (bucket + 1 < FREE_HISTOGRAM_BUCKETS && (run >> (bucket + 1)))
+            ++bucket;
+        stat->histogram[bucket] += 1;
+        stat->free_blocks += run;
+        stat->free_extents += 1;
+        if (run > stat->largest_free_extent)
+            stat->largest_free_extent = run;
+        run = 0;
+    }
+    return 0;
+}
+
+int FragReport_build(FILE * file, const char * image_path, struct SuperBlock * superBlock, u_int64_t root_inode_id,
+        const char * root_path, u_int64_t jobs, struct FragReport * report)
+/// collects extent statistics of every entry below root_inode_id (root_path is prepended to their paths) and
+/// free space of every group, bitmaps are scanned by jobs worker threads (0 picks number of CPUs)
+{
+    memset(report, 0, sizeof(struct FragReport));
+    struct frag_walk_ctx walk = {file, superBlock, report, root_path, 0, 0};
+    frag_add_entry(&walk, root_inode_id, root_inode_id, DEFT_DIRECTORY, "");
+    int err = walk_directory_tree(file, superBlock, root_inode_id, frag_walk_entry, &walk, NULL);
+
+    // every entry is counted into the directory holding it
+    qsort(report->dirs, report->dirs_count, sizeof(struct DirFragStat), dir_frag_compare);
+    for (u_int64_t i = 1; i < report->files_count; ++i)
+    {
+        struct FileFragStat * stat = report->files + i;
+        struct DirFragStat key = {.inode = stat->parent};
+        struct DirFragStat * dir = bsearch(&key, report->dirs, report->dirs_count, sizeof(struct DirFragStat),
+                                           dir_frag_compare);
+        if (dir == NULL) continue;
+        dir->files += 1;
+        dir->fragmented_files += stat->runs > 1;
+        dir->blocks += stat->blocks;
+        dir->extents += stat->extents;
+        dir->runs += stat->runs;
+    }
+
+    report->groups_count = get_groups_count(superBlock);
+    report->cluster_blocks = superBlock->s_cluster_blocks;
+    report->groups = calloc(report->groups_count ? report->groups_count : 1, sizeof(struct GroupFreeStat));
+    if (!err && scan_block_bitmaps(image_path, superBlock, jobs, group_free_space, report))
+        err = 1;
+    return err;
+}
+
+void FragReport_free(struct FragReport * report)
+{
+    for (u_int64_t i = 0; i < report->files_count; ++i)
+        free(report->files[i].path);
+    for (u_int64_t i = 0; i < report->dirs_count; ++i)
+        free(report->dirs[i].path);
+    free(report->files);
+    free(report->dirs);
+    free(report->groups);
+    memset(report, 0, sizeof(struct FragReport));
+}
+
+int file_runs_compare_desc(const void * a, const void * b)
+{
+    u_int64_t runs_a = (*(struct FileFragStat * const *)a)->runs, runs_b = (*(struct FileFragStat * const *)b)->runs;
+    return (runs_a < runs_b) - (runs_a > runs_b);
+}
+
+void FragReport_print_summary(struct FragReport * report, FILE * out)
+/// prints totals, the most fragmented files and free extent histogram of the whole file system
+{
+    u_int64_t fragmented = 0, blocks = 0, extents = 0, runs = 0, max_depth = 0;
+    for (u_int64_t i = 0; i < report->files_count; ++i)
+    {
+        struct FileFragStat * stat = report->files + i;
+        fragmented += stat->runs > 1;
+        blocks += stat->blocks;
+        extents += stat->extents;
+        runs += stat->runs;
+        if (stat->depth > max_depth) max_depth = stat->depth;
+    }
+    fprintf(out, "Files and directories: %" PRIu64 ", fragmented: %" PRIu64 " (%.1f%%)\n", report->files_count,
+            fragmented, report->files_count ? 100.0 * fragmented / report->files_count : 0.0);
+    fprintf(out, "Extents: %" PRIu64 ", runs: %" PRIu64 ", average run: %.1f blocks, deepest extent tree: %" PRIu64 "\n",
+            extents, runs, runs ? (double)blocks / runs : 0.0, max_depth);
+
+    struct FileFragStat ** sorted = malloc(sizeof(struct FileFragStat *) * (report->files_count ? report->files_count : 1));
+    for (u_int64_t i = 0; i < report->files_count; ++i)
+        sorted[i] = report->files + i;
+    qsort(sorted, report->files_count, sizeof(struct FileFragStat *), file_runs_compare_desc);
+    fprintf(out, "Most fragmented:\n");
+    for (u_int64_t i = 0; i < report->files_count && i < FRAG_SUMMARY_TOP_FILES && sorted[i]->runs > 1; ++i)
+        fprintf(out, "  %8" PRIu64 " runs  %10" PRIu64 " blocks  depth %" PRIu16 "  avg seek %10.1f  %s\n",
+                sorted[i]->runs, sorted[i]->blocks, sorted[i]->depth,
+                (double)sorted[i]->seek_distance / (sorted[i]->runs - 1), sorted[i]->path);
+    free(sorted);
+
+    u_int64_t histogram[FREE_HISTOGRAM_BUCKETS] = {0}, free_blocks = 0, free_extents = 0, largest = 0;
+    for (u_int64_t i = 0; i < report->groups_count; ++i)
+    {
+        struct GroupFreeStat * stat = report->groups + i;
+        for (int bucket = 0; bucket < FREE_HISTOGRAM_BUCKETS; ++bucket)
+            histogram[bucket] += stat->histogram[bucket];
+        free_blocks += stat->free_blocks;
+        free_extents += stat->free_extents;
+        if (stat->largest_free_extent > largest) largest = stat->largest_free_extent;
+    }
+    fprintf(out, "Free space in %" PRIu64 " groups: %" PRIu64 " blocks in %" PRIu64 " extents, average %.1f, largest %"
+                 PRIu64 "\n", report->groups_count, free_blocks, free_extents,
+            free_extents ? (double)free_blocks / free_extents : 0.0, largest);
+    for (int bucket = 0; bucket < FREE_HISTOGRAM_BUCKETS; ++bucket)
+        if (histogram[bucket])
+            fprintf(out, "  %6" PRIu64 "%s blocks: %" PRIu64 "\n", (u_int64_t)1 << bucket,
+                    bucket + 1 < FREE_HISTOGRAM_BUCKETS ? "+" : "+ (and longer)", histogram[bucket]);
+}
+
+int FragReport_write_json(struct FragReport * report, FILE * out)
+/// writes whole report as one JSON object, one array element per line
+{
+    fprintf(out, "{\"files\":[\n");
+    for (u_int64_t i = 0; i < report->files_count; ++i)
+    {
+        struct FileFragStat * stat = report->files + i;
+        fprintf(out, "%s{\"path\":", i ? ",\n" : "");
+        json_string(out, stat->path, strlen(stat->path));
+        fprintf(out, ",\"inode\":%" PRIu32 ",\"type\":\"%s\",\"size\":%" PRIu64 ",\"blocks\":%" PRIu64 ",\"extents\":%"
+                     PRIu64 ",\"runs\":%" PRIu64 ",\"average_run\":%.2f,\"depth\":%" PRIu16 ",\"tree_blocks\":%" PRIu64
+                     ",\"seek_distance\":%" PRIu64 ",\"backward_runs\":%" PRIu64 "}",
+                stat->inode, file_type_name(stat->file_type), stat->size, stat->blocks, stat->extents, stat->runs,
+                stat->runs ? (double)stat->blocks / stat->runs : 0.0, stat->depth, stat->tree_blocks,
+                stat->seek_distance, stat->backward_runs);
+    }
+    fprintf(out, "],\n\"directories\":[\n");
+    for (u_int64_t i = 0; i < report->dirs_count; ++i)
+    {
+        struct DirFragStat * dir = report->dirs + i;
+        fprintf(out, "%s{\"path\":", i ? ",\n" : "");
+        json_string(out, dir->path, strlen(dir->path));
+        fprintf(out, ",\"inode\":%" PRIu32 ",\"entries\":%" PRIu64 ",\"fragmented\":%" PRIu64 ",\"blocks\":%" PRIu64
+                     ",\"extents\":%" PRIu64 ",\"runs\":%" PRIu64 ",\"average_run\":%.2f}",
+                dir->inode, dir->files, dir->fragmented_files, dir->blocks, dir->extents, dir->runs,
+                dir->runs ? (double)dir->blocks / dir->runs : 0.0);
+    }
+    fprintf(out, "],\n\"groups\":[\n");
+    for (u_int64_t i = 0; i < report->groups_count; ++i)
+    {
+        struct GroupFreeStat * stat = report->groups + i;
+        fprintf(out, "%s{\"group\":%" PRIu64 ",\"blocks\":%" PRIu64 ",\"free_blocks\":%" PRIu64 ",\"free_extents\":%"
+                     PRIu64 ",\"largest_free_extent\":%" PRIu64 ",\"uninitialized\":%s,\"histogram\":[",
+                i ? ",\n" : "", i, stat->blocks, stat->free_blocks, stat->free_extents, stat->largest_free_extent,
+                stat->uninitialized ? "true" : "false");
+        for (int bucket = 0; bucket < FREE_HISTOGRAM_BUCKETS; ++bucket)
+            fprintf(out, "%s%" PRIu64, bucket ? "," : "", stat->histogram[bucket]);
+        fprintf(out, "]}");
+    }
+    fprintf(out, "]}\n");
+    return ferror(out) != 0;
+}
+
+void csv_string(FILE * out, const char * text)
+/// writes text as quoted CSV field
+{
+    fputc('"', out);
+    for (; *text; ++text)
+    {
+        if (*text == '"')
+            fputc('"', out);
+        fputc(*text, out);
+    }
+    fputc('"', out);
+}
+
+FILE * open_csv(const char * path_prefix, const char * table)
+{
+    char * path = malloc(strlen(path_prefix) + strlen(table) + 6);
+    sprintf(path, "%s.%s.csv", path_prefix, table);
+    FILE * out = fopen(path, "w");
+    if (out == NULL)
+        fprintf(stderr, "Error creating %s\n", path);
+    free(path);
+    return out;
+}
+
+int FragReport_write_csv(struct FragReport * report, const char * path_prefix)
+/// writes <path_prefix>.files.csv, <path_prefix>.dirs.csv and <path_prefix>.groups.csv
+{
+    FILE * files = open_csv(path_prefix, "files"), * dirs = open_csv(path_prefix, "dirs");
+    FILE * groups = open_csv(path_prefix, "groups");
+    int err = files == NULL || dirs == NULL || groups == NULL;
+    if (!err)
+    {
+        fprintf(files, "path,inode,type,size,blocks,extents,runs,average_run,depth,tree_blocks,seek_distance,backward_runs\n");
+        for (u_int64_t i = 0; i < report->files_count; ++i)
+        {
+            struct FileFragStat * stat = report->files + i;
+            csv_string(files, stat->path);
+            fprintf(files, ",%" PRIu32 ",%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.2f,%" PRIu16 ",%" PRIu64
+                           ",%" PRIu64 ",%" PRIu64 "\n",
+                    stat->inode, file_type_name(stat->file_type), stat->size, stat->blocks, stat->extents, stat->runs,
+                    stat->runs ? (double)stat->blocks / stat->runs : 0.0, stat->depth, stat->tree_blocks,
+                    stat->seek_distance, stat->backward_runs);
+        }
+        fprintf(dirs, "path,inode,entries,fragmented,blocks,extents,runs,average_run\n");
+        for (u_int64_t i = 0; i < report->dirs_count; ++i)
+        {
+            struct DirFragStat * dir = report->dirs + i;
+            csv_string(dirs, dir->path);
+            fprintf(dirs, ",%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.2f\n", dir->inode,
+                    dir->files, dir->fragmented_files, dir->blocks, dir->extents, dir->runs,
+                    dir->runs ? (double)dir->blocks / dir->runs : 0.0);
+        }
+        fprintf(groups, "group,blocks,free_blocks,free_extents,largest_free_extent,uninitialized");
+        for (int bucket = 0; bucket < FREE_HISTOGRAM_BUCKETS; ++bucket)
+            fprintf(groups, ",free_%" PRIu64, (u_int64_t)1 << bucket);
+        fprintf(groups, "\n");
+        for (u_int64_t i = 0; i < report->groups_count; ++i)
+        {
+            struct GroupFreeStat * stat = report->groups + i;
+            fprintf(groups, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%d", i, stat->blocks,
+                    stat->free_blocks, stat->free_extents, stat->largest_free_extent, stat->uninitialized);
+            for (int bucket = 0; bucket < FREE_HISTOGRAM_BUCKETS; ++bucket)
+                fprintf(groups, ",%" PRIu64, stat->histogram[bucket]);
+            fprintf(groups, "\n");
+        }
+    }
+    if (files && fclose(files)) err = 1;
+    if (dirs && fclose(dirs)) err = 1;
+    if (groups && fclose(groups)) err = 1;
+    return err;
+}
@@ -0,0 +1,65 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_FRAG_REPORT_H
+#define EXT4_BINARY_READ_FRAG_REPORT_H
+#include "filesystem.h"
+
+// Fragmentation and layout report: extent statistics of every file and directory below a directory, aggregated
+// per directory, and free space fragmentation of every block group computed from block bitmaps.
+
+#define FREE_HISTOGRAM_BUCKETS 16  // free extents of 1, 2-3, 4-7, ... blocks, the last bucket holds 2^15 and longer
+
+struct FileFragStat {
+    char * path;
+    u_int32_t inode;
+    u_int32_t parent;  // inode of directory holding the entry
+    u_int8_t file_type;  // DEFT_* of directory entry
+    u_int16_t depth;  // extent tree depth, 0 when all extents fit into the inode
+    u_int64_t size;
+    u_int64_t blocks;  // blocks covered by extents
+    u_int64_t extents;  // leaf extents
+    u_int64_t runs;  // physically contiguous runs, extents continuing each other count as one
+    u_int64_t tree_blocks;  // extent index and leaf blocks
+    u_int64_t seek_distance;  // sum of physical distances between logically consecutive runs, in blocks
+    u_int64_t backward_runs;  // runs placed physically before their logical predecessor
+};
+
+struct DirFragStat {  // files directly in a directory, directory itself not included
+    char * path;
+    u_int32_t inode;
+    u_int64_t files;
+    u_int64_t fragmented_files;  // files with more than one run
+    u_int64_t blocks;
+    u_int64_t extents;
+    u_int64_t runs;
+};
+
+struct GroupFreeStat {
+    u_int64_t blocks;  // blocks in group
+    u_int64_t free_blocks;
+    u_int64_t free_extents;  // maximal runs of free blocks
+    u_int64_t largest_free_extent;
+    u_int64_t histogram[FREE_HISTOGRAM_BUCKETS];  // number of free extents per length bucket
+    int uninitialized;  // bitmap was not initialized, free space is assumed to be one extent at the group end
+};
+
+struct FragReport {
+    struct FileFragStat * files;
+    u_int64_t files_count;
+    struct DirFragStat * dirs;
+    u_int64_t dirs_count;
+    struct GroupFreeStat * groups;
+    u_int64_t groups_count;
+    u_int64_t cluster_blocks;  // allocation unit of block bitmaps, free space is still counted in blocks
+};
+
+int FragReport_build(FILE * file, const char * image_path, struct SuperBlock * superBlock, u_int64_t root_inode_id,
+        const char * root_path, u_int64_t jobs, struct FragReport * report);
+void FragReport_free(struct FragReport * report);
+void FragReport_print_summary(struct FragReport * report, FILE * out);
+int FragReport_write_json(struct FragReport * report, FILE * out);
+int FragReport_write_csv(struct FragReport * report, const char * path_prefix);
+
+#endif //EXT4_BINARY_READ_FRAG_REPORT_H
@@ -0,0 +1,122 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include <string.h>
+
+#include "hash.h"
+
+static const u_int32_t SHA256_K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32u - (n))))
+
+void sha256_transform(struct Sha256 * sha, const u_char * block)
+/// processes one 64 byte block
+{
+    u_int32_t w[64];
+    for (int i = 0; i < 16; ++i)
+        w[i] = ((u_int32_t)block[i * 4] << 24u) | ((u_int32_t)block[i * 4 + 1] << 16u)
+               | ((u_int32_t)block[i * 4 + 2] << 8u) | (u_int32_t)block[i * 4 + 3];
+    for (int i = 16; i < 64; ++i)
+    {
+        u_int32_t s0 = ROTR(w[i - 15], 7u) ^ ROTR(w[i - 15], 18u) ^ (w[i - 15] >> 3u);
+        u_int32_t s1 = ROTR(w[i - 2], 17u) ^ ROTR(w[i - 2], 19u) ^ (w[i - 2] >> 10u);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    u_int32_t a = sha->state[0], b = sha->state[1], c = sha->state[2], d = sha->state[3];
+    u_int32_t e = sha->state[4], f = sha->state[5], g = sha->state[6], h = sha->state[7];
+    for (int i = 0; i < 64; ++i)
+    {
+        u_int32_t t1 = h + (ROTR(e, 6u) ^ ROTR(e, 11u) ^ ROTR(e, 25u)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+        u_int32_t t2 = (ROTR(a, 2u) ^ ROTR(a, 13u) ^ ROTR(a, 22u)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    sha->state[0] += a;
+    sha->state[1] += b;
+    sha->state[2] += c;
+    sha->state[3] += d;
+    sha->state[4] += e;
+    sha->state[5] += f;
+    sha->state[6] += g;
+    sha->state[7] += h;
+}
+
+void Sha256_init(struct Sha256 * sha)
+{
+    static const u_int32_t initial[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(sha->state, initial, sizeof(initial));
+    sha->length = 0;
+    sha->block_used = 0;
+}
+
+void Sha256_update(struct Sha256 * sha, const u_char * data, u_int64_t length)
+{
+    sha->length += length;
+    if (sha->block_used)
+    {
+        u_int64_t take = 64 - sha->block_used < length ? 64 - sha->block_used : length;
+        memcpy(sha->block + sha->block_used, data, take);
+        sha->block_used += take;
+        data += take;
+        length -= take;
+        if (sha->block_used < 64) return;
+        sha256_transform(sha, sha->block);
+        sha->block_used = 0;
+    }
+    for (; length >= 64; data += 64, length -= 64)
+        sha256_transform(sha, data);
+    memcpy(sha->block, data, length);
+    sha->block_used = length;
+}
+
+void Sha256_final(struct Sha256 * sha, u_char digest[32])
+/// pads message with 0x80, zeros and 64 bit big endian bit length, then outputs the state
+{
+    u_int64_t bit_length = sha->length * 8;
+    sha->block[sha->block_used++] = 0x80;
+    if (sha->block_used > 56)
+    {
+        memset(sha->block + sha->block_used, 0, 64 - sha->block_used);
+        sha256_transform(sha, sha->block);
+        sha->block_used = 0;
+    }
+    memset(sha->block + sha->block_used, 0, 56 - sha->block_used);
+    for (int i = 0; i < 8; ++i)
+        sha->block[56 + i] = (bit_length >> (56u - 8u * i)) & 0xFFu;
+    sha256_transform(sha, sha->block);
+    for (int i = 0; i < 8; ++i)
+    {
+        digest[i * 4] = sha->state[i] >> 24u;
+        digest[i * 4 + 1] = (sha->state[i] >> 16u) & 0xFFu;
+        digest[i * 4 + 2] = (sha->state[i] >> 8u) & 0xFFu;
+        digest[i * 4 + 3] = sha->state[i] & 0xFFu;
+    }
+}
+
+void Sha256_hex(const u_char digest[32], char hex[65])
+{
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 32; ++i)
+    {
+        hex[i * 2] = digits[digest[i] >> 4u];
+        hex[i * 2 + 1] = digits[digest[i] & 0xFu];
+    }
+    hex[64] = '\0';
+}
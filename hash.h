@@ -0,0 +1,23 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_HASH_H
+#define EXT4_BINARY_READ_HASH_H
+#include <stdlib.h>
+
+// SHA-256 (FIPS 180-4), used by batch mode to fingerprint file contents without extracting them
+
+struct Sha256 {
+    u_int32_t state[8];
+    u_int64_t length;  // number of bytes hashed so far
+    u_char block[64];
+    u_int64_t block_used;
+};
+
+void Sha256_init(struct Sha256 * sha);
+void Sha256_update(struct Sha256 * sha, const u_char * data, u_int64_t length);
+void Sha256_final(struct Sha256 * sha, u_char digest[32]);
+void Sha256_hex(const u_char digest[32], char hex[65]);
+
+#endif //EXT4_BINARY_READ_HASH_H
@@ -0,0 +1,699 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#define _GNU_SOURCE
+#include "image_backend.h"
+#include "stats.h"
+#include "partition_table.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+static const u_char QCOW2_MAGIC[4] = {'Q', 'F', 'I', 0xFB};
+static const u_int32_t ZSTD_FRAME_MAGIC = 0xFD2FB528;
+static const u_int32_t ZSTD_SKIPPABLE_SEEK_TABLE_MAGIC = 0x184D2A5E;
+static const u_int32_t ZSTD_SEEKABLE_MAGIC = 0x8F92EAB1;
+
+#define QCOW2_HEADER_SIZE 112
+#define QCOW2_OFFSET_MASK 0x00FFFFFFFFFFFE00ull  // host offset bits of L1 and plain L2 entries
+#define QCOW2_COMPRESSED (1ull << 62u)
+#define QCOW2_ZERO 1ull  // zero cluster flag of L2 entries (version 3)
+#define QCOW2_INCOMPAT_DIRTY 1ull
+#define QCOW2_INCOMPAT_COMPRESSION 8ull
+#define QCOW2_L2_KEY (1ull << 63u)  // cache keys of L2 tables, data chunks are keyed by cluster number
+#define ZSTD_SEEK_TABLE_FOOTER 9
+
+struct registered_backend {
+    FILE * file;  // NULL for a slot never used, REGISTERED_BACKEND_CLOSED once its stream was closed
+    struct ImageBackend * backend;
+};
+
+// compressed or partitioned images open at the moment, read_file_into_buffer finds the backend of a stream here on
+// every read, so lookups take no lock: a slot is filled (under the lock of writers) before its stream is handed out
+// and is published by a release store of the stream, the stream can't be read any more when its slot is closed.
+// Slots are an open addressing table keyed by the stream, a lookup usually ends at the first slot it probes.
+#define REGISTERED_BACKEND_SLOTS (2 * IMAGE_BACKENDS_MAX)  // power of two
+#define REGISTERED_BACKEND_CLOSED ((FILE *)1)  // lookups probe past closed slots, new streams reuse them
+static struct registered_backend registered_backends[REGISTERED_BACKEND_SLOTS];
+static u_int64_t registered_backends_count;
+static pthread_mutex_t registered_backends_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline u_int64_t registered_backend_slot(FILE * file)
+{
+    return ((u_int64_t)(uintptr_t)file * 0x9E3779B97F4A7C15ull >> 32u) & (REGISTERED_BACKEND_SLOTS - 1);
+}
+
+static inline u_int32_t be32(const u_char * bytes)
+{
+    return (u_int32_t)bytes[0] << 24u | (u_int32_t)bytes[1] << 16u | (u_int32_t)bytes[2] << 8u | bytes[3];
+}
+
+static inline u_int64_t be64(const u_char * bytes)
+{
+    return (u_int64_t)be32(bytes) << 32u | be32(bytes + 4);
+}
+
+static inline u_int32_t le32(const u_char * bytes)
+{
+    return bytes[0] | (u_int32_t)bytes[1] << 8u | (u_int32_t)bytes[2] << 16u | (u_int32_t)bytes[3] << 24u;
+}
+
+int container_read(struct ImageBackend * backend, u_char * buffer, u_int64_t offset, u_int64_t length)
+/// positional read of container bytes
+{
+    u_int64_t done = 0;
+    while (done < length)
+    {
+        ssize_t read_size = pread(backend->fd, buffer + done, length - done, (off_t)(offset + done));
+        if (read_size < 0 && errno == EINTR) continue;
+        if (read_size <= 0) return 1;
+        done += read_size;
+    }
+    return 0;
+}
+
+static inline struct ImageChunkShard * chunk_shard(struct ImageBackend * backend, u_int64_t key)
+{
+    // L2 keys are cluster aligned offsets, hash so that they spread over shards as well as cluster numbers do
+    return backend->shards + ((key * 0x9E3779B97F4A7C15ull) >> 60u) % IMAGE_CHUNK_CACHE_SHARDS;
+}
+
+void chunk_cache_init(struct ImageBackend * backend, u_int64_t chunk_size)
+{
+    u_int64_t capacity = IMAGE_CHUNK_CACHE_BYTES / (chunk_size ? chunk_size : 1) / IMAGE_CHUNK_CACHE_SHARDS;
+    if (capacity < 4) capacity = 4;
+    for (u_int64_t i = 0; i < IMAGE_CHUNK_CACHE_SHARDS; ++i)
+    {
+        struct ImageChunkShard * shard = backend->shards + i;
+        shard->chunks = calloc(capacity, sizeof(struct ImageChunk));
+        shard->capacity = capacity;
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+}
+
+void chunk_cache_free(struct ImageBackend * backend)
+{
+    for (u_int64_t i = 0; i < IMAGE_CHUNK_CACHE_SHARDS; ++i)
+    {
+        struct ImageChunkShard * shard = backend->shards + i;
+        if (shard->chunks == NULL) continue;
+        for (u_int64_t j = 0; j < shard->capacity; ++j)
+            free(shard->chunks[j].data);
+        free(shard->chunks);
+        pthread_mutex_destroy(&shard->lock);
+    }
+}
+
+int chunk_cache_read(struct ImageBackend * backend, u_int64_t key, u_char * buffer, u_int64_t offset,
+        u_int64_t length)
+/// copies bytes of a cached chunk into buffer, returns 1 when the chunk is not cached
+{
+    struct ImageChunkShard * shard = chunk_shard(backend, key);
+    pthread_mutex_lock(&shard->lock);
+    shard->tick += 1;
+    for (u_int64_t i = 0; i < shard->capacity; ++i)
+    {
+        struct ImageChunk * chunk = shard->chunks + i;
+        if (chunk->data && chunk->key == key)
+        {
+            memcpy(buffer, chunk->data + offset, length);
+            chunk->last_used = shard->tick;
+            shard->hits += 1;
+            pthread_mutex_unlock(&shard->lock);
+            return 0;
+        }
+    }
+    shard->misses += 1;
+    pthread_mutex_unlock(&shard->lock);
+    return 1;
+}
+
+void chunk_cache_insert(struct ImageBackend * backend, u_int64_t key, u_char * data, u_int64_t size)
+/// takes ownership of data, evicts least recently used chunk of the shard when it is full;
+/// data may be freed by any later insert, so the caller must be done with it
+{
+    struct ImageChunkShard * shard = chunk_shard(backend, key);
+    pthread_mutex_lock(&shard->lock);
+    struct ImageChunk * slot = shard->chunks;
+    for (u_int64_t i = 0; i < shard->capacity; ++i)
+    {
+        struct ImageChunk * chunk = shard->chunks + i;
+        if (chunk->data && chunk->key == key)
+        {
+            // another reader inflated it meanwhile
+            pthread_mutex_unlock(&shard->lock);
+            free(data);
+            return;
+        }
+        if (slot->data && (chunk->data == NULL || chunk->last_used < slot->last_used))
+            slot = chunk;
+    }
+    free(slot->data);
+    slot->key = key;
+    slot->data = data;
+    slot->size = size;
+    slot->last_used = ++shard->tick;
+    pthread_mutex_unlock(&shard->lock);
+}
+
+int inflate_chunk(u_int8_t compression, const u_char * source, u_int64_t source_size,
+        u_char * chunk, u_int64_t chunk_size)
+/// inflates compressed chunk (0 deflate without header, 1 zstd frame) filling exactly chunk_size bytes
+{
+#ifdef HAVE_ZLIB
+    if (compression == 0)
+    {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, -12) != Z_OK) return 1;
+        stream.next_in = (Bytef *)source;
+        stream.avail_in = source_size;
+        stream.next_out = chunk;
+        stream.avail_out = chunk_size;
+        int ret = inflate(&stream, Z_FINISH);
+        inflateEnd(&stream);
+        // compressed size is rounded up to sectors, so input may go on after the stream end
+        return !((ret == Z_STREAM_END || ret == Z_BUF_ERROR) && stream.avail_out == 0);
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (compression == 1)
+    {
+        size_t frame_size = ZSTD_findFrameCompressedSize(source, source_size);
+        if (ZSTD_isError(frame_size)) return 1;
+        size_t inflated = ZSTD_decompress(chunk, chunk_size, source, frame_size);
+        return ZSTD_isError(inflated) || inflated != chunk_size;
+    }
+#endif
+    return 1;
+}
+
+int read_compressed_chunk(struct ImageBackend * backend, u_int64_t key, u_int8_t compression, u_int64_t source_offset,
+        u_int64_t source_size, u_int64_t chunk_size, u_char * buffer, u_int64_t offset, u_int64_t length)
+/// reads part of a compressed chunk, inflating and caching it on a miss
+{
+    if (chunk_cache_read(backend, key, buffer, offset, length) == 0)
+    {
+        STAT_BEGIN();
+        STAT_CACHE_HIT(STAT_IMAGE_CHUNK);
+        STAT_END(STAT_IMAGE_CHUNK, 0);
+        return 0;
+    }
+    STAT_BEGIN();
+    if (source_offset + source_size > backend->container_size)
+        source_size = source_offset < backend->container_size ? backend->container_size - source_offset : 0;
+    u_char * source = malloc(source_size ? source_size : 1);
+    u_char * chunk = malloc(chunk_size);
+    if (container_read(backend, source, source_offset, source_size)
+        || inflate_chunk(compression, source, source_size, chunk, chunk_size))
+    {
+        fprintf(stderr, "Error inflating image chunk at container offset %" PRIu64 "\n", source_offset);
+        free(source);
+        free(chunk);
+        return 1;
+    }
+    free(source);
+    memcpy(buffer, chunk + offset, length);
+    chunk_cache_insert(backend, key, chunk, chunk_size);
+    STAT_END(STAT_IMAGE_CHUNK, chunk_size);
+    return 0;
+}
+
+int qcow2_l2_entry(struct ImageBackend * backend, u_int64_t cluster, u_int64_t * entry)
+/// L2 entry of an image cluster, 0 when its L2 table is not allocated
+{
+    u_int64_t l2_entries = 1ull << (backend->cluster_bits - 3);
+    u_int64_t l1_index = cluster / l2_entries;
+    u_int64_t l2_offset = l1_index < backend->l1_size ? backend->l1_table[l1_index] & QCOW2_OFFSET_MASK : 0;
+    *entry = 0;
+    if (l2_offset == 0) return 0;
+    u_char raw[8];
+    u_int64_t key = QCOW2_L2_KEY | l2_offset, index = cluster % l2_entries;
+    if (chunk_cache_read(backend, key, raw, index * 8, 8))
+    {
+        u_int64_t cluster_size = 1ull << backend->cluster_bits;
+        u_char * table = malloc(cluster_size);
+        if (container_read(backend, table, l2_offset, cluster_size))
+        {
+            fprintf(stderr, "Error reading qcow2 L2 table at %" PRIu64 "\n", l2_offset);
+            free(table);
+            return 1;
+        }
+        memcpy(raw, table + index * 8, 8);
+        chunk_cache_insert(backend, key, table, cluster_size);
+    }
+    *entry = be64(raw);
+    return 0;
+}
+
+int qcow2_read(struct ImageBackend * backend, u_char * buffer, u_int64_t offset, u_int64_t length)
+{
+    u_int64_t cluster_size = 1ull << backend->cluster_bits;
+    while (length)
+    {
+        u_int64_t cluster = offset >> backend->cluster_bits, within = offset & (cluster_size - 1);
+        u_int64_t part = cluster_size - within < length ? cluster_size - within : length;
+        u_int64_t entry;
+        if (qcow2_l2_entry(backend, cluster, &entry)) return 1;
+        if (entry & QCOW2_COMPRESSED)
+        {
+            u_int32_t offset_bits = 62 - (backend->cluster_bits - 8);
+            u_int64_t host_offset = entry & ((1ull << offset_bits) - 1);
+            u_int64_t sectors = ((entry & ~QCOW2_COMPRESSED) >> offset_bits) + 1;
+            u_int64_t compressed_size = sectors * 512 - (host_offset & 511u);
+            if (read_compressed_chunk(backend, cluster, backend->compression_type, host_offset, compressed_size,
+                                      cluster_size, buffer, within, part))
+                return 1;
+        }
+        else if ((entry & QCOW2_ZERO) || (entry & QCOW2_OFFSET_MASK) == 0)
+            memset(buffer, 0, part);  // zero or unallocated cluster
+        else if (container_read(backend, buffer, (entry & QCOW2_OFFSET_MASK) + within, part))
+            return 1;
+        buffer += part;
+        offset += part;
+        length -= part;
+    }
+    return 0;
+}
+
+int zstd_seekable_read(struct ImageBackend * backend, u_char * buffer, u_int64_t offset, u_int64_t length)
+{
+    while (length)
+    {
+        // last frame starting at or before offset
+        u_int64_t low = 0, high = backend->frames_count;
+        while (high - low > 1)
+        {
+            u_int64_t middle = (low + high) / 2;
+            if (backend->frame_starts[middle] <= offset) low = middle;
+            else high = middle;
+        }
+        u_int64_t frame_size = backend->frame_starts[low + 1] - backend->frame_starts[low];
+        u_int64_t within = offset - backend->frame_starts[low];
+        u_int64_t part = frame_size - within < length ? frame_size - within : length;
+        if (read_compressed_chunk(backend, low, 1, backend->frame_offsets[low],
+                                  backend->frame_offsets[low + 1] - backend->frame_offsets[low], frame_size, buffer,
+                                  within, part))
+            return 1;
+        buffer += part;
+        offset += part;
+        length -= part;
+    }
+    return 0;
+}
+
+int ImageBackend_read(struct ImageBackend * backend, u_char * buffer, u_int64_t offset, u_int64_t length)
+/// reads image bytes (offsets are relative to the selected partition), thread safe; fails when the range goes past
+/// the end of the image, as a short read would
+{
+    if (offset > backend->size || length > backend->size - offset) return 1;
+    offset += backend->partition_offset;
+    if (backend->format == IMAGE_QCOW2)
+        return qcow2_read(backend, buffer, offset, length);
+    if (backend->format == IMAGE_ZSTD_SEEKABLE)
+        return zstd_seekable_read(backend, buffer, offset, length);
+    return container_read(backend, buffer, offset, length);
+}
+
+void ImageBackend_prefetch(struct ImageBackend * backend, u_int64_t offset, u_int64_t length)
+/// readahead hint, only raw disks read straight from the container benefit from it
+{
+    if (backend->format == IMAGE_RAW)
+        posix_fadvise(backend->fd, (off_t)(offset + backend->partition_offset), (off_t)length, POSIX_FADV_WILLNEED);
+}
+
+int qcow2_open(struct ImageBackend * backend, const char * image_path)
+{
+    u_char header[QCOW2_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    if (container_read(backend, header, 0, backend->container_size < QCOW2_HEADER_SIZE ? 72 : QCOW2_HEADER_SIZE))
+    {
+        fprintf(stderr, "Error reading qcow2 header of %s\n", image_path);
+        return 1;
+    }
+    u_int32_t version = be32(header + 4);
+    backend->cluster_bits = be32(header + 20);
+    backend->size = be64(header + 24);
+    backend->l1_size = be32(header + 36);
+    u_int64_t l1_offset = be64(header + 40);
+    u_int64_t incompatible = version >= 3 ? be64(header + 72) : 0;
+    u_int32_t header_length = version >= 3 ? be32(header + 100) : 72;
+    if (version < 2 || version > 3 || backend->cluster_bits < 9 || backend->cluster_bits > 21)
+    {
+        fprintf(stderr, "Error unsupported qcow2 version %" PRIu32 " of %s\n", version, image_path);
+        return 1;
+    }
+    if (be64(header + 8) != 0 || be32(header + 32) != 0
+        || (incompatible & ~(QCOW2_INCOMPAT_DIRTY | QCOW2_INCOMPAT_COMPRESSION)) != 0)
+    {
+        fprintf(stderr, "Error qcow2 image %s uses backing file, encryption or unsupported features (0x%" PRIx64 ")\n",
+                        image_path, incompatible);
+        return 1;
+    }
+    if ((incompatible & QCOW2_INCOMPAT_COMPRESSION) && header_length > 104)
+        backend->compression_type = header[104];
+    if (backend->compression_type > 1)
+    {
+        fprintf(stderr, "Error unknown qcow2 compression type %u of %s\n", backend->compression_type, image_path);
+        return 1;
+    }
+    backend->l1_table = malloc(sizeof(u_int64_t) * (backend->l1_size ? backend->l1_size : 1));
+    u_char * raw = malloc(backend->l1_size * 8 + 1);
+    int err = container_read(backend, raw, l1_offset, backend->l1_size * 8);
+    for (u_int64_t i = 0; i < backend->l1_size && !err; ++i)
+        backend->l1_table[i] = be64(raw + i * 8);
+    free(raw);
+    if (err)
+    {
+        fprintf(stderr, "Error reading qcow2 L1 table of %s\n", image_path);
+        return 1;
+    }
+    chunk_cache_init(backend, 1ull << backend->cluster_bits);
+    return 0;
+}
+
+int zstd_seekable_open(struct ImageBackend * backend, const char * image_path)
+/// loads seek table: frames_count entries of compressed size, inflated size and optional checksum (4 bytes each)
+/// in a skippable frame ending with the number of frames, descriptor and seekable magic
+{
+    u_char footer[ZSTD_SEEK_TABLE_FOOTER];
+    if (container_read(backend, footer, backend->container_size - ZSTD_SEEK_TABLE_FOOTER, ZSTD_SEEK_TABLE_FOOTER))
+        return 1;
+    backend->frames_count = le32(footer);
+    u_int64_t entry_size = footer[4] & 0x80u ? 12 : 8;
+    u_int64_t table_size = backend->frames_count * entry_size + ZSTD_SEEK_TABLE_FOOTER;
+    if (table_size + 8 > backend->container_size)
+    {
+        fprintf(stderr, "Error broken zstd seek table of %s\n", image_path);
+        return 1;
+    }
+    u_int64_t table_offset = backend->container_size - table_size - 8;
+    u_char * table = malloc(table_size + 8);
+    if (container_read(backend, table, table_offset, table_size + 8) || le32(table) != ZSTD_SKIPPABLE_SEEK_TABLE_MAGIC
+        || le32(table + 4) != table_size)
+    {
+        fprintf(stderr, "Error broken zstd seek table of %s\n", image_path);
+        free(table);
+        return 1;
+    }
+    backend->frame_offsets = malloc(sizeof(u_int64_t) * (backend->frames_count + 1));
+    backend->frame_starts = malloc(sizeof(u_int64_t) * (backend->frames_count + 1));
+    backend->frame_offsets[0] = backend->frame_starts[0] = 0;
+    u_int64_t largest_frame = 0;
+    for (u_int64_t i = 0; i < backend->frames_count; ++i)
+    {
+        u_char * entry = table + 8 + i * entry_size;
+        backend->frame_offsets[i + 1] = backend->frame_offsets[i] + le32(entry);
+        backend->frame_starts[i + 1] = backend->frame_starts[i] + le32(entry + 4);
+        if (le32(entry + 4) > largest_frame) largest_frame = le32(entry + 4);
+    }
+    free(table);
+    if (backend->frame_offsets[backend->frames_count] != table_offset)
+    {
+        fprintf(stderr, "Error zstd seek table of %s doesn't match its frames\n", image_path);
+        return 1;
+    }
+    backend->size = backend->frame_starts[backend->frames_count];
+    chunk_cache_init(backend, largest_frame);
+    return 0;
+}
+
+void image_backend_free(struct ImageBackend * backend)
+{
+    chunk_cache_free(backend);
+    free(backend->l1_table);
+    free(backend->frame_offsets);
+    free(backend->frame_starts);
+    if (backend->fd >= 0)
+        close(backend->fd);
+    free(backend);
+}
+
+ssize_t image_cookie_read(void * cookie, char * buffer, size_t size)
+{
+    struct ImageBackend * backend = cookie;
+    if (backend->position >= backend->size) return 0;
+    if (size > backend->size - backend->position) size = backend->size - backend->position;
+    if (ImageBackend_read(backend, (u_char *)buffer, backend->position, size)) return -1;
+    backend->position += size;
+    return (ssize_t)size;
+}
+
+int image_cookie_seek(void * cookie, off64_t * offset, int whence)
+{
+    struct ImageBackend * backend = cookie;
+    int64_t base = whence == SEEK_SET ? 0 : whence == SEEK_CUR ? (int64_t)backend->position : (int64_t)backend->size;
+    if (base + *offset < 0) return -1;
+    backend->position = base + *offset;
+    *offset = (off64_t)backend->position;
+    return 0;
+}
+
+int image_cookie_close(void * cookie)
+{
+    pthread_mutex_lock(&registered_backends_lock);
+    for (u_int64_t i = 0; i < REGISTERED_BACKEND_SLOTS; ++i)
+        if (__atomic_load_n(&registered_backends[i].backend, __ATOMIC_RELAXED) == cookie)
+        {
+            __atomic_store_n(&registered_backends[i].file, REGISTERED_BACKEND_CLOSED, __ATOMIC_RELEASE);
+            __atomic_store_n(&registered_backends[i].backend, NULL, __ATOMIC_RELAXED);
+            registered_backends_count -= 1;
+        }
+    // with no image open nobody can be looking up a registered stream, closed slots are dropped to keep probes short
+    for (u_int64_t i = 0; i < REGISTERED_BACKEND_SLOTS && registered_backends_count == 0; ++i)
+        __atomic_store_n(&registered_backends[i].file, NULL, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&registered_backends_lock);
+    image_backend_free(cookie);
+    return 0;
+}
+
+struct ImageBackend * image_backend_open(const char * disk_path)
+/// opens the container of a disk image, returns NULL (with a message for containers that can't be read) on failure
+{
+    int fd = open(disk_path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct ImageBackend * backend = calloc(1, sizeof(struct ImageBackend));
+    backend->fd = fd;
+    off_t end = lseek(fd, 0, SEEK_END);
+    backend->container_size = end > 0 ? (u_int64_t)end : 0;
+    u_char magic[4] = {0, 0, 0, 0}, trailer[4] = {0, 0, 0, 0};
+    if (backend->container_size >= 4)
+        container_read(backend, magic, 0, 4);
+    if (backend->container_size >= ZSTD_SEEK_TABLE_FOOTER + 8)
+        container_read(backend, trailer, backend->container_size - 4, 4);
+    int err = 0;
+    if (memcmp(magic, QCOW2_MAGIC, 4) == 0)
+    {
+        backend->format = IMAGE_QCOW2;
+        err = qcow2_open(backend, disk_path);
+    }
+    else if (le32(trailer) == ZSTD_SEEKABLE_MAGIC)
+    {
+        backend->format = IMAGE_ZSTD_SEEKABLE;
+        err = zstd_seekable_open(backend, disk_path);
+    }
+    else if (le32(magic) == ZSTD_FRAME_MAGIC)
+    {
+        fprintf(stderr, "Error %s is zstd compressed without a seek table, it can't be read in place\n", disk_path);
+        err = 1;
+    }
+    else
+    {
+        backend->format = IMAGE_RAW;
+        backend->size = backend->container_size;
+    }
+#ifndef HAVE_ZLIB
+    if (!err && backend->format == IMAGE_QCOW2 && backend->compression_type == 0)
+    {
+        fprintf(stderr, "Error %s may hold deflate compressed clusters, reader was built without zlib\n", disk_path);
+        err = 1;
+    }
+#endif
+#ifndef HAVE_ZSTD
+    if (!err && (backend->format == IMAGE_ZSTD_SEEKABLE || backend->compression_type == 1))
+    {
+        fprintf(stderr, "Error %s is zstd compressed, reader was built without zstd\n", disk_path);
+        err = 1;
+    }
+#endif
+    if (err)
+    {
+        image_backend_free(backend);
+        return NULL;
+    }
+    backend->disk_size = backend->size;
+    return backend;
+}
+
+char * split_partition_path(const char * image_path, u_int32_t * partition_number)
+/// returns path of the disk, "<disk>#<n>" selects partition n unless a file of that whole name exists,
+/// partition_number is 0 when none was selected
+{
+    *partition_number = 0;
+    const char * hash = strrchr(image_path, '#');
+    if (hash == NULL || hash[1] < '0' || hash[1] > '9' || access(image_path, F_OK) == 0) return strdup(image_path);
+    char * end;
+    unsigned long number = strtoul(hash + 1, &end, 10);
+    if (*end || number == 0 || number > UINT32_MAX) return strdup(image_path);
+    *partition_number = number;
+    return strndup(image_path, hash - image_path);
+}
+
+int image_select_partition(struct ImageBackend * backend, const char * disk_path, u_int32_t partition_number)
+/// narrows the backend to the selected partition, without a selection to the whole disk when it holds ext4,
+/// otherwise to the first partition holding it
+{
+    if (partition_number == 0 && disk_has_ext4(backend, 0)) return 0;
+    struct ImagePartition partitions[PARTITIONS_MAX];
+    u_int64_t partitions_count;
+    const char * table_type;
+    read_partition_table(backend, partitions, &partitions_count, &table_type);
+    struct ImagePartition * selected = NULL;
+    for (u_int64_t i = 0; i < partitions_count && selected == NULL; ++i)
+        if (partition_number ? partitions[i].number == partition_number : partitions[i].ext4)
+            selected = partitions + i;
+    if (selected == NULL)
+    {
+        if (partition_number == 0) return 0;  // nothing better than the whole disk, opening will tell it's not ext4
+        fprintf(stderr, "Error %s has no partition %" PRIu32 "\n", disk_path, partition_number);
+        return 1;
+    }
+    if (selected->offset >= backend->disk_size)
+    {
+        fprintf(stderr, "Error partition %" PRIu32 " lies past the end of %s\n", selected->number, disk_path);
+        return 1;
+    }
+    backend->partition_offset = selected->offset;
+    backend->partition_number = selected->number;
+    backend->size = backend->disk_size - selected->offset < selected->size ? backend->disk_size - selected->offset
+                                                                           : selected->size;
+    return 0;
+}
+
+FILE * image_open(const char * image_path)
+/// opens image for reading whatever its container is and wherever its file system is, returns NULL (with
+/// a message for images that can't be read) on failure; the stream is closed with fclose as any other
+{
+    u_int32_t partition_number;
+    char * disk_path = split_partition_path(image_path, &partition_number);
+    struct ImageBackend * backend = image_backend_open(disk_path);
+    FILE * file = NULL;
+    if (backend && image_select_partition(backend, disk_path, partition_number))
+    {
+        image_backend_free(backend);
+        backend = NULL;
+    }
+    if (backend && backend->format == IMAGE_RAW && backend->partition_offset == 0)
+    {
+        // whole raw disk, plain stream keeps positional reads and readahead hints on its own descriptor
+        image_backend_free(backend);
+        backend = NULL;
+        file = fopen(disk_path, "r");
+    }
+    if (backend)
+    {
+        cookie_io_functions_t functions = {image_cookie_read, NULL, image_cookie_seek, image_cookie_close};
+        pthread_mutex_lock(&registered_backends_lock);
+        if (registered_backends_count < IMAGE_BACKENDS_MAX)
+            file = fopencookie(backend, "r", functions);
+        if (file)
+        {
+            // the table is never more than half full, so a free or closed slot is always found
+            u_int64_t slot = registered_backend_slot(file);
+            FILE * taken;
+            while ((taken = __atomic_load_n(&registered_backends[slot].file, __ATOMIC_RELAXED)) != NULL
+                   && taken != REGISTERED_BACKEND_CLOSED)
+                slot = (slot + 1) & (REGISTERED_BACKEND_SLOTS - 1);
+            __atomic_store_n(&registered_backends[slot].backend, backend, __ATOMIC_RELAXED);
+            __atomic_store_n(&registered_backends[slot].file, file, __ATOMIC_RELEASE);
+            registered_backends_count += 1;
+        }
+        pthread_mutex_unlock(&registered_backends_lock);
+        if (file == NULL)
+        {
+            fprintf(stderr, "Error too many compressed or partitioned images open\n");
+            image_backend_free(backend);
+        }
+    }
+    free(disk_path);
+    return file;
+}
+
+int print_partitions(const char * image_path, FILE * out)
+/// lists partitions of the disk of an image, the one image_open picks for image_path is marked with *;
+/// returns 1 without printing anything when the disk has no partition table
+{
+    u_int32_t partition_number;
+    char * disk_path = split_partition_path(image_path, &partition_number);
+    struct ImageBackend * backend = image_backend_open(disk_path);
+    if (backend == NULL)
+    {
+        free(disk_path);
+        return 1;
+    }
+    struct ImagePartition partitions[PARTITIONS_MAX];
+    u_int64_t partitions_count;
+    const char * table_type;
+    if (read_partition_table(backend, partitions, &partitions_count, &table_type))
+    {
+        image_backend_free(backend);
+        free(disk_path);
+        return 1;
+    }
+    image_select_partition(backend, disk_path, partition_number);
+    fprintf(out, "Partition table: %s\n", table_type);
+    if (partitions_count)
+        fprintf(out, "  #  start (bytes)    size (bytes)       type  ext4  name\n");
+    for (u_int64_t i = 0; i < partitions_count; ++i)
+    {
+        struct ImagePartition * partition = partitions + i;
+        char type[8] = "gpt";
+        if (partition->mbr_type)
+            snprintf(type, sizeof(type), "0x%02x", partition->mbr_type);
+        fprintf(out, "%c%2" PRIu32 "  %-16" PRIu64 " %-18" PRIu64 " %-5s %-5s %s\n",
+                partition->number == backend->partition_number ? '*' : ' ', partition->number, partition->offset,
+                partition->size, type, partition->ext4 ? "yes" : "no", partition->name);
+    }
+    image_backend_free(backend);
+    free(disk_path);
+    return 0;
+}
+
+struct ImageBackend * image_backend_of(FILE * file)
+/// backend of a stream opened by image_open, NULL for raw images and other streams; takes no lock, it is on the path
+/// of every read of a compressed or partitioned image
+{
+    u_int64_t slot = registered_backend_slot(file);
+    for (u_int64_t probes = 0; probes < REGISTERED_BACKEND_SLOTS; ++probes)
+    {
+        FILE * taken = __atomic_load_n(&registered_backends[slot].file, __ATOMIC_ACQUIRE);
+        if (taken == file)
+            return __atomic_load_n(&registered_backends[slot].backend, __ATOMIC_RELAXED);
+        if (taken == NULL) return NULL;
+        slot = (slot + 1) & (REGISTERED_BACKEND_SLOTS - 1);
+    }
+    return NULL;
+}
+
+const char * image_format_name(FILE * file)
+{
+    struct ImageBackend * backend = image_backend_of(file);
+    if (backend == NULL || backend->format == IMAGE_RAW) return "raw";
+    return backend->format == IMAGE_QCOW2 ? "qcow2" : "zstd seekable";
+}
+
+u_int32_t image_partition_of(FILE * file)
+/// number of the partition a stream of image_open reads, 0 for the whole disk
+{
+    struct ImageBackend * backend = image_backend_of(file);
+    return backend ? backend->partition_number : 0;
+}
@@ -0,0 +1,89 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_IMAGE_BACKEND_H
+#define EXT4_BINARY_READ_IMAGE_BACKEND_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+// Image containers read in place, without inflating the whole image to disk first:
+//   raw             - plain (or sparse) image file, read with pread as before
+//   qcow2           - version 2 and 3 images without backing file or encryption, clusters compressed with deflate
+//                     (zlib) or zstd are inflated on first touch, plain clusters are read straight from the container
+//                     and unallocated or zero clusters read as zeros
+//   seekable zstd   - sequence of independent zstd frames followed by a seek table skippable frame (zstd seekable
+//                     format, ie. written by t2sz or the seekable_format contrib of zstd), frames are inflated on
+//                     first touch
+// image_open detects the container by its magic. Compressed containers are returned as a FILE of fopencookie, so
+// every reader works with them unchanged, and read_file_into_buffer passes reads of such stream straight to its
+// backend (found in a registry read without any lock), bypassing the stream lock. Inflated chunks are kept in a cache
+// split into shards by chunk number (LRU within a shard, each shard with own lock), chunks are inflated outside of the
+// lock, so concurrent readers scale and only chunks that are touched are ever inflated: ls or find on a compressed
+// image reads metadata chunks only.
+// zlib and zstd are optional at build time (HAVE_ZLIB, HAVE_ZSTD), images needing a missing one are refused at open.
+// Whole disk images are opened in place as well: when the disk doesn't start with an ext4 file system its MBR or GPT
+// partition table is read (see partition_table.h) and the first partition holding ext4 is used, "<image>#<n>" picks
+// partition n. Reads of a partition go through the backend too, shifted by the partition offset, whatever the
+// container; only a raw image of the file system itself stays a plain stream. A partition of a raw disk still costs
+// a single pread of the disk per read, after the lock free lookup of its backend.
+
+#define IMAGE_CHUNK_CACHE_SHARDS 16
+#define IMAGE_CHUNK_CACHE_BYTES (64u << 20u)  // inflated chunks kept per opened image
+#define IMAGE_BACKENDS_MAX 64  // compressed or partitioned images open at once
+
+enum ImageFormat {
+    IMAGE_RAW,  // backend of a raw disk is used only to reach a partition in it
+    IMAGE_QCOW2,
+    IMAGE_ZSTD_SEEKABLE,
+};
+
+struct ImageChunk {
+    u_int64_t key;
+    u_int64_t last_used;  // tick of the shard when the chunk was last read
+    u_int64_t size;
+    u_char * data;  // NULL for a free slot
+};
+
+struct ImageChunkShard {
+    struct ImageChunk * chunks;
+    u_int64_t capacity;
+    u_int64_t tick;
+    u_int64_t hits;
+    u_int64_t misses;
+    pthread_mutex_t lock;
+};
+
+struct ImageBackend {
+    enum ImageFormat format;
+    int fd;  // container file
+    u_int64_t container_size;
+    u_int64_t disk_size;  // size of the disk inside the container
+    u_int64_t size;  // size of the selected partition, or of the whole disk
+    u_int64_t partition_offset;  // start of the selected partition on the disk
+    u_int32_t partition_number;  // 0 for the whole disk
+    u_int64_t position;  // position of the cookie stream, used only through stdio under the stream lock
+    // qcow2
+    u_int32_t cluster_bits;
+    u_int8_t compression_type;  // 0 deflate, 1 zstd
+    u_int64_t * l1_table;  // in host byte order
+    u_int64_t l1_size;
+    // seekable zstd, frame i holds image bytes frame_starts[i] up to frame_starts[i + 1]
+    u_int64_t frames_count;
+    u_int64_t * frame_offsets;  // offsets of frames in the container, frames_count + 1 of them
+    u_int64_t * frame_starts;
+    struct ImageChunkShard shards[IMAGE_CHUNK_CACHE_SHARDS];
+};
+
+FILE * image_open(const char * image_path);
+struct ImageBackend * image_backend_open(const char * disk_path);
+void image_backend_free(struct ImageBackend * backend);
+struct ImageBackend * image_backend_of(FILE * file);
+int ImageBackend_read(struct ImageBackend * backend, u_char * buffer, u_int64_t offset, u_int64_t length);
+void ImageBackend_prefetch(struct ImageBackend * backend, u_int64_t offset, u_int64_t length);
+const char * image_format_name(FILE * file);
+u_int32_t image_partition_of(FILE * file);
+int print_partitions(const char * image_path, FILE * out);
+
+#endif //EXT4_BINARY_READ_IMAGE_BACKEND_H
@@ -0,0 +1,193 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include "inode_record.h"
+#include "inode_scan.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+static inline u_int16_t le16(const u_char * bytes)
+{
+    return bytes[0] | (u_int16_t)(bytes[1] << 8u);
+}
+
+static inline u_int32_t le32(const u_char * bytes)
+{
+    return bytes[0] | (u_int32_t)bytes[1] << 8u | (u_int32_t)bytes[2] << 16u | (u_int32_t)bytes[3] << 24u;
+}
+
+void InodeRecord_new(struct InodeRecord * record, const u_char * raw_inode, u_int64_t inode_id)
+/// decodes hot fields of an on-disk inode, offsets as in InodeTable_new
+{
+    record->size = ((u_int64_t)le32(raw_inode + 0x6C) << 32u) + le32(raw_inode + 0x4);
+    record->inode = inode_id;
+    record->flags = le32(raw_inode + 0x20);
+    record->atime = le32(raw_inode + 0x8);
+    record->ctime = le32(raw_inode + 0xC);
+    record->mtime = le32(raw_inode + 0x10);
+    record->dtime = le32(raw_inode + 0x14);
+    record->mode = le16(raw_inode + 0x0);
+    record->links_count = le16(raw_inode + 0x1A);
+    record->unused = 0;
+    memcpy(record->extent_root, raw_inode + 0x28, INODE_RECORD_EXTENT_ROOT);
+}
+
+void InodeColumns_init(struct InodeColumns * columns, u_int64_t capacity)
+{
+    columns->count = 0;
+    columns->capacity = capacity;
+    columns->size = malloc(sizeof(u_int64_t) * capacity);
+    columns->inode = malloc(sizeof(u_int32_t) * capacity);
+    columns->flags = malloc(sizeof(u_int32_t) * capacity);
+    columns->atime = malloc(sizeof(u_int32_t) * capacity);
+    columns->ctime = malloc(sizeof(u_int32_t) * capacity);
+    columns->mtime = malloc(sizeof(u_int32_t) * capacity);
+    columns->dtime = malloc(sizeof(u_int32_t) * capacity);
+    columns->mode = malloc(sizeof(u_int16_t) * capacity);
+    columns->links_count = malloc(sizeof(u_int16_t) * capacity);
+    columns->uid = malloc(sizeof(u_int32_t) * capacity);
+    columns->gid = malloc(sizeof(u_int32_t) * capacity);
+    columns->extent_root = malloc(INODE_RECORD_EXTENT_ROOT * capacity);
+    columns->selected = malloc(capacity);
+}
+
+void InodeColumns_free(struct InodeColumns * columns)
+{
+    free(columns->size);
+    free(columns->inode);
+    free(columns->flags);
+    free(columns->atime);
+    free(columns->ctime);
+    free(columns->mtime);
+    free(columns->dtime);
+    free(columns->mode);
+    free(columns->links_count);
+    free(columns->uid);
+    free(columns->gid);
+    free(columns->extent_root);
+    free(columns->selected);
+    memset(columns, 0, sizeof(struct InodeColumns));
+}
+
+void InodeColumns_append(struct InodeColumns * columns, const u_char * raw_inode, u_int64_t inode_id)
+/// decodes hot fields of an on-disk inode into the next row, caller keeps count below capacity
+{
+    u_int64_t i = columns->count++;
+    columns->size[i] = ((u_int64_t)le32(raw_inode + 0x6C) << 32u) + le32(raw_inode + 0x4);
+    columns->inode[i] = inode_id;
+    columns->flags[i] = le32(raw_inode + 0x20);
+    columns->atime[i] = le32(raw_inode + 0x8);
+    columns->ctime[i] = le32(raw_inode + 0xC);
+    columns->mtime[i] = le32(raw_inode + 0x10);
+    columns->dtime[i] = le32(raw_inode + 0x14);
+    columns->mode[i] = le16(raw_inode + 0x0);
+    columns->links_count[i] = le16(raw_inode + 0x1A);
+    columns->uid[i] = le16(raw_inode + 0x2) | (u_int32_t)le16(raw_inode + 0x78) << 16u;
+    columns->gid[i] = le16(raw_inode + 0x18) | (u_int32_t)le16(raw_inode + 0x7A) << 16u;
+    memcpy(columns->extent_root + i * INODE_RECORD_EXTENT_ROOT, raw_inode + 0x28, INODE_RECORD_EXTENT_ROOT);
+}
+
+void InodeColumns_get(struct InodeColumns * columns, u_int64_t index, struct InodeRecord * record)
+/// gathers one row back into a record
+{
+    record->size = columns->size[index];
+    record->inode = columns->inode[index];
+    record->flags = columns->flags[index];
+    record->atime = columns->atime[index];
+    record->ctime = columns->ctime[index];
+    record->mtime = columns->mtime[index];
+    record->dtime = columns->dtime[index];
+    record->mode = columns->mode[index];
+    record->links_count = columns->links_count[index];
+    record->unused = 0;
+    memcpy(record->extent_root, columns->extent_root + index * INODE_RECORD_EXTENT_ROOT, INODE_RECORD_EXTENT_ROOT);
+}
+
+void InodeFilter_default(struct InodeFilter * filter)
+{
+    filter->type = 0;
+    filter->min_size = 0;
+    filter->max_size = UINT64_MAX;
+    filter->min_mtime = 0;
+    filter->max_mtime = UINT32_MAX;
+}
+
+u_int64_t InodeColumns_filter(struct InodeColumns * columns, struct InodeFilter * filter, u_int32_t * indexes)
+/// writes row indexes of inodes passing the filter into indexes (up to count of them), returns their number;
+/// every predicate is a branch free pass over one column, only the final gather looks at the result
+{
+    // columns are taken into restrict locals, stores into selected could otherwise alias them
+    u_int64_t count = columns->count;
+    u_char * restrict selected = columns->selected;
+    const u_int64_t * size = columns->size;
+    const u_int32_t * mtime = columns->mtime;
+    const u_int16_t * mode = columns->mode, * links_count = columns->links_count;
+    u_int64_t min_size = filter->min_size, max_size = filter->max_size;
+    u_int32_t min_mtime = filter->min_mtime, max_mtime = filter->max_mtime;
+    u_int16_t type = filter->type, any_type = filter->type == 0;
+    for (u_int64_t i = 0; i < count; ++i)
+        selected[i] = links_count[i] != 0;
+    for (u_int64_t i = 0; i < count; ++i)
+        selected[i] &= (size[i] >= min_size) & (size[i] <= max_size);
+    for (u_int64_t i = 0; i < count; ++i)
+        selected[i] &= (mtime[i] >= min_mtime) & (mtime[i] <= max_mtime);
+    for (u_int64_t i = 0; i < count; ++i)
+        selected[i] &= ((mode[i] & 0xF000u) == type) | any_type;
+    u_int64_t found = 0;
+    for (u_int64_t i = 0; i < count; ++i)
+    {
+        indexes[found] = i;
+        found += selected[i];
+    }
+    return found;
+}
+
+struct filter_scan {
+    struct InodeFilter * filter;
+    struct InodeRecord * records;
+    u_int64_t count;
+    u_int64_t capacity;
+    pthread_mutex_t lock;
+};
+
+int filter_columns(void * ctx, struct InodeColumns * columns)
+/// filters a batch in the worker, only matching records are appended under the lock
+{
+    struct filter_scan * scan = ctx;
+    u_int32_t indexes[INODE_COLUMNS_BATCH];
+    u_int64_t found = InodeColumns_filter(columns, scan->filter, indexes);
+    if (found == 0) return 0;
+    pthread_mutex_lock(&scan->lock);
+    if (scan->count + found > scan->capacity)
+    {
+        while (scan->count + found > scan->capacity)
+            scan->capacity = scan->capacity ? scan->capacity * 2 : 256;
+        scan->records = realloc(scan->records, sizeof(struct InodeRecord) * scan->capacity);
+    }
+    for (u_int64_t i = 0; i < found; ++i)
+        InodeColumns_get(columns, indexes[i], scan->records + scan->count++);
+    pthread_mutex_unlock(&scan->lock);
+    return 0;
+}
+
+int compare_records(const void * a, const void * b)
+{
+    u_int32_t inode_a = ((const struct InodeRecord *)a)->inode, inode_b = ((const struct InodeRecord *)b)->inode;
+    return (inode_a > inode_b) - (inode_a < inode_b);
+}
+
+int scan_inode_filter(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        struct InodeFilter * filter, struct InodeRecord ** records, u_int64_t * records_count)
+/// returns (through records, records_count) records of all used inodes passing the filter, in inode order
+{
+    struct filter_scan scan = {.filter = filter};
+    pthread_mutex_init(&scan.lock, NULL);
+    int err = scan_inode_columns(image_path, superBlock, jobs, filter_columns, &scan);
+    pthread_mutex_destroy(&scan.lock);
+    qsort(scan.records, scan.count, sizeof(struct InodeRecord), compare_records);
+    *records = scan.records;
+    *records_count = scan.count;
+    return err;
+}
@@ -0,0 +1,69 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_INODE_RECORD_H
+#define EXT4_BINARY_READ_INODE_RECORD_H
+#include "filesystem.h"
+
+// Compact inode record for bulk scans. InodeTable decodes every field of the on-disk inode (hi/lo pairs, obsolete
+// fields, the in-inode xattr area), which is wasted work when a scan looks at a few attributes of millions of inodes.
+// InodeRecord keeps only the hot fields in one 64 byte cache line, decoded straight from the raw inode, and
+// InodeColumns stores a batch of them as one array per field, so filters run as plain loops over contiguous columns
+// which the compiler vectorizes.
+
+#define INODE_RECORD_EXTENT_ROOT 24  // extent header and first extent (or index) entry of i_block
+#define INODE_COLUMNS_BATCH 4096  // inodes collected by a scan worker before they are passed on
+
+struct InodeRecord {  // 64 bytes
+    u_int64_t size;
+    u_int32_t inode;
+    u_int32_t flags;
+    u_int32_t atime;
+    u_int32_t ctime;
+    u_int32_t mtime;
+    u_int32_t dtime;
+    u_int16_t mode;
+    u_int16_t links_count;
+    u_int32_t unused;  // pads record to 64 bytes
+    u_char extent_root[INODE_RECORD_EXTENT_ROOT];
+};
+
+struct InodeColumns {  // structure of arrays, element i of every column belongs to the same inode
+    u_int64_t count;
+    u_int64_t capacity;
+    u_int64_t * size;
+    u_int32_t * inode;
+    u_int32_t * flags;
+    u_int32_t * atime;
+    u_int32_t * ctime;
+    u_int32_t * mtime;
+    u_int32_t * dtime;
+    u_int16_t * mode;
+    u_int16_t * links_count;
+    u_int32_t * uid;  // owner columns are not part of InodeRecord, they are kept for exports
+    u_int32_t * gid;
+    u_char * extent_root;  // INODE_RECORD_EXTENT_ROOT bytes per inode, cold: touched only for selected inodes
+    u_char * selected;  // scratch column of filter results
+};
+
+void InodeRecord_new(struct InodeRecord * record, const u_char * raw_inode, u_int64_t inode_id);
+void InodeColumns_init(struct InodeColumns * columns, u_int64_t capacity);
+void InodeColumns_free(struct InodeColumns * columns);
+void InodeColumns_append(struct InodeColumns * columns, const u_char * raw_inode, u_int64_t inode_id);
+void InodeColumns_get(struct InodeColumns * columns, u_int64_t index, struct InodeRecord * record);
+
+struct InodeFilter {  // all bounds are inclusive, default filter passes every inode
+    u_int16_t type;  // S_IF* file type, 0 passes any type
+    u_int64_t min_size;
+    u_int64_t max_size;
+    u_int32_t min_mtime;
+    u_int32_t max_mtime;
+};
+
+void InodeFilter_default(struct InodeFilter * filter);
+u_int64_t InodeColumns_filter(struct InodeColumns * columns, struct InodeFilter * filter, u_int32_t * indexes);
+int scan_inode_filter(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        struct InodeFilter * filter, struct InodeRecord ** records, u_int64_t * records_count);
+
+#endif //EXT4_BINARY_READ_INODE_RECORD_H
@@ -0,0 +1,297 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#define _GNU_SOURCE
+#include "inode_scan.h"
+#include "interfaces.h"
+#include "image_backend.h"
+#include "stats.h"
+#include "arena.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+
+static const u_int64_t INODE_SCAN_CHUNK_BYTES = 8u << 20u;  // max size of a single inode table read
+static const u_int64_t SCAN_MAX_UNIT_GROUPS = 256;  // max number of groups whose bitmaps are read at once
+
+struct scan_unit {  // consecutive groups with back to back metadata, taken by a worker as a whole
+    u_int64_t first_group;
+    u_int64_t groups;
+};
+
+struct inode_scan {
+    FILE * file;  // shared by workers, reads are positional
+    struct SuperBlock * superBlock;
+    struct GroupDescriptor * groupDescriptors;
+    u_int64_t groups_count;
+    struct scan_unit * units;
+    u_int64_t units_count;
+    int uninit_flags_valid;  // bg_flags and bg_itable_unused are maintained only with group descriptor checksums
+    inode_scan_callback callback;  // exactly one of the callbacks is set
+    inode_columns_callback columns_callback;
+    block_bitmap_callback bitmap_callback;
+    void * ctx;
+    u_int64_t next_unit;  // first unit not taken by any worker
+    int stop;  // set on error or when callback asks to stop, workers don't take further units
+    pthread_mutex_t lock;
+};
+
+u_int64_t used_inodes(struct inode_scan * scan, u_int64_t group_id)
+/// number of initialized inode table entries of a group, 0 when its table was never written
+{
+    struct GroupDescriptor * groupDescriptor = scan->groupDescriptors + group_id;
+    u_int64_t inodes_count = scan->superBlock->s_inodes_per_group;
+    if (!scan->uninit_flags_valid) return inodes_count;
+    if (groupDescriptor->bg_flags & BG_INODE_UNINIT) return 0;
+    return groupDescriptor->bg_itable_unused_u32 < inodes_count ? inodes_count - groupDescriptor->bg_itable_unused_u32
+                                                                 : inodes_count;
+}
+
+int scan_inode_unit(struct inode_scan * scan, FILE * file, struct scan_unit * unit, u_char * bitmaps, u_char * table,
+        struct InodeColumns * columns)
+/// reads inode bitmaps and initialized parts of inode tables of a unit and passes every inode to the callback
+/// (or used ones to the columns callback in batches), bitmaps take one request and tables of all groups are read
+/// through as one sequential range in large chunks
+{
+    struct SuperBlock * superBlock = scan->superBlock;
+    u_int64_t block_size = superBlock->s_block_size, inode_size = superBlock->s_inode_size;
+    u_int64_t inodes_per_group = superBlock->s_inodes_per_group;
+    u_int64_t first_used = unit->groups, last_used = 0;
+    for (u_int64_t i = 0; i < unit->groups; ++i)
+        if (used_inodes(scan, unit->first_group + i))
+        {
+            if (first_used == unit->groups) first_used = i;
+            last_used = i;
+        }
+    if (first_used == unit->groups) return 0;  // no inode of this unit was ever written
+
+    STAT_BEGIN();
+    struct GroupDescriptor * first_descriptor = scan->groupDescriptors + unit->first_group;
+    if (read_blocks(file, block_size, first_descriptor[first_used].bg_inode_bitmap_u64, last_used - first_used + 1,
+                    (char *)bitmaps))
+    {
+        fprintf(stderr, "Error reading inode bitmaps of groups %" PRIu64 "-%" PRIu64 "\n",
+                        unit->first_group + first_used, unit->first_group + last_used);
+        return 1;
+    }
+    // slots are numbered from the first inode of the unit, tables of its groups follow each other on disk
+    u_int64_t span_start = first_used * inodes_per_group;
+    u_int64_t span_end = last_used * inodes_per_group + used_inodes(scan, unit->first_group + last_used);
+    u_int64_t chunk_inodes = INODE_SCAN_CHUNK_BYTES / inode_size;
+    int err = 0;
+    for (u_int64_t first = span_start; first < span_end && !err; first += chunk_inodes)
+    {
+        u_int64_t count = span_end - first < chunk_inodes ? span_end - first : chunk_inodes;
+        u_int64_t first_block = first_descriptor->bg_inode_table_u64 + first * inode_size / block_size;
+        u_int64_t blocks = (count * inode_size + block_size - 1) / block_size;
+        if (read_blocks(file, block_size, first_block, blocks, (char *)table))
+        {
+            fprintf(stderr, "Error reading inode table at block %" PRIu64 "\n", first_block);
+            err = 1;
+            break;
+        }
+        // the kernel starts on the next chunk while callbacks work on this one
+        if (first + count < span_end)
+            prefetch_blocks(file, block_size, first_block + blocks, blocks);
+        for (u_int64_t i = 0; i < count && !err; ++i)
+        {
+            u_int64_t group = (first + i) / inodes_per_group, index = (first + i) % inodes_per_group;
+            if (index >= used_inodes(scan, unit->first_group + group)) continue;
+            const u_char * bitmap = bitmaps + (group - first_used) * block_size;
+            int in_use = (bitmap[index / 8] >> (index % 8)) & 1u;
+            u_int64_t inode_id = (unit->first_group + group) * inodes_per_group + index + 1;
+            if (columns)
+            {
+                if (in_use)
+                    InodeColumns_append(columns, table + i * inode_size, inode_id);
+                if (columns->count == columns->capacity)
+                {
+                    err = scan->columns_callback(scan->ctx, columns);
+                    columns->count = 0;
+                }
+                continue;
+            }
+            struct InodeTable inode;
+            InodeTable_new(&inode, (char *)table + i * inode_size, inode_size);
+            inode.i_ino = inode_id;
+            err = scan->callback(scan->ctx, file, &inode, in_use);
+        }
+    }
+    if (columns && columns->count && !err)
+        err = scan->columns_callback(scan->ctx, columns);
+    if (columns)
+        columns->count = 0;
+    STAT_END(STAT_SCAN_GROUP, (last_used - first_used + 1) * block_size + (span_end - span_start) * inode_size);
+    return err;
+}
+
+int scan_block_bitmap_unit(struct inode_scan * scan, FILE * file, struct scan_unit * unit, u_char * bitmaps)
+/// reads block bitmaps of all groups of a unit with one request and passes them to the callback
+{
+    struct SuperBlock * superBlock = scan->superBlock;
+    struct GroupDescriptor * first_descriptor = scan->groupDescriptors + unit->first_group;
+    u_int64_t initialized = 0;  // bitmaps past the last initialized one are not read
+    for (u_int64_t i = 0; i < unit->groups; ++i)
+        if (!scan->uninit_flags_valid || !(first_descriptor[i].bg_flags & BG_BLOCK_UNINIT))
+            initialized = i + 1;
+    if (initialized)
+    {
+        STAT_BEGIN();
+        if (read_blocks(file, superBlock->s_block_size, first_descriptor->bg_block_bitmap_u64, initialized,
+                        (char *)bitmaps))
+        {
+            fprintf(stderr, "Error reading block bitmaps of groups %" PRIu64 "-%" PRIu64 "\n", unit->first_group,
+                            unit->first_group + initialized - 1);
+            return 1;
+        }
+        STAT_END(STAT_SCAN_GROUP, initialized * superBlock->s_block_size);
+    }
+    int err = 0;
+    for (u_int64_t i = 0; i < unit->groups && !err; ++i)
+    {
+        u_int64_t group_id = unit->first_group + i;
+        u_int64_t group_start = superBlock->s_first_data_block + group_id * superBlock->s_blocks_per_group;
+        u_int64_t blocks_count = superBlock->s_blocks_count_u64 - group_start < superBlock->s_blocks_per_group
+                                 ? superBlock->s_blocks_count_u64 - group_start : superBlock->s_blocks_per_group;
+        int uninit = scan->uninit_flags_valid && (first_descriptor[i].bg_flags & BG_BLOCK_UNINIT);
+        err = scan->bitmap_callback(scan->ctx, group_id, first_descriptor + i,
+                                    uninit ? NULL : bitmaps + i * superBlock->s_block_size, blocks_count);
+    }
+    return err;
+}
+
+void * inode_scan_worker(void * arg)
+/// takes units in order until all are taken or the scan is stopped
+{
+    struct inode_scan * scan = arg;
+    FILE * file = scan->file;
+    u_char * bitmaps = malloc(scan->superBlock->s_block_size * SCAN_MAX_UNIT_GROUPS);
+    u_char * table = scan->bitmap_callback ? NULL : malloc(INODE_SCAN_CHUNK_BYTES);
+    struct InodeColumns columns;
+    if (scan->columns_callback)
+        InodeColumns_init(&columns, INODE_COLUMNS_BATCH);
+    while (1)
+    {
+        pthread_mutex_lock(&scan->lock);
+        u_int64_t unit = scan->next_unit;
+        int take = !scan->stop && unit < scan->units_count;
+        if (take)
+            scan->next_unit += 1;
+        pthread_mutex_unlock(&scan->lock);
+        if (!take) break;
+        if (scan->bitmap_callback ? scan_block_bitmap_unit(scan, file, scan->units + unit, bitmaps)
+                                  : scan_inode_unit(scan, file, scan->units + unit, bitmaps, table,
+                                                    scan->columns_callback ? &columns : NULL))
+        {
+            pthread_mutex_lock(&scan->lock);
+            scan->stop = 1;
+            pthread_mutex_unlock(&scan->lock);
+        }
+    }
+    if (scan->columns_callback)
+        InodeColumns_free(&columns);
+    free(table);
+    free(bitmaps);
+    stats_flush_thread();
+    Arena_free(&thread_arena);
+    return NULL;
+}
+
+void split_scan_units(struct inode_scan * scan)
+/// splits groups into units of back to back metadata, with flex_bg every flex group usually becomes one unit
+{
+    struct SuperBlock * superBlock = scan->superBlock;
+    // slots of a unit map to table blocks only when every table ends on a block boundary
+    int tables_aligned = ((u_int64_t)superBlock->s_inodes_per_group * superBlock->s_inode_size) % superBlock->s_block_size == 0;
+    scan->units = malloc(sizeof(struct scan_unit) * (scan->groups_count ? scan->groups_count : 1));
+    scan->units_count = 0;
+    for (u_int64_t group_id = 0; group_id < scan->groups_count;)
+    {
+        u_int64_t groups;
+        if (!scan->bitmap_callback)
+        {
+            groups = contiguous_metadata_groups(superBlock, scan->groupDescriptors, scan->groups_count, group_id,
+                                                GROUP_INODE_BITMAP, tables_aligned ? SCAN_MAX_UNIT_GROUPS : 1);
+            groups = contiguous_metadata_groups(superBlock, scan->groupDescriptors, scan->groups_count, group_id,
+                                                GROUP_INODE_TABLE, groups);
+        }
+        else
+            groups = contiguous_metadata_groups(superBlock, scan->groupDescriptors, scan->groups_count, group_id,
+                                                GROUP_BLOCK_BITMAP, SCAN_MAX_UNIT_GROUPS);
+        scan->units[scan->units_count].first_group = group_id;
+        scan->units[scan->units_count].groups = groups;
+        scan->units_count += 1;
+        group_id += groups;
+    }
+}
+
+int run_group_scan(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        inode_scan_callback callback, inode_columns_callback columns_callback, block_bitmap_callback bitmap_callback,
+        void * ctx)
+/// hands all groups, in units of back to back metadata, to jobs worker threads (0 picks number of CPUs)
+{
+    struct inode_scan scan;
+    memset(&scan, 0, sizeof(scan));
+    FILE * file = image_open(image_path);
+    if (file == NULL) return 1;
+    if (load_group_descriptors(file, superBlock, &scan.groupDescriptors, &scan.groups_count))
+    {
+        fprintf(stderr, "Error loading group descriptors\n");
+        fclose(file);
+        return 1;
+    }
+    if (jobs == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? cpus : 1;
+    }
+    scan.file = file;
+    scan.superBlock = superBlock;
+    scan.uninit_flags_valid = (superBlock->s_feature_ro_compat & (RO_COMPAT_GDT_CSUM | RO_COMPAT_METADATA_CSUM)) != 0;
+    scan.callback = callback;
+    scan.columns_callback = columns_callback;
+    scan.bitmap_callback = bitmap_callback;
+    scan.ctx = ctx;
+    split_scan_units(&scan);
+    if (jobs > scan.units_count) jobs = scan.units_count ? scan.units_count : 1;
+    pthread_mutex_init(&scan.lock, NULL);
+
+    pthread_t * workers = malloc(sizeof(pthread_t) * jobs);
+    u_int64_t started = 0;
+    for (; started < jobs; ++started)
+        if (pthread_create(workers + started, NULL, inode_scan_worker, &scan)) break;
+    for (u_int64_t i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    free(scan.units);
+    free(scan.groupDescriptors);
+    fclose(file);
+    pthread_mutex_destroy(&scan.lock);
+    return started == 0 || scan.stop;
+}
+
+int scan_inode_tables(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        inode_scan_callback callback, void * ctx)
+/// passes every initialized inode of the image to callback, groups are scanned by jobs worker threads
+/// (0 picks number of CPUs), so callback must be thread safe; returns non zero on error or when callback stopped it
+{
+    return run_group_scan(image_path, superBlock, jobs, callback, NULL, NULL, ctx);
+}
+
+int scan_inode_columns(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        inode_columns_callback callback, void * ctx)
+/// passes hot fields of every used inode to callback in column batches, groups are scanned by jobs worker threads
+/// (0 picks number of CPUs), so callback must be thread safe; returns non zero on error or when callback stopped it
+{
+    return run_group_scan(image_path, superBlock, jobs, NULL, callback, NULL, ctx);
+}
+
+int scan_block_bitmaps(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        block_bitmap_callback callback, void * ctx)
+/// passes block bitmap of every group to callback, same threading as scan_inode_tables
+{
+    return run_group_scan(image_path, superBlock, jobs, NULL, NULL, callback, ctx);
+}
@@ -0,0 +1,41 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_INODE_SCAN_H
+#define EXT4_BINARY_READ_INODE_SCAN_H
+#include "filesystem.h"
+#include "inode_record.h"
+
+// Whole file system inode scan. Workers take block groups in order and read every group's inode bitmap and the
+// initialized part of its inode table with a few large sequential requests, instead of one block read per inode,
+// so the image is covered in a single forward pass. Block bitmaps are scanned the same way. Groups whose metadata
+// lie back to back (flex_bg packs those of a whole flex group together, as found in the group descriptors) are taken
+// by one worker and their bitmaps and tables are read as single ranges.
+
+// called from worker threads for every initialized inode slot (used or not), in_use is its inode bitmap bit,
+// file is the image handle shared by all workers (read it only with read_block(s), which are positional),
+// returning non zero stops the scan
+typedef int (*inode_scan_callback)(void * ctx, FILE * file, struct InodeTable * inodeTable, int in_use);
+
+int scan_inode_tables(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        inode_scan_callback callback, void * ctx);
+
+// called from worker threads with hot fields of used inodes (inode bitmap bit set) decoded straight from the table
+// chunk, without building InodeTable; a batch holds up to INODE_COLUMNS_BATCH inodes of one unit in inode order and
+// its columns are reused after the call, returning non zero stops the scan
+typedef int (*inode_columns_callback)(void * ctx, struct InodeColumns * columns);
+
+int scan_inode_columns(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        inode_columns_callback callback, void * ctx);
+
+// called from worker threads with block bitmap of every group, blocks_count is the number of blocks in the group
+// (the last one may be shorter), bitmap is NULL for groups with uninitialized bitmap (BG_BLOCK_UNINIT);
+// with bigalloc the bitmap holds one bit per cluster of s_cluster_blocks blocks
+typedef int (*block_bitmap_callback)(void * ctx, u_int64_t group_id, struct GroupDescriptor * groupDescriptor,
+        const u_char * bitmap, u_int64_t blocks_count);
+
+int scan_block_bitmaps(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs,
+        block_bitmap_callback callback, void * ctx);
+
+#endif //EXT4_BINARY_READ_INODE_SCAN_H
@@ -2,18 +2,41 @@
 // Created by wdymel on 2020-11-11.
 //
 #include "interfaces.h"
+#include "stats.h"
+#include "image_backend.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
 
 int read_file_into_buffer(FILE * file, char * buffer, u_int64_t file_offset, u_int64_t read_length)
 // read <read_length> of bytes from stream into <buffer> starting from <file_offset> position
+// positional reads leave stream position alone, so any number of threads can read through one FILE at once
 {
-    u_int64_t read_size;
     // just some sanity checks
     if (file == NULL || buffer == NULL) return 1;
 
-    if (fseek(file, file_offset, SEEK_SET) != 0) return 3; // move file cursor to specified position, relative to file's beginning
-    read_size = fread(buffer, 1, read_length, file); // read file into buffer
-    if (read_size != read_length) return 4;
-
+    int fd = fileno(file);
+    if (fd < 0)
+    {
+        // compressed or partitioned image, its backend reads at any offset from any thread
+        struct ImageBackend * backend = image_backend_of(file);
+        if (backend)
+            return ImageBackend_read(backend, (u_char *)buffer, file_offset, read_length) ? 4 : 0;
+        // other stream without descriptor (ie. fopencookie), its position is shared so seek and read happen under its lock
+        flockfile(file);
+        int err = fseeko(file, (off_t)file_offset, SEEK_SET) != 0 ? 3
+                  : fread(buffer, 1, read_length, file) != read_length ? 4 : 0;
+        funlockfile(file);
+        return err;
+    }
+    u_int64_t done = 0;
+    while (done < read_length)
+    {
+        ssize_t read_size = pread(fd, buffer + done, read_length - done, (off_t)(file_offset + done));
+        if (read_size < 0 && errno == EINTR) continue;
+        if (read_size <= 0) return 4;  // error, or image ends before the requested range
+        done += read_size;
+    }
     return 0;
 }
 
@@ -34,8 +57,32 @@ u_int64_t convert_le_byte_array_to_uint(const char * byte_array, int number_of_b
 
 int read_block(FILE * file, u_int64_t block_size, u_int64_t block_id, char * buffer)
 {
+    STAT_BEGIN();
     u_int64_t starting_pos = block_size * block_id;
-    if (read_file_into_buffer(file, buffer, starting_pos, block_size))
-        return 1;
-    else return 0;
-}
\ No newline at end of file
+    int err = read_file_into_buffer(file, buffer, starting_pos, block_size) ? 1 : 0;
+    STAT_END(STAT_READ_BLOCK, block_size);
+    return err;
+}
+
+int read_blocks(FILE * file, u_int64_t block_size, u_int64_t first_block_id, u_int64_t block_count, char * buffer)
+// read <block_count> consecutive blocks starting at <first_block_id> with a single request
+{
+    STAT_BEGIN();
+    int err = read_file_into_buffer(file, buffer, block_size * first_block_id, block_size * block_count) ? 1 : 0;
+    STAT_END(STAT_READ_BLOCK, block_size * block_count);
+    return err;
+}
+
+void prefetch_blocks(FILE * file, u_int64_t block_size, u_int64_t first_block_id, u_int64_t block_count)
+// hint the kernel that given blocks will be read soon, so it can start reading them in the background
+{
+    if (file == NULL || block_count == 0) return;
+    if (fileno(file) < 0)
+    {
+        struct ImageBackend * backend = image_backend_of(file);
+        if (backend)
+            ImageBackend_prefetch(backend, block_size * first_block_id, block_size * block_count);
+        return;
+    }
+    posix_fadvise(fileno(file), (off_t)(block_size * first_block_id), (off_t)(block_size * block_count), POSIX_FADV_WILLNEED);
+}
@@ -10,4 +10,6 @@
 
 int read_file_into_buffer(FILE * file, char * buffer, u_int64_t file_offset, u_int64_t read_length);
 u_int64_t convert_le_byte_array_to_uint(const char * byte_array, int number_of_bytes);
-int read_block(FILE * file, u_int64_t block_size, u_int64_t block_id, char * buffer);
\ No newline at end of file
+int read_block(FILE * file, u_int64_t block_size, u_int64_t block_id, char * buffer);
+int read_blocks(FILE * file, u_int64_t block_size, u_int64_t first_block_id, u_int64_t block_count, char * buffer);
+void prefetch_blocks(FILE * file, u_int64_t block_size, u_int64_t first_block_id, u_int64_t block_count);
@@ -2,371 +2,762 @@
 #include <stdlib.h>
 //#include <stdbool.h>
 
-#include <errno.h>
-
 #include "interfaces.h"
 #include "flags.h"
 #include <inttypes.h>
 #include "structs/super_block.h"
 #include "structs/group_descriptor.h"
 #include "structs/inode_table.h"
+#include "filesystem.h"
+#include "metadata_index.h"
+#include "stats.h"
+#include "batch.h"
+#include "xattr.h"
+#include "undelete.h"
+#include "rmap.h"
+#include "frag_report.h"
+#include "ext4fs.h"
+#include "inode_record.h"
+#include "columnar_export.h"
+#include "snapshot_diff.h"
+#include "image_backend.h"
+#include "path_index.h"
+#include "arena.h"
 #include <string.h>
+#include <fnmatch.h>
+#include <time.h>
+#include <limits.h>
 
 static const char DRIVE_MOUNT[] = "binary.img"; // path on which the partition is mounted from
 
-int load_super_block(FILE * file, struct SuperBlock * superBlock)
-/// loads super block from second 1024 bytes of a device/file
+void print_bytes(u_char * bytes, uint64_t len, uint64_t index_offset)
+/// prints len given bytes from array as hex byte values
 {
-    static const uint sb_offset = 1024, sb_length = 1024;
-    char buffer[sb_length];
-    if (read_file_into_buffer(file, buffer, sb_offset, sb_length)) return 1;
-    return SuperBblock_new(superBlock, buffer);
+    const static uint8_t ROW_LEN = 16;
+    uint64_t i;
+    for (i = 0; i < len; ++i)
+    {
+        if (i % ROW_LEN == 0)
+//            printf("0x%08" PRIx64 "`0x%08" PRIx64 " ", ((index_offset + i) >> 32u ) << 32u, ((index_offset + i) << 32u ) >> 32u);
+            printf("0x%08" PRIx64 "`%08" PRIx64 " ", (index_offset + i) & 0xFFFFFFFF00000000, (index_offset + i) & 0x00000000FFFFFFFF);
+
+        printf("%02x ", (u_char)bytes[i]);
+        if (i % ROW_LEN == ROW_LEN - 1)
+            printf("\n");
+    }
+    if (i % ROW_LEN != ROW_LEN - 1)
+        printf("\n");
 }
 
-int load_group_descriptor(FILE * file, struct SuperBlock * superBlock, struct GroupDescriptor * groupDescriptor,
-                          u_int64_t group_id)
-/// loads group descriptor for given block group
+struct cat_ctx {
+    uint64_t page_size;
+    uint64_t bytes_printed;
+};
+
+int print_page(void * ctx, const u_char * data, uint64_t length)
+/// prints file content passed by read_inode_data, with a mark every block as a page <number>
 {
-    if (superBlock->s_feature_incompat & INCOMPAT_META_BG) return 1;  // meta block groups are not supported
-    // ALL group descriptor tables are located in first(0) block group
-    // other block groups MAY store copies of them
+    struct cat_ctx * cat = ctx;
+    uint64_t offset = 0;
+    while (offset < length)
+    {
+        uint64_t page_left = cat->page_size - cat->bytes_printed % cat->page_size;
+        uint64_t count = length - offset < page_left ? length - offset : page_left;
+        if (cat->bytes_printed % cat->page_size == 0)
+            printf("Page %" PRIu64 "\n", cat->bytes_printed / cat->page_size);
+        print_bytes((u_char *)data + offset, count, cat->bytes_printed);
+        offset += count;
+        cat->bytes_printed += count;
+    }
+    return 0;
+}
 
-    // locate block in which our group descriptor is in
-    uint64_t block_offset = (group_id * superBlock->s_desc_size) / superBlock->s_block_size;
-    // locate byte offset in block
-    uint64_t byte_offset = (group_id * superBlock->s_desc_size) % superBlock->s_block_size;
-    char * buffer = malloc(superBlock->s_block_size);
-    if (read_block(file, superBlock->s_block_size, superBlock->s_first_group_desc_block + block_offset, buffer)) return 1;
-    return GroupDescriptor_new(groupDescriptor, buffer + byte_offset, superBlock->s_desc_size);
+char dir_entry_type_char(uint8_t file_type)
+/// single letter file type shown by ls
+{
+    if (file_type == DEFT_REGULAR) return 'f';
+    if (file_type == DEFT_DIRECTORY) return 'd';
+    if (file_type == DEFT_SYMLINK) return 'l';
+    if (file_type == DEFT_CHAR_DEV) return 'c';
+    if (file_type == DEFT_BLOCK_DEV) return 'b';
+    if (file_type == DEFT_FIFO) return 'p';
+    if (file_type == DEFT_SOCKET) return 's';
+    return '?';
 }
 
-int load_inode_table(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable, uint64_t inode_id)
-/// loads inode of given id
+void print_time(const char * label, uint32_t seconds)
 {
-    // locate block group this inode belongs to
-    uint64_t block_group = (inode_id - 1) / superBlock->s_inodes_per_group;
-    uint64_t index = (inode_id - 1) % superBlock->s_inodes_per_group;
-    uint64_t containing_block = (index * superBlock->s_inode_size) / superBlock->s_block_size;
-    uint64_t byte_offset = (index * superBlock->s_inode_size) % superBlock->s_block_size;
-    struct GroupDescriptor groupDescriptor;
-    if (load_group_descriptor(file, superBlock, &groupDescriptor, block_group)) return 1;
-    char * buffer = malloc(superBlock->s_block_size);
-    uint8_t err = read_block(file, superBlock->s_block_size, groupDescriptor.bg_inode_table_u64 + containing_block, buffer);
-    if (!err)
-        InodeTable_new(inodeTable, buffer + byte_offset);
-    free(buffer);
-    return err;
+    char formatted[32];
+    time_t time = seconds;
+    strftime(formatted, sizeof(formatted), "%Y-%m-%d %H:%M:%S", gmtime(&time));
+    printf("%s: %s UTC\n", label, formatted);
 }
 
-int shell_load_directory(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
-        uint64_t * current_inode_id, uint64_t next_inode_id)
-/// attempts to change directory in our shell, if unsuccessful then attempts to load previous directory
+void print_inode_stat(const char * path, struct InodeStat * inodeStat, uint64_t extent_count)
+/// prints attributes of an inode in a stat like format
 {
-    if (load_inode_table(file, superBlock, inodeTable, next_inode_id))
+    const char * type = "unknown";
+    uint16_t file_format = inodeStat->mode & 0xF000u;
+    if (file_format == S_IFREG) type = "regular file";
+    else if (file_format == S_IFDIR) type = "directory";
+    else if (file_format == S_IFLNK) type = "symbolic link";
+    else if (file_format == S_IFCHR) type = "character device";
+    else if (file_format == S_IFBLK) type = "block device";
+    else if (file_format == S_IFIFO) type = "fifo";
+    else if (file_format == S_IFSOCK) type = "socket";
+    printf("  File: %s\n", path);
+    printf(" Inode: %" PRIu32 "\tType: %s\tLinks: %" PRIu16 "\n", inodeStat->inode, type, inodeStat->links_count);
+    printf("  Mode: %04o\tUid: %" PRIu32 "\tGid: %" PRIu32 "\n", inodeStat->mode & 0xFFFu, inodeStat->uid, inodeStat->gid);
+    printf("  Size: %" PRIu64 "\tExtents: %" PRIu64 "\tFlags: 0x%08" PRIx32 "\n", inodeStat->size, extent_count, inodeStat->flags);
+    print_time("Access", inodeStat->atime);
+    print_time("Modify", inodeStat->mtime);
+    print_time("Change", inodeStat->ctime);
+}
+
+struct find_ctx {
+    const char * pattern;
+    uint64_t found;
+};
+
+int print_if_name_matches(void * ctx, uint64_t parent_inode_id, struct ext4_dir_entry_2 * dir_entry,
+        const char * path, uint64_t path_len)
+{
+    (void)parent_inode_id;
+    struct find_ctx * find = ctx;
+    const char * name = path + path_len - dir_entry->name_len;
+    if (fnmatch(find->pattern, name, 0) == 0)
     {
-        printf("Error loading directory\n");
-        return load_inode_table(file, superBlock, inodeTable, *current_inode_id);
+        printf("%s\n", path);
+        find->found += 1;
     }
-    else
-        *current_inode_id = next_inode_id;
     return 0;
 }
 
-int inode_block_recursive(FILE * file, struct SuperBlock * superBlock, struct ext4_extent_header * extent_header,
-        u_char * extent_data, uint64_t * blocks, uint64_t * blocks_read)
-///
+const char * indexed_path(struct MetadataIndex * index, struct PathIndex * paths, uint64_t inode_id, char * buffer,
+        uint64_t buffer_size)
+/// path of inode from path index (into buffer), else from metadata index (first entry found), NULL when neither is
+/// loaded or the inode has no entry
 {
-    if (extent_header->eh_depth == 0)
+    if (paths) return PathIndex_path(paths, inode_id, buffer, buffer_size) ? NULL : buffer;
+    if (index == NULL) return NULL;
+    for (uint64_t i = 0; i < index->header->entry_count; ++i)
+        if (index->entries[i].inode == inode_id)
+            return MetadataIndexEntry_path(index, index->entries + i);
+    return NULL;
+}
+
+void print_block_owners(struct Rmap * rmap, struct MetadataIndex * index, struct PathIndex * paths, uint64_t first_block,
+        uint64_t last_block)
+/// prints owners of blocks first_block..last_block, intervals are cut to the asked range
+{
+    struct RmapInterval * found;
+    uint64_t found_count, covered = 0, covered_until = first_block;
+    Rmap_find(rmap, first_block, last_block, &found, &found_count);
+    printf("blocks %" PRIu64 "-%" PRIu64 " (%" PRIu64 " blocks)\n", first_block, last_block, last_block - first_block + 1);
+    for (uint64_t i = 0; i < found_count; ++i)
     {
-        for(uint64_t leaf_num = 0; leaf_num < extent_header->eh_entries; ++leaf_num)
+        uint64_t start = RmapInterval_start(found + i), end = start + RmapInterval_length(found + i) - 1;
+        uint64_t first = start > first_block ? start : first_block, last = end < last_block ? end : last_block;
+        enum RmapKind kind = RmapInterval_kind(found + i);
+        printf("  %" PRIu64 "-%" PRIu64 "\t%-12s", first, last, RmapKind_name(kind));
+        if (kind == RMAP_SUPER_BLOCK || kind == RMAP_BLOCK_BITMAP || kind == RMAP_INODE_BITMAP || kind == RMAP_INODE_TABLE)
+            printf("\tgroup %" PRIu32 "\n", found[i].owner);
+        else
         {
-            struct ext4_extent leaf;
-            ext4_extent_new(&leaf, (char*)extent_data + 12 + 12 * leaf_num);
-            for (uint64_t block_num = 0; block_num < leaf.ee_len; ++block_num)
-            {
-                blocks[*blocks_read] = leaf.ee_start_u64 + block_num;
-//                printf("%" PRIu64 "\n", leaf.ee_start_u64 + block_num);
-                *blocks_read += 1;
-            }
+            char buffer[PATH_MAX];
+            const char * path = indexed_path(index, paths, found[i].owner, buffer, sizeof(buffer));
+            printf("\tinode %" PRIu32, found[i].owner);
+            if (kind == RMAP_DATA)
+                printf("\tfile blocks %" PRIu64 "-%" PRIu64, found[i].logical + (first - start), found[i].logical + (last - start));
+            printf("%s%s\n", path ? "\t" : "", path ? path : "");
         }
-    }
-    else
-    {
-        u_char * leaf_data = malloc(superBlock->s_block_size * sizeof(u_char));
-        for(uint64_t index_num = 0; index_num < extent_header->eh_entries; ++index_num)
+        // intervals come in start order, so blocks covered by them can be counted in one sweep
+        if (last + 1 > covered_until)
         {
-            struct ext4_extent_idx index;
-            ext4_extent_idx_new(&index, (char*)extent_data + 12 + 12 * index_num);
-            read_block(file, superBlock->s_block_size, index.ei_leaf_u64, leaf_data);
-            struct ext4_extent_header header;
-            if (ext4_extent_header_new(&header, leaf_data))
-            {
-                printf("Error reading extent header from block num %" PRIu64 "\n", index.ei_leaf_u64);
-                return 1;
-            }
-            if (inode_block_recursive(file, superBlock, &header, leaf_data, blocks, blocks_read))
-                return 1;
+            covered += last + 1 - (first > covered_until ? first : covered_until);
+            covered_until = last + 1;
         }
     }
-    return 0;
+    if (covered < last_block - first_block + 1)
+        printf("  %" PRIu64 " blocks not used by any inode or metadata\n", last_block - first_block + 1 - covered);
+    free(found);
 }
 
-int get_inode_block_list(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
-        uint64_t ** blocks, uint64_t * blocks_count)
-/// returns (through uint64_t ** blocks, uint64_t * blocks_count params) an ordered list of block ids that given inode uses
+int parse_filter_value(const char * text, int is_time, uint64_t * value)
+/// size with optional K, M, G or T suffix (powers of 1024), time as seconds since the epoch or YYYY-MM-DD (UTC)
 {
-    uint64_t sector_size_in_block_count;
-    uint64_t blocks_in_inode;
-    if (!(superBlock->s_feature_ro_compat & 0x8u))
+    char * end;
+    int year, month, day;
+    if (is_time && sscanf(text, "%d-%d-%d", &year, &month, &day) == 3)
     {
-        sector_size_in_block_count = 512;
-        blocks_in_inode = inodeTable->i_blocks_lo;
+        struct tm date;
+        memset(&date, 0, sizeof(date));
+        date.tm_year = year - 1900;
+        date.tm_mon = month - 1;
+        date.tm_mday = day;
+        *value = timegm(&date);
+        return 0;
     }
-    else if (!(inodeTable->i_flags & EXT4_HUGE_FILE_FL))
+    *value = strtoull(text, &end, 10);
+    if (end == text) return 1;
+    const char * suffixes = "KMGT";
+    const char * suffix = *end && !is_time ? strchr(suffixes, *end) : NULL;
+    if (suffix)
     {
-        sector_size_in_block_count = 512;
-        blocks_in_inode = inodeTable->i_blocks_lo + ((uint64_t)inodeTable->l_i_blocks_high << 32u);
+        *value <<= 10u * (suffix - suffixes + 1);
+        ++end;
     }
-    else
-    {
-        sector_size_in_block_count = superBlock->s_block_size;
-        blocks_in_inode = ((uint64_t)inodeTable->i_blocks_lo + (uint64_t)inodeTable->l_i_blocks_high) << 32u;
-    }
-    blocks_in_inode /= superBlock->s_block_size / sector_size_in_block_count;
-
-    *blocks = malloc(sizeof(uint64_t) * blocks_in_inode);
-    struct ext4_extent_header header;
-    if (ext4_extent_header_new(&header, (char*)inodeTable->i_block + 0x0)) return 1;
-    uint64_t blocks_read = 0;
-    inode_block_recursive(file, superBlock, &header, inodeTable->i_block, *blocks, &blocks_read);
-    if (blocks_in_inode != blocks_read)
-        printf("Number of read blocks in inode " "is not equal to number of blocks declared in inode table\n");
-    *blocks_count = blocks_read;
-    return 0;
+    return *end != '\0';
 }
 
-int get_directory_list(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
-        struct ext4_dir_entry_2 ** dir_entries, uint64_t * dir_entries_count)
-/// returns (through struct ext4_dir_entry_2 ** dir_entries, uint64_t * dir_entries_count)
-/// a list of dir_entry elements that this directory contains
+int parse_inode_filter(char * arguments, struct InodeFilter * filter)
+/// fills filter from space separated conditions: size>N, size<N, mtime>T, mtime<T (all strict), type=f|d|l
 {
-    if ((inodeTable->i_mode & S_IFDIR) == 0) return 1; // if given inode is not a directory
-    if (inodeTable->i_flags & EXT4_INDEX_FL) printf("HASH TREE DIRECTORY\n");
-    uint64_t * blocks;
-    uint64_t block_count;
-    if (get_inode_block_list(file, superBlock, inodeTable, &blocks, &block_count))
+    InodeFilter_default(filter);
+    for (char * condition = strtok(arguments, " "); condition; condition = strtok(NULL, " "))
     {
-        printf("Error getting inode block list\n");
-        return 1;
-    }
-    char * block_data = malloc(superBlock->s_block_size * sizeof(u_char));
-    *dir_entries_count = 0;
-    for (uint64_t i = 0; i < block_count; ++i)
-    {
-        read_block(file, superBlock->s_block_size, blocks[i], block_data);
-        uint64_t pointer = 0;
-        while(pointer < superBlock->s_block_size)
+        uint64_t value;
+        if (strcmp(condition, "type=f") == 0) filter->type = S_IFREG;
+        else if (strcmp(condition, "type=d") == 0) filter->type = S_IFDIR;
+        else if (strcmp(condition, "type=l") == 0) filter->type = S_IFLNK;
+        else if (strncmp(condition, "size", 4) == 0 && (condition[4] == '>' || condition[4] == '<'))
         {
-            struct ext4_dir_entry_2 dir_entry;
-            ext4_dir_entry_2_new(&dir_entry, block_data + pointer, 0);
-            if (dir_entry.inode)
-                *dir_entries_count += 1;
-            pointer += dir_entry.rec_len;
+            // both bounds are strict, filter keeps inclusive limits
+            if (parse_filter_value(condition + 5, 0, &value)) return 1;
+            if (condition[4] == '>' && value < UINT64_MAX) filter->min_size = value + 1;
+            else if (condition[4] == '<' && value) filter->max_size = value - 1;
+            else return 1;
         }
-    }
-    *dir_entries = malloc(sizeof(struct ext4_dir_entry_2) * *dir_entries_count);
-    uint64_t current_entry = 0;
-    for (uint64_t i = 0; i < block_count && current_entry < *dir_entries_count; ++i)
-    {
-        read_block(file, superBlock->s_block_size, blocks[i], block_data);
-        uint64_t pointer = 0;
-        while(pointer < superBlock->s_block_size && current_entry < *dir_entries_count)
+        else if (strncmp(condition, "mtime", 5) == 0 && (condition[5] == '>' || condition[5] == '<'))
         {
-            struct ext4_dir_entry_2 * dir_entry = (*dir_entries) + current_entry;
-            ext4_dir_entry_2_new(dir_entry, block_data + pointer, 1);
-            if (dir_entry->inode)
-                current_entry += 1;
-            else
-                free(dir_entry->name);
-            pointer += dir_entry->rec_len;
+            if (parse_filter_value(condition + 6, 1, &value) || value > UINT32_MAX) return 1;
+            if (condition[5] == '>' && value < UINT32_MAX) filter->min_mtime = value + 1;
+            else if (condition[5] == '<' && value) filter->max_mtime = value - 1;
+            else return 1;
         }
+        else return 1;
     }
     return 0;
 }
 
-int find_path_in_directory(FILE * file, struct SuperBlock * superBlock, struct InodeTable * current_directory,
-        char * file_name, struct ext4_dir_entry_2 * found_dir_entry)
-/// attempts to find a dir_entry of given name
-/// returned through struct ext4_dir_entry_2 * found_dir_entry
-{
-    struct ext4_dir_entry_2 * dir_entries;
-    uint64_t file_name_len = strlen(file_name);
-    uint64_t elements_count;
-    get_directory_list(file, superBlock, current_directory, &dir_entries, &elements_count);
-    uint8_t found_dir = 0;
-    for (uint64_t i = 0; i < elements_count; ++i)
-    {
-        if (dir_entries[i].name_len == file_name_len && strncmp(file_name, dir_entries[i].name, dir_entries[i].name_len) == 0)
-        {
-            memcpy(found_dir_entry, dir_entries + i, sizeof(struct ext4_dir_entry_2));
-            found_dir = 1;
-        }
-        else
-            free(dir_entries[i].name);
-    }
-    return !found_dir;
-}
-
-void print_bytes(u_char * bytes, uint64_t len, uint64_t index_offset)
-/// prints len given bytes from array as hex byte values
-{
-    const static uint8_t ROW_LEN = 16;
-    uint64_t i;
-    for (i = 0; i < len; ++i)
-    {
-        if (i % ROW_LEN == 0)
-//            printf("0x%08" PRIx64 "`0x%08" PRIx64 " ", ((index_offset + i) >> 32u ) << 32u, ((index_offset + i) << 32u ) >> 32u);
-            printf("0x%08" PRIx64 "`%08" PRIx64 " ", (index_offset + i) & 0xFFFFFFFF00000000, (index_offset + i) & 0x00000000FFFFFFFF);
-
-        printf("%02x ", (u_char)bytes[i]);
-        if (i % ROW_LEN == ROW_LEN - 1)
-            printf("\n");
-    }
-    if (i % ROW_LEN != ROW_LEN - 1)
-        printf("\n");
-}
-
-void shell(FILE * file, struct SuperBlock * superBlock)
+void shell(struct Ext4Fs * fs)
+/// interactive shell, a thin client of the reader handle; commands built on lower level modules use the handle's FILE
 {
     static const uint MAX_INPUT_SIZE = 512;
+    static const uint64_t CAT_CHUNK_BLOCKS = 256;  // file content read by a single Ext4Fs_pread call
     char buffer[MAX_INPUT_SIZE];
-    static uint64_t root_inode_id = 2;  // 2 is always root directory
-    uint64_t current_inode_id = root_inode_id;
-    struct InodeTable current_directory;
-    if (load_inode_table(file, superBlock, &current_directory, root_inode_id))
-    {
-        printf("Error loading root directory");
-        return;
-    }
+    struct SuperBlock * superBlock = Ext4Fs_super_block(fs);
+    const char * image_path = Ext4Fs_image_path(fs);
+    uint64_t current_inode_id = ROOT_INODE_ID;
+    FILE * file = Ext4Fs_file(fs);
+    // metadata index lives next to the image, it is used for ls, find and stat when it matches the image
+    char * index_path = malloc(strlen(image_path) + 5);
+    sprintf(index_path, "%s.idx", image_path);
+    struct MetadataIndex index;
+    int index_status = MetadataIndex_open(&index, index_path, superBlock);
+    // block owner map lives next to the image as well, it is only loaded when it matches the image
+    char * rmap_path = malloc(strlen(image_path) + 6);
+    sprintf(rmap_path, "%s.rmap", image_path);
+    struct Rmap rmap;
+    int rmap_status = Rmap_open(&rmap, rmap_path, superBlock);
+    // inode -> path index is kept in memory only, built on demand
+    struct PathIndex paths;
+    int paths_status = 1;
+    if (index_status == 0)
+        printf("Using metadata index %s\n", index_path);
+    else if (index_status == 2)
+        printf("Metadata index %s is out of date, ignoring it\n", index_path);
     while (1)
     {
+        Arena_reset(&thread_arena);  // drops scratch memory of the previous command
         printf("> ");
-        fgets(buffer, MAX_INPUT_SIZE, stdin);
+        if (fgets(buffer, MAX_INPUT_SIZE, stdin) == NULL)
+            break;
         if ((strlen(buffer) > 0) && (buffer[strlen (buffer) - 1] == '\n'))  // strip \n if there is one
             buffer[strlen (buffer) - 1] = '\0';
 
         if (strcmp(buffer, "cd") == 0)
-        {
-            if (shell_load_directory(file, superBlock, &current_directory, &current_inode_id, root_inode_id))
-                return;
-        }
+            current_inode_id = ROOT_INODE_ID;
         else if (strncmp(buffer, "cd ", 3) == 0)
         {
-            struct ext4_dir_entry_2 found_entry;
-            if (find_path_in_directory(file, superBlock, &current_directory, buffer + 3, &found_entry))
+            uint64_t inode_id;
+            struct InodeStat inodeStat;
+            int err = Ext4Fs_resolve(fs, current_inode_id, buffer + 3, 1, &inode_id);
+            if (err || Ext4Fs_stat(fs, inode_id, &inodeStat, NULL))
             {
-                printf("No such directory as \"%s\"\n", buffer + 3);
+                printf(err == 2 ? "Too many levels of symbolic links in \"%s\"\n" : "No such directory as \"%s\"\n",
+                       buffer + 3);
                 continue;
             }
-            if (!(found_entry.file_type & DEFT_DIRECTORY))
+            if ((inodeStat.mode & 0xF000u) != S_IFDIR)
             {
                 printf("\"%s\" is not a directory\n", buffer + 3);
                 continue;
             }
-            if (shell_load_directory(file, superBlock, &current_directory, &current_inode_id, found_entry.inode))
-                return;
-            free(found_entry.name);
+            current_inode_id = inode_id;
         }
-        else if (strcmp(buffer, "ls") == 0)
+        else if (strcmp(buffer, "ls") == 0 && index_status == 0)
         {
-            struct ext4_dir_entry_2 * dir_entries;
+            struct MetadataIndexEntry * entries;
             uint64_t elements_count;
-            get_directory_list(file, superBlock, &current_directory, &dir_entries, &elements_count);
+            MetadataIndex_list_directory(&index, current_inode_id, &entries, &elements_count);
+            struct MetadataIndexNode * node = MetadataIndex_find_node(&index, current_inode_id);
             printf("type\tinode\tname\n");
+            printf("d\t%8" PRIu64 "\t.\n", current_inode_id);
+            if (node)
+                printf("d\t%8" PRIu32 "\t..\n", node->parent);
+            // symlink targets are not in the index, they are read from the image (through the handle caches)
+            char target[SYMLINK_MAX_TARGET];
             for (uint64_t i = 0; i < elements_count; ++i)
             {
-                char file_type;
-                if (dir_entries[i].file_type & DEFT_REGULAR) file_type = 'f';
-                else if (dir_entries[i].file_type & DEFT_DIRECTORY) file_type = 'd';
-                else file_type = '?';
-                printf("%c\t%8" PRIu32 "\t%.*s\n", file_type, dir_entries[i].inode, dir_entries[i].name_len, dir_entries[i].name);
-                free(dir_entries[i].name);
+                int is_link = entries[i].file_type == DEFT_SYMLINK
+                              && Ext4Fs_readlink(fs, entries[i].inode, target, sizeof(target)) == 0;
+                printf("%c\t%8" PRIu32 "\t%.*s%s%s\n", dir_entry_type_char(entries[i].file_type), entries[i].inode,
+                       entries[i].name_len, MetadataIndexEntry_name(&index, entries + i), is_link ? " -> " : "",
+                       is_link ? target : "");
+            }
+        }
+        else if (strcmp(buffer, "ls") == 0)
+        {
+            struct InodeStat inodeStat;
+            struct Ext4Dir * dir;
+            if (Ext4Fs_stat(fs, current_inode_id, &inodeStat, NULL) || Ext4Fs_opendir(fs, current_inode_id, &dir))
+            {
+                printf("Error loading directory\n");
+                continue;
+            }
+            if (inodeStat.flags & EXT4_INDEX_FL) printf("HASH TREE DIRECTORY\n");
+            printf("type\tinode\tname\n");
+            struct Ext4DirEntry entry;
+            char target[SYMLINK_MAX_TARGET];
+            while (Ext4Dir_read(dir, &entry) == 0)
+            {
+                int is_link = entry.file_type == DEFT_SYMLINK
+                              && Ext4Fs_readlink(fs, entry.inode, target, sizeof(target)) == 0;
+                printf("%c\t%8" PRIu32 "\t%s%s%s\n", dir_entry_type_char(entry.file_type), entry.inode, entry.name,
+                       is_link ? " -> " : "", is_link ? target : "");
             }
-            free(dir_entries);
+            Ext4Dir_close(dir);
         }
         else if (strcmp(buffer, "cat") == 0)
             printf("Please provide file name\n");
         else if (strncmp(buffer, "cat ", 4) == 0)
         {
-            struct ext4_dir_entry_2 found_entry;
-            if (find_path_in_directory(file, superBlock, &current_directory, buffer + 4, &found_entry))
+            uint64_t inode_id;
+            struct InodeStat inodeStat;
+            int err = Ext4Fs_resolve(fs, current_inode_id, buffer + 4, 1, &inode_id);
+            if (err || Ext4Fs_stat(fs, inode_id, &inodeStat, NULL))
             {
-                printf("No such file as \"%s\"\n", buffer + 4);
+                printf(err == 2 ? "Too many levels of symbolic links in \"%s\"\n" : "No such file as \"%s\"\n",
+                       buffer + 4);
                 continue;
             }
-            else if (!(found_entry.file_type & DEFT_REGULAR))
+            else if ((inodeStat.mode & 0xF000u) != S_IFREG)
             {
                 printf("\"%s\" is not a regular file\n", buffer + 4);
                 continue;
             }
-            struct InodeTable inode;
-            if (load_inode_table(file, superBlock, &inode, found_entry.inode))
+            struct cat_ctx cat = {superBlock->s_block_size, 0};
+            uint64_t chunk_size = CAT_CHUNK_BLOCKS * superBlock->s_block_size, read_length;
+            u_char * chunk = malloc(chunk_size);
+            for (uint64_t offset = 0; offset < inodeStat.size; offset += read_length)
+            {
+                if (Ext4Fs_pread(fs, inode_id, chunk, chunk_size, offset, &read_length) || read_length == 0)
+                {
+                    printf("Error reading file content\n");
+                    break;
+                }
+                print_page(&cat, chunk, read_length);
+            }
+            free(chunk);
+        }
+        else if ((strcmp(buffer, "stats") == 0 || strcmp(buffer, "stats reset") == 0
+                  || strncmp(buffer, "trace ", 6) == 0) && !stats_enabled())
+            printf("Statistics are compiled out, rebuild with cmake -DENABLE_STATS=ON\n");
+        else if (strcmp(buffer, "stats") == 0)
+            stats_print(stdout);
+        else if (strcmp(buffer, "stats reset") == 0)
+            stats_reset();
+        else if (strcmp(buffer, "trace off") == 0)
+            stats_trace_stop();
+        else if (strncmp(buffer, "trace ", 6) == 0)
+        {
+            if (stats_trace_start(buffer + 6))
+                printf("Error opening trace file %s\n", buffer + 6);
+            else
+                printf("Writing trace events into %s\n", buffer + 6);
+        }
+        else if (strncmp(buffer, "readahead ", 10) == 0)
+        {
+            leaf_prefetch_blocks = strtoull(buffer + 10, NULL, 10);
+            printf("Prefetching %" PRIu64 " blocks of every leaf extent\n", leaf_prefetch_blocks);
+        }
+        else if (strcmp(buffer, "index build") == 0)
+        {
+            if (index_status == 0)
+                MetadataIndex_close(&index);
+            if (MetadataIndex_build(file, superBlock, index_path))
+                printf("Error building metadata index\n");
+            index_status = MetadataIndex_open(&index, index_path, superBlock);
+            if (index_status == 0)
+                printf("Indexed %" PRIu64 " entries, %" PRIu64 " inodes, %" PRIu64 " extent runs into %s\n",
+                       index.header->entry_count, index.header->node_count, index.header->extent_count, index_path);
+        }
+        else if (strcmp(buffer, "index") == 0)
+        {
+            if (index_status == 0)
+                printf("Metadata index %s: %" PRIu64 " entries, %" PRIu64 " inodes, %" PRIu64 " extent runs\n", index_path,
+                       index.header->entry_count, index.header->node_count, index.header->extent_count);
+            else
+                printf("No metadata index loaded, use \"index build\" to create one\n");
+        }
+        else if (strncmp(buffer, "rmap build", 10) == 0 && (buffer[10] == '\0' || buffer[10] == ' '))
+        {
+            uint64_t budget_mb = buffer[10] ? strtoull(buffer + 11, NULL, 10) : RMAP_DEFAULT_MEMORY_BUDGET >> 20u;
+            if (rmap_status == 0)
+                Rmap_close(&rmap);
+            if (Rmap_build(image_path, superBlock, rmap_path, budget_mb << 20u, 0))
+                printf("Error building block owner map\n");
+            rmap_status = Rmap_open(&rmap, rmap_path, superBlock);
+            if (rmap_status == 0)
+                printf("Mapped %" PRIu64 " block intervals into %s\n", rmap.header->interval_count, rmap_path);
+        }
+        else if (strncmp(buffer, "rmap ", 5) == 0)
+        {
+            uint64_t first_block, last_block;
+            char * end;
+            if (rmap_status != 0)
+            {
+                printf(rmap_status == 2 ? "Block owner map %s is out of date, use \"rmap build\" to rebuild it\n"
+                                        : "No block owner map %s, use \"rmap build\" to create one\n", rmap_path);
+                continue;
+            }
+            if (strncmp(buffer + 5, "bytes ", 6) == 0)
+            {
+                uint64_t offset = strtoull(buffer + 11, &end, 10);
+                uint64_t length = *end ? strtoull(end, NULL, 10) : 1;
+                first_block = offset / superBlock->s_block_size;
+                last_block = (offset + (length ? length : 1) - 1) / superBlock->s_block_size;
+            }
+            else
+            {
+                first_block = strtoull(buffer + 5, &end, 10);
+                last_block = *end == '-' ? strtoull(end + 1, NULL, 10) : first_block;
+            }
+            if (last_block < first_block || last_block >= superBlock->s_blocks_count_u64)
+            {
+                printf("Block range outside of the file system (%" PRIu64 " blocks)\n", superBlock->s_blocks_count_u64);
+                continue;
+            }
+            print_block_owners(&rmap, index_status == 0 ? &index : NULL, paths_status == 0 ? &paths : NULL, first_block, last_block);
+        }
+        else if (strcmp(buffer, "paths build") == 0)
+        {
+            if (paths_status == 0)
+                PathIndex_free(&paths);
+            paths_status = 0;
+            if (PathIndex_build(file, superBlock, 0, &paths))
+                printf("Error reading some of the directories, paths of their entries are missing\n");
+            if (paths.slots == NULL)
+                paths_status = 1;
+            else
+                printf("Indexed parents of %" PRIu64 " inodes from %" PRIu64 " directories, %" PRIu64 " bytes of names\n",
+                       paths.linked_inodes, paths.directories, paths.names_size);
+        }
+        else if (strncmp(buffer, "path ", 5) == 0)
+        {
+            if (paths_status != 0)
+            {
+                printf("No path index loaded, use \"paths build\" to create one\n");
+                continue;
+            }
+            char * pointer = buffer + 5, * end;
+            char path[PATH_MAX];
+            for (uint64_t inode_id = strtoull(pointer, &end, 10); end != pointer; inode_id = strtoull(pointer, &end, 10))
+            {
+                pointer = end;
+                if (PathIndex_path(&paths, inode_id, path, sizeof(path)))
+                    printf("%" PRIu64 "\t<not linked>\n", inode_id);
+                else
+                    printf("%" PRIu64 "\t%s\n", inode_id, path);
+            }
+        }
+        else if (strcmp(buffer, "frag-report") == 0 || strncmp(buffer, "frag-report json ", 17) == 0
+                 || strncmp(buffer, "frag-report csv ", 16) == 0)
+        {
+            struct FragReport report;
+            int err = FragReport_build(file, image_path, superBlock, ROOT_INODE_ID, "", 0, &report);
+            if (err)
+                printf("Error reading some of the file system, report is incomplete\n");
+            if (buffer[11] == '\0')
+                FragReport_print_summary(&report, stdout);
+            else if (buffer[12] == 'c')
+            {
+                if (FragReport_write_csv(&report, buffer + 16))
+                    printf("Error writing report\n");
+                else
+                    printf("Report written into %s.files.csv, %s.dirs.csv and %s.groups.csv\n", buffer + 16,
+                           buffer + 16, buffer + 16);
+            }
+            else
+            {
+                FILE * out = fopen(buffer + 17, "w");
+                if (out == NULL || FragReport_write_json(&report, out))
+                    printf("Error writing report into %s\n", buffer + 17);
+                else
+                    printf("Report written into %s\n", buffer + 17);
+                if (out)
+                    fclose(out);
+            }
+            FragReport_free(&report);
+        }
+        else if (strcmp(buffer, "filter") == 0 || strncmp(buffer, "filter ", 7) == 0)
+        {
+            struct InodeFilter filter;
+            struct InodeRecord * records;
+            uint64_t records_count;
+            if (parse_inode_filter(buffer + 6, &filter))
+            {
+                printf("Usage: filter [size>N] [size<N] [mtime>T] [mtime<T] [type=f|d|l]"
+                       " (N with K/M/G/T suffix, T as seconds or YYYY-MM-DD)\n");
+                continue;
+            }
+            if (scan_inode_filter(image_path, superBlock, 0, &filter, &records, &records_count))
+                printf("Error reading some of the inode tables, results are incomplete\n");
+            printf("inode\ttype\tsize\tmtime\tpath\n");
+            for (uint64_t i = 0; i < records_count; ++i)
             {
-                printf("Error loading inode %" PRIu32 "\n", found_entry.inode);
+                char formatted[32];
+                time_t time = records[i].mtime;
+                strftime(formatted, sizeof(formatted), "%Y-%m-%d %H:%M:%S", gmtime(&time));
+                uint16_t file_format = records[i].mode & 0xF000u;
+                char path_buffer[PATH_MAX];
+                const char * path = indexed_path(index_status == 0 ? &index : NULL, paths_status == 0 ? &paths : NULL,
+                                                 records[i].inode, path_buffer, sizeof(path_buffer));
+                printf("%" PRIu32 "\t%c\t%" PRIu64 "\t%s\t%s\n", records[i].inode,
+                       file_format == S_IFREG ? 'f' : file_format == S_IFDIR ? 'd' : file_format == S_IFLNK ? 'l' : '?',
+                       records[i].size, formatted, path ? path : "");
+            }
+            printf("%" PRIu64 " matches\n", records_count);
+            free(records);
+        }
+        else if (strncmp(buffer, "export ", 7) == 0)
+        {
+            if (export_columnar(file, image_path, superBlock, 0, buffer + 7) == 0)
+                printf("Metadata exported into %s\n", buffer + 7);
+        }
+        else if (strcmp(buffer, "partitions") == 0)
+        {
+            if (print_partitions(image_path, stdout))
+                printf("No partition table, the image is the file system itself\n");
+        }
+        else if (strncmp(buffer, "diff ", 5) == 0)
+        {
+            int full = strncmp(buffer + 5, "--full ", 7) == 0;
+            const char * other_path = buffer + (full ? 12 : 5);
+            struct Ext4Fs * other;
+            if (Ext4Fs_open(&other, other_path, NULL) == 0)
+            {
+                diff_images(file, superBlock, Ext4Fs_file(other), Ext4Fs_super_block(other), 0, full, stdout);
+                Ext4Fs_close(other);
+            }
+        }
+        else if (strncmp(buffer, "find ", 5) == 0)
+        {
+            struct find_ctx find = {buffer + 5, 0};
+            if (index_status == 0)
+            {
+                for (uint64_t i = 0; i < index.header->entry_count; ++i)
+                {
+                    struct MetadataIndexEntry * entry = index.entries + i;
+                    char name[256];
+                    memcpy(name, MetadataIndexEntry_name(&index, entry), entry->name_len);
+                    name[entry->name_len] = '\0';
+                    if (fnmatch(find.pattern, name, 0) == 0)
+                    {
+                        printf("%s\n", MetadataIndexEntry_path(&index, entry));
+                        find.found += 1;
+                    }
+                }
+            }
+            else
+                walk_directory_tree(file, superBlock, ROOT_INODE_ID, print_if_name_matches, &find, NULL);
+            printf("%" PRIu64 " matches\n", find.found);
+        }
+        else if (strncmp(buffer, "getfattr ", 9) == 0)
+        {
+            uint64_t inode_id;
+            struct Xattr * xattrs;
+            uint64_t xattrs_count;
+            if (Ext4Fs_lookup(fs, current_inode_id, buffer + 9, &inode_id))
+            {
+                printf("No such file as \"%s\"\n", buffer + 9);
                 continue;
             }
-            uint64_t * blocks;
-            uint64_t block_count;
-            if (get_inode_block_list(file, superBlock, &inode, &blocks, &block_count))
+            if (Ext4Fs_get_xattrs(fs, inode_id, &xattrs, &xattrs_count))
             {
-                printf("Error getting inode block list\n");
+                printf("Error reading extended attributes of inode %" PRIu64 "\n", inode_id);
                 continue;
             }
-            uint64_t bytes_read = 0;
-            uint64_t bytes_left_to_read = inode.i_size_u64;
-            u_char * block_bytes = malloc(sizeof(u_char) * superBlock->s_block_size);
-            for (uint64_t i = 0; i < block_count; ++i)
+            printf("# file: %s\n", buffer + 9);
+            for (uint64_t i = 0; i < xattrs_count; ++i)
             {
-                read_block(file, superBlock->s_block_size, blocks[i], (char *)block_bytes);
-                uint64_t bytes_to_read = (bytes_left_to_read > superBlock->s_block_size) ? superBlock->s_block_size : bytes_left_to_read;
-                printf("Page %" PRIu64 "\n", i);
-                print_bytes(block_bytes, bytes_to_read, bytes_read);
-                bytes_left_to_read -= bytes_to_read;
-                bytes_read += bytes_to_read;
+                char * value = format_xattr_value(xattrs + i);
+                printf("%s=%s\n", xattrs[i].name, value);
+                free(value);
             }
-            uint8_t a = 1;
+            Xattrs_free(xattrs, xattrs_count);
+        }
+        else if (strncmp(buffer, "stat ", 5) == 0)
+        {
+            uint64_t inode_id;
+            struct InodeStat inodeStat;
+            uint64_t extent_count;
+            if (index_status == 0)
+            {
+                struct MetadataIndexNode * node;
+                if (MetadataIndex_resolve_path(&index, file, superBlock, current_inode_id, buffer + 5, 0, &inode_id)
+                    || (node = MetadataIndex_find_node(&index, inode_id)) == NULL)
+                {
+                    printf("No such file as \"%s\"\n", buffer + 5);
+                    continue;
+                }
+                inodeStat = node->stat;
+                extent_count = node->extent_count;
+            }
+            else
+            {
+                if (Ext4Fs_lookup(fs, current_inode_id, buffer + 5, &inode_id))
+                {
+                    printf("No such file as \"%s\"\n", buffer + 5);
+                    continue;
+                }
+                if (Ext4Fs_stat(fs, inode_id, &inodeStat, &extent_count))
+                {
+                    printf("Error loading inode %" PRIu64 "\n", inode_id);
+                    continue;
+                }
+            }
+            // a symlink is described itself, with its target next to the path
+            char label[2 * SYMLINK_MAX_TARGET];
+            char target[SYMLINK_MAX_TARGET];
+            if ((inodeStat.mode & 0xF000u) == S_IFLNK && Ext4Fs_readlink(fs, inode_id, target, sizeof(target)) == 0)
+                snprintf(label, sizeof(label), "%s -> %s", buffer + 5, target);
+            else
+                snprintf(label, sizeof(label), "%s", buffer + 5);
+            print_inode_stat(label, &inodeStat, extent_count);
         }
         else if (strcmp(buffer, "exit") == 0)
             break;
         else
             printf("error unknown command \"%s\"\n", buffer);
     }
+    if (index_status == 0)
+        MetadataIndex_close(&index);
+    if (rmap_status == 0)
+        Rmap_close(&rmap);
+    if (paths_status == 0)
+        PathIndex_free(&paths);
+    free(rmap_path);
+    stats_trace_stop();
+    free(index_path);
+    Arena_free(&thread_arena);
     printf("Bye\n");
 }
 
 int main(int argc, char ** argv) {
-    if (argc != 2)
+    const char * batch_path = NULL;  // batch mode runs commands from file instead of the shell
+    const char * recover_dir = NULL;
+    const char * export_path = NULL;  // export mode writes columnar metadata export and exits
+    const char * partition = NULL;  // partition of a whole disk image, first one holding ext4 when not given
+    const char * diff_path = NULL;  // diff mode compares the image with another snapshot of it and exits
+    int full_diff = 0;
+    int undelete_scan_mode = 0;
+    uint64_t jobs = 0;
+    int usage = argc < 2;
+    for (int i = 2; i < argc && !usage; ++i)
+    {
+        if (strcmp(argv[i], "--undelete-scan") == 0)
+            undelete_scan_mode = 1;
+        else if (strcmp(argv[i], "--full") == 0)
+            full_diff = 1;
+        else if (i + 1 == argc)
+            usage = 1;  // remaining options take a value
+        else if (strcmp(argv[i], "--batch") == 0)
+            batch_path = argv[++i];
+        else if (strcmp(argv[i], "--jobs") == 0)
+            jobs = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--recover") == 0)
+            recover_dir = argv[++i];
+        else if (strcmp(argv[i], "--export") == 0)
+            export_path = argv[++i];
+        else if (strcmp(argv[i], "--diff") == 0)
+            diff_path = argv[++i];
+        else if (strcmp(argv[i], "--partition") == 0)
+            partition = argv[++i];
+        else
+            usage = 1;
+    }
+    if (usage || (batch_path != NULL) + undelete_scan_mode + (export_path != NULL) + (diff_path != NULL) > 1
+        || (recover_dir && !undelete_scan_mode) || (full_diff && !diff_path))
+    {
+        printf("Usage: ext4_binary_read <path/to/binary/image> [--batch <commands file or -> [--jobs <n>]]\n"
+               "       ext4_binary_read <path/to/binary/image> --undelete-scan [--recover <dir>] [--jobs <n>]\n"
+               "       ext4_binary_read <path/to/binary/image> --export <columnar file> [--jobs <n>]\n"
+               "       ext4_binary_read <path/to/binary/image A> --diff <path/to/binary/image B> [--full] [--jobs <n>]\n"
+               "       any mode takes --partition <n> to read partition n of a whole disk image\n");
+        return 1;
+    }
+    char * image_path = malloc(strlen(argv[1]) + (partition ? strlen(partition) + 2 : 1));
+    if (partition)
+        sprintf(image_path, "%s#%s", argv[1], partition);
+    else
+        strcpy(image_path, argv[1]);
+    struct Ext4Fs * fs;
+    if (Ext4Fs_open(&fs, image_path, NULL))
     {
-        printf("Usage: ext4_binary_read <path/to/binary/image>\n");
+        print_partitions(image_path, stdout);  // lists what there is to pick from when the disk is partitioned
+        free(image_path);
         return 1;
     }
-    FILE * file;
-    errno = 0;
-    file = fopen(argv[1], "r");
-    if (file == NULL)
+    free(image_path);
+    struct SuperBlock * superBlock = Ext4Fs_super_block(fs);
+    if (batch_path || undelete_scan_mode)
+    {
+        int err = batch_path ? run_batch(Ext4Fs_file(fs), superBlock, batch_path, jobs, stdout)
+                             : undelete_scan(Ext4Fs_image_path(fs), superBlock, jobs, recover_dir, stdout);
+        Ext4Fs_close(fs);
+        return err;
+    }
+    if (diff_path)
+    {
+        struct Ext4Fs * other;
+        int err = Ext4Fs_open(&other, diff_path, NULL);
+        if (!err)
+        {
+            err = diff_images(Ext4Fs_file(fs), superBlock, Ext4Fs_file(other), Ext4Fs_super_block(other), jobs,
+                              full_diff, stdout);
+            Ext4Fs_close(other);
+        }
+        Ext4Fs_close(fs);
+        return err;
+    }
+    if (export_path)
     {
-        fprintf(stderr, "error opening device_file errno=%d\n", errno);
-        exit(1);
+        int err = export_columnar(Ext4Fs_file(fs), Ext4Fs_image_path(fs), superBlock, jobs, export_path);
+        Ext4Fs_close(fs);
+        return err;
     }
-    struct SuperBlock superBlock;
-    load_super_block(file, &superBlock);
 
-    if (superBlock.s_feature_incompat & REQUIRED_FEATURE_FLEX_BLOCK_GROUPS) printf("SYSTEM USES FLEX GROUPS\n");
-    if (superBlock.s_feature_incompat & REQUIRED_FEATURE_64BIT) printf("SYSTEM USES 64BIT FEATURE\n");
-    if (superBlock.s_feature_incompat & INCOMPAT_FILETYPE) printf("INCOMPAT_FILETYPE filesystem uses ext4_dir_entry_2\n");
-    if (superBlock.s_feature_incompat & INCOMPAT_DIRDATA) printf("INCOMPAT_DIRDATA\n");
+    if (strcmp(image_format_name(Ext4Fs_file(fs)), "raw") != 0)
+        printf("IMAGE IS READ FROM %s CONTAINER\n", image_format_name(Ext4Fs_file(fs)));
+    if (image_partition_of(Ext4Fs_file(fs))) printf("IMAGE PARTITION %" PRIu32 "\n", image_partition_of(Ext4Fs_file(fs)));
+    if (superBlock->s_feature_incompat & REQUIRED_FEATURE_FLEX_BLOCK_GROUPS) printf("SYSTEM USES FLEX GROUPS\n");
+    if (superBlock->s_feature_incompat & REQUIRED_FEATURE_64BIT) printf("SYSTEM USES 64BIT FEATURE\n");
+    if (superBlock->s_feature_incompat & INCOMPAT_FILETYPE) printf("INCOMPAT_FILETYPE filesystem uses ext4_dir_entry_2\n");
+    if (superBlock->s_feature_incompat & INCOMPAT_DIRDATA) printf("INCOMPAT_DIRDATA\n");
 
-    shell(file, &superBlock);
-    fclose(file);
+    shell(fs);
+    Ext4Fs_close(fs);
     return 0;
 }
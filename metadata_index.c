@@ -0,0 +1,364 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#define _GNU_SOURCE
+// must come before fcntl.h, which defines file mode macros named like inode_table.h constants
+#include "metadata_index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct index_builder {
+    FILE * file;
+    struct SuperBlock * superBlock;
+    u_char * seen;  // bitmap of inodes already added to nodes table
+    struct MetadataIndexNode * nodes;
+    uint64_t node_count, node_capacity;
+    struct MetadataIndexEntry * entries;
+    uint64_t entry_count, entry_capacity;
+    struct ExtentRun * extents;
+    uint64_t extent_count, extent_capacity;
+    char * strings;
+    uint64_t strings_size, strings_capacity;
+};
+
+void * grow_array(void * array, uint64_t * capacity, uint64_t needed, uint64_t element_size)
+/// makes sure array can hold needed elements
+{
+    if (needed <= *capacity) return array;
+    while (*capacity < needed)
+        *capacity = *capacity ? *capacity * 2 : 64;
+    return realloc(array, *capacity * element_size);
+}
+
+int index_builder_add_node(struct index_builder * builder, uint64_t inode_id, uint64_t parent_inode_id)
+/// loads inode and its extent runs into nodes table, every inode is added only once
+{
+    if (inode_id == 0 || inode_id > builder->superBlock->s_inodes_count) return 1;
+    if (builder->seen[inode_id / 8] & (1u << (inode_id % 8))) return 0;
+    builder->seen[inode_id / 8] |= 1u << (inode_id % 8);
+
+    struct InodeTable inodeTable;
+    if (load_inode_table(builder->file, builder->superBlock, &inodeTable, inode_id))
+    {
+        fprintf(stderr, "Error loading inode %" PRIu64 "\n", inode_id);
+        return 1;
+    }
+    struct ExtentRun * runs;
+    uint64_t runs_count;
+    if (get_inode_extent_runs(builder->file, builder->superBlock, &inodeTable, &runs, &runs_count))
+    {
+        fprintf(stderr, "Error reading extents of inode %" PRIu64 "\n", inode_id);
+        runs = NULL;
+        runs_count = 0;
+    }
+    builder->nodes = grow_array(builder->nodes, &builder->node_capacity, builder->node_count + 1,
+                                sizeof(struct MetadataIndexNode));
+    struct MetadataIndexNode * node = builder->nodes + builder->node_count++;
+    InodeStat_new(&node->stat, &inodeTable, inode_id);
+    node->parent = parent_inode_id;
+    node->extent_count = runs_count;
+    node->extent_first = builder->extent_count;
+    builder->extents = grow_array(builder->extents, &builder->extent_capacity, builder->extent_count + runs_count,
+                                  sizeof(struct ExtentRun));
+    if (runs_count)
+        memcpy(builder->extents + builder->extent_count, runs, sizeof(struct ExtentRun) * runs_count);
+    builder->extent_count += runs_count;
+    free(runs);
+    return 0;
+}
+
+int index_builder_add_entry(void * ctx, uint64_t parent_inode_id, struct ext4_dir_entry_2 * dir_entry,
+        const char * path, uint64_t path_len)
+{
+    struct index_builder * builder = ctx;
+    builder->strings = grow_array(builder->strings, &builder->strings_capacity, builder->strings_size + path_len + 1, 1);
+    memcpy(builder->strings + builder->strings_size, path, path_len + 1);
+    builder->entries = grow_array(builder->entries, &builder->entry_capacity, builder->entry_count + 1,
+                                  sizeof(struct MetadataIndexEntry));
+    struct MetadataIndexEntry * entry = builder->entries + builder->entry_count++;
+    memset(entry, 0, sizeof(struct MetadataIndexEntry));
+    entry->parent = parent_inode_id;
+    entry->inode = dir_entry->inode;
+    entry->path_offset = builder->strings_size;
+    entry->path_len = path_len;
+    entry->name_len = dir_entry->name_len;
+    entry->file_type = dir_entry->file_type;
+    builder->strings_size += path_len + 1;
+    index_builder_add_node(builder, dir_entry->inode, parent_inode_id);
+    return 0;
+}
+
+int index_node_compare(const void * a, const void * b)
+{
+    uint32_t inode_a = ((const struct MetadataIndexNode *)a)->stat.inode;
+    uint32_t inode_b = ((const struct MetadataIndexNode *)b)->stat.inode;
+    return (inode_a > inode_b) - (inode_a < inode_b);
+}
+
+int compare_names(const char * name_a, uint64_t len_a, const char * name_b, uint64_t len_b)
+{
+    int result = memcmp(name_a, name_b, len_a < len_b ? len_a : len_b);
+    if (result) return result;
+    return (len_a > len_b) - (len_a < len_b);
+}
+
+int index_entry_compare(const void * a, const void * b, void * strings)
+/// orders entries by parent inode, then by name
+{
+    const struct MetadataIndexEntry * entry_a = a, * entry_b = b;
+    if (entry_a->parent != entry_b->parent)
+        return (entry_a->parent > entry_b->parent) - (entry_a->parent < entry_b->parent);
+    const char * name_a = (const char *)strings + entry_a->path_offset + entry_a->path_len - entry_a->name_len;
+    const char * name_b = (const char *)strings + entry_b->path_offset + entry_b->path_len - entry_b->name_len;
+    return compare_names(name_a, entry_a->name_len, name_b, entry_b->name_len);
+}
+
+uint64_t align8(uint64_t value)
+{
+    return (value + 7u) & ~(uint64_t)7u;
+}
+
+int write_padded(FILE * out, const void * data, uint64_t size)
+/// writes data followed by zero padding up to 8 byte boundary
+{
+    static const char padding[8] = {0};
+    if (size && fwrite(data, 1, size, out) != size) return 1;
+    if (align8(size) != size && fwrite(padding, 1, align8(size) - size, out) != align8(size) - size) return 1;
+    return 0;
+}
+
+int MetadataIndex_build(FILE * file, struct SuperBlock * superBlock, const char * index_path)
+/// walks whole directory tree and writes its metadata index into index_path, an index is only written when every
+/// directory was read
+{
+    struct index_builder builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.file = file;
+    builder.superBlock = superBlock;
+    builder.seen = calloc(superBlock->s_inodes_count / 8 + 1, 1);
+    int err = index_builder_add_node(&builder, ROOT_INODE_ID, ROOT_INODE_ID);
+    uint64_t unreadable = 0;
+    if (!err)
+        err = walk_directory_tree(file, superBlock, ROOT_INODE_ID, index_builder_add_entry, &builder, &unreadable);
+    if (!err && unreadable)
+    {
+        // a later session would answer from the index as if the missing subtrees didn't exist
+        fprintf(stderr, "Error %" PRIu64 " directories couldn't be read, index would miss entries below them, "
+                        "not saving it\n", unreadable);
+        err = 1;
+    }
+    if (!err)
+    {
+        qsort(builder.nodes, builder.node_count, sizeof(struct MetadataIndexNode), index_node_compare);
+        qsort_r(builder.entries, builder.entry_count, sizeof(struct MetadataIndexEntry), index_entry_compare,
+                builder.strings);
+
+        struct MetadataIndexHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, METADATA_INDEX_MAGIC, sizeof(header.magic));
+        memcpy(header.uuid, superBlock->s_uuid, sizeof(header.uuid));
+        header.s_wtime = superBlock->s_wtime;
+        header.s_kbytes_written = superBlock->s_kbytes_written;
+        header.node_count = builder.node_count;
+        header.entry_count = builder.entry_count;
+        header.extent_count = builder.extent_count;
+        header.strings_size = builder.strings_size;
+        header.nodes_offset = align8(sizeof(header));
+        header.entries_offset = header.nodes_offset + align8(sizeof(struct MetadataIndexNode) * header.node_count);
+        header.extents_offset = header.entries_offset + align8(sizeof(struct MetadataIndexEntry) * header.entry_count);
+        header.strings_offset = header.extents_offset + align8(sizeof(struct ExtentRun) * header.extent_count);
+
+        // write into temporary file first, so a reader never maps half written index
+        uint64_t tmp_path_len = strlen(index_path) + 5;
+        char * tmp_path = malloc(tmp_path_len);
+        snprintf(tmp_path, tmp_path_len, "%s.tmp", index_path);
+        FILE * out = fopen(tmp_path, "wb");
+        if (out == NULL)
+        {
+            fprintf(stderr, "Error creating index file %s\n", tmp_path);
+            err = 1;
+        }
+        else
+        {
+            err = write_padded(out, &header, sizeof(header))
+                  || write_padded(out, builder.nodes, sizeof(struct MetadataIndexNode) * header.node_count)
+                  || write_padded(out, builder.entries, sizeof(struct MetadataIndexEntry) * header.entry_count)
+                  || write_padded(out, builder.extents, sizeof(struct ExtentRun) * header.extent_count)
+                  || write_padded(out, builder.strings, header.strings_size);
+            if (fclose(out)) err = 1;
+            if (!err && rename(tmp_path, index_path)) err = 1;
+            if (err)
+            {
+                fprintf(stderr, "Error writing index file %s\n", index_path);
+                remove(tmp_path);
+            }
+        }
+        free(tmp_path);
+    }
+    free(builder.seen);
+    free(builder.nodes);
+    free(builder.entries);
+    free(builder.extents);
+    free(builder.strings);
+    return err;
+}
+
+int MetadataIndex_open(struct MetadataIndex * index, const char * index_path, struct SuperBlock * superBlock)
+/// maps index file into memory
+/// returns 1 if there is no usable index file, 2 if index was built for another state of the image
+{
+    memset(index, 0, sizeof(struct MetadataIndex));
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) return 1;
+    off_t file_size = lseek(fd, 0, SEEK_END);
+    if (file_size < 0 || (uint64_t)file_size < sizeof(struct MetadataIndexHeader))
+    {
+        close(fd);
+        return 1;
+    }
+    uint64_t size = file_size;
+    void * map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 1;
+    struct MetadataIndexHeader * header = map;
+    if (memcmp(header->magic, METADATA_INDEX_MAGIC, sizeof(header->magic)) != 0
+        || header->nodes_offset + sizeof(struct MetadataIndexNode) * header->node_count > size
+        || header->entries_offset + sizeof(struct MetadataIndexEntry) * header->entry_count > size
+        || header->extents_offset + sizeof(struct ExtentRun) * header->extent_count > size
+        || header->strings_offset + header->strings_size > size)
+    {
+        munmap(map, size);
+        return 1;
+    }
+    if (memcmp(header->uuid, superBlock->s_uuid, sizeof(header->uuid)) != 0
+        || header->s_wtime != superBlock->s_wtime || header->s_kbytes_written != superBlock->s_kbytes_written)
+    {
+        munmap(map, size);
+        return 2;
+    }
+    index->map = map;
+    index->map_size = size;
+    index->header = header;
+    index->nodes = (struct MetadataIndexNode *)((char *)map + header->nodes_offset);
+    index->entries = (struct MetadataIndexEntry *)((char *)map + header->entries_offset);
+    index->extents = (struct ExtentRun *)((char *)map + header->extents_offset);
+    index->strings = (const char *)map + header->strings_offset;
+    return 0;
+}
+
+void MetadataIndex_close(struct MetadataIndex * index)
+{
+    if (index->map)
+        munmap(index->map, index->map_size);
+    memset(index, 0, sizeof(struct MetadataIndex));
+}
+
+struct MetadataIndexNode * MetadataIndex_find_node(struct MetadataIndex * index, uint64_t inode_id)
+/// binary search for inode in nodes table, NULL if inode isn't indexed
+{
+    uint64_t low = 0, high = index->header->node_count;
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (index->nodes[middle].stat.inode < inode_id) low = middle + 1;
+        else high = middle;
+    }
+    if (low < index->header->node_count && index->nodes[low].stat.inode == inode_id)
+        return index->nodes + low;
+    return NULL;
+}
+
+const char * MetadataIndexEntry_path(struct MetadataIndex * index, struct MetadataIndexEntry * entry)
+{
+    return index->strings + entry->path_offset;
+}
+
+const char * MetadataIndexEntry_name(struct MetadataIndex * index, struct MetadataIndexEntry * entry)
+{
+    return index->strings + entry->path_offset + entry->path_len - entry->name_len;
+}
+
+int MetadataIndex_list_directory(struct MetadataIndex * index, uint64_t inode_id,
+        struct MetadataIndexEntry ** first_entry, uint64_t * entries_count)
+/// returns (through first_entry, entries_count) name ordered entries of given directory
+{
+    uint64_t low = 0, high = index->header->entry_count;
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (index->entries[middle].parent < inode_id) low = middle + 1;
+        else high = middle;
+    }
+    uint64_t end = low;
+    while (end < index->header->entry_count && index->entries[end].parent == inode_id)
+        ++end;
+    *first_entry = index->entries + low;
+    *entries_count = end - low;
+    return 0;
+}
+
+struct index_walk {
+    struct MetadataIndex * index;
+    FILE * file;
+    struct SuperBlock * superBlock;
+};
+
+int index_walk_lookup(void * ctx, uint64_t directory_inode_id, const char * name, uint8_t name_len,
+        uint64_t * inode_id, uint8_t * file_type, char * target, uint64_t target_size)
+/// lookup step of MetadataIndex_resolve_path, entries come from the index with a binary search per component,
+/// only targets of followed symlinks are read from the image (the index keeps no file content)
+{
+    struct index_walk * walk = ctx;
+    struct MetadataIndex * index = walk->index;
+    struct MetadataIndexNode * node = MetadataIndex_find_node(index, directory_inode_id);
+    if (node == NULL || (node->stat.mode & 0xF000u) != S_IFDIR) return 1;
+    // the index holds no "." and ".." entries, parents of directories are in their nodes
+    if ((name_len == 1 && name[0] == '.') || (name_len == 2 && name[0] == '.' && name[1] == '.'))
+    {
+        *inode_id = name_len == 1 ? directory_inode_id : node->parent;
+        *file_type = DEFT_DIRECTORY;
+        return 0;
+    }
+    struct MetadataIndexEntry * entries;
+    uint64_t entries_count;
+    MetadataIndex_list_directory(index, directory_inode_id, &entries, &entries_count);
+    uint64_t low = 0, high = entries_count;
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (compare_names(MetadataIndexEntry_name(index, entries + middle), entries[middle].name_len,
+                          name, name_len) < 0)
+            low = middle + 1;
+        else high = middle;
+    }
+    if (low == entries_count || compare_names(MetadataIndexEntry_name(index, entries + low), entries[low].name_len,
+                                              name, name_len) != 0)
+        return 1;
+    *inode_id = entries[low].inode;
+    *file_type = entries[low].file_type;
+    if (*file_type == DEFT_UNKNOWN)
+    {
+        struct MetadataIndexNode * found = MetadataIndex_find_node(index, *inode_id);
+        if (found == NULL) return 1;
+        *file_type = mode_file_type(found->stat.mode);
+    }
+    if (target == NULL || *file_type != DEFT_SYMLINK) return 0;
+    struct InodeTable inode;
+    if (load_inode_table(walk->file, walk->superBlock, &inode, *inode_id)) return 1;
+    return read_symlink(walk->file, walk->superBlock, &inode, target, target_size);
+}
+
+int MetadataIndex_resolve_path(struct MetadataIndex * index, FILE * file, struct SuperBlock * superBlock,
+        uint64_t start_inode_id, const char * path, int follow_last, uint64_t * inode_id)
+/// same as resolve_path (returns 1 for a missing component, 2 for a symlink loop), but directories are served from
+/// the index, the image is read only for targets of symlinks on the way
+{
+    struct index_walk walk = {index, file, superBlock};
+    return walk_path(index_walk_lookup, &walk, start_inode_id, path, follow_last, inode_id);
+}
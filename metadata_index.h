@@ -0,0 +1,69 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_METADATA_INDEX_H
+#define EXT4_BINARY_READ_METADATA_INDEX_H
+#include "filesystem.h"
+
+// Sidecar file (<image>.idx) holding path -> inode map, inode attributes and extent runs of a whole image.
+// Index is bound to the image by UUID, s_wtime and s_kbytes_written, any of those changing invalidates it.
+// All tables are stored in host byte order at 8 byte aligned offsets, so the file can be used straight from mmap.
+
+static const char METADATA_INDEX_MAGIC[8] = {'E', '4', 'M', 'I', 'D', 'X', '0', '2'};
+
+struct MetadataIndexHeader {
+    char magic[8];
+    u_char uuid[16];  // s_uuid of indexed image
+    u_int32_t s_wtime;  // s_wtime of indexed image
+    u_int32_t reserved;
+    u_int64_t s_kbytes_written;  // s_kbytes_written of indexed image
+    u_int64_t node_count;
+    u_int64_t entry_count;
+    u_int64_t extent_count;
+    u_int64_t strings_size;
+    u_int64_t nodes_offset;  // byte offsets of tables from the beginning of the file
+    u_int64_t entries_offset;
+    u_int64_t extents_offset;
+    u_int64_t strings_offset;
+};
+
+struct MetadataIndexNode {  // one per inode, sorted by inode number
+    struct InodeStat stat;
+    u_int32_t parent;  // inode of directory this inode was first found in
+    u_int32_t extent_count;
+    u_int64_t extent_first;  // position of first run in extents table
+};
+
+struct MetadataIndexEntry {  // one per directory entry, sorted by parent inode and name
+    u_int32_t parent;
+    u_int32_t inode;
+    u_int64_t path_offset;  // full path in strings table, entry name is its last name_len bytes
+    u_int32_t path_len;
+    u_int8_t name_len;
+    u_int8_t file_type;
+    u_int16_t reserved;
+};
+
+struct MetadataIndex {
+    void * map;
+    u_int64_t map_size;
+    struct MetadataIndexHeader * header;
+    struct MetadataIndexNode * nodes;
+    struct MetadataIndexEntry * entries;
+    struct ExtentRun * extents;
+    const char * strings;
+};
+
+int MetadataIndex_build(FILE * file, struct SuperBlock * superBlock, const char * index_path);
+int MetadataIndex_open(struct MetadataIndex * index, const char * index_path, struct SuperBlock * superBlock);
+void MetadataIndex_close(struct MetadataIndex * index);
+struct MetadataIndexNode * MetadataIndex_find_node(struct MetadataIndex * index, u_int64_t inode_id);
+int MetadataIndex_list_directory(struct MetadataIndex * index, u_int64_t inode_id,
+        struct MetadataIndexEntry ** first_entry, u_int64_t * entries_count);
+int MetadataIndex_resolve_path(struct MetadataIndex * index, FILE * file, struct SuperBlock * superBlock,
+        u_int64_t start_inode_id, const char * path, int follow_last, u_int64_t * inode_id);
+const char * MetadataIndexEntry_name(struct MetadataIndex * index, struct MetadataIndexEntry * entry);
+const char * MetadataIndexEntry_path(struct MetadataIndex * index, struct MetadataIndexEntry * entry);
+
+#endif //EXT4_BINARY_READ_METADATA_INDEX_H
@@ -0,0 +1,159 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include "partition_table.h"
+
+#include <string.h>
+
+#define MBR_ENTRIES_OFFSET 446
+#define MBR_ENTRY_SIZE 16
+#define MBR_SECTOR 512
+#define MBR_TYPE_GPT_PROTECTIVE 0xEE
+#define EXT4_MAGIC_OFFSET (1024 + 0x38)
+#define EBR_CHAIN_MAX 1024  // logical partitions followed, guards against looped chains
+
+static inline u_int16_t le16(const u_char * bytes)
+{
+    return bytes[0] | (u_int16_t)(bytes[1] << 8u);
+}
+
+static inline u_int32_t le32(const u_char * bytes)
+{
+    return bytes[0] | (u_int32_t)bytes[1] << 8u | (u_int32_t)bytes[2] << 16u | (u_int32_t)bytes[3] << 24u;
+}
+
+static inline u_int64_t le64(const u_char * bytes)
+{
+    return le32(bytes) | (u_int64_t)le32(bytes + 4) << 32u;
+}
+
+int disk_has_ext4(struct ImageBackend * disk, u_int64_t offset)
+/// ext4 super block magic at given byte offset of the disk
+{
+    u_char magic[2];
+    if (ImageBackend_read(disk, magic, offset + EXT4_MAGIC_OFFSET, 2)) return 0;
+    return le16(magic) == 0xEF53;
+}
+
+static inline int is_extended_type(u_int8_t type)
+{
+    return type == 0x05 || type == 0x0F || type == 0x85;
+}
+
+void add_partition(struct ImageBackend * disk, struct ImagePartition * partitions, u_int64_t * partitions_count,
+        u_int32_t number, u_int64_t offset, u_int64_t size, u_int8_t mbr_type)
+{
+    if (*partitions_count == PARTITIONS_MAX || size == 0) return;
+    struct ImagePartition * partition = partitions + (*partitions_count)++;
+    memset(partition, 0, sizeof(struct ImagePartition));
+    partition->number = number;
+    partition->offset = offset;
+    partition->size = size;
+    partition->mbr_type = mbr_type;
+    partition->ext4 = disk_has_ext4(disk, offset);
+}
+
+int read_gpt(struct ImageBackend * disk, u_int64_t sector_size, struct ImagePartition * partitions,
+        u_int64_t * partitions_count)
+/// reads partition entries of the primary GPT header in LBA 1, returns 1 when there is no such header
+{
+    u_char header[92];
+    if (ImageBackend_read(disk, header, sector_size, sizeof(header)) || memcmp(header, "EFI PART", 8) != 0)
+        return 1;
+    u_int64_t entries_lba = le64(header + 72);
+    u_int64_t entries_count = le32(header + 80), entry_size = le32(header + 84);
+    if (entry_size < 128 || entries_count > 4096) return 1;
+    u_char * entries = malloc(entries_count * entry_size + 1);
+    if (ImageBackend_read(disk, entries, entries_lba * sector_size, entries_count * entry_size))
+    {
+        free(entries);
+        return 1;
+    }
+    static const u_char unused_type[16];
+    for (u_int64_t i = 0; i < entries_count; ++i)
+    {
+        u_char * entry = entries + i * entry_size;
+        if (memcmp(entry, unused_type, 16) == 0) continue;
+        u_int64_t first_lba = le64(entry + 32), last_lba = le64(entry + 40);
+        if (last_lba < first_lba) continue;
+        u_int64_t before = *partitions_count;
+        add_partition(disk, partitions, partitions_count, i + 1, first_lba * sector_size,
+                      (last_lba - first_lba + 1) * sector_size, 0);
+        if (*partitions_count == before) continue;
+        char * name = partitions[before].name;
+        for (u_int64_t c = 0; c < PARTITION_NAME_LENGTH - 1; ++c)
+        {
+            u_int16_t character = le16(entry + 56 + c * 2);
+            if (character == 0) break;
+            name[c] = character < 0x80 ? (char)character : '?';
+        }
+    }
+    free(entries);
+    return 0;
+}
+
+void read_mbr_logical(struct ImageBackend * disk, u_int64_t extended_start, struct ImagePartition * partitions,
+        u_int64_t * partitions_count)
+/// follows the chain of extended boot records, entry 1 of each is a logical partition relative to its EBR and
+/// entry 2 links the next EBR relative to the start of the extended partition
+{
+    u_int64_t ebr = extended_start;
+    for (u_int32_t number = 5; number < 5 + EBR_CHAIN_MAX; ++number)
+    {
+        u_char sector[MBR_SECTOR];
+        if (ImageBackend_read(disk, sector, ebr * MBR_SECTOR, MBR_SECTOR) || sector[510] != 0x55
+            || sector[511] != 0xAA)
+            return;
+        u_char * logical = sector + MBR_ENTRIES_OFFSET, * next = logical + MBR_ENTRY_SIZE;
+        if (le32(logical + 12))
+            add_partition(disk, partitions, partitions_count, number, (ebr + le32(logical + 8)) * MBR_SECTOR,
+                          (u_int64_t)le32(logical + 12) * MBR_SECTOR, logical[4]);
+        if (!is_extended_type(next[4]) || le32(next + 8) == 0) return;
+        ebr = extended_start + le32(next + 8);
+    }
+}
+
+int compare_partitions(const void * a, const void * b)
+{
+    u_int32_t number_a = ((const struct ImagePartition *)a)->number, number_b = ((const struct ImagePartition *)b)->number;
+    return (number_a > number_b) - (number_a < number_b);
+}
+
+int read_partition_table(struct ImageBackend * disk, struct ImagePartition * partitions, u_int64_t * partitions_count,
+        const char ** table_type)
+/// fills up to PARTITIONS_MAX partitions of the disk, returns 1 when the disk has no partition table
+{
+    *partitions_count = 0;
+    *table_type = "none";
+    u_char sector[MBR_SECTOR];
+    if (ImageBackend_read(disk, sector, 0, MBR_SECTOR) || sector[510] != 0x55 || sector[511] != 0xAA)
+        return 1;
+    int protective = 0;
+    for (u_int64_t i = 0; i < 4; ++i)
+        if (sector[MBR_ENTRIES_OFFSET + i * MBR_ENTRY_SIZE + 4] == MBR_TYPE_GPT_PROTECTIVE)
+            protective = 1;
+    if (protective)
+    {
+        *table_type = "gpt";
+        if (read_gpt(disk, 512, partitions, partitions_count) == 0
+            || read_gpt(disk, 4096, partitions, partitions_count) == 0)
+            return 0;
+    }
+    // a file system on the whole disk may keep a stale boot sector in its first 1024 bytes, it wins over the table
+    if (disk_has_ext4(disk, 0)) return 1;
+    *table_type = "mbr";
+    for (u_int32_t i = 0; i < 4; ++i)
+    {
+        u_char * entry = sector + MBR_ENTRIES_OFFSET + i * MBR_ENTRY_SIZE;
+        u_int64_t start = le32(entry + 8), sectors = le32(entry + 12);
+        if (entry[4] == 0 || sectors == 0) continue;
+        if (is_extended_type(entry[4]))
+            read_mbr_logical(disk, start, partitions, partitions_count);
+        else
+            add_partition(disk, partitions, partitions_count, i + 1, start * MBR_SECTOR, sectors * MBR_SECTOR,
+                          entry[4]);
+    }
+    // logical partitions were added where the extended one is, primary ones after it would follow them
+    qsort(partitions, *partitions_count, sizeof(struct ImagePartition), compare_partitions);
+    return 0;
+}
@@ -0,0 +1,29 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_PARTITION_TABLE_H
+#define EXT4_BINARY_READ_PARTITION_TABLE_H
+#include "image_backend.h"
+
+// Partition tables of whole disk images. GPT (512 or 4096 byte sectors, primary header) is read when present,
+// otherwise MBR with its primary partitions (1-4) and logical partitions of the extended partition chain (5 and up),
+// numbered as the kernel numbers them. Every partition is checked for an ext4 super block (s_magic at 1024 + 0x38).
+
+#define PARTITIONS_MAX 128
+#define PARTITION_NAME_LENGTH 37  // GPT names are up to 36 UTF-16 characters, kept as ASCII
+
+struct ImagePartition {
+    u_int32_t number;
+    u_int64_t offset;  // bytes from the start of the disk
+    u_int64_t size;
+    u_int8_t mbr_type;  // partition type of MBR entries, 0 for GPT
+    u_int8_t ext4;  // holds an ext4 super block
+    char name[PARTITION_NAME_LENGTH];  // GPT partition name
+};
+
+int read_partition_table(struct ImageBackend * disk, struct ImagePartition * partitions, u_int64_t * partitions_count,
+        const char ** table_type);
+int disk_has_ext4(struct ImageBackend * disk, u_int64_t offset);
+
+#endif //EXT4_BINARY_READ_PARTITION_TABLE_H
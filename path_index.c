@@ -0,0 +1,250 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include "path_index.h"
+#include "stats.h"
+#include "arena.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+
+struct path_walk_entry {  // entry of a directory read by a worker, name in the worker's own buffer
+    u_int32_t inode;
+    u_int32_t name_offset;
+    u_int8_t name_len;
+    u_int8_t file_type;
+};
+
+struct path_walk_batch {  // all entries of one directory
+    struct path_walk_entry * entries;
+    u_int64_t entries_count;
+    u_int64_t entries_capacity;
+    char * names;
+    u_int64_t names_size;
+    u_int64_t names_capacity;
+};
+
+struct path_walk {
+    FILE * file;  // shared by workers, reads are positional
+    struct SuperBlock * superBlock;
+    struct PathIndex * index;
+    u_int32_t * queue;  // directories found but not read yet
+    u_int64_t queue_count;
+    u_int64_t queue_capacity;
+    u_int64_t names_capacity;
+    u_int64_t busy;  // workers reading a directory, they may still queue more
+    u_int64_t unreadable;  // directories that failed to read, entries read before the failure are kept
+    int stop;  // name arena is full
+    pthread_mutex_t lock;
+    pthread_cond_t wake;  // queue got a directory or the last busy worker finished
+};
+
+void path_walk_batch_add(struct path_walk_batch * batch, struct ext4_dir_entry_2 * dir_entry)
+{
+    if (batch->entries_count == batch->entries_capacity)
+    {
+        batch->entries_capacity = batch->entries_capacity ? batch->entries_capacity * 2 : 64;
+        batch->entries = realloc(batch->entries, sizeof(struct path_walk_entry) * batch->entries_capacity);
+    }
+    if (batch->names_size + dir_entry->name_len > batch->names_capacity)
+    {
+        batch->names_capacity = batch->names_capacity ? batch->names_capacity * 2 : 4096;
+        batch->names = realloc(batch->names, batch->names_capacity);
+    }
+    struct path_walk_entry * entry = batch->entries + batch->entries_count++;
+    entry->inode = dir_entry->inode;
+    entry->name_offset = batch->names_size;
+    entry->name_len = dir_entry->name_len;
+    entry->file_type = dir_entry->file_type;
+    memcpy(batch->names + batch->names_size, dir_entry->name, dir_entry->name_len);
+    batch->names_size += dir_entry->name_len;
+}
+
+int path_walk_read_directory(struct path_walk * walk, u_int32_t directory_inode, struct path_walk_batch * batch)
+/// reads all entries of a directory except "." and ".." into the batch, outside of the walk lock
+{
+    batch->entries_count = 0;
+    batch->names_size = 0;
+    struct InodeTable directory;
+    struct DirCursor cursor;
+    struct ext4_dir_entry_2 dir_entry;
+    if (load_inode_table(walk->file, walk->superBlock, &directory, directory_inode)
+        || DirCursor_open(&cursor, walk->file, walk->superBlock, &directory))
+        return 1;
+    while (DirCursor_next(&cursor, &dir_entry) == 0)
+    {
+        u_int8_t is_dot = (dir_entry.name_len == 1 && dir_entry.name[0] == '.')
+                          || (dir_entry.name_len == 2 && dir_entry.name[0] == '.' && dir_entry.name[1] == '.');
+        if (!is_dot)
+            path_walk_batch_add(batch, &dir_entry);
+    }
+    int err = cursor.err;
+    DirCursor_close(&cursor);
+    return err;
+}
+
+int path_walk_merge(struct path_walk * walk, u_int32_t directory_inode, struct path_walk_batch * batch)
+/// links entries of a directory into the index and queues directories found for the first time, under the walk lock
+{
+    struct PathIndex * index = walk->index;
+    for (u_int64_t i = 0; i < batch->entries_count; ++i)
+    {
+        struct path_walk_entry * entry = batch->entries + i;
+        if (entry->inode >= index->slots_count) continue;
+        struct PathIndexSlot * slot = index->slots + entry->inode;
+        int is_directory = entry->file_type == DEFT_DIRECTORY;
+        if (slot->parent != 0 && (is_directory || directory_inode >= slot->parent)) continue;
+        if (index->names_size + 1 + entry->name_len > PATH_INDEX_MAX_NAMES_SIZE)
+        {
+            fprintf(stderr, "Error path index names exceed %" PRIu64 " bytes\n", (u_int64_t)PATH_INDEX_MAX_NAMES_SIZE);
+            return 1;
+        }
+        if (index->names_size + 1 + entry->name_len > walk->names_capacity)
+        {
+            walk->names_capacity *= 2;
+            index->names = realloc(index->names, walk->names_capacity);
+        }
+        if (slot->parent == 0)
+        {
+            index->linked_inodes += 1;
+            if (is_directory)
+            {
+                if (walk->queue_count == walk->queue_capacity)
+                {
+                    walk->queue_capacity *= 2;
+                    walk->queue = realloc(walk->queue, sizeof(u_int32_t) * walk->queue_capacity);
+                }
+                walk->queue[walk->queue_count++] = entry->inode;
+            }
+        }
+        slot->parent = directory_inode;
+        slot->name_offset = index->names_size;
+        index->names[index->names_size] = (char)entry->name_len;
+        memcpy(index->names + index->names_size + 1, batch->names + entry->name_offset, entry->name_len);
+        index->names_size += 1 + entry->name_len;
+    }
+    return 0;
+}
+
+void * path_walk_worker(void * arg)
+/// takes queued directories until the queue is empty and no other worker can queue more
+{
+    struct path_walk * walk = arg;
+    struct path_walk_batch batch;
+    memset(&batch, 0, sizeof(batch));
+    pthread_mutex_lock(&walk->lock);
+    while (1)
+    {
+        while (walk->queue_count == 0 && walk->busy && !walk->stop)
+            pthread_cond_wait(&walk->wake, &walk->lock);
+        if (walk->queue_count == 0 || walk->stop) break;
+        u_int32_t directory_inode = walk->queue[--walk->queue_count];
+        walk->busy += 1;
+        pthread_mutex_unlock(&walk->lock);
+        int err = path_walk_read_directory(walk, directory_inode, &batch);
+        pthread_mutex_lock(&walk->lock);
+        walk->busy -= 1;
+        walk->index->directories += 1;
+        if (err)
+        {
+            char path[PATH_MAX];
+            walk->unreadable += 1;
+            if (PathIndex_path(walk->index, directory_inode, path, sizeof(path)))
+                sprintf(path, "<inode %" PRIu32 ">", directory_inode);
+            fprintf(stderr, "Error reading directory %s/\n", path);
+        }
+        if (path_walk_merge(walk, directory_inode, &batch))
+            walk->stop = 1;
+        pthread_cond_broadcast(&walk->wake);
+    }
+    pthread_cond_broadcast(&walk->wake);
+    pthread_mutex_unlock(&walk->lock);
+    free(batch.entries);
+    free(batch.names);
+    stats_flush_thread();
+    Arena_free(&thread_arena);
+    return NULL;
+}
+
+int PathIndex_build(FILE * file, struct SuperBlock * superBlock, u_int64_t jobs, struct PathIndex * index)
+/// walks the whole tree with jobs worker threads (0 picks number of CPUs) and fills parents of all linked inodes;
+/// returns 1 when some directory couldn't be read (the index holds everything else) or the walk failed
+{
+    memset(index, 0, sizeof(struct PathIndex));
+    index->slots_count = (u_int64_t)superBlock->s_inodes_count + 1;
+    index->slots = calloc(index->slots_count, sizeof(struct PathIndexSlot));
+    if (index->slots == NULL)
+    {
+        fprintf(stderr, "Error allocating path index of %" PRIu64 " inodes\n", index->slots_count);
+        return 1;
+    }
+    struct path_walk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.file = file;
+    walk.superBlock = superBlock;
+    walk.index = index;
+    walk.names_capacity = 1u << 16u;
+    index->names = malloc(walk.names_capacity);
+    walk.queue_capacity = 1024;
+    walk.queue = malloc(sizeof(u_int32_t) * walk.queue_capacity);
+    walk.queue[walk.queue_count++] = ROOT_INODE_ID;
+    index->slots[ROOT_INODE_ID].parent = ROOT_INODE_ID;
+    index->linked_inodes = 1;
+    if (jobs == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? cpus : 1;
+    }
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.wake, NULL);
+
+    pthread_t * workers = malloc(sizeof(pthread_t) * jobs);
+    u_int64_t started = 0;
+    for (; started < jobs; ++started)
+        if (pthread_create(workers + started, NULL, path_walk_worker, &walk)) break;
+    for (u_int64_t i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    free(walk.queue);
+    pthread_cond_destroy(&walk.wake);
+    pthread_mutex_destroy(&walk.lock);
+    return started == 0 || walk.stop || walk.unreadable;
+}
+
+void PathIndex_free(struct PathIndex * index)
+{
+    free(index->slots);
+    free(index->names);
+    index->slots = NULL;
+    index->names = NULL;
+    index->slots_count = 0;
+}
+
+int PathIndex_path(struct PathIndex * index, u_int64_t inode_id, char * path, u_int64_t path_size)
+/// writes full path of an inode into path, components are put together from the end of the buffer while following
+/// parents; returns 1 when the inode isn't linked from the tree or its path doesn't fit
+{
+    if (inode_id >= index->slots_count || index->slots[inode_id].parent == 0 || path_size < 2) return 1;
+    u_int64_t start = path_size - 1;
+    path[start] = '\0';
+    // every component takes at least 2 bytes, so a buffer bound walk ends even on a looped chain of parents
+    while (inode_id != ROOT_INODE_ID)
+    {
+        struct PathIndexSlot * slot = index->slots + inode_id;
+        if (slot->parent == 0) return 1;
+        u_int8_t name_len = (u_int8_t)index->names[slot->name_offset];
+        if (start < (u_int64_t)name_len + 1) return 1;
+        start -= name_len;
+        memcpy(path + start, index->names + slot->name_offset + 1, name_len);
+        path[--start] = '/';
+        inode_id = slot->parent;
+    }
+    if (start == path_size - 1)
+        path[--start] = '/';
+    memmove(path, path + start, path_size - start);
+    return 0;
+}
@@ -0,0 +1,38 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_PATH_INDEX_H
+#define EXT4_BINARY_READ_PATH_INDEX_H
+#include "filesystem.h"
+
+// In memory inode -> path index (parent pointers). One parallel walk of the directory tree fills a slot per inode
+// number with the directory the inode was found in and the offset of its name in a shared arena of names, so paths
+// of any number of inodes are put together afterwards by following parents up to the root, one slot lookup per path
+// component, without reading the image again. Worker threads take directories from a shared queue and read them
+// on their own, entries of a whole directory are merged into the index under one lock.
+// A hard linked file keeps the link from the directory with the lowest inode number (the first of them when it is
+// linked more times from one directory), so the index is the same whatever the order of the walk. A directory is
+// queued only the first time it is found, a corrupted tree linking a directory twice can't make the walk loop.
+
+#define PATH_INDEX_MAX_NAMES_SIZE 0xFFFFFFFFull  // name offsets are 32 bit
+
+struct PathIndexSlot {
+    u_int32_t parent;  // 0 when the inode was not found in any directory, root is its own parent
+    u_int32_t name_offset;  // name in the arena, stored as its length byte followed by the name
+};
+
+struct PathIndex {
+    struct PathIndexSlot * slots;  // indexed by inode number
+    u_int64_t slots_count;  // s_inodes_count + 1
+    char * names;
+    u_int64_t names_size;
+    u_int64_t linked_inodes;  // inodes with a parent, root included
+    u_int64_t directories;  // directories read by the walk
+};
+
+int PathIndex_build(FILE * file, struct SuperBlock * superBlock, u_int64_t jobs, struct PathIndex * index);
+void PathIndex_free(struct PathIndex * index);
+int PathIndex_path(struct PathIndex * index, u_int64_t inode_id, char * path, u_int64_t path_size);
+
+#endif //EXT4_BINARY_READ_PATH_INDEX_H
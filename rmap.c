@@ -0,0 +1,445 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#define _GNU_SOURCE
+// must come before fcntl.h, which defines file mode macros named like inode_table.h constants
+#include "rmap.h"
+#include "inode_scan.h"
+#include "image_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static const u_int64_t RMAP_START_MASK = 0xFFFFFFFFFFFFu;  // low 48 bits of start_length
+static const u_int64_t RMAP_MERGE_BUFFER = 1u << 20u;  // largest stdio buffer of a spilled run while merging
+static const u_int64_t RMAP_MERGE_BUFFER_MIN = 16u << 10u;  // smallest one, when many runs share the budget
+
+static const char * RMAP_KIND_NAMES[RMAP_KIND_COUNT] = {
+        "data", "extent tree", "xattr block", "super block", "block bitmap", "inode bitmap", "inode table"
+};
+
+u_int64_t RmapInterval_start(const struct RmapInterval * interval)
+{
+    return interval->start_length & RMAP_START_MASK;
+}
+
+u_int64_t RmapInterval_length(const struct RmapInterval * interval)
+{
+    return (interval->start_length >> 48u) + 1;
+}
+
+enum RmapKind RmapInterval_kind(const struct RmapInterval * interval)
+{
+    return interval->logical >= RMAP_KIND_BASE ? (enum RmapKind)(interval->logical - RMAP_KIND_BASE) : RMAP_DATA;
+}
+
+const char * RmapKind_name(enum RmapKind kind)
+{
+    return kind < RMAP_KIND_COUNT ? RMAP_KIND_NAMES[kind] : "unknown";
+}
+
+int rmap_interval_compare(const void * a, const void * b)
+/// orders by first block, then owner and logical block, so the table is deterministic whatever the scan order was
+{
+    const struct RmapInterval * interval_a = a, * interval_b = b;
+    u_int64_t start_a = RmapInterval_start(interval_a), start_b = RmapInterval_start(interval_b);
+    if (start_a != start_b) return (start_a > start_b) - (start_a < start_b);
+    if (interval_a->owner != interval_b->owner) return (interval_a->owner > interval_b->owner) - (interval_a->owner < interval_b->owner);
+    return (interval_a->logical > interval_b->logical) - (interval_a->logical < interval_b->logical);
+}
+
+struct interval_list {
+    struct RmapInterval * intervals;
+    u_int64_t count;
+    u_int64_t capacity;
+};
+
+void interval_list_append(struct interval_list * list, u_int64_t start, u_int64_t length, u_int32_t owner,
+        u_int32_t logical)
+/// appends block run, data continuing previous interval of the same owner is merged into it, runs longer than
+/// RMAP_MAX_LENGTH are split
+{
+    while (length)
+    {
+        if (list->count && logical < RMAP_KIND_BASE)
+        {
+            struct RmapInterval * last = list->intervals + list->count - 1;
+            u_int64_t last_length = RmapInterval_length(last);
+            if (last->owner == owner && last->logical < RMAP_KIND_BASE && RmapInterval_start(last) + last_length == start
+                && (u_int64_t)last->logical + last_length == logical && last_length < RMAP_MAX_LENGTH)
+            {
+                u_int64_t added = RMAP_MAX_LENGTH - last_length < length ? RMAP_MAX_LENGTH - last_length : length;
+                last->start_length = RmapInterval_start(last) | ((last_length + added - 1) << 48u);
+                start += added;
+                logical += added;
+                length -= added;
+                continue;
+            }
+        }
+        if (list->count == list->capacity)
+        {
+            list->capacity = list->capacity ? list->capacity * 2 : 64;
+            list->intervals = realloc(list->intervals, sizeof(struct RmapInterval) * list->capacity);
+        }
+        u_int64_t piece = length < RMAP_MAX_LENGTH ? length : RMAP_MAX_LENGTH;
+        struct RmapInterval * interval = list->intervals + list->count++;
+        interval->start_length = (start & RMAP_START_MASK) | ((piece - 1) << 48u);
+        interval->owner = owner;
+        interval->logical = logical;
+        start += piece;
+        if (logical < RMAP_KIND_BASE)
+            logical += piece;
+        length -= piece;
+    }
+}
+
+struct rmap_builder {
+    struct SuperBlock * superBlock;
+    struct RmapInterval * buffer;  // unsorted intervals not spilled yet
+    u_int64_t count;
+    u_int64_t capacity;
+    FILE ** runs;  // spilled runs, every one sorted
+    u_int64_t runs_count;
+    u_int64_t total;
+    int err;
+    pthread_mutex_t lock;
+};
+
+int rmap_builder_spill(struct rmap_builder * builder)
+/// sorts the buffer and moves it into a new temporary run, called with builder lock held
+{
+    qsort(builder->buffer, builder->count, sizeof(struct RmapInterval), rmap_interval_compare);
+    FILE * run = tmpfile();
+    if (run == NULL || fwrite(builder->buffer, sizeof(struct RmapInterval), builder->count, run) != builder->count
+        || fflush(run) || fseek(run, 0, SEEK_SET))
+    {
+        fprintf(stderr, "Error writing temporary run of block owner map\n");
+        if (run) fclose(run);
+        return 1;
+    }
+    builder->runs = realloc(builder->runs, sizeof(FILE *) * (builder->runs_count + 1));
+    builder->runs[builder->runs_count++] = run;
+    builder->count = 0;
+    return 0;
+}
+
+int rmap_builder_add(struct rmap_builder * builder, struct RmapInterval * intervals, u_int64_t count)
+{
+    pthread_mutex_lock(&builder->lock);
+    while (count && !builder->err)
+    {
+        if (builder->count == builder->capacity && rmap_builder_spill(builder))
+        {
+            builder->err = 1;
+            break;
+        }
+        u_int64_t space = builder->capacity - builder->count, copied = count < space ? count : space;
+        memcpy(builder->buffer + builder->count, intervals, sizeof(struct RmapInterval) * copied);
+        builder->count += copied;
+        builder->total += copied;
+        intervals += copied;
+        count -= copied;
+    }
+    int err = builder->err;
+    pthread_mutex_unlock(&builder->lock);
+    return err;
+}
+
+struct inode_intervals_ctx {
+    struct interval_list list;
+    u_int32_t owner;
+};
+
+int rmap_add_extent(void * ctx, struct ext4_extent * extent)
+{
+    struct inode_intervals_ctx * inode = ctx;
+    interval_list_append(&inode->list, extent->ee_start_u64, ext4_extent_length(extent), inode->owner, extent->ee_block);
+    return 0;
+}
+
+int rmap_add_tree_block(void * ctx, u_int64_t block)
+{
+    struct inode_intervals_ctx * inode = ctx;
+    interval_list_append(&inode->list, block, 1, inode->owner, RMAP_KIND_BASE + RMAP_EXTENT_TREE);
+    return 0;
+}
+
+int rmap_add_inode(void * ctx, FILE * file, struct InodeTable * inodeTable, int in_use)
+/// inode scan callback, adds blocks of every allocated inode
+{
+    struct rmap_builder * builder = ctx;
+    if (!in_use) return 0;
+    struct inode_intervals_ctx inode;
+    memset(&inode, 0, sizeof(inode));
+    inode.owner = inodeTable->i_ino;
+    struct ext4_extent_header header;
+    if ((inodeTable->i_flags & EXT4_EXTENTS_FL) && !(inodeTable->i_flags & EXT4_INLINE_DATA_FL)
+        && ext4_extent_header_new(&header, (char *)inodeTable->i_block) == 0
+        && extent_tree_walk(file, builder->superBlock, &header, inodeTable->i_block, rmap_add_extent,
+                            rmap_add_tree_block, &inode))
+        fprintf(stderr, "Error reading extents of inode %" PRIu32 ", block owner map misses some of its blocks\n",
+                        inodeTable->i_ino);
+    u_int64_t xattr_block = ((u_int64_t)inodeTable->l_i_file_acl_high << 32u) + inodeTable->i_file_acl_lo;
+    if (xattr_block)
+        interval_list_append(&inode.list, xattr_block, 1, inode.owner, RMAP_KIND_BASE + RMAP_XATTR_BLOCK);
+    int err = rmap_builder_add(builder, inode.list.intervals, inode.list.count);
+    free(inode.list.intervals);
+    return err;
+}
+
+void rmap_add_group_metadata(struct SuperBlock * superBlock, struct GroupDescriptor * groupDescriptors,
+        u_int64_t groups_count, struct interval_list * list)
+/// super block copies with group descriptor tables, bitmaps and inode tables of all groups
+{
+    int meta_bg = (superBlock->s_feature_incompat & INCOMPAT_META_BG) != 0;
+    u_int64_t descriptors_per_block = get_descriptors_per_block(superBlock);
+    // with META_BG reserved GDT blocks are not used and only the first s_first_meta_bg table blocks follow super block
+    u_int64_t old_gdt_blocks = get_old_descriptor_blocks(superBlock) + (meta_bg ? 0 : superBlock->s_reserved_gdt_blocks);
+    u_int64_t inode_table_blocks = get_inode_table_blocks(superBlock);
+    for (u_int64_t group_id = 0; group_id < groups_count; ++group_id)
+    {
+        struct GroupDescriptor * groupDescriptor = groupDescriptors + group_id;
+        u_int64_t group_block = superBlock->s_first_data_block + group_id * superBlock->s_blocks_per_group;
+        u_int64_t super_blocks = group_has_super_block(superBlock, group_id) ? 1 : 0;
+        u_int64_t meta_group = group_id / descriptors_per_block, index = group_id % descriptors_per_block;
+        if (!meta_bg || meta_group < superBlock->s_first_meta_bg)
+            super_blocks += super_blocks ? old_gdt_blocks : 0;
+        else if (index == 0 || index == 1 || index == descriptors_per_block - 1)
+            super_blocks += 1;  // descriptor block of meta group or one of its two copies
+        if (super_blocks)
+        {
+            // block 0 (boot sector on 1KiB block images) is counted to the primary super block
+            u_int64_t first = group_id ? group_block : 0;
+            u_int64_t last = group_block + super_blocks - 1;
+            interval_list_append(list, first, last - first + 1, group_id, RMAP_KIND_BASE + RMAP_SUPER_BLOCK);
+        }
+        interval_list_append(list, groupDescriptor->bg_block_bitmap_u64, 1, group_id, RMAP_KIND_BASE + RMAP_BLOCK_BITMAP);
+        interval_list_append(list, groupDescriptor->bg_inode_bitmap_u64, 1, group_id, RMAP_KIND_BASE + RMAP_INODE_BITMAP);
+        interval_list_append(list, groupDescriptor->bg_inode_table_u64, inode_table_blocks, group_id,
+                             RMAP_KIND_BASE + RMAP_INODE_TABLE);
+    }
+}
+
+struct merge_head {  // smallest not yet merged interval of a run
+    struct RmapInterval interval;
+    u_int64_t run;
+};
+
+void merge_heap_down(struct merge_head * heap, u_int64_t count, u_int64_t position)
+{
+    while (1)
+    {
+        u_int64_t smallest = position, left = 2 * position + 1, right = left + 1;
+        if (left < count && rmap_interval_compare(&heap[left].interval, &heap[smallest].interval) < 0) smallest = left;
+        if (right < count && rmap_interval_compare(&heap[right].interval, &heap[smallest].interval) < 0) smallest = right;
+        if (smallest == position) return;
+        struct merge_head swap = heap[position];
+        heap[position] = heap[smallest];
+        heap[smallest] = swap;
+        position = smallest;
+    }
+}
+
+int rmap_merge_runs(FILE ** runs, u_int64_t runs_count, u_int64_t buffer_size, FILE * out)
+/// k-way merge of sorted runs into out, memory use is one stdio buffer of buffer_size bytes per run
+{
+    struct merge_head * heap = malloc(sizeof(struct merge_head) * runs_count);
+    char ** buffers = malloc(sizeof(char *) * runs_count);
+    u_int64_t heap_count = 0;
+    for (u_int64_t i = 0; i < runs_count; ++i)
+    {
+        buffers[i] = malloc(buffer_size);
+        setvbuf(runs[i], buffers[i], _IOFBF, buffer_size);
+        if (fread(&heap[heap_count].interval, sizeof(struct RmapInterval), 1, runs[i]) == 1)
+            heap[heap_count++].run = i;
+    }
+    for (u_int64_t i = heap_count / 2; i-- > 0;)
+        merge_heap_down(heap, heap_count, i);
+    int err = 0;
+    while (heap_count && !err)
+    {
+        err = fwrite(&heap[0].interval, sizeof(struct RmapInterval), 1, out) != 1;
+        if (fread(&heap[0].interval, sizeof(struct RmapInterval), 1, runs[heap[0].run]) != 1)
+            heap[0] = heap[--heap_count];
+        merge_heap_down(heap, heap_count, 0);
+    }
+    // runs have to be closed before their buffers are freed
+    for (u_int64_t i = 0; i < runs_count; ++i)
+    {
+        fclose(runs[i]);
+        runs[i] = NULL;
+        free(buffers[i]);
+    }
+    free(buffers);
+    free(heap);
+    return err;
+}
+
+int Rmap_build(const char * image_path, struct SuperBlock * superBlock, const char * rmap_path, u_int64_t memory_budget,
+        u_int64_t jobs)
+/// scans whole image and writes its block owner map into rmap_path, memory_budget (bytes) bounds the interval buffer,
+/// intervals above it are spilled into sorted temporary runs and merged at the end
+{
+    struct rmap_builder builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.superBlock = superBlock;
+    builder.capacity = memory_budget / sizeof(struct RmapInterval);
+    if (builder.capacity < 1024) builder.capacity = 1024;
+    builder.buffer = malloc(sizeof(struct RmapInterval) * builder.capacity);
+    pthread_mutex_init(&builder.lock, NULL);
+
+    struct GroupDescriptor * groupDescriptors;
+    u_int64_t groups_count;
+    FILE * file = image_open(image_path);
+    int err = file == NULL || load_group_descriptors(file, superBlock, &groupDescriptors, &groups_count);
+    if (file)
+        fclose(file);
+    if (!err)
+    {
+        struct interval_list metadata = {NULL, 0, 0};
+        rmap_add_group_metadata(superBlock, groupDescriptors, groups_count, &metadata);
+        err = rmap_builder_add(&builder, metadata.intervals, metadata.count);
+        free(metadata.intervals);
+        free(groupDescriptors);
+    }
+    if (!err)
+        err = scan_inode_tables(image_path, superBlock, jobs, rmap_add_inode, &builder);
+
+    uint64_t tmp_path_len = strlen(rmap_path) + 5;
+    char * tmp_path = malloc(tmp_path_len);
+    snprintf(tmp_path, tmp_path_len, "%s.tmp", rmap_path);
+    FILE * out = err ? NULL : fopen(tmp_path, "wb");
+    if (out)
+    {
+        struct RmapHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RMAP_MAGIC, sizeof(header.magic));
+        memcpy(header.uuid, superBlock->s_uuid, sizeof(header.uuid));
+        header.s_wtime = superBlock->s_wtime;
+        header.s_kbytes_written = superBlock->s_kbytes_written;
+        header.interval_count = builder.total;
+        header.intervals_offset = sizeof(header);
+        err = fwrite(&header, sizeof(header), 1, out) != 1;
+        if (!err && builder.runs_count == 0)
+        {
+            // everything fit into the budget, no need for temporary runs
+            qsort(builder.buffer, builder.count, sizeof(struct RmapInterval), rmap_interval_compare);
+            err = fwrite(builder.buffer, sizeof(struct RmapInterval), builder.count, out) != builder.count;
+        }
+        else if (!err)
+        {
+            err = rmap_builder_spill(&builder);
+            // buffer is not needed anymore, merge runs within the budget
+            free(builder.buffer);
+            builder.buffer = NULL;
+            // run buffers share the budget, only a floor of them may go over it when there are very many runs
+            u_int64_t buffer_size = memory_budget / builder.runs_count;
+            if (buffer_size > RMAP_MERGE_BUFFER) buffer_size = RMAP_MERGE_BUFFER;
+            if (buffer_size < RMAP_MERGE_BUFFER_MIN) buffer_size = RMAP_MERGE_BUFFER_MIN;
+            if (!err)
+                err = rmap_merge_runs(builder.runs, builder.runs_count, buffer_size, out);
+        }
+        if (fclose(out)) err = 1;
+        if (!err && rename(tmp_path, rmap_path)) err = 1;
+        if (err)
+        {
+            fprintf(stderr, "Error writing block owner map %s\n", rmap_path);
+            remove(tmp_path);
+        }
+    }
+    else if (!err)
+    {
+        fprintf(stderr, "Error creating block owner map %s\n", tmp_path);
+        err = 1;
+    }
+    free(tmp_path);
+    for (u_int64_t i = 0; i < builder.runs_count; ++i)
+        if (builder.runs[i])
+            fclose(builder.runs[i]);
+    free(builder.runs);
+    free(builder.buffer);
+    pthread_mutex_destroy(&builder.lock);
+    return err;
+}
+
+int Rmap_open(struct Rmap * rmap, const char * rmap_path, struct SuperBlock * superBlock)
+/// maps block owner map into memory
+/// returns 1 if there is no usable map file, 2 if map was built for another state of the image
+{
+    memset(rmap, 0, sizeof(struct Rmap));
+    int fd = open(rmap_path, O_RDONLY);
+    if (fd < 0) return 1;
+    off_t file_size = lseek(fd, 0, SEEK_END);
+    if (file_size < 0 || (u_int64_t)file_size < sizeof(struct RmapHeader))
+    {
+        close(fd);
+        return 1;
+    }
+    u_int64_t size = file_size;
+    void * map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 1;
+    struct RmapHeader * header = map;
+    if (memcmp(header->magic, RMAP_MAGIC, sizeof(header->magic)) != 0
+        || header->intervals_offset + sizeof(struct RmapInterval) * header->interval_count > size)
+    {
+        munmap(map, size);
+        return 1;
+    }
+    if (memcmp(header->uuid, superBlock->s_uuid, sizeof(header->uuid)) != 0
+        || header->s_wtime != superBlock->s_wtime || header->s_kbytes_written != superBlock->s_kbytes_written)
+    {
+        munmap(map, size);
+        return 2;
+    }
+    rmap->map = map;
+    rmap->map_size = size;
+    rmap->header = header;
+    rmap->intervals = (struct RmapInterval *)((char *)map + header->intervals_offset);
+    return 0;
+}
+
+void Rmap_close(struct Rmap * rmap)
+{
+    if (rmap->map)
+        munmap(rmap->map, rmap->map_size);
+    memset(rmap, 0, sizeof(struct Rmap));
+}
+
+int Rmap_find(struct Rmap * rmap, u_int64_t first_block, u_int64_t last_block, struct RmapInterval ** found,
+        u_int64_t * found_count)
+/// returns (through found, found_count) all intervals overlapping blocks first_block..last_block, in block order
+/// no interval is longer than RMAP_MAX_LENGTH, so only those starting at most that far before first_block are checked
+{
+    u_int64_t lowest_start = first_block >= RMAP_MAX_LENGTH ? first_block - RMAP_MAX_LENGTH + 1 : 0;
+    u_int64_t low = 0, high = rmap->header->interval_count;
+    while (low < high)
+    {
+        u_int64_t middle = low + (high - low) / 2;
+        if (RmapInterval_start(rmap->intervals + middle) < lowest_start) low = middle + 1;
+        else high = middle;
+    }
+    u_int64_t capacity = 16;
+    *found = malloc(sizeof(struct RmapInterval) * capacity);
+    *found_count = 0;
+    for (u_int64_t i = low; i < rmap->header->interval_count; ++i)
+    {
+        struct RmapInterval * interval = rmap->intervals + i;
+        u_int64_t start = RmapInterval_start(interval);
+        if (start > last_block) break;
+        if (start + RmapInterval_length(interval) <= first_block) continue;
+        if (*found_count == capacity)
+        {
+            capacity *= 2;
+            *found = realloc(*found, sizeof(struct RmapInterval) * capacity);
+        }
+        (*found)[(*found_count)++] = *interval;
+    }
+    return 0;
+}
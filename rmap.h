@@ -0,0 +1,67 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_RMAP_H
+#define EXT4_BINARY_READ_RMAP_H
+#include "filesystem.h"
+
+// Reverse block map: sidecar file (<image>.rmap) with a sorted table of block intervals and their owners, answering
+// which inode (or which group metadata) uses given block. Intervals come from a parallel scan of all inode tables
+// (data extents, extent tree blocks, xattr blocks) plus superblock copies, group descriptors, bitmaps and inode
+// tables of every group. Build works within a memory budget: full buffers are sorted and spilled into temporary
+// runs, which are merged into the final table. Bound to the image the same way as the metadata index.
+
+static const char RMAP_MAGIC[8] = {'E', '4', 'R', 'M', 'A', 'P', '0', '1'};
+
+enum RmapKind {
+    RMAP_DATA,  // file content, owner is inode
+    RMAP_EXTENT_TREE,  // extent index or leaf block, owner is inode
+    RMAP_XATTR_BLOCK,  // external xattr block, owner is inode (shared blocks have one interval per inode)
+    RMAP_SUPER_BLOCK,  // super block copy, group descriptors (META_BG ones too) and reserved GDT blocks, owner is group
+    RMAP_BLOCK_BITMAP,  // owner is group
+    RMAP_INODE_BITMAP,  // owner is group
+    RMAP_INODE_TABLE,  // owner is group
+    RMAP_KIND_COUNT
+};
+
+static const u_int32_t RMAP_KIND_BASE = 0xFFFFFFF0;  // logical values from here on encode kind of non data intervals
+static const u_int64_t RMAP_MAX_LENGTH = 0x10000;  // longer runs are split into several intervals
+static const u_int64_t RMAP_DEFAULT_MEMORY_BUDGET = 256u << 20u;  // interval buffer of the build, in bytes
+
+struct RmapInterval {  // 16 bytes, sorted by first block
+    u_int64_t start_length;  // first block in low 48 bits, number of blocks - 1 in high 16 bits
+    u_int32_t owner;  // inode number, or group number for group metadata
+    u_int32_t logical;  // first file block of data intervals, RMAP_KIND_BASE + kind for the others
+};
+
+u_int64_t RmapInterval_start(const struct RmapInterval * interval);
+u_int64_t RmapInterval_length(const struct RmapInterval * interval);
+enum RmapKind RmapInterval_kind(const struct RmapInterval * interval);
+const char * RmapKind_name(enum RmapKind kind);
+
+struct RmapHeader {
+    char magic[8];
+    u_char uuid[16];  // s_uuid of mapped image
+    u_int32_t s_wtime;  // s_wtime of mapped image
+    u_int32_t reserved;
+    u_int64_t s_kbytes_written;  // s_kbytes_written of mapped image
+    u_int64_t interval_count;
+    u_int64_t intervals_offset;
+};
+
+struct Rmap {
+    void * map;
+    u_int64_t map_size;
+    struct RmapHeader * header;
+    struct RmapInterval * intervals;
+};
+
+int Rmap_build(const char * image_path, struct SuperBlock * superBlock, const char * rmap_path, u_int64_t memory_budget,
+        u_int64_t jobs);
+int Rmap_open(struct Rmap * rmap, const char * rmap_path, struct SuperBlock * superBlock);
+void Rmap_close(struct Rmap * rmap);
+int Rmap_find(struct Rmap * rmap, u_int64_t first_block, u_int64_t last_block, struct RmapInterval ** found,
+        u_int64_t * found_count);
+
+#endif //EXT4_BINARY_READ_RMAP_H
@@ -0,0 +1,446 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#include "snapshot_diff.h"
+#include "interfaces.h"
+#include "stats.h"
+#include "arena.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// raw inode fields used by the comparison, offsets as in InodeTable_new
+#define INODE_ATIME 0x8
+#define INODE_GENERATION 0x64
+#define INODE_CHECKSUM_LO 0x7C
+#define INODE_EXTRA_ISIZE 0x80
+#define INODE_CHECKSUM_HI 0x82
+#define INODE_ATIME_EXTRA 0x8C
+#define INODE_CRTIME 0x90
+
+struct snapshot_side {  // one of the compared images
+    FILE * file;  // shared by workers, reads are positional
+    struct SuperBlock * superBlock;
+    struct GroupDescriptor * groupDescriptors;
+    int uninit_flags_valid;
+};
+
+struct snapshot_diff {
+    struct snapshot_side a;
+    struct snapshot_side b;
+    u_int64_t groups_count;
+    int full;
+    u_int64_t next_group;  // first group not taken by any worker
+    int stop;
+    struct DiffChange * changes;
+    u_int64_t changes_count;
+    u_int64_t changes_capacity;
+    struct DiffSummary summary;
+    pthread_mutex_t lock;
+};
+
+static inline u_int32_t le32_at(const u_char * bytes)
+{
+    return bytes[0] | (u_int32_t)bytes[1] << 8u | (u_int32_t)bytes[2] << 16u | (u_int32_t)bytes[3] << 24u;
+}
+
+int group_descriptors_equal(struct GroupDescriptor * a, struct GroupDescriptor * b)
+/// descriptor fields that change whenever inodes or blocks of the group are allocated or freed
+{
+    return a->bg_checksum == b->bg_checksum && a->bg_flags == b->bg_flags
+           && a->bg_inode_table_u64 == b->bg_inode_table_u64 && a->bg_inode_bitmap_u64 == b->bg_inode_bitmap_u64
+           && a->bg_free_inodes_count_u32 == b->bg_free_inodes_count_u32
+           && a->bg_free_blocks_count_u32 == b->bg_free_blocks_count_u32
+           && a->bg_used_dirs_count_u32 == b->bg_used_dirs_count_u32
+           && a->bg_itable_unused_u32 == b->bg_itable_unused_u32
+           && a->bg_inode_bitmap_csum_u32 == b->bg_inode_bitmap_csum_u32
+           && a->bg_block_bitmap_csum_u32 == b->bg_block_bitmap_csum_u32;
+}
+
+u_int64_t side_used_inodes(struct snapshot_side * side, u_int64_t group_id)
+/// number of initialized inode table entries of a group, as in the inode scan
+{
+    struct GroupDescriptor * groupDescriptor = side->groupDescriptors + group_id;
+    u_int64_t inodes_count = side->superBlock->s_inodes_per_group;
+    if (!side->uninit_flags_valid) return inodes_count;
+    if (groupDescriptor->bg_flags & BG_INODE_UNINIT) return 0;
+    return groupDescriptor->bg_itable_unused_u32 < inodes_count ? inodes_count - groupDescriptor->bg_itable_unused_u32
+                                                                 : inodes_count;
+}
+
+int read_group_inodes(struct snapshot_side * side, u_int64_t group_id, u_int64_t used, u_char * bitmap,
+        u_char * table)
+/// reads inode bitmap and initialized part of the inode table of a group
+{
+    struct GroupDescriptor * groupDescriptor = side->groupDescriptors + group_id;
+    u_int64_t block_size = side->superBlock->s_block_size;
+    u_int64_t blocks = (used * side->superBlock->s_inode_size + block_size - 1) / block_size;
+    if (read_blocks(side->file, block_size, groupDescriptor->bg_inode_bitmap_u64, 1, (char *)bitmap)
+        || read_blocks(side->file, block_size, groupDescriptor->bg_inode_table_u64, blocks, (char *)table))
+    {
+        fprintf(stderr, "Error reading inode table of group %" PRIu64 "\n", group_id);
+        return 1;
+    }
+    return 0;
+}
+
+int inode_reused(const u_char * a, const u_char * b, u_int64_t inode_size)
+/// inode number was freed and taken by another file: new generation, creation time or file type
+{
+    if (le32_at(a + INODE_GENERATION) != le32_at(b + INODE_GENERATION)) return 1;
+    if (((a[1] ^ b[1]) & 0xF0u) != 0) return 1;  // file type bits of i_mode
+    u_int64_t extra_a = inode_size > INODE_EXTRA_ISIZE ? (a[INODE_EXTRA_ISIZE] | a[INODE_EXTRA_ISIZE + 1] << 8u) : 0;
+    u_int64_t extra_b = inode_size > INODE_EXTRA_ISIZE ? (b[INODE_EXTRA_ISIZE] | b[INODE_EXTRA_ISIZE + 1] << 8u) : 0;
+    return extra_a >= INODE_CRTIME + 4 - INODE_EXTRA_ISIZE && extra_b >= INODE_CRTIME + 4 - INODE_EXTRA_ISIZE
+           && le32_at(a + INODE_CRTIME) != le32_at(b + INODE_CRTIME);
+}
+
+int inodes_equal(const u_char * a, const u_char * b, u_int64_t inode_size, int checksums)
+/// equal checksums decide right away, otherwise raw inodes are compared without access time and checksum
+{
+    u_int64_t extra_a = inode_size > INODE_EXTRA_ISIZE ? (a[INODE_EXTRA_ISIZE] | a[INODE_EXTRA_ISIZE + 1] << 8u) : 0;
+    u_int64_t extra_b = inode_size > INODE_EXTRA_ISIZE ? (b[INODE_EXTRA_ISIZE] | b[INODE_EXTRA_ISIZE + 1] << 8u) : 0;
+    if (checksums && extra_a >= 4 && extra_b >= 4
+        && memcmp(a + INODE_CHECKSUM_LO, b + INODE_CHECKSUM_LO, 2) == 0
+        && memcmp(a + INODE_CHECKSUM_HI, b + INODE_CHECKSUM_HI, 2) == 0)
+        return 1;
+    u_char masked_a[inode_size], masked_b[inode_size];
+    memcpy(masked_a, a, inode_size);
+    memcpy(masked_b, b, inode_size);
+    memset(masked_a + INODE_ATIME, 0, 4);
+    memset(masked_b + INODE_ATIME, 0, 4);
+    memset(masked_a + INODE_CHECKSUM_LO, 0, 2);
+    memset(masked_b + INODE_CHECKSUM_LO, 0, 2);
+    if (inode_size > INODE_CHECKSUM_HI + 2)
+    {
+        memset(masked_a + INODE_CHECKSUM_HI, 0, 2);
+        memset(masked_b + INODE_CHECKSUM_HI, 0, 2);
+    }
+    if (inode_size > INODE_ATIME_EXTRA + 4)
+    {
+        memset(masked_a + INODE_ATIME_EXTRA, 0, 4);
+        memset(masked_b + INODE_ATIME_EXTRA, 0, 4);
+    }
+    return memcmp(masked_a, masked_b, inode_size) == 0;
+}
+
+void diff_add_change(struct DiffChange ** changes, u_int64_t * count, u_int64_t * capacity, u_int64_t inode_id,
+        u_int8_t kind)
+{
+    if (*count == *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        *changes = realloc(*changes, sizeof(struct DiffChange) * *capacity);
+    }
+    (*changes)[*count].inode = inode_id;
+    (*changes)[*count].kind = kind;
+    *count += 1;
+}
+
+int diff_group(struct snapshot_diff * diff, u_int64_t group_id, u_char * bitmaps, u_char * tables,
+        struct DiffChange ** changes, u_int64_t * count, u_int64_t * capacity)
+/// compares inodes of one group, changes are appended to the worker's list
+{
+    struct SuperBlock * superBlock = diff->a.superBlock;
+    u_int64_t block_size = superBlock->s_block_size, inode_size = superBlock->s_inode_size;
+    u_int64_t inodes_per_group = superBlock->s_inodes_per_group;
+    u_int64_t table_size = (inodes_per_group * inode_size + block_size - 1) / block_size * block_size;
+    u_int64_t used_a = side_used_inodes(&diff->a, group_id), used_b = side_used_inodes(&diff->b, group_id);
+    u_char * bitmap_a = bitmaps, * bitmap_b = bitmaps + block_size;
+    u_char * table_a = tables, * table_b = tables + table_size;
+    if ((used_a && read_group_inodes(&diff->a, group_id, used_a, bitmap_a, table_a))
+        || (used_b && read_group_inodes(&diff->b, group_id, used_b, bitmap_b, table_b)))
+        return 1;
+    int checksums = (superBlock->s_feature_ro_compat & RO_COMPAT_METADATA_CSUM)
+                    && (diff->b.superBlock->s_feature_ro_compat & RO_COMPAT_METADATA_CSUM);
+    u_int64_t used = used_a > used_b ? used_a : used_b;
+    for (u_int64_t index = 0; index < used; ++index)
+    {
+        u_int64_t inode_id = group_id * inodes_per_group + index + 1;
+        if (inode_id < superBlock->s_first_ino && inode_id != ROOT_INODE_ID) continue;  // journal and other reserved
+        int in_use_a = index < used_a && ((bitmap_a[index / 8] >> (index % 8)) & 1u);
+        int in_use_b = index < used_b && ((bitmap_b[index / 8] >> (index % 8)) & 1u);
+        const u_char * inode_a = table_a + index * inode_size, * inode_b = table_b + index * inode_size;
+        if (in_use_a && in_use_b)
+        {
+            if (inode_reused(inode_a, inode_b, inode_size))
+            {
+                // inode number was freed and taken by another file
+                diff_add_change(changes, count, capacity, inode_id, DIFF_REMOVED);
+                diff_add_change(changes, count, capacity, inode_id, DIFF_ADDED);
+            }
+            else if (!inodes_equal(inode_a, inode_b, inode_size, checksums))
+                diff_add_change(changes, count, capacity, inode_id, DIFF_MODIFIED);
+        }
+        else if (in_use_a)
+            diff_add_change(changes, count, capacity, inode_id, DIFF_REMOVED);
+        else if (in_use_b)
+            diff_add_change(changes, count, capacity, inode_id, DIFF_ADDED);
+    }
+    return 0;
+}
+
+void * snapshot_diff_worker(void * arg)
+/// takes groups in order until all are taken or the diff is stopped
+{
+    struct snapshot_diff * diff = arg;
+    struct SuperBlock * superBlock = diff->a.superBlock;
+    u_int64_t block_size = superBlock->s_block_size;
+    u_int64_t table_size = ((u_int64_t)superBlock->s_inodes_per_group * superBlock->s_inode_size + block_size - 1)
+                           / block_size * block_size;
+    u_char * bitmaps = malloc(block_size * 2);
+    u_char * tables = malloc(table_size * 2);
+    struct DiffChange * changes = NULL;
+    u_int64_t count = 0, capacity = 0, skipped = 0;
+    while (1)
+    {
+        pthread_mutex_lock(&diff->lock);
+        u_int64_t group_id = diff->next_group;
+        int take = !diff->stop && group_id < diff->groups_count;
+        if (take)
+            diff->next_group += 1;
+        pthread_mutex_unlock(&diff->lock);
+        if (!take) break;
+        if (!diff->full && group_descriptors_equal(diff->a.groupDescriptors + group_id,
+                                                   diff->b.groupDescriptors + group_id))
+        {
+            skipped += 1;
+            continue;
+        }
+        STAT_BEGIN();
+        int err = diff_group(diff, group_id, bitmaps, tables, &changes, &count, &capacity);
+        STAT_END(STAT_SCAN_GROUP, 2 * (block_size + table_size));
+        if (err)
+        {
+            pthread_mutex_lock(&diff->lock);
+            diff->stop = 1;
+            pthread_mutex_unlock(&diff->lock);
+        }
+    }
+    pthread_mutex_lock(&diff->lock);
+    for (u_int64_t i = 0; i < count; ++i)
+        diff_add_change(&diff->changes, &diff->changes_count, &diff->changes_capacity, changes[i].inode,
+                        changes[i].kind);
+    diff->summary.groups_skipped += skipped;
+    pthread_mutex_unlock(&diff->lock);
+    free(changes);
+    free(tables);
+    free(bitmaps);
+    stats_flush_thread();
+    Arena_free(&thread_arena);
+    return NULL;
+}
+
+int compare_changes(const void * a, const void * b)
+{
+    const struct DiffChange * change_a = a, * change_b = b;
+    if (change_a->inode != change_b->inode) return (change_a->inode > change_b->inode) - (change_a->inode < change_b->inode);
+    return (change_a->kind > change_b->kind) - (change_a->kind < change_b->kind);
+}
+
+int diff_inode_tables(FILE * file_a, struct SuperBlock * superBlock_a, FILE * file_b, struct SuperBlock * superBlock_b,
+        u_int64_t jobs, int full, struct DiffChange ** changes, u_int64_t * changes_count, struct DiffSummary * summary)
+/// compares inode tables of two images of the same geometry on jobs worker threads (0 picks number of CPUs), groups
+/// with identical descriptors are skipped unless full is set; returns changed inodes sorted by inode number
+{
+    *changes = NULL;
+    *changes_count = 0;
+    memset(summary, 0, sizeof(struct DiffSummary));
+    if (superBlock_a->s_inodes_per_group != superBlock_b->s_inodes_per_group
+        || superBlock_a->s_inodes_count != superBlock_b->s_inodes_count
+        || superBlock_a->s_inode_size != superBlock_b->s_inode_size
+        || superBlock_a->s_block_size != superBlock_b->s_block_size)
+    {
+        fprintf(stderr, "Error images have different inode table geometry, they are not snapshots of one file system\n");
+        return 1;
+    }
+    struct snapshot_diff diff;
+    memset(&diff, 0, sizeof(diff));
+    u_int64_t groups_a, groups_b;
+    if (load_group_descriptors(file_a, superBlock_a, &diff.a.groupDescriptors, &groups_a))
+    {
+        fprintf(stderr, "Error loading group descriptors\n");
+        return 1;
+    }
+    if (load_group_descriptors(file_b, superBlock_b, &diff.b.groupDescriptors, &groups_b))
+    {
+        fprintf(stderr, "Error loading group descriptors\n");
+        free(diff.a.groupDescriptors);
+        return 1;
+    }
+    diff.a.file = file_a;
+    diff.a.superBlock = superBlock_a;
+    diff.a.uninit_flags_valid = (superBlock_a->s_feature_ro_compat & (RO_COMPAT_GDT_CSUM | RO_COMPAT_METADATA_CSUM)) != 0;
+    diff.b.file = file_b;
+    diff.b.superBlock = superBlock_b;
+    diff.b.uninit_flags_valid = (superBlock_b->s_feature_ro_compat & (RO_COMPAT_GDT_CSUM | RO_COMPAT_METADATA_CSUM)) != 0;
+    // inode tables of groups past the end of the smaller image hold no inodes (inode counts are equal)
+    diff.groups_count = groups_a < groups_b ? groups_a : groups_b;
+    diff.full = full;
+    pthread_mutex_init(&diff.lock, NULL);
+    if (jobs == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? cpus : 1;
+    }
+    if (jobs > diff.groups_count) jobs = diff.groups_count ? diff.groups_count : 1;
+
+    pthread_t * workers = malloc(sizeof(pthread_t) * jobs);
+    u_int64_t started = 0;
+    for (; started < jobs; ++started)
+        if (pthread_create(workers + started, NULL, snapshot_diff_worker, &diff)) break;
+    for (u_int64_t i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    pthread_mutex_destroy(&diff.lock);
+    free(diff.a.groupDescriptors);
+    free(diff.b.groupDescriptors);
+
+    qsort(diff.changes, diff.changes_count, sizeof(struct DiffChange), compare_changes);
+    diff.summary.groups_count = diff.groups_count;
+    for (u_int64_t i = 0; i < diff.changes_count; ++i)
+    {
+        if (diff.changes[i].kind == DIFF_ADDED) diff.summary.added += 1;
+        else if (diff.changes[i].kind == DIFF_REMOVED) diff.summary.removed += 1;
+        else diff.summary.modified += 1;
+    }
+    *changes = diff.changes;
+    *changes_count = diff.changes_count;
+    *summary = diff.summary;
+    return started == 0 || diff.stop;
+}
+
+struct diff_line {
+    char * path;  // NULL when no path of the inode was found
+    u_int32_t inode;
+    u_int8_t kind;
+};
+
+struct diff_naming {  // collects paths of changed inodes of one image during its tree walk
+    struct DiffChange * changes;
+    u_int64_t changes_count;
+    u_int8_t kinds;  // bit per DiffKind named from this image
+    u_int8_t * named;  // change got at least one path
+    struct diff_line * lines;
+    u_int64_t lines_count;
+    u_int64_t lines_capacity;
+};
+
+void diff_add_line(struct diff_naming * naming, char * path, u_int32_t inode, u_int8_t kind)
+{
+    if (naming->lines_count == naming->lines_capacity)
+    {
+        naming->lines_capacity = naming->lines_capacity ? naming->lines_capacity * 2 : 256;
+        naming->lines = realloc(naming->lines, sizeof(struct diff_line) * naming->lines_capacity);
+    }
+    naming->lines[naming->lines_count].path = path;
+    naming->lines[naming->lines_count].inode = inode;
+    naming->lines[naming->lines_count].kind = kind;
+    naming->lines_count += 1;
+}
+
+int diff_name_entry(void * ctx, u_int64_t parent_inode_id, struct ext4_dir_entry_2 * dir_entry, const char * path,
+        u_int64_t path_len)
+/// binary search of the entry's inode among changes, every change of a kind named from this image gets the path
+{
+    (void)parent_inode_id;
+    struct diff_naming * naming = ctx;
+    u_int64_t low = 0, high = naming->changes_count;
+    while (low < high)
+    {
+        u_int64_t middle = (low + high) / 2;
+        if (naming->changes[middle].inode < dir_entry->inode) low = middle + 1;
+        else high = middle;
+    }
+    for (u_int64_t i = low; i < naming->changes_count && naming->changes[i].inode == dir_entry->inode; ++i)
+        if (naming->kinds & (1u << naming->changes[i].kind))
+        {
+            diff_add_line(naming, strndup(path, path_len), dir_entry->inode, naming->changes[i].kind);
+            naming->named[i] = 1;
+        }
+    return 0;
+}
+
+int compare_diff_lines(const void * a, const void * b)
+{
+    const struct diff_line * line_a = a, * line_b = b;
+    if (line_a->path == NULL || line_b->path == NULL)
+    {
+        if (line_a->path || line_b->path) return line_a->path ? -1 : 1;
+        return (line_a->inode > line_b->inode) - (line_a->inode < line_b->inode);
+    }
+    int order = strcmp(line_a->path, line_b->path);
+    return order ? order : (line_a->kind > line_b->kind) - (line_a->kind < line_b->kind);
+}
+
+int diff_images(FILE * file_a, struct SuperBlock * superBlock_a, FILE * file_b, struct SuperBlock * superBlock_b,
+        u_int64_t jobs, int full, FILE * out)
+/// prints changes from image A to image B sorted by path, one per line as A (added), D (removed) or M (modified)
+/// with the path, hard linked inodes appear under all of their paths, unreachable ones as <inode n>
+{
+    struct DiffChange * changes;
+    u_int64_t changes_count;
+    struct DiffSummary summary;
+    int err = diff_inode_tables(file_a, superBlock_a, file_b, superBlock_b, jobs, full, &changes, &changes_count,
+                                &summary);
+    if (err && summary.groups_count == 0)
+        return err;
+
+    struct diff_naming naming;
+    memset(&naming, 0, sizeof(naming));
+    naming.changes = changes;
+    naming.changes_count = changes_count;
+    naming.named = calloc(changes_count ? changes_count : 1, 1);
+    u_int64_t unreadable_a = 0, unreadable_b = 0;  // directories the walks skipped, changes below them have no path
+    // the directory trees are walked only for kinds of changes that were found
+    if (summary.added || summary.modified)
+    {
+        naming.kinds = 1u << DIFF_ADDED | 1u << DIFF_MODIFIED;
+        if (walk_directory_tree(file_b, superBlock_b, ROOT_INODE_ID, diff_name_entry, &naming, &unreadable_b)) err = 1;
+    }
+    if (summary.removed)
+    {
+        naming.kinds = 1u << DIFF_REMOVED;
+        if (walk_directory_tree(file_a, superBlock_a, ROOT_INODE_ID, diff_name_entry, &naming, &unreadable_a)) err = 1;
+    }
+    for (u_int64_t i = 0; i < changes_count; ++i)
+        if (!naming.named[i])
+        {
+            if (changes[i].inode == ROOT_INODE_ID)
+                diff_add_line(&naming, strdup("/"), changes[i].inode, changes[i].kind);
+            else
+                diff_add_line(&naming, NULL, changes[i].inode, changes[i].kind);
+        }
+    qsort(naming.lines, naming.lines_count, sizeof(struct diff_line), compare_diff_lines);
+    static const char kind_marks[] = {'A', 'D', 'M'};
+    for (u_int64_t i = 0; i < naming.lines_count; ++i)
+    {
+        struct diff_line * line = naming.lines + i;
+        if (line->path)
+            fprintf(out, "%c\t%s\n", kind_marks[line->kind], line->path);
+        else
+            fprintf(out, "%c\t<inode %" PRIu32 ">\n", kind_marks[line->kind], line->inode);
+        free(line->path);
+    }
+    fprintf(out, "%" PRIu64 " added, %" PRIu64 " removed, %" PRIu64 " modified inodes; %" PRIu64 " of %" PRIu64
+                 " groups compared, %" PRIu64 " skipped with identical descriptors\n",
+            summary.added, summary.removed, summary.modified, summary.groups_count - summary.groups_skipped,
+            summary.groups_count, summary.groups_skipped);
+    if (summary.groups_skipped)
+        // skipped groups only prove nothing was allocated or freed in them, the counts above may miss changes there
+        fprintf(out, "%" PRIu64 " groups not verified: changes that allocate nothing (chmod, touch, in place overwrite) "
+                     "are not detected in them, use --full for in-place changes\n", summary.groups_skipped);
+    if (unreadable_a || unreadable_b)
+    {
+        fprintf(out, "%" PRIu64 " directories of image A and %" PRIu64 " of image B couldn't be read, changes below "
+                     "them are listed as <inode n>\n", unreadable_a, unreadable_b);
+        err = 1;
+    }
+    free(naming.lines);
+    free(naming.named);
+    free(changes);
+    return err;
+}
@@ -0,0 +1,45 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_SNAPSHOT_DIFF_H
+#define EXT4_BINARY_READ_SNAPSHOT_DIFF_H
+#include "filesystem.h"
+
+// Diff of two images of the same file system (ie. daily snapshots of one volume). Group descriptors are compared
+// first: a group whose descriptor is identical in both images (checksum, free counts, bitmap checksums, table
+// location) is skipped without reading its inode bitmap or table. In the remaining groups both inode tables are read
+// and inodes compared one by one: inode bitmap bits give added and removed inodes, a new i_generation, creation time
+// or file type tells a reused inode number from a modified inode, and used inodes are equal when their i_checksum
+// (metadata_csum) matches, otherwise when the raw inodes match except for access time and checksum (extent root,
+// size, times, mode, owners...).
+// Paths of changed inodes are found by walking directory trees afterwards, image B for added and modified inodes and
+// image A for removed ones, only when there is something to name.
+// Descriptor skipping is a heuristic: an inode update that changes no allocation in its group (chmod, touch, in place
+// overwrite) leaves the descriptor as it was, full mode compares inode tables of every group.
+
+enum DiffKind {
+    DIFF_ADDED,
+    DIFF_REMOVED,
+    DIFF_MODIFIED,
+};
+
+struct DiffChange {
+    u_int32_t inode;
+    u_int8_t kind;
+};
+
+struct DiffSummary {
+    u_int64_t groups_count;
+    u_int64_t groups_skipped;  // identical descriptors, tables not read
+    u_int64_t added;
+    u_int64_t removed;
+    u_int64_t modified;
+};
+
+int diff_inode_tables(FILE * file_a, struct SuperBlock * superBlock_a, FILE * file_b, struct SuperBlock * superBlock_b,
+        u_int64_t jobs, int full, struct DiffChange ** changes, u_int64_t * changes_count, struct DiffSummary * summary);
+int diff_images(FILE * file_a, struct SuperBlock * superBlock_a, FILE * file_b, struct SuperBlock * superBlock_b,
+        u_int64_t jobs, int full, FILE * out);
+
+#endif //EXT4_BINARY_READ_SNAPSHOT_DIFF_H
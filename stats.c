@@ -0,0 +1,170 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#define _GNU_SOURCE
+#include "stats.h"
+
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+static const char * STAT_COUNTER_NAMES[STAT_COUNTER_COUNT] = {
+        "read_block", "load_inode_table", "load_group_descriptor", "get_directory_list", "extent_walk", "xattr_block",
+        "scan_group", "image_chunk"
+};
+
+#ifdef EXT4_STATS
+__thread struct StatCounters thread_stats;
+
+// counters of threads that already flushed theirs, guarded by stats_lock
+static struct StatCounters flushed_stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// trace events are appended by all threads, guarded by trace_lock
+static FILE * trace_file = NULL;
+static u_int64_t trace_events = 0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+u_int64_t stats_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void stats_record(enum StatCounterId counter, u_int64_t bytes, u_int64_t start_ns)
+/// adds one call to calling thread's counters, and a complete ("X") event to trace log if it is open
+{
+    u_int64_t end_ns = stats_now_ns();
+    struct StatCounter * stat = thread_stats.counters + counter;
+    stat->calls += 1;
+    stat->bytes += bytes;
+    stat->ns += end_ns - start_ns;
+    // lock free peek, so counters cost no lock while no trace is open; start and stop publish the file atomically
+    if (__atomic_load_n(&trace_file, __ATOMIC_ACQUIRE) == NULL) return;
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file)
+    {
+        fprintf(trace_file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld,"
+                            "\"args\":{\"bytes\":%" PRIu64 "}}",
+                trace_events ? ",\n" : "", STAT_COUNTER_NAMES[counter], start_ns / 1000.0,
+                (end_ns - start_ns) / 1000.0, getpid(), syscall(SYS_gettid), bytes);
+        trace_events += 1;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+int stats_enabled()
+{
+    return 1;
+}
+
+void stats_flush_thread()
+/// moves calling thread's counters into process wide totals, worker threads call it before exiting
+{
+    pthread_mutex_lock(&stats_lock);
+    for (int i = 0; i < STAT_COUNTER_COUNT; ++i)
+    {
+        flushed_stats.counters[i].calls += thread_stats.counters[i].calls;
+        flushed_stats.counters[i].bytes += thread_stats.counters[i].bytes;
+        flushed_stats.counters[i].ns += thread_stats.counters[i].ns;
+        flushed_stats.counters[i].cache_hits += thread_stats.counters[i].cache_hits;
+    }
+    pthread_mutex_unlock(&stats_lock);
+    memset(&thread_stats, 0, sizeof(thread_stats));
+}
+
+void stats_collect(struct StatCounters * counters)
+/// returns (through counters) totals of flushed threads plus counters of calling thread
+{
+    pthread_mutex_lock(&stats_lock);
+    memcpy(counters, &flushed_stats, sizeof(struct StatCounters));
+    pthread_mutex_unlock(&stats_lock);
+    for (int i = 0; i < STAT_COUNTER_COUNT; ++i)
+    {
+        counters->counters[i].calls += thread_stats.counters[i].calls;
+        counters->counters[i].bytes += thread_stats.counters[i].bytes;
+        counters->counters[i].ns += thread_stats.counters[i].ns;
+        counters->counters[i].cache_hits += thread_stats.counters[i].cache_hits;
+    }
+}
+
+void stats_reset()
+{
+    pthread_mutex_lock(&stats_lock);
+    memset(&flushed_stats, 0, sizeof(flushed_stats));
+    pthread_mutex_unlock(&stats_lock);
+    memset(&thread_stats, 0, sizeof(thread_stats));
+}
+
+int stats_trace_start(const char * path)
+/// starts writing trace events into path (JSON array of Chrome trace events), replaces previous trace
+{
+    stats_trace_stop();
+    FILE * file = fopen(path, "w");
+    if (file == NULL) return 1;
+    fprintf(file, "[\n");
+    pthread_mutex_lock(&trace_lock);
+    trace_events = 0;
+    __atomic_store_n(&trace_file, file, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+}
+
+void stats_trace_stop()
+{
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file)
+    {
+        fprintf(trace_file, "\n]\n");
+        fclose(trace_file);
+        __atomic_store_n(&trace_file, NULL, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+#else
+int stats_enabled()
+{
+    return 0;
+}
+
+void stats_flush_thread()
+{
+}
+
+void stats_collect(struct StatCounters * counters)
+{
+    memset(counters, 0, sizeof(struct StatCounters));
+}
+
+void stats_reset()
+{
+}
+
+int stats_trace_start(const char * path)
+{
+    (void)path;
+    return 1;
+}
+
+void stats_trace_stop()
+{
+}
+#endif
+
+void stats_print(FILE * out)
+/// prints counters table, averages are per call
+{
+    struct StatCounters counters;
+    stats_collect(&counters);
+    fprintf(out, "%-24s%12s%16s%14s%12s%12s\n", "counter", "calls", "bytes", "total ms", "avg us", "cache hits");
+    for (int i = 0; i < STAT_COUNTER_COUNT; ++i)
+    {
+        struct StatCounter * stat = counters.counters + i;
+        fprintf(out, "%-24s%12" PRIu64 "%16" PRIu64 "%14.3f%12.3f%12" PRIu64 "\n", STAT_COUNTER_NAMES[i], stat->calls,
+                stat->bytes, stat->ns / 1e6, stat->calls ? stat->ns / 1e3 / stat->calls : 0.0, stat->cache_hits);
+    }
+}
@@ -0,0 +1,64 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_STATS_H
+#define EXT4_BINARY_READ_STATS_H
+#include <stdio.h>
+#include <stdlib.h>
+
+// Per thread counters of reader hot paths (call count, bytes, time and cache hits) and an optional
+// Chrome trace event log (load the file in chrome://tracing or ui.perfetto.dev).
+// Everything is compiled in only when EXT4_STATS is defined (cmake -DENABLE_STATS=ON),
+// otherwise STAT_* macros expand to nothing and instrumented functions are exactly as before.
+// Times are inclusive, so get_directory_list time also contains its read_block calls.
+
+enum StatCounterId {
+    STAT_READ_BLOCK,  // read_block and read_blocks, bytes read from image
+    STAT_LOAD_INODE_TABLE,
+    STAT_LOAD_GROUP_DESCRIPTOR,
+    STAT_GET_DIRECTORY_LIST,  // bytes of directory blocks parsed
+    STAT_EXTENT_WALK,  // whole extent tree walks of an inode, bytes of index blocks read
+    STAT_XATTR_BLOCK,  // external xattr block loads, hits of the shared block cache
+    STAT_SCAN_GROUP,  // bitmaps and inode tables of a run of groups read by the group scan
+    STAT_IMAGE_CHUNK,  // chunks of compressed images inflated, bytes inflated, hits of the chunk cache
+    STAT_COUNTER_COUNT
+};
+
+struct StatCounter {
+    u_int64_t calls;
+    u_int64_t bytes;
+    u_int64_t ns;
+    u_int64_t cache_hits;
+};
+
+struct StatCounters {
+    struct StatCounter counters[STAT_COUNTER_COUNT];
+};
+
+#ifdef EXT4_STATS
+extern __thread struct StatCounters thread_stats;
+
+u_int64_t stats_now_ns();
+void stats_record(enum StatCounterId counter, u_int64_t bytes, u_int64_t start_ns);
+
+#define STAT_BEGIN() u_int64_t stat_start_ns = stats_now_ns()
+#define STAT_END(counter, byte_count) stats_record((counter), (byte_count), stat_start_ns)
+#define STAT_ADD_BYTES(counter, byte_count) (thread_stats.counters[(counter)].bytes += (byte_count))
+#define STAT_CACHE_HIT(counter) (thread_stats.counters[(counter)].cache_hits += 1)
+#else
+#define STAT_BEGIN()
+#define STAT_END(counter, byte_count)
+#define STAT_ADD_BYTES(counter, byte_count)
+#define STAT_CACHE_HIT(counter)
+#endif
+
+int stats_enabled();
+void stats_flush_thread();
+void stats_collect(struct StatCounters * counters);
+void stats_reset();
+void stats_print(FILE * out);
+int stats_trace_start(const char * path);
+void stats_trace_stop();
+
+#endif //EXT4_BINARY_READ_STATS_H
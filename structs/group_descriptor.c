@@ -92,6 +92,7 @@ int GroupDescriptor_new(struct GroupDescriptor *groupDescriptor, char *sb_bytes,
         groupDescriptor->bg_exclude_bitmap_u64 = ((u_int64_t)groupDescriptor->bg_exclude_bitmap_hi << 32u) + groupDescriptor->bg_exclude_bitmap_lo;
         groupDescriptor->bg_block_bitmap_csum_u32 = ((u_int32_t)groupDescriptor->bg_block_bitmap_csum_hi << 16u) + groupDescriptor->bg_block_bitmap_csum_lo;
         groupDescriptor->bg_inode_bitmap_csum_u32 = ((u_int32_t)groupDescriptor->bg_inode_bitmap_csum_hi << 16u) + groupDescriptor->bg_inode_bitmap_csum_lo;
+        groupDescriptor->bg_itable_unused_u32 = ((u_int32_t)groupDescriptor->bg_itable_unused_hi << 16u) + groupDescriptor->bg_itable_unused_lo;
     } else
     {
         groupDescriptor->bg_block_bitmap_u64 = groupDescriptor->bg_block_bitmap_lo;
@@ -103,6 +104,7 @@ int GroupDescriptor_new(struct GroupDescriptor *groupDescriptor, char *sb_bytes,
         groupDescriptor->bg_exclude_bitmap_u64 = groupDescriptor->bg_exclude_bitmap_lo;
         groupDescriptor->bg_block_bitmap_csum_u32 = groupDescriptor->bg_block_bitmap_csum_lo;
         groupDescriptor->bg_inode_bitmap_csum_u32 = groupDescriptor->bg_inode_bitmap_csum_lo;
+        groupDescriptor->bg_itable_unused_u32 = groupDescriptor->bg_itable_unused_lo;
     }
 
     return 0;
@@ -5,6 +5,12 @@
 #ifndef EXT4_BINARY_READ_GROUP_DESCRIPTOR_H
 #define EXT4_BINARY_READ_GROUP_DESCRIPTOR_H
 #include <stdlib.h>
+
+// bg_flags
+static const u_int16_t BG_INODE_UNINIT = 0x1;  // inode table and bitmap are not initialized
+static const u_int16_t BG_BLOCK_UNINIT = 0x2;  // block bitmap is not initialized
+static const u_int16_t BG_INODE_ZEROED = 0x4;  // inode table is zeroed
+
 struct GroupDescriptor {
     u_int32_t bg_block_bitmap_lo;  // Lower 32-bits of location of block bitmap.
     u_int32_t bg_inode_bitmap_lo;  // Lower 32-bits of location of inode bitmap.
@@ -45,6 +51,7 @@ struct GroupDescriptor {
     u_int64_t bg_exclude_bitmap_u64;  // location of snapshot exclusion bitmap.
     u_int32_t bg_block_bitmap_csum_u32;  // block bitmap checksum.
     u_int32_t bg_inode_bitmap_csum_u32;  // inode bitmap checksum.
+    u_int32_t bg_itable_unused_u32;  // unused inode count.
 };
 
 int GroupDescriptor_new(struct GroupDescriptor * groupDescriptor, char * sb_bytes, u_int16_t s_desc_size);
@@ -5,7 +5,7 @@
 #include "inode_table.h"
 #include "../interfaces.h"
 #include <string.h>
-int InodeTable_new(struct InodeTable * inodeTable, char * sb_bytes)
+int InodeTable_new(struct InodeTable * inodeTable, char * sb_bytes, u_int16_t inode_size)
 {
     // File mode. Any of:
     //0x1 	S_IXOTH (Others may execute)
@@ -107,8 +107,27 @@ int InodeTable_new(struct InodeTable * inodeTable, char * sb_bytes)
     // Unused.
     inodeTable->l_i_reserved = convert_le_byte_array_to_uint(sb_bytes + 0x74 + 0xA, sizeof(inodeTable->l_i_reserved));
 
+    inodeTable->i_ino = 0;
+    inodeTable->i_xattr_size = 0;
+    if (inode_size <= 128)
+    {
+        // original ext2 inode, fields below don't exist and the bytes belong to the next inode
+        inodeTable->i_extra_isize = inodeTable->i_checksum_hi = 0;
+        inodeTable->i_ctime_extra = inodeTable->i_mtime_extra = inodeTable->i_atime_extra = 0;
+        inodeTable->i_crtime = inodeTable->i_crtime_extra = inodeTable->i_version_hi = inodeTable->i_projid = 0;
+        inodeTable->i_size_u64 = ((u_int64_t) inodeTable->i_size_high << 32u) + inodeTable->i_size_lo;
+        inodeTable->i_blocks_u64 = ((u_int64_t) inodeTable->l_i_blocks_high << 32u) + inodeTable->i_blocks_lo;
+        return 0;
+    }
     // Size of this inode - 128. Alternately, the size of the extended inode fields beyond the original ext2 inode, including this field.
     inodeTable->i_extra_isize = convert_le_byte_array_to_uint(sb_bytes + 0x80, sizeof(inodeTable->i_extra_isize));
+    // In-inode extended attributes start right after the extra fields and run to the end of the inode.
+    if (128 + inodeTable->i_extra_isize < inode_size)
+    {
+        u_int64_t xattr_size = inode_size - 128 - inodeTable->i_extra_isize;
+        inodeTable->i_xattr_size = xattr_size < INODE_MAX_XATTR_AREA ? xattr_size : INODE_MAX_XATTR_AREA;
+        memcpy(inodeTable->i_xattr, sb_bytes + 128 + inodeTable->i_extra_isize, inodeTable->i_xattr_size);
+    }
     // Upper 16-bits of the inode checksum.
     inodeTable->i_checksum_hi = convert_le_byte_array_to_uint(sb_bytes + 0x82, sizeof(inodeTable->i_checksum_hi));
     // Extra change time bits. This provides sub-second precision. See Inode Timestamps section.
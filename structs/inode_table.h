@@ -70,6 +70,8 @@ static const u_int32_t EXT4_RESERVED_FL = 0x80000000; // Reserved for ext4 libra
 // endregion u_int_32_t i_flags flags
 // endregion inode constants
 
+#define INODE_MAX_XATTR_AREA 896  // in-inode xattr area kept by InodeTable_new, enough for inodes of up to 1024 bytes
+
 
 struct InodeTable {  // TODO add 0x24, 0x28, and 0x74 manually
     // File mode. Any of:
@@ -159,8 +161,11 @@ struct InodeTable {  // TODO add 0x24, 0x28, and 0x74 manually
     u_int32_t i_projid;  // Project ID.
     u_int64_t i_size_u64;
     u_int64_t i_blocks_u64;
+    u_int32_t i_ino;  // Number of this inode, not stored on disk, filled in by whoever loads the inode.
+    u_int16_t i_xattr_size;  // Number of valid bytes in i_xattr.
+    u_char i_xattr[INODE_MAX_XATTR_AREA];  // In-inode extended attribute area, bytes following i_extra_isize up to the end of the inode.
 };
-int InodeTable_new(struct InodeTable * inodeTable, char * sb_bytes);
+int InodeTable_new(struct InodeTable * inodeTable, char * sb_bytes, u_int16_t inode_size);
 
 struct ext4_extent_header {
     u_int16_t eh_magic;  // Magic number, 0xF30A.
@@ -4,6 +4,7 @@
 
 #include "super_block.h"
 #include "../interfaces.h"
+#include <string.h>
 int SuperBblock_new(struct SuperBlock *superBlock, char *sb_bytes) {
     /* Initializes an instance of superBlock from data in sb_bytes
      * superBlock => pointer to a superBlock
@@ -155,6 +156,8 @@ int SuperBblock_new(struct SuperBlock *superBlock, char *sb_bytes) {
     //0x2000 	Filesystem tracks project quotas. (RO_COMPAT_PROJECT)
     superBlock->s_feature_ro_compat = convert_le_byte_array_to_uint(sb_bytes + 0x64,
                                                                     sizeof(superBlock->s_feature_ro_compat));
+    // 128-bit UUID for volume.
+    memcpy(superBlock->s_uuid, sb_bytes + 0x68, sizeof(superBlock->s_uuid));
     // For compression (Not used in e2fsprogs/Linux)
     superBlock->s_algorithm_usage_bitmap = convert_le_byte_array_to_uint(sb_bytes + 0xC8,
                                                                          sizeof(superBlock->s_algorithm_usage_bitmap));
@@ -182,6 +185,8 @@ int SuperBblock_new(struct SuperBlock *superBlock, char *sb_bytes) {
     superBlock->s_hash_seed = convert_le_byte_array_to_uint(sb_bytes + 0xEC, sizeof(superBlock->s_hash_seed));
     // Size of group descriptors, in bytes, if the 64bit incompat feature flag is set.
     superBlock->s_desc_size = convert_le_byte_array_to_uint(sb_bytes + 0xFE, sizeof(superBlock->s_desc_size));
+    if (!(superBlock->s_feature_incompat & INCOMPAT_64BIT) || superBlock->s_desc_size == 0)
+        superBlock->s_desc_size = 32;  // without 64bit feature descriptors are always 32 bytes, whatever this field holds
     // Default mount options. Any of:
     //0x0001 	Print debugging info upon (re)mount. (EXT4_DEFM_DEBUG)
     //0x0002 	New files take the gid of the containing directory (instead of the fsgid of the current process). (EXT4_DEFM_BSDGROUPS)
@@ -302,8 +307,8 @@ int SuperBblock_new(struct SuperBlock *superBlock, char *sb_bytes) {
     //1 	256-bit AES in XTS mode (ENCRYPTION_MODE_AES_256_XTS).
     //2 	256-bit AES in GCM mode (ENCRYPTION_MODE_AES_256_GCM).
     //3 	256-bit AES in CBC mode (ENCRYPTION_MODE_AES_256_CBC).
-    superBlock->s_backup_bgs = convert_le_byte_array_to_uint(sb_bytes + 0x24C,
-                                                             sizeof(superBlock->s_backup_bgs));
+    superBlock->s_backup_bgs[0] = convert_le_byte_array_to_uint(sb_bytes + 0x24C, sizeof(superBlock->s_backup_bgs[0]));
+    superBlock->s_backup_bgs[1] = convert_le_byte_array_to_uint(sb_bytes + 0x250, sizeof(superBlock->s_backup_bgs[1]));
     // Inode number of lost+found
     superBlock->s_lpf_ino = convert_le_byte_array_to_uint(sb_bytes + 0x268, sizeof(superBlock->s_lpf_ino));
     // Inode that tracks project quotas.
@@ -323,7 +328,10 @@ int SuperBblock_new(struct SuperBlock *superBlock, char *sb_bytes) {
     superBlock->s_r_blocks_count_u64 = ((u_int64_t) superBlock->s_r_blocks_count_hi << 32u) + superBlock->s_r_blocks_count_lo;
     superBlock->s_free_blocks_count_u64 = ((u_int64_t) superBlock->s_free_blocks_count_hi << 32u) + superBlock->s_free_blocks_count_lo;
     superBlock->s_block_size = 1024u << superBlock->s_log_block_size;
-    superBlock->s_cluster_size = (u_int64_t)1u << superBlock->s_log_cluster_size;
+    superBlock->s_cluster_size = superBlock->s_feature_ro_compat & RO_COMPAT_BIGALLOC
+                                 ? (u_int64_t)1024u << superBlock->s_log_cluster_size : superBlock->s_block_size;
+    superBlock->s_cluster_blocks = superBlock->s_cluster_size > superBlock->s_block_size
+                                   ? superBlock->s_cluster_size / superBlock->s_block_size : 1;
     superBlock->s_first_group_desc_block = superBlock->s_block_size == 1024 ? 2 : 1;
     superBlock->s_groups_per_flex = (u_int64_t)1u << superBlock->s_log_groups_per_flex;
     // endregion
@@ -9,9 +9,14 @@
 // super block flags
 
 static const u_int32_t RO_COMPAT_SPARSE_SUPER = 0x1;
+static const u_int32_t RO_COMPAT_GDT_CSUM = 0x10;
+static const u_int32_t RO_COMPAT_BIGALLOC = 0x200;
+static const u_int32_t RO_COMPAT_METADATA_CSUM = 0x400;
 static const u_int32_t COMPAT_DIR_INDEX = 0x20;
+static const u_int32_t COMPAT_SPARSE_SUPER2 = 0x200;
 static const u_int32_t INCOMPAT_FILETYPE = 0x2;
 static const u_int32_t INCOMPAT_META_BG = 0x10;
+static const u_int32_t INCOMPAT_64BIT = 0x80;
 static const u_int32_t INCOMPAT_DIRDATA = 0x1000;
 
 struct SuperBlock {  // numbers in the comments show bits that fields occupy in the superblock
@@ -109,6 +114,7 @@ struct SuperBlock {  // numbers in the comments show bits that fields occupy in
     //0x1000 	Read-only filesystem image; the kernel will not mount this image read-write and most tools will refuse to write to the image. (RO_COMPAT_READONLY).
     //0x2000 	Filesystem tracks project quotas. (RO_COMPAT_PROJECT)
     u_int32_t s_feature_ro_compat;
+    u_char s_uuid[16];  // 128-bit UUID for volume.
     // For compression (Not used in e2fsprogs/Linux)
     //Performance hints. Directory preallocation should only happen if the EXT4_FEATURE_COMPAT_DIR_PREALLOC flag is on.
     u_int32_t s_algorithm_usage_bitmap;
@@ -185,7 +191,7 @@ struct SuperBlock {  // numbers in the comments show bits that fields occupy in
     //1 	256-bit AES in XTS mode (ENCRYPTION_MODE_AES_256_XTS).
     //2 	256-bit AES in GCM mode (ENCRYPTION_MODE_AES_256_GCM).
     //3 	256-bit AES in CBC mode (ENCRYPTION_MODE_AES_256_CBC).
-    u_int32_t s_backup_bgs;
+    u_int32_t s_backup_bgs[2];
     u_int32_t s_lpf_ino;  // Inode number of lost+found
     u_int32_t s_prj_quota_inum;  // Inode that tracks project quotas.
     u_int32_t s_checksum_seed;  // Checksum seed used for metadata_csum calculations. This value is crc32c(~0, $orig_fs_uuid).
@@ -198,7 +204,8 @@ struct SuperBlock {  // numbers in the comments show bits that fields occupy in
     u_int64_t s_r_blocks_count_u64;  // This number of blocks can only be allocated by the super-user.
     u_int64_t s_free_blocks_count_u64;  // Free block count.
     u_int64_t s_block_size;  // Block size is 2 ^ (10 + s_log_block_size).
-    u_int64_t s_cluster_size; // Cluster size is (2 ^ s_log_cluster_size) blocks if bigalloc is enabled. Otherwise s_log_cluster_size must equal s_log_block_size.
+    u_int64_t s_cluster_size; // Cluster size is 2 ^ (10 + s_log_cluster_size) bytes, equal to block size without bigalloc.
+    u_int64_t s_cluster_blocks;  // Blocks per cluster, block bitmaps keep one bit per cluster.
     u_int8_t s_first_group_desc_block;  // which
     u_int64_t s_groups_per_flex;  // Size of a flexible block group is 2 ^ s_log_groups_per_flex.
 };
@@ -0,0 +1,338 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#define _GNU_SOURCE
+#include "undelete.h"
+#include "inode_scan.h"
+#include "interfaces.h"
+#include "image_backend.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+static const u_int64_t RECOVER_CHUNK_BLOCKS = 256;  // max number of blocks read by a single request when recovering
+static const u_int64_t BITMAP_RUN_MAX_GROUPS = 256;  // max number of block bitmaps loaded by a single request
+
+struct undelete_candidate {
+    u_int64_t inode_id;
+    u_int16_t mode;
+    u_int64_t size;
+    u_int32_t dtime;  // for orphans (still allocated) this is the next inode of the orphan list, not a time
+    u_int32_t mtime;
+    int in_use;
+    int extents_lost;  // extent tree existed but could not be walked
+    struct ExtentRun * runs;
+    u_int64_t runs_count;
+    u_int64_t blocks;  // blocks covered by extents
+    u_int64_t free_blocks;  // of those, blocks still free in the block bitmap
+    struct InodeTable * inline_inode;  // copy of inodes with inline data, their content is recovered from the inode
+};
+
+struct undelete {
+    struct SuperBlock * superBlock;
+    struct undelete_candidate * candidates;
+    u_int64_t count;
+    u_int64_t capacity;
+    pthread_mutex_t lock;
+};
+
+struct block_bitmaps {  // block bitmaps of groups, loaded on first use
+    struct GroupDescriptor * groupDescriptors;
+    u_int64_t groups_count;
+    int uninit_flags_valid;
+    u_char ** bitmaps;
+};
+
+const char * inode_type_name(u_int16_t mode)
+{
+    u_int16_t file_format = mode & 0xF000u;
+    if (file_format == S_IFREG) return "file";
+    if (file_format == S_IFDIR) return "dir";
+    if (file_format == S_IFLNK) return "symlink";
+    if (file_format == S_IFCHR) return "char";
+    if (file_format == S_IFBLK) return "block";
+    if (file_format == S_IFIFO) return "fifo";
+    if (file_format == S_IFSOCK) return "socket";
+    return "unknown";
+}
+
+int extent_root_valid(struct SuperBlock * superBlock, struct InodeTable * inodeTable)
+/// checks if i_block of a (possibly deleted) inode still holds a non empty extent tree that points inside the image,
+/// so walking it won't read garbage locations
+{
+    struct ext4_extent_header header;
+    if (!(inodeTable->i_flags & EXT4_EXTENTS_FL)) return 0;
+    if (ext4_extent_header_new(&header, (char *)inodeTable->i_block)) return 0;
+    if (header.eh_entries == 0 || header.eh_entries > header.eh_max || header.eh_max > 4
+        || header.eh_depth > MAX_EXTENT_DEPTH) return 0;
+    for (u_int64_t i = 0; i < header.eh_entries && header.eh_depth > 0; ++i)
+    {
+        struct ext4_extent_idx index;
+        ext4_extent_idx_new(&index, (char *)inodeTable->i_block + 12 + 12 * i);
+        if (index.ei_leaf_u64 < superBlock->s_first_data_block || index.ei_leaf_u64 >= superBlock->s_blocks_count_u64)
+            return 0;
+    }
+    return 1;
+}
+
+int collect_candidate(void * ctx, FILE * file, struct InodeTable * inodeTable, int in_use)
+/// inode scan callback, keeps deleted inodes along with their extent runs
+{
+    struct undelete * undelete = ctx;
+    if (inodeTable->i_ino < undelete->superBlock->s_first_ino || inodeTable->i_mode == 0) return 0;
+    int has_extents = extent_root_valid(undelete->superBlock, inodeTable);
+    if (inodeTable->i_dtime == 0 && (in_use || !has_extents)) return 0;  // live inode or never used slot
+
+    struct undelete_candidate candidate;
+    memset(&candidate, 0, sizeof(candidate));
+    candidate.inode_id = inodeTable->i_ino;
+    candidate.mode = inodeTable->i_mode;
+    candidate.size = inodeTable->i_size_u64;
+    candidate.dtime = inodeTable->i_dtime;
+    candidate.mtime = inodeTable->i_mtime;
+    candidate.in_use = in_use;
+    if (inodeTable->i_flags & EXT4_INLINE_DATA_FL)
+    {
+        candidate.inline_inode = malloc(sizeof(struct InodeTable));
+        memcpy(candidate.inline_inode, inodeTable, sizeof(struct InodeTable));
+    }
+    else if (has_extents && get_inode_extent_runs(file, undelete->superBlock, inodeTable, &candidate.runs,
+                                                  &candidate.runs_count))
+        candidate.extents_lost = 1;
+    for (u_int64_t i = 0; i < candidate.runs_count; ++i)
+        candidate.blocks += candidate.runs[i].length;
+
+    pthread_mutex_lock(&undelete->lock);
+    if (undelete->count == undelete->capacity)
+    {
+        undelete->capacity = undelete->capacity ? undelete->capacity * 2 : 64;
+        undelete->candidates = realloc(undelete->candidates, sizeof(struct undelete_candidate) * undelete->capacity);
+    }
+    undelete->candidates[undelete->count++] = candidate;
+    pthread_mutex_unlock(&undelete->lock);
+    return 0;
+}
+
+int candidate_compare(const void * a, const void * b)
+{
+    u_int64_t id_a = ((const struct undelete_candidate *)a)->inode_id;
+    u_int64_t id_b = ((const struct undelete_candidate *)b)->inode_id;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+int load_block_bitmaps(FILE * file, struct SuperBlock * superBlock, struct block_bitmaps * block_bitmaps,
+        u_int64_t group_id)
+/// loads bitmap of given group together with the bitmaps lying next to it on disk (with flex_bg, bitmaps of the
+/// whole flex group), since candidates often have blocks in neighbouring groups too
+{
+    u_int64_t block_size = superBlock->s_block_size;
+    // find the run of back to back bitmaps containing the group, runs never cross a flex group boundary
+    u_int64_t first = group_id - group_id % superBlock->s_groups_per_flex, count = 1;
+    while (first <= group_id)
+    {
+        count = contiguous_metadata_groups(superBlock, block_bitmaps->groupDescriptors, block_bitmaps->groups_count,
+                                           first, GROUP_BLOCK_BITMAP, BITMAP_RUN_MAX_GROUPS);
+        if (group_id < first + count) break;
+        first += count;
+    }
+    u_char * run = malloc(block_size * count);
+    if (read_blocks(file, block_size, block_bitmaps->groupDescriptors[first].bg_block_bitmap_u64, count, (char *)run))
+    {
+        fprintf(stderr, "Error reading block bitmaps of groups %" PRIu64 "-%" PRIu64 "\n", first, first + count - 1);
+        free(run);
+        return 1;
+    }
+    for (u_int64_t i = first; i < first + count; ++i)
+    {
+        if (block_bitmaps->bitmaps[i]) continue;
+        block_bitmaps->bitmaps[i] = calloc(1, block_size);
+        if (!(block_bitmaps->uninit_flags_valid && (block_bitmaps->groupDescriptors[i].bg_flags & BG_BLOCK_UNINIT)))
+            memcpy(block_bitmaps->bitmaps[i], run + (i - first) * block_size, block_size);
+    }
+    free(run);
+    return 0;
+}
+
+int block_is_free(FILE * file, struct SuperBlock * superBlock, struct block_bitmaps * block_bitmaps, u_int64_t block,
+        int * is_free)
+/// checks given block in the current block bitmap, blocks outside of the image are never free
+{
+    *is_free = 0;
+    if (block < superBlock->s_first_data_block || block >= superBlock->s_blocks_count_u64) return 0;
+    u_int64_t group_id = (block - superBlock->s_first_data_block) / superBlock->s_blocks_per_group;
+    // bitmaps of bigalloc file systems keep one bit per cluster
+    u_int64_t index = (block - superBlock->s_first_data_block) % superBlock->s_blocks_per_group
+                      / superBlock->s_cluster_blocks;
+    if (block_bitmaps->bitmaps[group_id] == NULL && load_block_bitmaps(file, superBlock, block_bitmaps, group_id))
+        return 1;
+    *is_free = !((block_bitmaps->bitmaps[group_id][index / 8] >> (index % 8)) & 1u);
+    return 0;
+}
+
+int count_free_blocks(FILE * file, struct SuperBlock * superBlock, struct block_bitmaps * block_bitmaps,
+        struct undelete_candidate * candidate)
+{
+    candidate->free_blocks = 0;
+    for (u_int64_t i = 0; i < candidate->runs_count; ++i)
+        for (u_int64_t block = 0; block < candidate->runs[i].length; ++block)
+        {
+            int is_free;
+            if (block_is_free(file, superBlock, block_bitmaps, candidate->runs[i].physical + block, &is_free)) return 1;
+            candidate->free_blocks += is_free;
+        }
+    return 0;
+}
+
+int recover_candidate(FILE * file, struct SuperBlock * superBlock, struct block_bitmaps * block_bitmaps,
+        struct undelete_candidate * candidate, const char * path)
+/// carves content of a deleted inode into path, only blocks that are still free are copied, the rest stays a hole
+/// (i_size is often zeroed on deletion, then the file ends with the last extent)
+{
+    FILE * out = fopen(path, "w");
+    if (out == NULL) return 1;
+    if (candidate->inline_inode)
+    {
+        int err = copy_inode_data(file, superBlock, candidate->inline_inode, out);
+        fclose(out);
+        return err;
+    }
+    u_int64_t block_size = superBlock->s_block_size, size = candidate->size;
+    if (size == 0 && candidate->runs_count)
+        size = (candidate->runs[candidate->runs_count - 1].logical + candidate->runs[candidate->runs_count - 1].length)
+               * block_size;
+    // whole clusters per request, reused clusters are skipped at once
+    u_int64_t cluster_blocks = superBlock->s_cluster_blocks;
+    u_int64_t chunk_blocks = RECOVER_CHUNK_BLOCKS > cluster_blocks ? RECOVER_CHUNK_BLOCKS : cluster_blocks;
+    char * chunk = malloc(block_size * chunk_blocks);
+    int err = 0;
+    for (u_int64_t i = 0; i < candidate->runs_count && !err; ++i)
+    {
+        struct ExtentRun * run = candidate->runs + i;
+        if (run->uninitialized) continue;  // never written, stays a hole of the recovered file
+        u_int64_t block = 0;
+        while (block < run->length && run->logical * block_size + block * block_size < size && !err)
+        {
+            // copy the longest stretch of free blocks starting here, or skip a reused one
+            u_int64_t stretch = 0;
+            int is_free;
+            while (block + stretch < run->length && stretch < chunk_blocks
+                   && !(err = block_is_free(file, superBlock, block_bitmaps, run->physical + block + stretch, &is_free))
+                   && is_free)
+                ++stretch;
+            if (err) break;
+            if (stretch == 0)
+            {
+                block += cluster_blocks - (run->physical + block) % cluster_blocks;
+                continue;
+            }
+            u_int64_t offset = (run->logical + block) * block_size;
+            u_int64_t length = stretch * block_size < size - offset ? stretch * block_size : size - offset;
+            err = read_blocks(file, block_size, run->physical + block, stretch, chunk)
+                  || fseeko(out, (off_t)offset, SEEK_SET) || fwrite(chunk, 1, length, out) != length;
+            block += stretch;
+        }
+    }
+    free(chunk);
+    if (!err)
+        err = fflush(out) || ftruncate(fileno(out), (off_t)size);
+    fclose(out);
+    return err;
+}
+
+const char * candidate_state(struct undelete_candidate * candidate)
+{
+    if (candidate->inline_inode) return "inline";
+    if (candidate->extents_lost) return "extents_lost";
+    if (candidate->blocks == 0) return "no_extents";
+    if (candidate->free_blocks == candidate->blocks) return "recoverable";
+    if (candidate->free_blocks) return "partial";
+    return "overwritten";
+}
+
+int undelete_scan(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs, const char * recover_dir,
+        FILE * out)
+/// scans all inode tables for deleted inodes (jobs worker threads, 0 picks number of CPUs) and reports them in inode
+/// order, with recover_dir set content of every inode with any block left is carved into <recover_dir>/inode_<id>
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct undelete undelete;
+    memset(&undelete, 0, sizeof(undelete));
+    undelete.superBlock = superBlock;
+    pthread_mutex_init(&undelete.lock, NULL);
+    // a group that can't be read stops the scan, candidates collected until then are still reported below
+    int err = scan_inode_tables(image_path, superBlock, jobs, collect_candidate, &undelete);
+    pthread_mutex_destroy(&undelete.lock);
+    qsort(undelete.candidates, undelete.count, sizeof(struct undelete_candidate), candidate_compare);
+
+    struct block_bitmaps block_bitmaps;
+    memset(&block_bitmaps, 0, sizeof(block_bitmaps));
+    FILE * file = image_open(image_path);
+    int bitmaps_err = file == NULL || load_group_descriptors(file, superBlock, &block_bitmaps.groupDescriptors,
+                                                             &block_bitmaps.groups_count);
+    err |= bitmaps_err;
+    block_bitmaps.uninit_flags_valid = (superBlock->s_feature_ro_compat & (RO_COMPAT_GDT_CSUM | RO_COMPAT_METADATA_CSUM)) != 0;
+    block_bitmaps.bitmaps = calloc(block_bitmaps.groups_count ? block_bitmaps.groups_count : 1, sizeof(u_char *));
+
+    u_int64_t recoverable = 0, partial = 0, recovered = 0, failed = 0;
+    char * path = malloc(strlen(recover_dir ? recover_dir : "") + 32);
+    for (u_int64_t i = 0; i < undelete.count; ++i)
+    {
+        struct undelete_candidate * candidate = undelete.candidates + i;
+        fprintf(out, "{\"inode\":%" PRIu64 ",\"type\":\"%s\",\"mode\":\"%04o\",\"size\":%" PRIu64 ",\"dtime\":%" PRIu32
+                     ",\"mtime\":%" PRIu32 ",\"allocated\":%s,\"extents\":%" PRIu64 ",\"blocks\":%" PRIu64,
+                candidate->inode_id, inode_type_name(candidate->mode), candidate->mode & 0xFFFu, candidate->size,
+                candidate->dtime, candidate->mtime, candidate->in_use ? "true" : "false", candidate->runs_count,
+                candidate->blocks);
+        if (bitmaps_err || count_free_blocks(file, superBlock, &block_bitmaps, candidate))
+        {
+            // free blocks of this candidate are unknown, the others are checked on
+            fprintf(out, ",\"state\":\"error\",\"error\":\"error reading block bitmaps\"}\n");
+            failed += 1;
+            err = 1;
+            continue;
+        }
+        const char * state = candidate_state(candidate);
+        recoverable += candidate->blocks && candidate->free_blocks == candidate->blocks;
+        partial += candidate->free_blocks && candidate->free_blocks < candidate->blocks;
+        fprintf(out, ",\"free_blocks\":%" PRIu64 ",\"state\":\"%s\"", candidate->free_blocks, state);
+        if (recover_dir && (candidate->free_blocks || candidate->inline_inode))
+        {
+            sprintf(path, "%s/inode_%" PRIu64, recover_dir, candidate->inode_id);
+            if (recover_candidate(file, superBlock, &block_bitmaps, candidate, path))
+                fprintf(out, ",\"recover_error\":\"could not write %s\"", path);
+            else
+            {
+                fprintf(out, ",\"recovered\":\"%s\"", path);
+                recovered += 1;
+            }
+        }
+        fprintf(out, "}\n");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fprintf(out, "{\"summary\":{\"groups\":%" PRIu64 ",\"candidates\":%" PRIu64 ",\"recoverable\":%" PRIu64
+                 ",\"partial\":%" PRIu64 ",\"recovered\":%" PRIu64 ",\"failed\":%" PRIu64
+                 ",\"seconds\":%.3f,\"status\":\"%s\"}}\n",
+            block_bitmaps.groups_count, undelete.count, recoverable, partial, recovered, failed,
+            (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, err ? "error" : "ok");
+    fflush(out);
+
+    free(path);
+    for (u_int64_t i = 0; i < block_bitmaps.groups_count; ++i)
+        free(block_bitmaps.bitmaps[i]);
+    free(block_bitmaps.bitmaps);
+    free(block_bitmaps.groupDescriptors);
+    for (u_int64_t i = 0; i < undelete.count; ++i)
+    {
+        free(undelete.candidates[i].runs);
+        free(undelete.candidates[i].inline_inode);
+    }
+    free(undelete.candidates);
+    if (file)
+        fclose(file);
+    return err;
+}
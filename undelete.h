@@ -0,0 +1,17 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_UNDELETE_H
+#define EXT4_BINARY_READ_UNDELETE_H
+#include "filesystem.h"
+
+// Deleted file scanner. Candidates are inodes with deletion time set (deleted and orphaned ones) and inodes that are
+// free in the inode bitmap but still hold a valid extent tree. Every block their extents point to is checked against
+// the current block bitmap: blocks still free hold the old content, allocated ones were reused by other files.
+// Reports one JSON object per candidate (NDJSON) followed by a summary object.
+
+int undelete_scan(const char * image_path, struct SuperBlock * superBlock, u_int64_t jobs, const char * recover_dir,
+        FILE * out);
+
+#endif //EXT4_BINARY_READ_UNDELETE_H
@@ -0,0 +1,355 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+#define _GNU_SOURCE
+#include "xattr.h"
+#include "interfaces.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+static const u_int64_t XATTR_ENTRY_SIZE = 16;  // fixed part of an entry, name follows
+static const u_int64_t XATTR_BLOCK_HEADER_SIZE = 32;
+static const u_int64_t XATTR_MAX_EA_INODE_VALUE = 64 * 1024 * 1024;  // sanity limit for values stored in EA inodes
+
+// POSIX ACL as stored by ext4 (not the xattr format used by syscalls)
+static const u_int16_t ACL_USER_OBJ = 0x01;
+static const u_int16_t ACL_USER = 0x02;
+static const u_int16_t ACL_GROUP_OBJ = 0x04;
+static const u_int16_t ACL_GROUP = 0x08;
+static const u_int16_t ACL_MASK = 0x10;
+static const u_int16_t ACL_OTHER = 0x20;
+
+const char * xattr_prefix(u_int8_t name_index)
+{
+    if (name_index == XATTR_INDEX_USER) return "user.";
+    if (name_index == XATTR_INDEX_POSIX_ACL_ACCESS) return "system.posix_acl_access";
+    if (name_index == XATTR_INDEX_POSIX_ACL_DEFAULT) return "system.posix_acl_default";
+    if (name_index == XATTR_INDEX_TRUSTED) return "trusted.";
+    if (name_index == XATTR_INDEX_SECURITY) return "security.";
+    if (name_index == XATTR_INDEX_SYSTEM) return "system.";
+    if (name_index == XATTR_INDEX_RICHACL) return "system.richacl";
+    return "unknown.";
+}
+
+// called for every entry of an xattr region, value is NULL when it is stored in value_inode
+typedef int (*xattr_entry_callback)(void * ctx, u_int8_t name_index, const char * name, u_int8_t name_len,
+        const u_char * value, u_int32_t value_size, u_int32_t value_inode);
+
+int walk_xattr_entries(const u_char * entries, u_int64_t entries_size, const u_char * value_base,
+        u_int64_t value_base_size, xattr_entry_callback callback, void * ctx)
+/// parses entry table of in-inode area or xattr block, stops at the 4 zero bytes terminating the table
+{
+    u_int64_t offset = 0;
+    while (offset + XATTR_ENTRY_SIZE <= entries_size && convert_le_byte_array_to_uint((char *)entries + offset, 4) != 0)
+    {
+        u_int8_t name_len = entries[offset];
+        u_int8_t name_index = entries[offset + 1];
+        u_int16_t value_offset = convert_le_byte_array_to_uint((char *)entries + offset + 2, 2);
+        u_int32_t value_inode = convert_le_byte_array_to_uint((char *)entries + offset + 4, 4);
+        u_int32_t value_size = convert_le_byte_array_to_uint((char *)entries + offset + 8, 4);
+        if (offset + XATTR_ENTRY_SIZE + name_len > entries_size) return 1;
+        if (value_inode == 0 && (u_int64_t)value_offset + value_size > value_base_size) return 1;
+        if (callback(ctx, name_index, (char *)entries + offset + XATTR_ENTRY_SIZE, name_len,
+                     value_inode ? NULL : value_base + value_offset, value_size, value_inode))
+            return 0;
+        offset += (XATTR_ENTRY_SIZE + name_len + 3) & ~(u_int64_t)3u;
+    }
+    return 0;
+}
+
+struct find_xattr_ctx {
+    u_int8_t name_index;
+    const char * name;
+    u_int64_t name_len;
+    const u_char * value;
+    u_int32_t value_size;
+    u_int8_t found;
+};
+
+int find_xattr_entry(void * ctx, u_int8_t name_index, const char * name, u_int8_t name_len, const u_char * value,
+        u_int32_t value_size, u_int32_t value_inode)
+{
+    struct find_xattr_ctx * find = ctx;
+    if (name_index != find->name_index || name_len != find->name_len || value_inode != 0
+        || memcmp(name, find->name, name_len) != 0)
+        return 0;
+    find->value = value;
+    find->value_size = value_size;
+    find->found = 1;
+    return 1;
+}
+
+int find_inode_xattr(struct InodeTable * inodeTable, u_int8_t name_index, const char * name, const u_char ** value,
+        u_int32_t * value_size)
+/// looks up extended attribute in the in-inode xattr area (no I/O), value points into inodeTable
+{
+    const u_char * area = inodeTable->i_xattr;
+    u_int64_t area_size = inodeTable->i_xattr_size;
+    if (area_size < 4 || convert_le_byte_array_to_uint((char *)area, 4) != XATTR_MAGIC) return 1;
+    struct find_xattr_ctx find = {name_index, name, strlen(name), NULL, 0, 0};
+    // entries follow 4 byte header, values offsets are relative to the first entry
+    walk_xattr_entries(area + 4, area_size - 4, area + 4, area_size - 4, find_xattr_entry, &find);
+    if (!find.found) return 1;
+    *value = find.value;
+    *value_size = find.value_size;
+    return 0;
+}
+
+void XattrCache_init(struct XattrCache * cache, u_int64_t capacity)
+{
+    u_int64_t shard_capacity = (capacity + XATTR_CACHE_SHARDS - 1) / XATTR_CACHE_SHARDS;
+    if (shard_capacity == 0) shard_capacity = 1;
+    for (u_int64_t i = 0; i < XATTR_CACHE_SHARDS; ++i)
+    {
+        struct XattrCacheShard * shard = cache->shards + i;
+        shard->entries = malloc(sizeof(struct XattrCacheEntry) * shard_capacity);
+        shard->count = 0;
+        shard->capacity = shard_capacity;
+        shard->hits = 0;
+        shard->misses = 0;
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+}
+
+void XattrCache_free(struct XattrCache * cache)
+{
+    for (u_int64_t i = 0; i < XATTR_CACHE_SHARDS; ++i)
+    {
+        struct XattrCacheShard * shard = cache->shards + i;
+        for (u_int64_t j = 0; j < shard->count; ++j)
+            free(shard->entries[j].data);
+        free(shard->entries);
+        shard->entries = NULL;
+        shard->count = 0;
+        pthread_mutex_destroy(&shard->lock);
+    }
+}
+
+int load_xattr_block(FILE * file, struct SuperBlock * superBlock, struct XattrCache * cache, u_int64_t block,
+        u_char * data)
+/// copies xattr block into data, from cache when possible
+{
+    STAT_BEGIN();
+    struct XattrCacheShard * shard = cache ? cache->shards + block % XATTR_CACHE_SHARDS : NULL;
+    if (shard)
+    {
+        pthread_mutex_lock(&shard->lock);
+        for (u_int64_t i = 0; i < shard->count; ++i)
+        {
+            struct XattrCacheEntry * entry = shard->entries + i;
+            if (entry->block != block) continue;
+            memcpy(data, entry->data, superBlock->s_block_size);
+            shard->hits += 1;
+            if (--entry->remaining_hits == 0)
+            {
+                // every inode sharing the block was served, it won't be asked for again during a scan
+                free(entry->data);
+                *entry = shard->entries[--shard->count];
+            }
+            pthread_mutex_unlock(&shard->lock);
+            STAT_CACHE_HIT(STAT_XATTR_BLOCK);
+            STAT_END(STAT_XATTR_BLOCK, 0);
+            return 0;
+        }
+        shard->misses += 1;
+        pthread_mutex_unlock(&shard->lock);
+    }
+    if (read_block(file, superBlock->s_block_size, block, (char *)data)) return 1;
+    STAT_END(STAT_XATTR_BLOCK, superBlock->s_block_size);
+    if (convert_le_byte_array_to_uint((char *)data, 4) != XATTR_MAGIC) return 1;
+    u_int32_t refcount = convert_le_byte_array_to_uint((char *)data + 4, 4);
+    if (shard == NULL || refcount <= 1) return 0;
+
+    pthread_mutex_lock(&shard->lock);
+    struct XattrCacheEntry * slot = NULL;
+    int cached = 0;  // another reader could have cached it meanwhile
+    for (u_int64_t i = 0; i < shard->count; ++i)
+        cached |= shard->entries[i].block == block;
+    if (cached)
+        ;
+    else if (shard->count < shard->capacity)
+        slot = shard->entries + shard->count++;
+    else
+    {
+        // evict block expecting the fewest further hits, if it expects fewer than the new one
+        struct XattrCacheEntry * victim = shard->entries;
+        for (u_int64_t i = 1; i < shard->count; ++i)
+            if (shard->entries[i].remaining_hits < victim->remaining_hits)
+                victim = shard->entries + i;
+        if (victim->remaining_hits < refcount - 1)
+        {
+            free(victim->data);
+            slot = victim;
+        }
+    }
+    if (slot)
+    {
+        slot->block = block;
+        slot->remaining_hits = refcount - 1;
+        slot->data = malloc(superBlock->s_block_size);
+        memcpy(slot->data, data, superBlock->s_block_size);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return 0;
+}
+
+struct collect_xattrs_ctx {
+    FILE * file;
+    struct SuperBlock * superBlock;
+    struct Xattr * xattrs;
+    u_int64_t count;
+    u_int64_t capacity;
+    int err;
+};
+
+int append_value(void * ctx, const u_char * data, u_int64_t length)
+{
+    struct Xattr * xattr = ctx;
+    memcpy(xattr->value + xattr->value_size, data, length);
+    xattr->value_size += length;
+    return 0;
+}
+
+int collect_xattr(void * ctx, u_int8_t name_index, const char * name, u_int8_t name_len, const u_char * value,
+        u_int32_t value_size, u_int32_t value_inode)
+{
+    struct collect_xattrs_ctx * collect = ctx;
+    if (collect->count == collect->capacity)
+    {
+        collect->capacity = collect->capacity ? collect->capacity * 2 : 8;
+        collect->xattrs = realloc(collect->xattrs, sizeof(struct Xattr) * collect->capacity);
+    }
+    struct Xattr * xattr = collect->xattrs + collect->count;
+    const char * prefix = xattr_prefix(name_index);
+    u_int64_t prefix_len = strlen(prefix);
+    xattr->name_index = name_index;
+    xattr->name = malloc(prefix_len + name_len + 1);
+    memcpy(xattr->name, prefix, prefix_len);
+    memcpy(xattr->name + prefix_len, name, name_len);
+    xattr->name[prefix_len + name_len] = '\0';
+    xattr->value = malloc(value_size ? value_size : 1);
+    xattr->value_size = 0;
+    collect->count += 1;
+    if (value_inode == 0)
+    {
+        memcpy(xattr->value, value, value_size);
+        xattr->value_size = value_size;
+        return 0;
+    }
+    // value is the content of an EA inode
+    struct InodeTable ea_inode;
+    if (value_size > XATTR_MAX_EA_INODE_VALUE
+        || load_inode_table(collect->file, collect->superBlock, &ea_inode, value_inode)
+        || ea_inode.i_size_u64 != value_size
+        || read_inode_data(collect->file, collect->superBlock, &ea_inode, append_value, xattr))
+        collect->err = 1;
+    return 0;
+}
+
+int get_inode_xattrs(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        struct XattrCache * cache, struct Xattr ** xattrs, u_int64_t * xattrs_count)
+/// returns (through xattrs, xattrs_count) all extended attributes of an inode, in-inode ones first,
+/// cache may be NULL, release result with Xattrs_free
+{
+    struct collect_xattrs_ctx collect = {file, superBlock, NULL, 0, 0, 0};
+    const u_char * area = inodeTable->i_xattr;
+    u_int64_t area_size = inodeTable->i_xattr_size;
+    if (area_size >= 4 && convert_le_byte_array_to_uint((char *)area, 4) == XATTR_MAGIC)
+        collect.err |= walk_xattr_entries(area + 4, area_size - 4, area + 4, area_size - 4, collect_xattr, &collect);
+
+    u_int64_t block = ((u_int64_t)inodeTable->l_i_file_acl_high << 32u) + inodeTable->i_file_acl_lo;
+    if (block && !collect.err)
+    {
+        u_char * data = malloc(superBlock->s_block_size);
+        if (load_xattr_block(file, superBlock, cache, block, data))
+            collect.err = 1;
+        else
+            collect.err |= walk_xattr_entries(data + XATTR_BLOCK_HEADER_SIZE,
+                                              superBlock->s_block_size - XATTR_BLOCK_HEADER_SIZE, data,
+                                              superBlock->s_block_size, collect_xattr, &collect);
+        free(data);
+    }
+    if (collect.err)
+    {
+        Xattrs_free(collect.xattrs, collect.count);
+        return 1;
+    }
+    *xattrs = collect.xattrs;
+    *xattrs_count = collect.count;
+    return 0;
+}
+
+void Xattrs_free(struct Xattr * xattrs, u_int64_t xattrs_count)
+{
+    for (u_int64_t i = 0; i < xattrs_count; ++i)
+    {
+        free(xattrs[i].name);
+        free(xattrs[i].value);
+    }
+    free(xattrs);
+}
+
+int format_posix_acl(FILE * out, const u_char * value, u_int32_t value_size)
+/// writes ACL in the short text form used by getfacl -c, ie. user::rw-,user:1000:r--,group::r--,mask::r--,other::---
+{
+    if (value_size < 4 || convert_le_byte_array_to_uint((char *)value, 4) != 1) return 1;  // a_version
+    u_int64_t offset = 4;
+    u_int8_t first = 1;
+    while (offset + 4 <= value_size)
+    {
+        u_int16_t tag = convert_le_byte_array_to_uint((char *)value + offset, 2);
+        u_int16_t perm = convert_le_byte_array_to_uint((char *)value + offset + 2, 2);
+        u_int8_t has_id = tag == ACL_USER || tag == ACL_GROUP;  // short entries have no id
+        if (has_id && offset + 8 > value_size) return 1;
+        const char * tag_name;
+        if (tag == ACL_USER_OBJ || tag == ACL_USER) tag_name = "user";
+        else if (tag == ACL_GROUP_OBJ || tag == ACL_GROUP) tag_name = "group";
+        else if (tag == ACL_MASK) tag_name = "mask";
+        else if (tag == ACL_OTHER) tag_name = "other";
+        else return 1;
+        fprintf(out, "%s%s:", first ? "" : ",", tag_name);
+        if (has_id)
+            fprintf(out, "%" PRIu64, convert_le_byte_array_to_uint((char *)value + offset + 4, 4));
+        fprintf(out, ":%c%c%c", perm & 4u ? 'r' : '-', perm & 2u ? 'w' : '-', perm & 1u ? 'x' : '-');
+        first = 0;
+        offset += has_id ? 8 : 4;
+    }
+    return offset != value_size;
+}
+
+char * format_xattr_value(struct Xattr * xattr)
+/// returns printable form of a value (caller frees it): decoded ACL, "text" when value is printable
+/// (a single trailing NUL, as in SELinux labels, is allowed), 0x<hex> otherwise
+{
+    char * text;
+    size_t text_size;
+    FILE * out;
+    if (xattr->name_index == XATTR_INDEX_POSIX_ACL_ACCESS || xattr->name_index == XATTR_INDEX_POSIX_ACL_DEFAULT)
+    {
+        out = open_memstream(&text, &text_size);
+        int err = format_posix_acl(out, xattr->value, xattr->value_size);
+        fclose(out);
+        if (!err) return text;
+        free(text);  // malformed ACL, shown as raw value
+    }
+    out = open_memstream(&text, &text_size);
+    u_int32_t length = xattr->value_size;
+    if (length && xattr->value[length - 1] == '\0')
+        --length;
+    u_int8_t printable = 1;
+    for (u_int32_t i = 0; i < length && printable; ++i)
+        printable = xattr->value[i] >= 0x20 && xattr->value[i] < 0x7F;
+    if (printable)
+        fprintf(out, "\"%.*s\"", (int)length, (char *)xattr->value);
+    else
+    {
+        fprintf(out, "0x");
+        for (u_int32_t i = 0; i < xattr->value_size; ++i)
+            fprintf(out, "%02x", xattr->value[i]);
+    }
+    fclose(out);
+    return text;
+}
@@ -0,0 +1,66 @@
+//
+// Created by wdymel on 2026-10-19.
+//
+
+#ifndef EXT4_BINARY_READ_XATTR_H
+#define EXT4_BINARY_READ_XATTR_H
+#include <pthread.h>
+#include "filesystem.h"
+
+// Extended attributes: in-inode area (after i_extra_isize) and external xattr block (i_file_acl).
+// Values may also live in a separate EA inode (INCOMPAT_EA_INODE), those are read through its extents.
+
+static const u_int32_t XATTR_MAGIC = 0xEA020000;
+// name indexes, full name is prefix of the index followed by the stored name
+static const u_int8_t XATTR_INDEX_USER = 1;
+static const u_int8_t XATTR_INDEX_POSIX_ACL_ACCESS = 2;
+static const u_int8_t XATTR_INDEX_POSIX_ACL_DEFAULT = 3;
+static const u_int8_t XATTR_INDEX_TRUSTED = 4;
+static const u_int8_t XATTR_INDEX_SECURITY = 6;
+static const u_int8_t XATTR_INDEX_SYSTEM = 7;
+static const u_int8_t XATTR_INDEX_RICHACL = 8;
+
+struct Xattr {
+    u_int8_t name_index;
+    char * name;  // full name with prefix, ie. "user.comment", NUL terminated
+    u_char * value;
+    u_int32_t value_size;
+};
+
+// Cache of external xattr blocks. Such block is shared by every inode with identical attributes and tells
+// how many inodes reference it (h_refcount), so a block stays cached only while not all of its users were served:
+// blocks with refcount 1 are never cached, the rest are dropped after refcount - 1 hits, and when the cache is full
+// the block expecting the least hits is evicted. Blocks are spread over shards by number, each shard with its own
+// lock and an equal part of the capacity, so concurrent readers rarely wait for each other.
+#define XATTR_CACHE_SHARDS 16
+
+struct XattrCacheEntry {
+    u_int64_t block;
+    u_int64_t remaining_hits;
+    u_char * data;  // whole block
+};
+
+struct XattrCacheShard {
+    struct XattrCacheEntry * entries;
+    u_int64_t count;
+    u_int64_t capacity;
+    u_int64_t hits;
+    u_int64_t misses;
+    pthread_mutex_t lock;
+};
+
+struct XattrCache {
+    struct XattrCacheShard shards[XATTR_CACHE_SHARDS];
+};
+
+void XattrCache_init(struct XattrCache * cache, u_int64_t capacity);
+void XattrCache_free(struct XattrCache * cache);
+
+int find_inode_xattr(struct InodeTable * inodeTable, u_int8_t name_index, const char * name, const u_char ** value,
+        u_int32_t * value_size);
+int get_inode_xattrs(FILE * file, struct SuperBlock * superBlock, struct InodeTable * inodeTable,
+        struct XattrCache * cache, struct Xattr ** xattrs, u_int64_t * xattrs_count);
+void Xattrs_free(struct Xattr * xattrs, u_int64_t xattrs_count);
+char * format_xattr_value(struct Xattr * xattr);
+
+#endif //EXT4_BINARY_READ_XATTR_H